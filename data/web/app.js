@@ -13,6 +13,8 @@ let recordStartTime = 0;
 let stepDots = [];
 let stepColumns = Array.from({ length: 16 }, () => []);
 let lastCurrentStep = null;
+let lastTrackSteps = null;  // Polimetría: posición de cada track
+let songModeActive = false;  // Song mode: el secuenciador encadena patrones
 
 // Visualizer data
 let spectrumData = new Array(64).fill(0);
@@ -84,6 +86,7 @@ const instrumentPalette = [
 const padSampleMetadata = new Array(8).fill(null);
 const DEFAULT_SAMPLE_QUALITY = '44.1kHz • 16-bit mono';
 const sampleCatalog = {};
+const samplePages = {}; // getSamples paginado: páginas recibidas por familia
 let sampleSelectorContext = null;
 let pendingAutoPlayPad = null;
 let activeSampleFilter = 'ALL';
@@ -187,13 +190,14 @@ function handleWebSocketMessage(data) {
             }
             break;
         case 'step':
-            updateCurrentStep(data.step);
+            updateCurrentStep(data.step, data.tracks);
             break;
         case 'pad':
             flashPad(data.pad);
             break;
         case 'pattern':
             loadPatternData(data);
+            document.querySelectorAll('.btn-pattern.queued').forEach(btn => btn.classList.remove('queued'));
             // Actualizar botón activo y nombre del patrón si viene el índice
             if (data.index !== undefined) {
                 const patternButtons = document.querySelectorAll('.btn-pattern');
@@ -207,6 +211,14 @@ function handleWebSocketMessage(data) {
                 });
             }
             break;
+        case 'patternQueued':
+            document.querySelectorAll('.btn-pattern').forEach(btn => {
+                btn.classList.toggle('queued', parseInt(btn.dataset.pattern) === data.index);
+            });
+            break;
+        case 'song':
+            updateSongButton(data.mode, data.length);
+            break;
         case 'sampleCounts':
             handleSampleCountsMessage(data);
             break;
@@ -286,6 +298,24 @@ function handleWebSocketMessage(data) {
             }
             console.log(`Step velocity set: Track ${data.track}, Step ${data.step}, Velocity ${data.velocity}`);
             break;
+        case 'stepRejected': {
+            // Step pool of the device is full: undo the toggle
+            const rejectedEl = document.querySelector(`.seq-step[data-track="${data.track}"][data-step="${data.step}"]`);
+            if (rejectedEl) rejectedEl.classList.toggle('active', data.active);
+            if (window.showToast) {
+                window.showToast(`❌ Memoria de steps llena (${data.poolSize}): step no añadido`, window.TOAST_TYPES.ERROR, 3000);
+            }
+            break;
+        }
+        case 'stepRatchet':
+            setStepRatchetUI(data.track, data.step, data.hits, data.ramp);
+            break;
+        case 'stepCondition':
+            setStepConditionUI(data.track, data.step, data.probability, data.condition);
+            break;
+        case 'stepLock':
+            setStepLockUI(data.lock);
+            break;
         case 'stepVelocity':
             // Response to getStepVelocity query
             console.log(`Step velocity: Track ${data.track}, Step ${data.step} = ${data.velocity}`);
@@ -366,6 +396,32 @@ function loadPatternData(data) {
         console.log('Velocities loaded from pattern data');
     }
     
+    // Ratchets (lista dispersa: solo los steps que tienen)
+    document.querySelectorAll('.seq-step[data-ratchet]').forEach(el => setStepRatchetUI(el.dataset.track, el.dataset.step, 1, 0));
+    if (Array.isArray(data.ratchets)) {
+        data.ratchets.forEach(([track, step, hits, spacing, ramp]) => setStepRatchetUI(track, step, hits, ramp));
+    }
+    
+    // Probabilidad / condiciones (también dispersas)
+    document.querySelectorAll('.seq-step[data-probability]').forEach(el => setStepConditionUI(el.dataset.track, el.dataset.step, 100, ''));
+    if (Array.isArray(data.conditions)) {
+        data.conditions.forEach(([track, step, probability, condition]) => setStepConditionUI(track, step, probability, condition));
+    }
+    
+    // Parameter locks: [track, step, params, cutoff, resonance, pitch, decay, pan, slot]
+    document.querySelectorAll('.seq-step[data-lock]').forEach(el => setStepLockUI([el.dataset.track, el.dataset.step, 0]));
+    if (Array.isArray(data.locks)) {
+        data.locks.forEach(setStepLockUI);
+    }
+    
+    // Longitud por track: los steps fuera de la longitud no suenan
+    if (Array.isArray(data.trackLength)) {
+        document.querySelectorAll('.seq-step').forEach(el => {
+            const length = data.trackLength[parseInt(el.dataset.track, 10)];
+            el.classList.toggle('beyond-length', length !== undefined && parseInt(el.dataset.step, 10) >= length);
+        });
+    }
+    
     console.log(`Total steps activated: ${activatedSteps}`);
 }
 
@@ -958,7 +1014,44 @@ function toggleStep(track, step, element) {
     });
 }
 
-function updateCurrentStep(step) {
+function setStepRatchetUI(track, step, hits, ramp) {
+    const stepEl = document.querySelector(`.seq-step[data-track="${track}"][data-step="${step}"]`);
+    if (!stepEl) return;
+    if (hits > 1) {
+        stepEl.dataset.ratchet = hits;
+        stepEl.dataset.ramp = ramp || 0;
+    } else {
+        delete stepEl.dataset.ratchet;
+        delete stepEl.dataset.ramp;
+    }
+}
+
+function setStepConditionUI(track, step, probability, condition) {
+    const stepEl = document.querySelector(`.seq-step[data-track="${track}"][data-step="${step}"]`);
+    if (!stepEl) return;
+    if (probability < 100 || condition) {
+        stepEl.dataset.probability = probability;
+        stepEl.dataset.condition = condition || '';
+        stepEl.title = `${probability}%${condition ? ' ' + condition : ''}`;
+    } else {
+        delete stepEl.dataset.probability;
+        delete stepEl.dataset.condition;
+        stepEl.removeAttribute('title');
+    }
+}
+
+function setStepLockUI(lock) {
+    const stepEl = document.querySelector(`.seq-step[data-track="${lock[0]}"][data-step="${lock[1]}"]`);
+    if (!stepEl) return;
+    if (lock[2]) {
+        stepEl.dataset.lock = JSON.stringify(lock);
+    } else {
+        delete stepEl.dataset.lock;
+    }
+    if (window.refreshStepLock) window.refreshStepLock(lock[0], lock[1]);
+}
+
+function updateCurrentStep(step, tracks) {
     if (!stepDots.length) {
         stepDots = Array.from(document.querySelectorAll('.step-dot'));
     }
@@ -973,22 +1066,33 @@ function updateCurrentStep(step) {
     }
 
     currentStep = step;
+    // La rejilla muestra 16 steps: los patrones más largos se ven por vueltas de 16
+    const column = step % stepColumns.length;
+    const trackSteps = Array.isArray(tracks) ? tracks.map(pos => pos % stepColumns.length) : null;
 
-    if (step === lastCurrentStep) return;
+    if (column === lastCurrentStep && !trackSteps && !lastTrackSteps) return;
 
     if (lastCurrentStep !== null) {
         const prevDot = stepDots[lastCurrentStep];
         if (prevDot) prevDot.classList.remove('current');
-        const prevColumn = stepColumns[lastCurrentStep] || [];
-        prevColumn.forEach(el => el.classList.remove('current'));
     }
+    document.querySelectorAll('.seq-step.current').forEach(el => el.classList.remove('current'));
 
-    const nextDot = stepDots[step];
+    const nextDot = stepDots[column];
     if (nextDot) nextDot.classList.add('current');
-    const nextColumn = stepColumns[step] || [];
-    nextColumn.forEach(el => el.classList.add('current'));
+    if (trackSteps) {
+        // Cada track resalta su propia posición
+        trackSteps.forEach((pos, track) => {
+            const el = (stepColumns[pos] || [])[track];
+            if (el) el.classList.add('current');
+        });
+    } else {
+        const nextColumn = stepColumns[column] || [];
+        nextColumn.forEach(el => el.classList.add('current'));
+    }
 
-    lastCurrentStep = step;
+    lastCurrentStep = column;
+    lastTrackSteps = trackSteps;
 }
 
 // Controls
@@ -1101,10 +1205,23 @@ function setupControls() {
     // Pattern buttons
     document.querySelectorAll('.btn-pattern').forEach(btn => {
         btn.addEventListener('click', (e) => {
+            const pattern = parseInt(btn.dataset.pattern);
+            
+            // Shift+click: añadir el patrón al final de la song
+            if (e.shiftKey) {
+                sendWebSocket({ cmd: 'songAppend', pattern: pattern, repeats: 1 });
+                return;
+            }
+            
+            // Sonando: el cambio entra al final del patrón (sin cortes)
+            if (isPlaying) {
+                sendWebSocket({ cmd: 'queuePattern', index: pattern });
+                return;
+            }
+            
             document.querySelectorAll('.btn-pattern').forEach(b => b.classList.remove('active'));
             btn.classList.add('active');
             
-            const pattern = parseInt(btn.dataset.pattern);
             const patternName = btn.textContent.trim();
             
             // Actualizar display del patrón
@@ -1119,6 +1236,31 @@ function setupControls() {
         });
     });
     
+    // Song mode: encadena los patrones añadidos con Shift+click
+    const songToggle = document.getElementById('songToggle');
+    if (songToggle) {
+        songToggle.addEventListener('click', (e) => {
+            if (e.shiftKey) {
+                sendWebSocket({ cmd: 'clearSong' });
+                return;
+            }
+            sendWebSocket({ cmd: 'songMode', value: !songModeActive });
+        });
+    }
+    
+    // Fill: activo mientras se mantiene pulsado (condiciones fill / !fill)
+    const fillButton = document.getElementById('fillButton');
+    if (fillButton) {
+        const setFill = (value) => {
+            if (fillButton.classList.contains('active') === value) return;
+            fillButton.classList.toggle('active', value);
+            sendWebSocket({ cmd: 'fill', value: value });
+        };
+        fillButton.addEventListener('pointerdown', () => setFill(true));
+        fillButton.addEventListener('pointerup', () => setFill(false));
+        fillButton.addEventListener('pointerleave', () => setFill(false));
+    }
+    
     // Color mode toggle
     const colorToggle = document.getElementById('colorToggle');
     colorToggle.addEventListener('click', () => {
@@ -1438,6 +1580,10 @@ function updateSequencerState(data) {
     // Update playing state
     isPlaying = data.playing || false;
     
+    if (data.songMode !== undefined) {
+        updateSongButton(data.songMode, data.songLength);
+    }
+    
     // Update pattern button
     if (data.pattern !== undefined) {
         document.querySelectorAll('.btn-pattern').forEach(btn => {
@@ -1562,6 +1708,14 @@ function setupKeyboardControls() {
     window.stopKeyboardTremolo = stopKeyboardTremolo;
 }
 
+function updateSongButton(mode, length) {
+    songModeActive = !!mode;
+    const songToggle = document.getElementById('songToggle');
+    if (!songToggle) return;
+    songToggle.classList.toggle('active', songModeActive);
+    songToggle.textContent = length ? `SONG (${length})` : 'SONG';
+}
+
 function changePattern(delta) {
     const patternButtons = Array.from(document.querySelectorAll('.btn-pattern'));
     if (patternButtons.length === 0) return;
@@ -1747,7 +1901,22 @@ function showSampleSelector(padIndex, family) {
 function displaySampleList(data) {
     const padIndex = data.pad;
     const family = data.family;
-    const samples = data.samples;
+    const offset = data.offset || 0;
+    const page = data.samples || [];
+    const samples = offset > 0 && samplePages[family] ? samplePages[family].concat(page) : page;
+    
+    // Pedir la siguiente página hasta tener `total`
+    if (data.total && samples.length < data.total && page.length > 0) {
+        samplePages[family] = samples;
+        sendWebSocket({
+            cmd: 'getSamples',
+            family: family,
+            pad: padIndex,
+            offset: samples.length
+        });
+        return;
+    }
+    delete samplePages[family];
     
     if (!samples || samples.length === 0) {
         if (sampleSelectorContext && sampleSelectorContext.family === family) {
@@ -1764,7 +1933,9 @@ function displaySampleList(data) {
         format: sample.format ? sample.format.toUpperCase() : inferFormatFromName(sample.name),
         rate: sample.rate || 0,
         channels: sample.channels || 1,
-        bits: sample.bits || 16
+        bits: sample.bits || 16,
+        duration: sample.duration || 0,
+        peak: sample.peak || 0
     }));
     scheduleSampleBrowserRender();
 
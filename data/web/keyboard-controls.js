@@ -717,6 +717,18 @@ function showVelocityEditor(track, step) {
   
   // Position near selected cell
   const stepElement = document.querySelector(`[data-track="${track}"][data-step="${step}"]`);
+  const hits = stepElement && stepElement.dataset.ratchet ? parseInt(stepElement.dataset.ratchet) : 1;
+  const ramp = stepElement && stepElement.dataset.ramp ? parseInt(stepElement.dataset.ramp) : 0;
+  editor.querySelectorAll('.ratchet-hits button').forEach(btn => {
+    btn.classList.toggle('active', parseInt(btn.dataset.hits) === hits);
+  });
+  editor.querySelector('#ratchet-ramp').value = ramp;
+  editor.querySelector('#ratchet-ramp-value').textContent = ramp;
+  const probability = stepElement && stepElement.dataset.probability ? parseInt(stepElement.dataset.probability) : 100;
+  editor.querySelector('#trig-probability').value = probability;
+  editor.querySelector('#trig-probability-value').textContent = probability;
+  editor.querySelector('#trig-condition').value = stepElement && stepElement.dataset.condition ? stepElement.dataset.condition : '';
+  showStepLock(editor, stepElement);
   if (stepElement) {
     const rect = stepElement.getBoundingClientRect();
     editor.style.left = `${rect.left}px`;
@@ -750,6 +762,48 @@ function createVelocityEditor() {
         <button onclick="applyVelocityPreset(100)" title="E">Medium</button>
         <button onclick="applyVelocityPreset(127)" title="R">Accent</button>
       </div>
+      <label>Ratchet:</label>
+      <div class="ratchet-hits">
+        <button data-hits="1">1</button>
+        <button data-hits="2">2</button>
+        <button data-hits="3">3</button>
+        <button data-hits="4">4</button>
+        <button data-hits="6">6</button>
+        <button data-hits="8">8</button>
+      </div>
+      <label>Ramp: <span id="ratchet-ramp-value">0</span></label>
+      <input type="range" id="ratchet-ramp" min="-32" max="32" value="0">
+      <label>Probability: <span id="trig-probability-value">100</span>%</label>
+      <input type="range" id="trig-probability" min="1" max="100" value="100">
+      <label>Condition:</label>
+      <select id="trig-condition">
+        <option value="">-</option>
+        <option value="1:2">1:2</option>
+        <option value="2:2">2:2</option>
+        <option value="1:4">1:4</option>
+        <option value="3:4">3:4</option>
+        <option value="4:4">4:4</option>
+        <option value="1:8">1:8</option>
+        <option value="fill">FILL</option>
+        <option value="!fill">!FILL</option>
+        <option value="first">FIRST</option>
+        <option value="!first">!FIRST</option>
+        <option value="pre">PRE</option>
+        <option value="!pre">!PRE</option>
+      </select>
+      <label>Lock: <span id="lock-value-text">-</span></label>
+      <div class="lock-row">
+        <select id="lock-param">
+          <option value="cutoff">Cutoff</option>
+          <option value="resonance">Reso</option>
+          <option value="pitch">Pitch</option>
+          <option value="decay">Decay</option>
+          <option value="pan">Pan</option>
+          <option value="slot">Sample</option>
+        </select>
+        <button id="lock-clear" title="Shift: todos los locks del step">Clear</button>
+      </div>
+      <input type="range" id="lock-value" min="0" max="127" value="64">
       <div class="keyboard-hints">
         <small>↑↓: ±10 | Shift+↑↓: ±1 | Q/W/E/R: Presets | 1-9: Steps</small>
       </div>
@@ -777,9 +831,109 @@ function createVelocityEditor() {
     }
   });
   
+  // Ratchet: golpes dentro del step, rampa de velocity por golpe
+  editor.querySelectorAll('.ratchet-hits button').forEach(btn => {
+    btn.addEventListener('click', () => {
+      editor.querySelectorAll('.ratchet-hits button').forEach(b => b.classList.toggle('active', b === btn));
+      sendStepRatchet();
+    });
+  });
+  editor.querySelector('#ratchet-ramp').addEventListener('change', sendStepRatchet);
+  editor.querySelector('#ratchet-ramp').addEventListener('input', function(e) {
+    editor.querySelector('#ratchet-ramp-value').textContent = e.target.value;
+  });
+  
+  // Probabilidad y condición del trig
+  editor.querySelector('#trig-probability').addEventListener('input', function(e) {
+    editor.querySelector('#trig-probability-value').textContent = e.target.value;
+  });
+  editor.querySelector('#trig-probability').addEventListener('change', sendStepCondition);
+  editor.querySelector('#trig-condition').addEventListener('change', sendStepCondition);
+  
+  // Parameter locks: un parámetro a la vez, el step guarda todos los que tenga
+  editor.querySelector('#lock-param').addEventListener('change', () => {
+    showStepLock(editor, selectedCell ? document.querySelector(`.seq-step[data-track="${selectedCell.track}"][data-step="${selectedCell.step}"]`) : null);
+  });
+  editor.querySelector('#lock-value').addEventListener('input', function(e) {
+    editor.querySelector('#lock-value-text').textContent = e.target.value;
+  });
+  editor.querySelector('#lock-value').addEventListener('change', sendStepLock);
+  editor.querySelector('#lock-clear').addEventListener('click', function(e) {
+    if (!selectedCell || !window.sendWebSocket) return;
+    const msg = { cmd: 'clearStepLock', track: selectedCell.track, step: selectedCell.step };
+    if (!e.shiftKey) msg.param = editor.querySelector('#lock-param').value;
+    window.sendWebSocket(msg);
+  });
+  
   return editor;
 }
 
+// Rango y valor del parámetro elegido; '-' si el step no lo tiene bloqueado
+const LOCK_PARAMS = {
+  cutoff:    { bit: 0x01, index: 3, min: 0, max: 127, def: 64 },
+  resonance: { bit: 0x02, index: 4, min: 0, max: 127, def: 20 },
+  pitch:     { bit: 0x04, index: 5, min: -24, max: 24, def: 0 },
+  decay:     { bit: 0x08, index: 6, min: 0, max: 127, def: 64 },
+  pan:       { bit: 0x10, index: 7, min: -100, max: 100, def: 0 },
+  slot:      { bit: 0x20, index: 8, min: 0, max: 7, def: 0 }
+};
+
+function showStepLock(editor, stepElement) {
+  const param = LOCK_PARAMS[editor.querySelector('#lock-param').value];
+  const lock = stepElement && stepElement.dataset.lock ? JSON.parse(stepElement.dataset.lock) : null;
+  const locked = lock && (lock[2] & param.bit);
+  const slider = editor.querySelector('#lock-value');
+  slider.min = param.min;
+  slider.max = param.max;
+  slider.value = locked ? lock[param.index] : param.def;
+  editor.querySelector('#lock-value-text').textContent = locked ? slider.value : '-';
+}
+
+// Lock cambiado (respuesta o pattern nuevo): el editor abierto sobre ese step se actualiza
+window.refreshStepLock = function(track, step) {
+  const editor = document.getElementById('velocity-editor');
+  if (!editor || editor.style.display !== 'block' || !selectedCell) return;
+  if (selectedCell.track != track || selectedCell.step != step) return;
+  showStepLock(editor, document.querySelector(`.seq-step[data-track="${track}"][data-step="${step}"]`));
+};
+
+function sendStepLock() {
+  if (!selectedCell || !window.sendWebSocket) return;
+  const editor = document.getElementById('velocity-editor');
+  window.sendWebSocket({
+    cmd: 'setStepLock',
+    track: selectedCell.track,
+    step: selectedCell.step,
+    param: editor.querySelector('#lock-param').value,
+    value: parseInt(editor.querySelector('#lock-value').value)
+  });
+}
+
+function sendStepRatchet() {
+  if (!selectedCell || !window.sendWebSocket) return;
+  const editor = document.getElementById('velocity-editor');
+  const activeHits = editor.querySelector('.ratchet-hits button.active');
+  window.sendWebSocket({
+    cmd: 'setStepRatchet',
+    track: selectedCell.track,
+    step: selectedCell.step,
+    hits: activeHits ? parseInt(activeHits.dataset.hits) : 1,
+    ramp: parseInt(editor.querySelector('#ratchet-ramp').value)
+  });
+}
+
+function sendStepCondition() {
+  if (!selectedCell || !window.sendWebSocket) return;
+  const editor = document.getElementById('velocity-editor');
+  window.sendWebSocket({
+    cmd: 'setStepCondition',
+    track: selectedCell.track,
+    step: selectedCell.step,
+    probability: parseInt(editor.querySelector('#trig-probability').value),
+    condition: editor.querySelector('#trig-condition').value
+  });
+}
+
 function applyVelocityPreset(velocity) {
   if (selectedCell) {
     setStepVelocity(selectedCell.track, selectedCell.step, velocity);
@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+"""
+pack_samples.py
+Empaqueta los samples de data/ en un solo fichero indexado (src/SampleBank.h)
+para que el arranque los cargue con lecturas secuenciales grandes, sin
+recorrer carpetas ni parsear cabeceras WAV en el ESP32.
+
+Uso:
+    python pack_samples.py <data_folder> [salida] [--all]
+
+Ejemplo:
+    python pack_samples.py ./data ./data/samples.bank
+
+Por defecto empaqueta el primer sample (orden alfabético) de cada familia de
+arranque, que se carga en su pad. Con --all incluye todos los WAV de cada
+carpeta (los que no son de arranque quedan con pad 0xFF).
+"""
+
+import sys
+import struct
+import wave
+from pathlib import Path
+
+# Mismo orden que los pads de arranque en main.cpp
+BOOT_FAMILIES = ['BD', 'SD', 'CH', 'OH', 'CP', 'RS', 'CL', 'CY']
+OTHER_FAMILIES = ['CB', 'MA', 'HT', 'LT', 'MT', 'MC', 'HC', 'LC']
+
+MAGIC = b'R808BNK1'
+VERSION = 1
+ALIGN = 16
+NO_PAD = 0xFF
+TARGET_RATE = 44100
+SAMPLES_PARTITION_SIZE = 0x400000    # partitions_custom.csv
+MAX_SAMPLE_BYTES = 2 * 1024 * 1024   # MAX_SAMPLE_SIZE: los más grandes se cargan como WAV (streaming)
+
+HEADER_FMT = '<8sHHIII'        # SampleBankHeader
+ENTRY_FMT = '<32s4sBBHIII'     # SampleBankEntry
+HEADER_SIZE = struct.calcsize(HEADER_FMT)
+ENTRY_SIZE = struct.calcsize(ENTRY_FMT)
+
+
+def read_wav_mono16(path):
+    """Lee un WAV PCM (8/16/24/32 bits) y devuelve (bytes int16 mono, sample_rate)"""
+    with wave.open(str(path), 'rb') as w:
+        channels = w.getnchannels()
+        width = w.getsampwidth()
+        rate = w.getframerate()
+        frames = w.readframes(w.getnframes())
+
+    count = len(frames) // width
+    if width == 1:
+        values = [(b - 128) << 8 for b in frames]                  # 8-bit unsigned
+    elif width == 2:
+        values = list(struct.unpack('<%dh' % count, frames))
+    elif width == 3:
+        values = [int.from_bytes(frames[i:i + 3], 'little', signed=True) >> 8
+                  for i in range(0, count * 3, 3)]
+    elif width == 4:
+        values = [v >> 16 for v in struct.unpack('<%di' % count, frames)]
+    else:
+        raise ValueError(f'{width * 8}-bit no soportado')
+
+    # Stereo -> mono, como SampleManager: (L / 2) + (R / 2)
+    if channels == 2:
+        values = [int(values[i] / 2) + int(values[i + 1] / 2) for i in range(0, len(values) - 1, 2)]
+    elif channels != 1:
+        raise ValueError(f'{channels} canales no soportado')
+
+    return struct.pack('<%dh' % len(values), *values), rate
+
+
+def read_raw(path):
+    """RAW: 16-bit mono sin cabecera (como en el ESP32)"""
+    data = path.read_bytes()
+    return data[:len(data) & ~1], TARGET_RATE
+
+
+def collect(data_dir, include_all):
+    """Lista de (familia, fichero, pad) en orden de empaquetado"""
+    items = []
+    for family in BOOT_FAMILIES + OTHER_FAMILIES:
+        folder = data_dir / family
+        if not folder.is_dir():
+            continue
+        files = sorted(f for f in folder.iterdir()
+                       if f.is_file() and f.suffix.lower() in ('.wav', '.raw'))
+        if not files:
+            continue
+        pad = BOOT_FAMILIES.index(family) if family in BOOT_FAMILIES else NO_PAD
+        items.append((family, files[0], pad))
+        if include_all:
+            items.extend((family, f, NO_PAD) for f in files[1:])
+    return items
+
+
+def align(value):
+    return (value + ALIGN - 1) & ~(ALIGN - 1)
+
+
+def pack(data_dir, output, include_all):
+    items = collect(data_dir, include_all)
+    if not items:
+        print(f"❌ No se encontraron samples en {data_dir}")
+        return False
+
+    entries = []
+    payloads = []
+    data_offset = align(HEADER_SIZE + ENTRY_SIZE * len(items))
+    offset = data_offset
+
+    for family, path, pad in items:
+        try:
+            pcm, rate = read_raw(path) if path.suffix.lower() == '.raw' else read_wav_mono16(path)
+        except (wave.Error, ValueError, EOFError) as e:
+            print(f"⚠️  {family}/{path.name}: {e}, se omite")
+            continue
+        if len(pcm) > MAX_SAMPLE_BYTES:
+            print(f"⚠️  {family}/{path.name}: {len(pcm) / 1024:.0f} KB, demasiado grande para el banco, se omite")
+            continue
+        if rate != TARGET_RATE:
+            print(f"⚠️  {family}/{path.name}: {rate} Hz (el motor reproduce a {TARGET_RATE} Hz)")
+
+        name = path.name.encode('ascii', 'replace')[:31]
+        entries.append(struct.pack(ENTRY_FMT, name, family.encode('ascii')[:4], pad, 1, 16,
+                                   rate, offset, len(pcm) // 2))
+        payloads.append((offset, pcm))
+        tag = f"pad {pad}" if pad != NO_PAD else "biblioteca"
+        print(f"✅ {family}/{path.name}: {len(pcm) // 2} samples @ {offset} ({tag})")
+        offset = align(offset + len(pcm))
+
+    if offset > SAMPLES_PARTITION_SIZE:
+        print(f"⚠️  {offset / 1024:.0f} KB: no cabe en la partición samples (solo LittleFS)")
+
+    # Si se omitió alguno el índice reservado queda más largo que count: data_offset sigue siendo válido
+    total = offset
+    header = struct.pack(HEADER_FMT, MAGIC, VERSION, len(entries), ENTRY_SIZE, data_offset, total)
+
+    with open(output, 'wb') as f:
+        f.write(header)
+        f.write(b''.join(entries))
+        for payload_offset, pcm in payloads:
+            f.write(b'\0' * (payload_offset - f.tell()))
+            f.write(pcm)
+        f.write(b'\0' * (total - f.tell()))
+
+    print("=" * 60)
+    print(f"✅ {len(entries)} samples -> {output} ({total / 1024:.1f} KB)")
+    return True
+
+
+def main():
+    args = [a for a in sys.argv[1:] if not a.startswith('--')]
+    include_all = '--all' in sys.argv
+    if len(args) < 1 or len(args) > 2:
+        print("Uso: python pack_samples.py <data_folder> [salida] [--all]")
+        print("Ejemplo: python pack_samples.py ./data ./data/samples.bank")
+        sys.exit(1)
+
+    data_dir = Path(args[0])
+    output = Path(args[1]) if len(args) == 2 else data_dir / 'samples.bank'
+
+    print("🥁 ESP32-S3 Drum Machine - Sample Bank Packer")
+    if pack(data_dir, output, include_all):
+        print("📌 Siguiente paso: pio run --target uploadfs")
+        print(f"   o a la partición samples: esptool.py --chip esp32s3 write_flash 0xB10000 {output}")
+    else:
+        sys.exit(1)
+
+
+if __name__ == "__main__":
+    main()
@@ -4,18 +4,89 @@
  */
 
 #include "AudioEngine.h"
+#include "SampleStreamer.h"
 
-AudioEngine::AudioEngine() : i2sPort(I2S_NUM_0),
-                             processCount(0), lastCpuCheck(0), cpuLoad(0.0f) {
+#ifdef ESP_PLATFORM
+#include <esp_async_memcpy.h>
+#include <esp32s3/rom/cache.h>
+#endif
+
+extern SampleStreamer sampleStreamer;
+extern TriggerTiming triggerTiming;
+
+// Fork/join state for the Core 0 render worker
+enum WorkerState : uint8_t {
+  WORKER_IDLE = 0,
+  WORKER_POSTED = 1,
+  WORKER_RUNNING = 2,
+  WORKER_DONE = 3
+};
+
+// Retire slot lifecycle
+enum RetireState : uint8_t {
+  RETIRE_FREE = 0,
+  RETIRE_CLAIMING = 1,  // Core 0 filling in the slot
+  RETIRE_PENDING = 2,   // Waiting for the audio core
+  RETIRE_ACKED = 3      // Voices stopped at ackEpoch
+};
+
+#ifdef ESP_PLATFORM
+// Async memcpy completion (ISR): one fewer copy in flight
+static bool IRAM_ATTR onPrefetchDone(async_memcpy_t mcp, async_memcpy_event_t* event, void* arg) {
+  static_cast<std::atomic<int>*>(arg)->fetch_sub(1, std::memory_order_release);
+  return false;
+}
+#endif
+
+AudioEngine::AudioEngine() : activeBank(0), i2sPort(I2S_NUM_0),
+                             processCount(0), lastCpuCheck(0), cpuLoad(0.0f),
+                             voiceCap(MAX_VOICES), quietBlocks(0), voiceOrderCounter(0),
+                             workerTaskHandle(nullptr), dualCoreRequested(false), dualCoreActive(false),
+                             workerPadMask(0), workerSamples(0), workerKickUs(0), workerStartUs(0),
+                             workerState(WORKER_IDLE), lateInWindow(0), windowBlocks(0), cooldownBlocks(0),
+                             prefetchDma(nullptr), prefetchEnabled(false), stagesValid(false), prefetchPending(0),
+                             retirePending(0), blockEpoch(0), scheduleHead(0), scheduleTail(0),
+                             pendingCount(0), liveHead(0), liveTail(0) {
   // Initialize voices
   for (int i = 0; i < MAX_VOICES; i++) {
     resetVoice(i);
   }
   
-  // Initialize sample buffers
+  // Initialize sample buffers (both banks)
+  for (int b = 0; b < PAD_BANKS; b++) {
+    for (int i = 0; i < 16; i++) {
+      padBanks[b][i].buffer = nullptr;
+      padBanks[b][i].length = 0;
+      padBanks[b][i].head = nullptr;
+      padBanks[b][i].headLength = 0;
+      padBanks[b][i].format = SAMPLE_PCM16;
+      padBanks[b][i].resident = 0;
+      padBanks[b][i].channels = 1;
+    }
+  }
+  
+  // Constant-power pan law: L = cos, R = sin, scaled by sqrt(2) so the centre is unity
+  for (int i = 0; i < PAN_STEPS; i++) {
+    float angle = (float)i / (PAN_STEPS - 1) * (PI / 2.0f);
+    panGains[i][0] = (int16_t)lroundf(cosf(angle) * M_SQRT2 * (1 << PAN_SHIFT));
+    panGains[i][1] = (int16_t)lroundf(sinf(angle) * M_SQRT2 * (1 << PAN_SHIFT));
+  }
   for (int i = 0; i < 16; i++) {
-    sampleBuffers[i] = nullptr;
-    sampleLengths[i] = 0;
+    busPan[i] = PAN_CENTER;
+  }
+  
+  // Parameter lock tables: a lock costs a lookup at voice start, never a coefficient calculation
+  for (int i = 0; i <= LOCK_VALUE_MAX; i++) {
+    float t = (float)i / LOCK_VALUE_MAX;
+    float cutoff = 20.0f * powf(1000.0f, t);                 // 20 Hz - 20 kHz
+    if (cutoff > SAMPLE_RATE * 0.45f) cutoff = SAMPLE_RATE * 0.45f;
+    lockCutoffG[i] = tanf(PI * cutoff / SAMPLE_RATE);
+    lockResonanceK[i] = 1.0f / (0.5f * powf(40.0f, t));      // Q 0.5 - 20
+    float decay = 0.01f * powf(200.0f, t) * SAMPLE_RATE;     // 10 ms - 2 s to -60 dB, in frames
+    lockDecayMul[i] = powf(LOCK_DECAY_FLOOR, 1.0f / decay);
+  }
+  for (int i = 0; i <= 2 * LOCK_PITCH_RANGE; i++) {
+    lockPitchStep[i] = (uint32_t)lroundf(powf(2.0f, (i - LOCK_PITCH_RANGE) / 12.0f) * PITCH_UNITY);
   }
   
   // Initialize FX
@@ -40,16 +111,20 @@ AudioEngine::AudioEngine() : i2sPort(I2S_NUM_0),
     trackFilters[i].gain = 0.0f;
     trackFilters[i].state.x1 = trackFilters[i].state.x2 = 0.0f;
     trackFilters[i].state.y1 = trackFilters[i].state.y2 = 0.0f;
+    trackFilters[i].stateR = trackFilters[i].state;
     trackFilterActive[i] = false;
+    trackSvfG[i] = lockCutoffG[LOCK_VALUE_MAX];
+    trackSvfK[i] = M_SQRT2;
   }
   
-  for (int i = 0; i < 16; i++) {
+  for (int i = 0; i < MAX_PADS; i++) {
     padFilters[i].filterType = FILTER_NONE;
     padFilters[i].cutoff = 1000.0f;
     padFilters[i].resonance = 1.0f;
     padFilters[i].gain = 0.0f;
     padFilters[i].state.x1 = padFilters[i].state.x2 = 0.0f;
     padFilters[i].state.y1 = padFilters[i].state.y2 = 0.0f;
+    padFilters[i].stateR = padFilters[i].state;
     padFilterActive[i] = false;
   }
   
@@ -61,6 +136,20 @@ AudioEngine::AudioEngine() : i2sPort(I2S_NUM_0),
   // Initialize visualization
   captureIndex = 0;
   memset(captureBuffer, 0, sizeof(captureBuffer));
+  
+  // Initialize governor statistics
+  resetRenderStats();
+  memset(&dualStats, 0, sizeof(dualStats));
+  memset(&prefetchStats, 0, sizeof(prefetchStats));
+  memset(&retireStats, 0, sizeof(retireStats));
+  for (int i = 0; i < RETIRE_SLOTS; i++) {
+    retireSlots[i].state.store(RETIRE_FREE);
+    retireSlots[i].buffer = nullptr;
+    retireSlots[i].ackEpoch = 0;
+  }
+  memset(stageBuffers, 0, sizeof(stageBuffers));
+  memset(mixAcc, 0, sizeof(mixAcc));
+  memset(workerAcc, 0, sizeof(workerAcc));
 }
 
 AudioEngine::~AudioEngine() {
@@ -111,18 +200,117 @@ bool AudioEngine::begin(int bckPin, int wsPin, int dataPin) {
   return true;
 }
 
-bool AudioEngine::setSampleBuffer(int padIndex, int16_t* buffer, uint32_t length) {
-  if (padIndex < 0 || padIndex >= 8) return false;
+bool AudioEngine::setSampleBuffer(int padIndex, int16_t* buffer, uint32_t length, SampleFormat format,
+                                  uint8_t channels) {
+  return setBankSample(getActiveBank(), padIndex, buffer, length, format, channels);
+}
+
+// Attack copy in internal SRAM: the first samples of every voice are read
+// from here instead of PSRAM, hiding the cache misses at the transient
+void AudioEngine::setSampleHead(int padIndex, const int16_t* head, uint32_t headLength) {
+  setBankHead(getActiveBank(), padIndex, head, headLength);
+}
+
+// Streamed sample: buffer holds the first samples, SampleStreamer reads the rest
+void AudioEngine::setSampleStreamLength(int padIndex, uint32_t totalLength) {
+  setBankStreamLength(getActiveBank(), padIndex, totalLength);
+}
+
+bool AudioEngine::setBankSample(int bank, int padIndex, int16_t* buffer, uint32_t length, SampleFormat format,
+                                uint8_t channels) {
+  if (bank < 0 || bank >= PAD_BANKS || padIndex < 0 || padIndex >= 8) return false;
+  PadSample& sample = padBanks[bank][padIndex];
   
-  sampleBuffers[padIndex] = buffer;
-  sampleLengths[padIndex] = length;
+  // A new buffer invalidates the old head copy (SampleManager sets the new one)
+  sample.head = nullptr;
+  sample.headLength = 0;
+  sample.buffer = buffer;
+  sample.length = length;
+  sample.resident = length;
+  sample.format = format;
+  sample.channels = (channels == 2 && format == SAMPLE_PCM16) ? 2 : 1;
+  
+#ifdef ESP_PLATFORM
+  // El prefetch llegeix la PSRAM per DMA, sense passar per la cache: escriure-la
+  if (buffer != nullptr && length > 0) {
+    Cache_WriteBack_Addr((uint32_t)(uintptr_t)buffer, SampleCodec::encodedSize(format, length) * sample.channels);
+  }
+#endif
   
-  Serial.printf("[AudioEngine] Sample buffer set: Pad %d, Buffer: %p, Length: %d samples\n", 
-                padIndex, buffer, length);
+  Serial.printf("[AudioEngine] Sample buffer set: Bank %d, Pad %d, Buffer: %p, Length: %d samples (%s, %s)\n", 
+                bank, padIndex, buffer, length, SampleCodec::formatName(format),
+                sample.channels == 2 ? "stereo" : "mono");
   
   return true;
 }
 
+void AudioEngine::setBankHead(int bank, int padIndex, const int16_t* head, uint32_t headLength) {
+  if (bank < 0 || bank >= PAD_BANKS || padIndex < 0 || padIndex >= 8) return;
+  
+  padBanks[bank][padIndex].head = head;
+  padBanks[bank][padIndex].headLength = head ? headLength : 0;
+}
+
+void AudioEngine::setBankStreamLength(int bank, int padIndex, uint32_t totalLength) {
+  if (bank < 0 || bank >= PAD_BANKS || padIndex < 0 || padIndex >= 8) return;
+  PadSample& sample = padBanks[bank][padIndex];
+  if (sample.buffer != nullptr && totalLength > sample.resident) sample.length = totalLength;
+}
+
+// Every trigger after this reads the other bank. Voices already playing keep
+// their own copy of the old pointers until SampleManager retires that bank
+void AudioEngine::swapBank() {
+  activeBank.store(getActiveBank() ^ 1, std::memory_order_release);
+}
+
+// SampleStreamer asks whether a slot's voice is still the one that claimed it
+bool AudioEngine::ownsStream(int voiceIndex, uint32_t token, int slot) {
+  if (voiceIndex < 0 || voiceIndex >= MAX_VOICES) return false;
+  const Voice& voice = voices[voiceIndex];
+  return voice.active && voice.streamSlot == slot && voice.startOrder == token;
+}
+
+// Common voice setup for a pad's sample (caller sets velocity/volume and activates)
+void AudioEngine::startVoice(int voiceIndex, int padIndex, const PadSample& sample) {
+  Voice& voice = voices[voiceIndex];
+  if (voice.streamSlot >= 0) {
+    sampleStreamer.release(voice.streamSlot, voiceIndex, voice.startOrder);
+    voice.streamSlot = -1;
+  }
+  voice.buffer = sample.buffer;
+  voice.format = sample.format;
+  voice.channels = sample.channels;
+  voice.decodedBlock = UINT32_MAX;
+  voice.head = sample.head;
+  voice.headLength = sample.headLength;
+  voice.position = 0;
+  voice.length = sample.length;
+  voice.pitchShift = 1.0f;
+  voice.loop = false;
+  voice.padIndex = padIndex;
+  voice.startOrder = voiceOrderCounter++;
+  voice.stagedCount = 0;
+  voice.startDelay = 0;
+  voice.residentLength = sample.resident;
+  voice.streamRead = 0;
+  voice.pitchStep = PITCH_UNITY;
+  voice.pitchFrac = 0;
+  voice.envGain = 1.0f;
+  voice.envMul = 0.0f;
+  voice.pan = PAN_UNLOCKED;
+  voice.svfMode = FILTER_NONE;
+  voice.timingSource = TIMING_NONE;
+  
+  // Long sample: claim a stream slot, or play only what is in memory
+  if (voice.residentLength < voice.length) {
+    voice.streamSlot = sampleStreamer.open(padIndex, voiceIndex, voice.startOrder);
+    if (voice.streamSlot < 0) voice.length = voice.residentLength;
+  }
+  
+  if (voice.head != nullptr) stats.headHits++;
+  else stats.headMisses++;
+}
+
 void AudioEngine::triggerSample(int padIndex, uint8_t velocity) {
   triggerSampleLive(padIndex, velocity);
 }
@@ -132,68 +320,182 @@ void AudioEngine::triggerSampleSequencer(int padIndex, uint8_t velocity) {
     Serial.printf("[AudioEngine] ERROR: Invalid pad index %d\n", padIndex);
     return;
   }
-  if (sampleBuffers[padIndex] == nullptr) {
-    Serial.printf("[AudioEngine] ERROR: No sample buffer for pad %d\n", padIndex);
-    return;
+  // Unscheduled: starts at the next block, through the live queue
+  queueLive(padIndex, velocity, TIMING_SEQUENCER, 0);
+}
+
+// Core 0 side of the schedule queue: the bank is resolved now, the sample at start time
+bool AudioEngine::scheduleSampleSequencer(int padIndex, uint8_t velocity, uint32_t frame, const ParamLock* lock) {
+  if (padIndex < 0 || padIndex >= 8) {
+    Serial.printf("[AudioEngine] ERROR: Invalid pad index %d\n", padIndex);
+    return false;
   }
-  int voiceIndex = findFreeVoice();
-  if (voiceIndex < 0) {
-    voiceIndex = 0;
-    Serial.println("[AudioEngine] No free voice, stealing voice 0");
+  uint32_t head = scheduleHead.load(std::memory_order_relaxed);
+  if (head - scheduleTail.load(std::memory_order_acquire) >= SCHEDULE_QUEUE_LEN) {
+    stats.scheduleDrops++;
+    return false;
   }
-  voices[voiceIndex].buffer = sampleBuffers[padIndex];
-  voices[voiceIndex].position = 0;
-  voices[voiceIndex].length = sampleLengths[padIndex];
-  voices[voiceIndex].active = true;
-  voices[voiceIndex].velocity = velocity;
-  voices[voiceIndex].volume = sequencerVolume;
-  voices[voiceIndex].pitchShift = 1.0f;
-  voices[voiceIndex].loop = false;
-  voices[voiceIndex].padIndex = padIndex;
-  voices[voiceIndex].isLivePad = false;
-  Serial.printf("[AudioEngine] *** SEQ PAD %d -> Voice %d, Length: %d samples, Velocity: %d ***\n",
-                padIndex, voiceIndex, sampleLengths[padIndex], velocity);
+  ScheduledTrigger& trigger = scheduleQueue[head & (SCHEDULE_QUEUE_LEN - 1)];
+  trigger.frame = frame;
+  trigger.pad = padIndex;
+  trigger.velocity = velocity;
+  trigger.bank = getActiveBank();
+  if (lock != nullptr) trigger.lock = *lock;
+  else trigger.lock.params = 0;
+  scheduleHead.store(head + 1, std::memory_order_release);
+  return true;
 }
 
-void AudioEngine::triggerSampleLive(int padIndex, uint8_t velocity) {
+// Block start (audio core): triggers due in this block start with an offset of silence.
+// The pad table is read here, before scanRetired: a retired buffer is either gone from
+// the table or its new voice is stopped in the same block
+void AudioEngine::startScheduled(uint32_t blockStart, size_t samples) {
+  uint32_t tail = scheduleTail.load(std::memory_order_relaxed);
+  uint32_t head = scheduleHead.load(std::memory_order_acquire);
+  while (tail != head && pendingCount < SCHEDULE_PENDING_LEN) {
+    pendingTriggers[pendingCount++] = scheduleQueue[tail & (SCHEDULE_QUEUE_LEN - 1)];
+    tail++;
+  }
+  scheduleTail.store(tail, std::memory_order_release);
+  
+  // Micro-timing and swing can reorder triggers: the list is scanned, not popped in order
+  for (int i = 0; i < pendingCount;) {
+    ScheduledTrigger& trigger = pendingTriggers[i];
+    int32_t offset = (int32_t)(trigger.frame - blockStart);
+    if (offset >= (int32_t)samples && offset < SCHEDULE_MAX_AHEAD) {
+      i++;
+      continue;
+    }
+    if (offset >= SCHEDULE_MAX_AHEAD) {
+      stats.scheduleDrops++;
+    } else {
+      // Frame the voice starts on vs the frame it was scheduled for
+      uint32_t lateFrames = 0;
+      if (offset < 0) {
+        stats.lateTriggers++;
+        lateFrames = (uint32_t)(-offset);
+        offset = 0;
+      }
+      triggerTiming.recordStart(TIMING_SEQUENCER, (uint32_t)((uint64_t)lateFrames * 1000000ULL / SAMPLE_RATE));
+      // Slot lock: another pad's sample through this track's bus, filter and mute
+      int source = trigger.pad;
+      if ((trigger.lock.params & LOCK_SLOT) && trigger.lock.slot < MAX_PADS) source = trigger.lock.slot;
+      const PadSample& sample = padBanks[trigger.bank][source];
+      if (sample.buffer != nullptr) {
+        int voiceIndex = allocateVoice();
+        startVoice(voiceIndex, source, sample);
+        voices[voiceIndex].padIndex = trigger.pad;
+        if (trigger.lock.params) applyLock(voiceIndex, trigger.pad, trigger.lock);
+        voices[voiceIndex].velocity = trigger.velocity;
+        voices[voiceIndex].volume = sequencerVolume;
+        voices[voiceIndex].isLivePad = false;
+        voices[voiceIndex].startDelay = offset;
+        voices[voiceIndex].active = true;
+        stats.scheduledTriggers++;
+      }
+    }
+    pendingTriggers[i] = pendingTriggers[--pendingCount];
+  }
+}
+
+// Lock values -> voice state, from the boot tables. Unlocked filter values come from the
+// track filter (trackSvfG/K, updated when the filter is edited)
+void AudioEngine::applyLock(int voiceIndex, int track, const ParamLock& lock) {
+  Voice& voice = voices[voiceIndex];
+  
+  // The stream reader fetches frames at 1x: pitch only on resident voices
+  if ((lock.params & LOCK_PITCH) && voice.streamSlot < 0) {
+    int semitones = constrain((int)lock.pitch, -LOCK_PITCH_RANGE, LOCK_PITCH_RANGE);
+    voice.pitchStep = lockPitchStep[semitones + LOCK_PITCH_RANGE];
+  }
+  if (lock.params & LOCK_DECAY) {
+    voice.envMul = lockDecayMul[lock.decay > LOCK_VALUE_MAX ? LOCK_VALUE_MAX : lock.decay];
+  }
+  if (lock.params & LOCK_PAN) {
+    int pan = constrain((int)lock.pan, -100, 100);
+    voice.pan = (uint8_t)((pan + 100) * (PAN_STEPS - 1) / 200);
+  }
+  if (lock.params & (LOCK_CUTOFF | LOCK_RESONANCE)) {
+    FilterType type = trackFilterActive[track] ? trackFilters[track].filterType : FILTER_LOWPASS;
+    if (type != FILTER_HIGHPASS && type != FILTER_BANDPASS && type != FILTER_NOTCH) type = FILTER_LOWPASS;
+    float g = (lock.params & LOCK_CUTOFF)
+              ? lockCutoffG[lock.cutoff > LOCK_VALUE_MAX ? LOCK_VALUE_MAX : lock.cutoff] : trackSvfG[track];
+    float k = (lock.params & LOCK_RESONANCE)
+              ? lockResonanceK[lock.resonance > LOCK_VALUE_MAX ? LOCK_VALUE_MAX : lock.resonance] : trackSvfK[track];
+    voice.svfMode = type;
+    voice.svfK = k;
+    voice.svfA1 = 1.0f / (1.0f + g * (g + k));
+    voice.svfA2 = g * voice.svfA1;
+    voice.svfA3 = g * voice.svfA2;
+    voice.svfIc1 = voice.svfIc2 = 0.0f;
+    voice.svfIc1R = voice.svfIc2R = 0.0f;
+  }
+}
+
+// Core 0 (web, UDP, MIDI): only queues the trigger. The audio core reads the pad table
+// and starts the voice at the next block, so a retired buffer can't be picked up late
+void AudioEngine::triggerSampleLive(int padIndex, uint8_t velocity, uint8_t source, uint32_t requestUs) {
+  if (requestUs == 0) requestUs = micros();
   if (padIndex < 0 || padIndex >= 8) {
     Serial.printf("[AudioEngine] ERROR: Invalid pad index %d\n", padIndex);
     return;
   }
-  if (sampleBuffers[padIndex] == nullptr) {
-    Serial.printf("[AudioEngine] ERROR: No sample buffer for pad %d\n", padIndex);
-    return;
+  if (!queueLive(padIndex, velocity, source, requestUs)) {
+    Serial.printf("[AudioEngine] Live queue full, pad %d dropped\n", padIndex);
   }
-  
-  // Find free voice
-  int voiceIndex = findFreeVoice();
-  if (voiceIndex < 0) {
-    // No free voice, steal oldest
-    voiceIndex = 0;
-    Serial.println("[AudioEngine] No free voice, stealing voice 0");
+}
+
+bool AudioEngine::queueLive(int padIndex, uint8_t velocity, uint8_t source, uint32_t requestUs) {
+  bool queued = false;
+  portENTER_CRITICAL(&liveMux);
+  uint32_t head = liveHead.load(std::memory_order_relaxed);
+  if (head - liveTail.load(std::memory_order_acquire) < LIVE_QUEUE_LEN) {
+    LiveTrigger& trigger = liveQueue[head & (LIVE_QUEUE_LEN - 1)];
+    trigger.pad = padIndex;
+    trigger.velocity = velocity;
+    trigger.source = source;
+    trigger.requestUs = requestUs;
+    liveHead.store(head + 1, std::memory_order_release);
+    queued = true;
+  } else {
+    stats.liveDrops++;
   }
-  
-  // Setup voice
-  voices[voiceIndex].buffer = sampleBuffers[padIndex];
-  voices[voiceIndex].position = 0;
-  voices[voiceIndex].length = sampleLengths[padIndex];
-  voices[voiceIndex].active = true;
-  voices[voiceIndex].velocity = velocity;
-  // Apply 20% boost to livepads so they sound louder than sequencer at same volume setting
-  voices[voiceIndex].volume = (liveVolume * 120) / 100;
-  voices[voiceIndex].pitchShift = 1.0f;
-  voices[voiceIndex].loop = false;
-  voices[voiceIndex].padIndex = padIndex;
-  voices[voiceIndex].isLivePad = true;
-  
-  Serial.printf("[AudioEngine] *** LIVE PAD %d -> Voice %d, Length: %d samples, Velocity: %d ***\n",
-                padIndex, voiceIndex, sampleLengths[padIndex], velocity);
+  portEXIT_CRITICAL(&liveMux);
+  return queued;
+}
+
+// Block start (audio core), like startScheduled: the pad table is read before scanRetired
+void AudioEngine::startLive() {
+  uint32_t tail = liveTail.load(std::memory_order_relaxed);
+  uint32_t head = liveHead.load(std::memory_order_acquire);
+  for (; tail != head; tail++) {
+    const LiveTrigger& trigger = liveQueue[tail & (LIVE_QUEUE_LEN - 1)];
+    const PadSample& sample = padBanks[getActiveBank()][trigger.pad];
+    if (sample.buffer == nullptr) continue;  // Pad unloaded since the trigger
+    
+    // Find free voice (or steal the lowest-priority one)
+    int voiceIndex = allocateVoice();
+    startVoice(voiceIndex, trigger.pad, sample);
+    voices[voiceIndex].velocity = trigger.velocity;
+    if (trigger.source == TIMING_SEQUENCER) {
+      voices[voiceIndex].volume = sequencerVolume;
+      voices[voiceIndex].isLivePad = false;
+    } else {
+      // Apply 20% boost to livepads so they sound louder than sequencer at same volume setting
+      voices[voiceIndex].volume = (liveVolume * 120) / 100;
+      voices[voiceIndex].isLivePad = true;
+      voices[voiceIndex].requestUs = trigger.requestUs;
+      voices[voiceIndex].timingSource = trigger.source;
+    }
+    voices[voiceIndex].active = true;
+  }
+  liveTail.store(tail, std::memory_order_release);
 }
 
 void AudioEngine::stopSample(int padIndex) {
   // Stop all voices playing this sample
   for (int i = 0; i < MAX_VOICES; i++) {
-    if (voices[i].active && voices[i].buffer == sampleBuffers[padIndex]) {
+    if (voices[i].active && voices[i].buffer == padBanks[getActiveBank()][padIndex].buffer) {
       voices[i].active = false;
     }
   }
@@ -216,14 +518,25 @@ void AudioEngine::setLoop(int voiceIndex, bool loop, uint32_t start, uint32_t en
   voices[voiceIndex].loop = loop;
   voices[voiceIndex].loopStart = start;
   voices[voiceIndex].loopEnd = end > 0 ? end : voices[voiceIndex].length;
+  if (voices[voiceIndex].streamSlot >= 0) {
+    sampleStreamer.setLoop(voices[voiceIndex].streamSlot, loop, start);
+  }
 }
 
 void AudioEngine::process() {
   static uint32_t logCounter = 0;
   static uint32_t lastLogTime = 0;
   
-  // Fill mix buffer
+  // Fill mix buffer (timed for the voice governor)
+  uint32_t renderStart = micros();
   fillBuffer(mixBuffer, DMA_BUF_LEN);
+  uint32_t renderUs = micros() - renderStart;
+  
+  int activeVoices = countActiveVoices();
+  updateGovernor(renderUs, activeVoices);
+  
+  // Copy the next block of every voice to SRAM while i2s_write blocks
+  issuePrefetch();
   
   // Write to I2S External DAC
   size_t bytes_written;
@@ -232,78 +545,94 @@ void AudioEngine::process() {
   // Log every 5 seconds
   logCounter++;
   if (millis() - lastLogTime > 5000) {
-    int activeVoices = 0;
-    for (int i = 0; i < MAX_VOICES; i++) {
-      if (voices[i].active) activeVoices++;
-    }
-    Serial.printf("[AudioEngine] Process loop running OK, active voices: %d, calls: %d/5sec\n", 
-                  activeVoices, logCounter);
+    Serial.printf("[AudioEngine] Process loop running OK, active voices: %d/%d, render: %dus (peak %dus / %dus), calls: %d/5sec\n", 
+                  activeVoices, voiceCap, renderUs, stats.peakRenderUs, stats.budgetUs, logCounter);
     lastLogTime = millis();
     logCounter = 0;
   }
   
-  // Update CPU load calculation
+  // Update CPU load calculation (fraction of the block deadline spent rendering)
   processCount++;
   uint32_t now = millis();
   if (now - lastCpuCheck > 1000) {
-    cpuLoad = (processCount * DMA_BUF_LEN * 1000.0f) / (SAMPLE_RATE * (now - lastCpuCheck));
+    cpuLoad = cpuLoad * 0.5f + ((float)renderUs / stats.budgetUs) * 0.5f;
     processCount = 0;
     lastCpuCheck = now;
   }
 }
 
 void AudioEngine::fillBuffer(int16_t* buffer, size_t samples) {
-  // Clear output buffer
-  memset(buffer, 0, samples * sizeof(int16_t) * 2);
-
   // Usar un acumulador de 32 bits para evitar distorsión/clipping durante el mix
-  static int32_t mixAcc[DMA_BUF_LEN * 2];
-  memset(mixAcc, 0, sizeof(mixAcc));
+  memset(mixAcc, 0, samples * sizeof(int32_t) * 2);
+  
+  // Blocs de les veus copiats durant l'i2s_write anterior
+  waitPrefetch();
+  
+  // Triggers del sequencer que cauen dins d'aquest bloc
+  startScheduled(blockEpoch.load(std::memory_order_relaxed) * DMA_BUF_LEN, samples);
+  // Pads live rebuts des del bloc anterior
+  startLive();
   
-  // Mix all active voices
+  // Live triggers: received -> first block that renders them
+  uint32_t blockUs = micros();
   for (int v = 0; v < MAX_VOICES; v++) {
-    if (!voices[v].active) continue;
+    if (voices[v].timingSource != TIMING_NONE && voices[v].active) {
+      triggerTiming.recordStart(voices[v].timingSource, blockUs - voices[v].requestUs);
+      voices[v].timingSource = TIMING_NONE;
+    }
+  }
+  
+  // Block boundary: stop voices that still read a retired buffer
+  if (retirePending.load(std::memory_order_acquire) > 0) {
+    scanRetired();
+  }
+  
+  // Dual-core: només si està demanat i no estem en cooldown per càrrega de xarxa
+  if (cooldownBlocks > 0) cooldownBlocks--;
+  dualCoreActive = dualCoreRequested && workerTaskHandle != nullptr && cooldownBlocks == 0;
+  
+  if (dualCoreActive) {
+    // FORK: el worker de Core 0 renderitza els seus busos a workerAcc
+    workerPadMask = partitionBuses();
+    workerSamples = samples;
+    workerKickUs = micros();
+    workerState.store(WORKER_POSTED, std::memory_order_release);
+    xTaskNotifyGive(workerTaskHandle);
     
-    Voice& voice = voices[v];
+    renderVoices(mixAcc, samples, ~workerPadMask);
     
-    for (size_t i = 0; i < samples; i++) {
-      if (voice.position >= voice.length) {
-        if (voice.loop && voice.loopEnd > voice.loopStart) {
-          voice.position = voice.loopStart;
-        } else {
-          voice.active = false;
-          break;
+    // JOIN: esperar el worker (spin curt). Si encara no ha començat, cancel·lar i fer-ho aquí
+    uint32_t waitStart = micros();
+    bool late = false;
+    while (true) {
+      uint8_t state = workerState.load(std::memory_order_acquire);
+      if (state == WORKER_DONE) {
+        for (size_t i = 0; i < samples * 2; i++) {
+          mixAcc[i] += workerAcc[i];
         }
+        late = workerStartUs > DUALCORE_LATE_START_US;
+        break;
       }
-      
-      // Get sample
-      int16_t sample = voice.buffer[voice.position];
-      
-      // Apply velocity and per-source volume
-      int32_t scaled = ((int32_t)sample * voice.velocity) / 127;
-      scaled = (scaled * voice.volume) / 100;
-      
-      // Apply per-pad or per-track filter if active
-      int16_t filtered = (int16_t)constrain(scaled, -32768, 32767);
-      if (voice.padIndex >= 0 && voice.padIndex < MAX_PADS) {
-        // Check if pad has filter (for live pads)
-        if (voice.isLivePad && padFilterActive[voice.padIndex]) {
-          filtered = applyFilter(filtered, padFilters[voice.padIndex]);
-        }
-        // Check if track has filter (for sequencer tracks)
-        else if (!voice.isLivePad && voice.padIndex < MAX_AUDIO_TRACKS && trackFilterActive[voice.padIndex]) {
-          filtered = applyFilter(filtered, trackFilters[voice.padIndex]);
+      if (state == WORKER_POSTED && (micros() - workerKickUs) > DUALCORE_CANCEL_US) {
+        uint8_t expected = WORKER_POSTED;
+        if (workerState.compare_exchange_strong(expected, WORKER_IDLE, std::memory_order_acq_rel)) {
+          renderVoices(mixAcc, samples, workerPadMask);
+          late = true;
+          break;
         }
       }
-      
-      // Mix to accumulator
-      mixAcc[i * 2] += filtered;      // Left
-      mixAcc[i * 2 + 1] += filtered;  // Right
-      
-      voice.position++;
     }
+    workerState.store(WORKER_IDLE, std::memory_order_release);
+    dualStats.joinWaitUs = micros() - waitStart;
+    dualStats.dualBlocks++;
+    updateDualCore(workerStartUs, late);
+  } else {
+    renderVoices(mixAcc, samples, 0xFFFFFFFFUL);
   }
   
+  // No voice reads sample memory past this point until the next block
+  blockEpoch.fetch_add(1, std::memory_order_release);
+  
   // Soft clipping and conversion to 16bit with FX and volume
   for (size_t i = 0; i < samples * 2; i++) {
     int32_t val = mixAcc[i];
@@ -325,17 +654,324 @@ void AudioEngine::fillBuffer(int16_t* buffer, size_t samples) {
   }
 }
 
+// Mix the active voices whose pad (bus) is in padMask into acc.
+// Each bus owns its filter state, so two cores never touch the same state.
+// Mono and stereo voices have their own kernels: mono voices don't pay for stereo
+void AudioEngine::renderVoices(int32_t* acc, size_t samples, uint32_t padMask) {
+  for (int v = 0; v < MAX_VOICES; v++) {
+    if (!voices[v].active) continue;
+    
+    int bus = (voices[v].padIndex >= 0 && voices[v].padIndex < 16) ? voices[v].padIndex : 31;
+    if (!(padMask & (1UL << bus))) continue;
+    
+    if (voices[v].channels == 2) renderStereoVoice(v, acc, samples, bus);
+    else renderMonoVoice(v, acc, samples, bus);
+  }
+}
+
+// Per-pad filter for live voices, per-track filter for sequencer voices (nullptr = none)
+FXParams* AudioEngine::voiceFilter(const Voice& voice) {
+  if (voice.padIndex < 0 || voice.padIndex >= MAX_PADS) return nullptr;
+  if (voice.isLivePad) return padFilterActive[voice.padIndex] ? &padFilters[voice.padIndex] : nullptr;
+  if (voice.padIndex < MAX_AUDIO_TRACKS && trackFilterActive[voice.padIndex]) return &trackFilters[voice.padIndex];
+  return nullptr;
+}
+
+void AudioEngine::renderMonoVoice(int v, int32_t* acc, size_t samples, int bus) {
+  Voice& voice = voices[v];
+  
+  // Staged block only valid for the buffer it was copied from (retrigger = other sample)
+  const int16_t* stage = voice.staged;
+  uint32_t stageStart = voice.stagedStart;
+  uint32_t stageCount = (voice.stagedSrc == voice.buffer) ? voice.stagedCount : 0;
+  bool compressed = voice.format != SAMPLE_PCM16;
+  FXParams* filter = voice.svfMode ? nullptr : voiceFilter(voice);
+  const int16_t* pan = panGains[voice.pan != PAN_UNLOCKED ? voice.pan : (bus < 16 ? busPan[bus] : PAN_CENTER)];
+  int32_t gainL = pan[0];
+  int32_t gainR = pan[1];
+  
+  // Streamed part: SPSC ring filled by the SampleStreamer reader on Core 0
+  const int16_t* streamRing = nullptr;
+  uint32_t streamAvailable = 0;
+  bool underrun = false;
+  if (voice.streamSlot >= 0) {
+    streamRing = sampleStreamer.ring(voice.streamSlot);
+    streamAvailable = sampleStreamer.available(voice.streamSlot);
+  }
+  
+  // Scheduled trigger: starts startDelay frames into this block
+  size_t first = voice.startDelay;
+  voice.startDelay = 0;
+  for (size_t i = first; i < samples; i++) {
+    if (voice.position >= voice.length) {
+      if (voice.loop && voice.loopEnd > voice.loopStart) {
+        voice.position = voice.loopStart;
+      } else {
+        voice.active = false;
+        break;
+      }
+    }
+    
+    // Get sample (prefetched block or attack head in SRAM, otherwise PSRAM)
+    int16_t sample;
+    uint32_t stageOffset = voice.position - stageStart;
+    if (stageOffset < stageCount) {
+      sample = stage[stageOffset];
+    } else if (voice.position < voice.headLength) {
+      sample = voice.head[voice.position];
+    } else if (compressed) {
+      // Decode a whole block when the playhead enters it (blocks are seek points)
+      uint32_t block = voice.position / CODEC_BLOCK_SAMPLES;
+      if (block != voice.decodedBlock) {
+        uint32_t first = block * CODEC_BLOCK_SAMPLES;
+        uint32_t count = voice.length - first;
+        if (count > CODEC_BLOCK_SAMPLES) count = CODEC_BLOCK_SAMPLES;
+        SampleCodec::decodeBlock(voice.format, (const uint8_t*)voice.buffer, block, count, decodeBuffers[v]);
+        voice.decodedBlock = block;
+      }
+      sample = decodeBuffers[v][voice.position % CODEC_BLOCK_SAMPLES];
+    } else if (voice.position < voice.residentLength) {
+      sample = voice.buffer[voice.position];
+    } else if (voice.streamRead < streamAvailable) {
+      sample = streamRing[voice.streamRead & STREAM_RING_MASK];
+      voice.streamRead++;
+    } else {
+      // Reader behind: silence, keep time (the tail is cut by the same amount)
+      sample = 0;
+      underrun = true;
+    }
+    
+    // Apply velocity and per-source volume
+    int32_t scaled = ((int32_t)sample * voice.velocity) / 127;
+    scaled = (scaled * voice.volume) / 100;
+    if (voice.envMul > 0.0f) {
+      scaled = (int32_t)(scaled * voice.envGain);
+      voice.envGain *= voice.envMul;
+      if (voice.envGain < LOCK_DECAY_FLOOR) voice.active = false;  // After this frame
+    }
+    
+    // Apply per-pad or per-track filter if active (or the step's locked filter)
+    int16_t filtered = (int16_t)constrain(scaled, -32768, 32767);
+    if (filter != nullptr) filtered = applyFilter(filtered, *filter);
+    else if (voice.svfMode) filtered = applyLockFilter(voice, filtered, voice.svfIc1, voice.svfIc2);
+    
+    // Mix to accumulator (mono -> stereo through the pan law)
+    acc[i * 2] += (filtered * gainL) >> PAN_SHIFT;      // Left
+    acc[i * 2 + 1] += (filtered * gainR) >> PAN_SHIFT;  // Right
+    
+    // Pitch lock: Q16 step (resident voices only, the stream path reads one frame per output frame)
+    if (voice.pitchStep == PITCH_UNITY) {
+      voice.position++;
+    } else {
+      voice.pitchFrac += voice.pitchStep;
+      voice.position += voice.pitchFrac >> 16;
+      voice.pitchFrac &= 0xFFFF;
+    }
+    if (!voice.active) break;
+  }
+  
+  if (voice.streamSlot >= 0) {
+    sampleStreamer.consume(voice.streamSlot, voice.streamRead);
+    if (underrun) sampleStreamer.noteUnderrun();
+  }
+}
+
+// Interleaved PCM16 frames, always resident (no codec, no stream, no stage).
+// Pan works as balance: each side keeps its own channel
+void AudioEngine::renderStereoVoice(int v, int32_t* acc, size_t samples, int bus) {
+  Voice& voice = voices[v];
+  FXParams* filter = voice.svfMode ? nullptr : voiceFilter(voice);
+  const int16_t* pan = panGains[voice.pan != PAN_UNLOCKED ? voice.pan : (bus < 16 ? busPan[bus] : PAN_CENTER)];
+  int32_t gainL = pan[0];
+  int32_t gainR = pan[1];
+  int32_t gain = voice.velocity * voice.volume;  // / (127 * 100)
+  
+  size_t first = voice.startDelay;
+  voice.startDelay = 0;
+  for (size_t i = first; i < samples; i++) {
+    if (voice.position >= voice.length) {
+      if (voice.loop && voice.loopEnd > voice.loopStart) {
+        voice.position = voice.loopStart;
+      } else {
+        voice.active = false;
+        break;
+      }
+    }
+    
+    const int16_t* frame = (voice.position < voice.headLength ? voice.head : voice.buffer) + voice.position * 2;
+    int32_t scaledL = ((int32_t)frame[0] * gain) / (127 * 100);
+    int32_t scaledR = ((int32_t)frame[1] * gain) / (127 * 100);
+    if (voice.envMul > 0.0f) {
+      scaledL = (int32_t)(scaledL * voice.envGain);
+      scaledR = (int32_t)(scaledR * voice.envGain);
+      voice.envGain *= voice.envMul;
+      if (voice.envGain < LOCK_DECAY_FLOOR) voice.active = false;
+    }
+    int16_t left = (int16_t)constrain(scaledL, -32768, 32767);
+    int16_t right = (int16_t)constrain(scaledR, -32768, 32767);
+    if (filter != nullptr) {
+      left = applyFilter(left, *filter, filter->state);
+      right = applyFilter(right, *filter, filter->stateR);
+    } else if (voice.svfMode) {
+      left = applyLockFilter(voice, left, voice.svfIc1, voice.svfIc2);
+      right = applyLockFilter(voice, right, voice.svfIc1R, voice.svfIc2R);
+    }
+    
+    acc[i * 2] += (left * gainL) >> PAN_SHIFT;
+    acc[i * 2 + 1] += (right * gainR) >> PAN_SHIFT;
+    
+    if (voice.pitchStep == PITCH_UNITY) {
+      voice.position++;
+    } else {
+      voice.pitchFrac += voice.pitchStep;
+      voice.position += voice.pitchFrac >> 16;
+      voice.pitchFrac &= 0xFFFF;
+    }
+    if (!voice.active) break;
+  }
+}
+
 int AudioEngine::findFreeVoice() {
+  // Respect the governor cap: above it, a new trigger must steal
+  if (countActiveVoices() >= voiceCap) return -1;
+  
   for (int i = 0; i < MAX_VOICES; i++) {
     if (!voices[i].active) return i;
   }
   return -1;
 }
 
+// Lowest priority = sequencer before live, quieter before louder, older before newer
+uint32_t AudioEngine::voicePriority(const Voice& voice) {
+  uint32_t priority = voice.isLivePad ? 0x80000000UL : 0;
+  priority |= ((uint32_t)voice.velocity * voice.volume) << 12;
+  // Age, not the raw order (which would wrap every 4096 triggers): saturated, older = lower
+  uint32_t age = voiceOrderCounter - voice.startOrder;
+  priority |= 0xFFF - (age < 0xFFF ? age : 0xFFF);
+  return priority;
+}
+
+int AudioEngine::findVoiceToSteal() {
+  int victim = -1;
+  uint32_t lowest = 0xFFFFFFFFUL;
+  for (int i = 0; i < MAX_VOICES; i++) {
+    if (!voices[i].active) continue;
+    uint32_t priority = voicePriority(voices[i]);
+    if (victim < 0 || priority < lowest) {
+      lowest = priority;
+      victim = i;
+    }
+  }
+  return victim;
+}
+
+int AudioEngine::allocateVoice() {
+  int voiceIndex = findFreeVoice();
+  if (voiceIndex >= 0) return voiceIndex;
+  
+  voiceIndex = findVoiceToSteal();
+  if (voiceIndex < 0) voiceIndex = 0;
+  voices[voiceIndex].active = false;
+  stats.voiceSteals++;
+  Serial.printf("[AudioEngine] No free voice (cap %d), stealing voice %d\n", voiceCap, voiceIndex);
+  return voiceIndex;
+}
+
+int AudioEngine::countActiveVoices() {
+  int count = 0;
+  for (int i = 0; i < MAX_VOICES; i++) {
+    if (voices[i].active) count++;
+  }
+  return count;
+}
+
+// ============= VOICE GOVERNOR =============
+// Mesura el temps de render per bloc i ajusta el límit efectiu de veus
+// abans que es perdi el deadline del DMA (el cost de FX varia en viu)
+
+void AudioEngine::updateGovernor(uint32_t renderUs, int activeVoices) {
+  stats.lastRenderUs = renderUs;
+  if (renderUs > stats.peakRenderUs) stats.peakRenderUs = renderUs;
+  if (renderUs > stats.budgetUs) stats.deadlineMisses++;
+  
+  uint32_t loadPct = (renderUs * 100) / stats.budgetUs;
+  uint32_t bin = loadPct / 10;
+  if (bin >= RENDER_HIST_BINS) bin = RENDER_HIST_BINS - 1;
+  stats.histogram[bin]++;
+  
+  if (activeVoices > 0) {
+    float cost = (float)renderUs / activeVoices;
+    stats.voiceCostUs = stats.voiceCostUs * 0.9f + cost * 0.1f;
+    
+    // Cost per mode, to compare single-core vs dual-core headroom
+    if (dualCoreActive) {
+      dualStats.dualCostUs = dualStats.dualCostUs * 0.9f + cost * 0.1f;
+    } else {
+      dualStats.singleCostUs = dualStats.singleCostUs * 0.9f + cost * 0.1f;
+    }
+    
+    // And with/without prefetch, for the before/after comparison
+    if (prefetchEnabled) {
+      prefetchStats.onCostUs = prefetchStats.onCostUs * 0.9f + cost * 0.1f;
+    } else {
+      prefetchStats.offCostUs = prefetchStats.offCostUs * 0.9f + cost * 0.1f;
+    }
+  }
+  
+  if (loadPct >= GOVERNOR_HIGH_LOAD_PCT && stats.voiceCostUs > 0.0f) {
+    // Retallar el límit al que cap dins la càrrega objectiu
+    int affordable = (int)((stats.budgetUs * GOVERNOR_TARGET_LOAD_PCT / 100) / stats.voiceCostUs);
+    affordable = constrain(affordable, GOVERNOR_MIN_VOICES, MAX_VOICES);
+    if (affordable < voiceCap) voiceCap = affordable;
+    quietBlocks = 0;
+    
+    // Eliminar les veus de menor prioritat que sobrepassen el límit
+    while (activeVoices > voiceCap) {
+      int victim = findVoiceToSteal();
+      if (victim < 0) break;
+      voices[victim].active = false;
+      stats.governorDrops++;
+      activeVoices--;
+    }
+  } else if (loadPct < GOVERNOR_LOW_LOAD_PCT) {
+    if (++quietBlocks >= GOVERNOR_RECOVER_BLOCKS && voiceCap < MAX_VOICES) {
+      voiceCap++;
+      quietBlocks = 0;
+    }
+  } else {
+    quietBlocks = 0;
+  }
+  
+  stats.voiceCap = voiceCap;
+}
+
+int AudioEngine::getVoiceCap() {
+  return voiceCap;
+}
+
+void AudioEngine::getRenderStats(RenderStats& out) {
+  out = stats;
+  out.voiceCap = voiceCap;
+}
+
+void AudioEngine::resetRenderStats() {
+  memset(&stats, 0, sizeof(stats));
+  stats.budgetUs = BLOCK_BUDGET_US;
+  stats.voiceCap = voiceCap;
+}
+
 void AudioEngine::resetVoice(int voiceIndex) {
   voices[voiceIndex].buffer = nullptr;
+  voices[voiceIndex].format = SAMPLE_PCM16;
+  voices[voiceIndex].channels = 1;
+  voices[voiceIndex].decodedBlock = UINT32_MAX;
+  voices[voiceIndex].head = nullptr;
+  voices[voiceIndex].headLength = 0;
   voices[voiceIndex].position = 0;
   voices[voiceIndex].length = 0;
+  voices[voiceIndex].residentLength = 0;
+  voices[voiceIndex].streamSlot = -1;
+  voices[voiceIndex].streamRead = 0;
   voices[voiceIndex].active = false;
   voices[voiceIndex].velocity = 127;
   voices[voiceIndex].volume = 100;
@@ -345,6 +981,323 @@ void AudioEngine::resetVoice(int voiceIndex) {
   voices[voiceIndex].loopEnd = 0;
   voices[voiceIndex].padIndex = -1;
   voices[voiceIndex].isLivePad = false;
+  voices[voiceIndex].startOrder = 0;
+  voices[voiceIndex].staged = nullptr;
+  voices[voiceIndex].stagedSrc = nullptr;
+  voices[voiceIndex].stagedStart = 0;
+  voices[voiceIndex].stagedCount = 0;
+  voices[voiceIndex].startDelay = 0;
+  voices[voiceIndex].pitchStep = PITCH_UNITY;
+  voices[voiceIndex].pitchFrac = 0;
+  voices[voiceIndex].envGain = 1.0f;
+  voices[voiceIndex].envMul = 0.0f;
+  voices[voiceIndex].pan = PAN_UNLOCKED;
+  voices[voiceIndex].svfMode = FILTER_NONE;
+  voices[voiceIndex].requestUs = 0;
+  voices[voiceIndex].timingSource = TIMING_NONE;
+}
+
+// ============= DUAL-CORE RENDER =============
+// Core 1 fa el fork (notificació a la tasca worker de Core 0), renderitza
+// els seus busos, i al join suma l'acumulador del worker.
+
+void AudioEngine::renderWorkerTask(void* arg) {
+  AudioEngine* engine = static_cast<AudioEngine*>(arg);
+  Serial.printf("[Task] Render Worker iniciada en Core 0 (Prioridad: %d)\n", DUALCORE_WORKER_PRIORITY);
+  
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    
+    // Agafar la feina només si Core 1 no l'ha cancel·lada
+    uint8_t expected = WORKER_POSTED;
+    if (!engine->workerState.compare_exchange_strong(expected, WORKER_RUNNING, std::memory_order_acq_rel)) {
+      continue;
+    }
+    engine->workerStartUs = micros() - engine->workerKickUs;
+    
+    memset(engine->workerAcc, 0, engine->workerSamples * sizeof(int32_t) * 2);
+    engine->renderVoices(engine->workerAcc, engine->workerSamples, engine->workerPadMask);
+    
+    engine->workerState.store(WORKER_DONE, std::memory_order_release);
+  }
+}
+
+// Greedy balance: each bus goes to the core with fewer voices so far
+uint32_t AudioEngine::partitionBuses() {
+  int padVoices[16] = {0};
+  for (int v = 0; v < MAX_VOICES; v++) {
+    if (voices[v].active && voices[v].padIndex >= 0 && voices[v].padIndex < 16) {
+      padVoices[voices[v].padIndex]++;
+    }
+  }
+  
+  uint32_t mask = 0;
+  int localCount = 0;
+  int workerCount = 0;
+  for (int pad = 0; pad < 16; pad++) {
+    if (padVoices[pad] == 0) continue;
+    if (workerCount < localCount) {
+      mask |= (1UL << pad);
+      workerCount += padVoices[pad];
+    } else {
+      localCount += padVoices[pad];
+    }
+  }
+  return mask;
+}
+
+// Fall back to single-core when Core 0 can't start the worker on time
+void AudioEngine::updateDualCore(uint32_t startUs, bool late) {
+  dualStats.workerStartUs = startUs;
+  if (late) {
+    dualStats.lateStarts++;
+    lateInWindow++;
+  }
+  
+  if (++windowBlocks >= DUALCORE_WINDOW_BLOCKS) {
+    windowBlocks = 0;
+    lateInWindow = 0;
+  }
+  
+  if (lateInWindow >= DUALCORE_LATE_LIMIT) {
+    cooldownBlocks = DUALCORE_COOLDOWN_BLOCKS;
+    lateInWindow = 0;
+    windowBlocks = 0;
+    dualStats.fallbacks++;
+    Serial.println("[AudioEngine] Core 0 busy, dual-core render -> single-core (cooldown 5s)");
+  }
+}
+
+bool AudioEngine::setDualCoreRender(bool enabled) {
+  if (enabled && workerTaskHandle == nullptr) {
+    BaseType_t ok = xTaskCreatePinnedToCore(
+      renderWorkerTask,
+      "RenderWorker",
+      4096,
+      this,
+      DUALCORE_WORKER_PRIORITY,
+      &workerTaskHandle,
+      0       // CORE 0: meitat dels busos
+    );
+    if (ok != pdPASS) {
+      workerTaskHandle = nullptr;
+      Serial.println("[AudioEngine] ERROR: Failed to create render worker");
+      return false;
+    }
+  }
+  
+  dualCoreRequested = enabled;
+  cooldownBlocks = 0;
+  lateInWindow = 0;
+  windowBlocks = 0;
+  Serial.printf("[AudioEngine] Dual-core render: %s\n", enabled ? "ON" : "OFF");
+  return true;
+}
+
+bool AudioEngine::isDualCoreRender() {
+  return dualCoreRequested;
+}
+
+void AudioEngine::getDualCoreStats(DualCoreStats& out) {
+  out = dualStats;
+  out.enabled = dualCoreRequested;
+  out.active = dualCoreRequested && workerTaskHandle != nullptr && cooldownBlocks == 0;
+}
+
+// ============= BLOCK PREFETCH =============
+// Després de renderitzar el bloc N es copia el bloc N+1 de cada veu a un
+// buffer intern; la GDMA treballa mentre i2s_write espera el DMA de l'I2S,
+// i el mixer del bloc següent només llegeix SRAM contigua.
+
+void AudioEngine::issuePrefetch() {
+  if (!prefetchEnabled) {
+    if (stagesValid) clearStages();
+    return;
+  }
+  
+  for (int v = 0; v < MAX_VOICES; v++) {
+    Voice& voice = voices[v];
+    voice.stagedCount = 0;
+    if (!voice.active || voice.buffer == nullptr || voice.position >= voice.length) continue;
+    if (voice.format != SAMPLE_PCM16) continue;  // Compressed: decoded block is already in SRAM
+    if (voice.channels != 1) continue;           // Stages are sized for mono blocks: stereo reads PSRAM
+    
+    if (voice.position >= voice.residentLength) continue;  // Streamed part: already sequential
+    uint32_t start = voice.position;
+    uint32_t count = voice.residentLength - start;
+    if (count > DMA_BUF_LEN) count = DMA_BUF_LEN;
+    if (start + count <= voice.headLength) continue;  // Tot el bloc ja és al head en SRAM
+    
+    // Source aligned down to PREFETCH_ALIGN, size rounded up (a few bytes past the end are harmless)
+    uintptr_t src = (uintptr_t)(voice.buffer + start);
+    uintptr_t alignedSrc = src & ~(uintptr_t)(PREFETCH_ALIGN - 1);
+    uint32_t lead = (src - alignedSrc) / sizeof(int16_t);
+    size_t bytes = ((lead + count) * sizeof(int16_t) + PREFETCH_ALIGN - 1) & ~(size_t)(PREFETCH_ALIGN - 1);
+    
+    if (!copyToStage(stageBuffers[v], (const void*)alignedSrc, bytes)) continue;
+    
+    voice.staged = stageBuffers[v] + lead;
+    voice.stagedSrc = voice.buffer;
+    voice.stagedStart = start;
+    voice.stagedCount = count;
+    stagesValid = true;
+  }
+}
+
+bool AudioEngine::copyToStage(int16_t* dst, const void* src, size_t bytes) {
+#ifdef ESP_PLATFORM
+  if (prefetchDma != nullptr) {
+    prefetchPending.fetch_add(1, std::memory_order_relaxed);
+    esp_err_t err = esp_async_memcpy((async_memcpy_t)prefetchDma, dst, (void*)src, bytes,
+                                     onPrefetchDone, &prefetchPending);
+    if (err == ESP_OK) {
+      prefetchStats.copies++;
+      prefetchStats.bytes += bytes;
+      return true;
+    }
+    prefetchPending.fetch_sub(1, std::memory_order_relaxed);
+    prefetchStats.dmaErrors++;
+  }
+#endif
+  memcpy(dst, src, bytes);
+  prefetchStats.copies++;
+  prefetchStats.bytes += bytes;
+  return true;
+}
+
+// Wait (bounded) for the copies issued during the previous i2s_write
+void AudioEngine::waitPrefetch() {
+  if (prefetchPending.load(std::memory_order_acquire) == 0) {
+    prefetchStats.waitUs = 0;
+    return;
+  }
+  
+  uint32_t waitStart = micros();
+  while (prefetchPending.load(std::memory_order_acquire) > 0) {
+    if ((micros() - waitStart) > PREFETCH_WAIT_US) {
+      // La DMA encara escriu: aquest bloc llegeix la PSRAM directament
+      prefetchStats.timeouts++;
+      clearStages();
+      break;
+    }
+  }
+  prefetchStats.waitUs = micros() - waitStart;
+}
+
+void AudioEngine::clearStages() {
+  for (int v = 0; v < MAX_VOICES; v++) {
+    voices[v].stagedCount = 0;
+  }
+  stagesValid = false;
+}
+
+bool AudioEngine::setPrefetch(bool enabled) {
+#ifdef ESP_PLATFORM
+  if (enabled && prefetchDma == nullptr) {
+    async_memcpy_config_t config = ASYNC_MEMCPY_DEFAULT_CONFIG();
+    config.backlog = MAX_VOICES;
+    config.psram_trans_align = PREFETCH_ALIGN;
+    config.sram_trans_align = PREFETCH_ALIGN;
+    async_memcpy_t handle = nullptr;
+    esp_err_t err = esp_async_memcpy_install(&config, &handle);
+    if (err == ESP_OK) {
+      prefetchDma = handle;
+    } else {
+      Serial.printf("[AudioEngine] Async memcpy install failed (%d), prefetch with memcpy\n", err);
+    }
+  }
+#endif
+  
+  prefetchEnabled = enabled;
+  Serial.printf("[AudioEngine] Block prefetch: %s (%s)\n", enabled ? "ON" : "OFF",
+                prefetchDma != nullptr ? "GDMA" : "memcpy");
+  return true;
+}
+
+bool AudioEngine::isPrefetch() {
+  return prefetchEnabled;
+}
+
+void AudioEngine::getPrefetchStats(PrefetchStats& out) {
+  out = prefetchStats;
+  out.enabled = prefetchEnabled;
+  out.dma = prefetchDma != nullptr;
+}
+
+// ============= DEFERRED RECLAMATION =============
+// SampleManager treu el buffer de les taules de pads i el retira; el core
+// d'àudio, a l'inici del bloc, para les veus que encara el llegeixen i marca
+// l'epoch. Passats RETIRE_GRACE_BLOCKS blocs ja es pot alliberar.
+// Al costat de l'àudio només hi ha loads/stores atòmics, cap lock.
+
+int AudioEngine::retireBuffer(const void* buffer) {
+  if (buffer == nullptr) return -1;
+  
+  for (int i = 0; i < RETIRE_SLOTS; i++) {
+    uint8_t expected = RETIRE_FREE;
+    if (!retireSlots[i].state.compare_exchange_strong(expected, RETIRE_CLAIMING, std::memory_order_acq_rel)) {
+      continue;
+    }
+    retireSlots[i].buffer = buffer;
+    retireSlots[i].ackEpoch = 0;
+    retireSlots[i].state.store(RETIRE_PENDING, std::memory_order_release);
+    retirePending.fetch_add(1, std::memory_order_release);
+    retireStats.retired++;
+    return i;
+  }
+  
+  retireStats.queueFull++;
+  return -1;
+}
+
+void AudioEngine::scanRetired() {
+  uint32_t epoch = blockEpoch.load(std::memory_order_relaxed);
+  
+  for (int r = 0; r < RETIRE_SLOTS; r++) {
+    RetireSlot& slot = retireSlots[r];
+    uint8_t state = slot.state.load(std::memory_order_acquire);
+    if (state != RETIRE_PENDING && state != RETIRE_ACKED) continue;
+    
+    // Keep scanning ACKED slots: a trigger racing the unload may still start a voice on it
+    for (int v = 0; v < MAX_VOICES; v++) {
+      Voice& voice = voices[v];
+      if (voice.active && (voice.buffer == slot.buffer || voice.head == slot.buffer)) {
+        voice.active = false;
+        retireStats.voicesStopped++;
+      }
+    }
+    
+    if (state == RETIRE_PENDING) {
+      slot.ackEpoch = epoch;
+      slot.state.store(RETIRE_ACKED, std::memory_order_release);
+    }
+  }
+}
+
+bool AudioEngine::isRetireComplete(int slot) {
+  if (slot < 0 || slot >= RETIRE_SLOTS) return true;
+  RetireSlot& r = retireSlots[slot];
+  if (r.state.load(std::memory_order_acquire) != RETIRE_ACKED) return false;
+  return (getBlockEpoch() - r.ackEpoch) >= RETIRE_GRACE_BLOCKS;
+}
+
+void AudioEngine::releaseRetireSlot(int slot) {
+  if (slot < 0 || slot >= RETIRE_SLOTS) return;
+  uint8_t state = retireSlots[slot].state.load(std::memory_order_acquire);
+  if (state == RETIRE_PENDING || state == RETIRE_ACKED) {
+    retirePending.fetch_sub(1, std::memory_order_release);
+  }
+  retireSlots[slot].buffer = nullptr;
+  retireSlots[slot].state.store(RETIRE_FREE, std::memory_order_release);
+}
+
+void AudioEngine::noteReclaimWait(uint32_t waitMs) {
+  retireStats.lastWaitMs = waitMs;
+  if (waitMs > retireStats.peakWaitMs) retireStats.peakWaitMs = waitMs;
+}
+
+void AudioEngine::getRetireStats(RetireStats& out) {
+  out = retireStats;
 }
 
 // ============= FX IMPLEMENTATION =============
@@ -536,11 +1489,7 @@ inline int16_t AudioEngine::processFX(int16_t input) {
 }
 
 int AudioEngine::getActiveVoices() {
-  int count = 0;
-  for (int i = 0; i < MAX_VOICES; i++) {
-    if (voices[i].active) count++;
-  }
-  return count;
+  return countActiveVoices();
 }
 
 float AudioEngine::getCpuLoad() {
@@ -584,6 +1533,22 @@ void AudioEngine::captureAudioData(uint8_t* spectrum, uint8_t* waveform) {
   }
 }
 
+// ============= PER-TRACK PAN =============
+
+void AudioEngine::setTrackPan(int track, int pan) {
+  if (track < 0 || track >= 16) return;
+  pan = constrain(pan, -100, 100);
+  busPan[track] = (uint8_t)((pan + 100) * (PAN_STEPS - 1) / 200);
+  Serial.printf("[AudioEngine] Track %d pan: %d (L %.2f / R %.2f)\n", track, pan,
+                panGains[busPan[track]][0] / (float)(1 << PAN_SHIFT),
+                panGains[busPan[track]][1] / (float)(1 << PAN_SHIFT));
+}
+
+int AudioEngine::getTrackPan(int track) {
+  if (track < 0 || track >= 16) return 0;
+  return (busPan[track] * 200 + (PAN_STEPS - 1) / 2) / (PAN_STEPS - 1) - 100;
+}
+
 // ============= PER-TRACK FILTER MANAGEMENT =============
 
 bool AudioEngine::setTrackFilter(int track, FilterType type, float cutoff, float resonance, float gain) {
@@ -607,6 +1572,9 @@ bool AudioEngine::setTrackFilter(int track, FilterType type, float cutoff, float
   if (type != FILTER_NONE) {
     calculateBiquadCoeffs(trackFilters[track]);
   }
+  // Base for steps that lock only the cutoff or only the resonance
+  trackSvfG[track] = tanf(PI * trackFilters[track].cutoff / SAMPLE_RATE);
+  trackSvfK[track] = 1.0f / trackFilters[track].resonance;
   
   Serial.printf("[AudioEngine] Track %d filter: %s (cutoff: %.1f Hz, Q: %.2f, gain: %.1f dB)\n",
                 track, getFilterName(type), cutoff, resonance, gain);
@@ -617,6 +1585,8 @@ void AudioEngine::clearTrackFilter(int track) {
   if (track < 0 || track >= MAX_AUDIO_TRACKS) return;
   trackFilters[track].filterType = FILTER_NONE;
   trackFilterActive[track] = false;
+  trackSvfG[track] = lockCutoffG[LOCK_VALUE_MAX];
+  trackSvfK[track] = M_SQRT2;
   Serial.printf("[AudioEngine] Track %d filter cleared\n", track);
 }
 
@@ -821,13 +1791,40 @@ void AudioEngine::calculateBiquadCoeffs(FXParams& fxParam) {
 // ============= EXTENDED FILTER PROCESSING =============
 
 inline int16_t AudioEngine::applyFilter(int16_t input, FXParams& fxParam) {
+  return applyFilter(input, fxParam, fxParam.state);
+}
+
+// Locked filter: TPT state-variable filter, coefficients set once in applyLock
+// (stable when a lock jumps the cutoff, no biquad recalculation per step)
+inline int16_t AudioEngine::applyLockFilter(const Voice& voice, int16_t input, float& ic1, float& ic2) {
+  float x = (float)input;
+  float v3 = x - ic2;
+  float v1 = voice.svfA1 * ic1 + voice.svfA2 * v3;
+  float v2 = ic2 + voice.svfA2 * ic1 + voice.svfA3 * v3;
+  ic1 = 2.0f * v1 - ic1;
+  ic2 = 2.0f * v2 - ic2;
+  
+  float y;
+  switch (voice.svfMode) {
+    case FILTER_HIGHPASS: y = x - voice.svfK * v1 - v2; break;
+    case FILTER_BANDPASS: y = v1; break;
+    case FILTER_NOTCH: y = x - voice.svfK * v1; break;
+    default: y = v2; break;
+  }
+  if (y > 32767.0f) y = 32767.0f;
+  else if (y < -32768.0f) y = -32768.0f;
+  return (int16_t)y;
+}
+
+// Same coefficients, separate history (left/right of a stereo voice)
+inline int16_t AudioEngine::applyFilter(int16_t input, FXParams& fxParam, FilterState& state) {
   if (fxParam.filterType == FILTER_NONE) return input;
   
   float x = (float)input;
-  float y = fxParam.coeffs.b0 * x + fxParam.state.x1;
+  float y = fxParam.coeffs.b0 * x + state.x1;
   
-  fxParam.state.x1 = fxParam.coeffs.b1 * x - fxParam.coeffs.a1 * y + fxParam.state.x2;
-  fxParam.state.x2 = fxParam.coeffs.b2 * x - fxParam.coeffs.a2 * y;
+  state.x1 = fxParam.coeffs.b1 * x - fxParam.coeffs.a1 * y + state.x2;
+  state.x2 = fxParam.coeffs.b2 * x - fxParam.coeffs.a2 * y;
   
   // Clamp to prevent overflow
   if (y > 32767.0f) y = 32767.0f;
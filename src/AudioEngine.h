@@ -10,12 +10,64 @@
 #include <Arduino.h>
 #include <driver/i2s.h>
 #include <cmath>
+#include <atomic>
+#include "SampleCodec.h"
+#include "ParamLock.h"
+#include "TriggerTiming.h"
 
-#define MAX_VOICES 8
+#define MAX_VOICES 32
 #define SAMPLE_RATE 44100
 #define DMA_BUF_COUNT 4
 #define DMA_BUF_LEN 128
 
+// Voice governor: adapta el límite de veus al temps de render mesurat
+#define BLOCK_BUDGET_US ((DMA_BUF_LEN * 1000000UL) / SAMPLE_RATE)  // ~2902us per bloc
+#define GOVERNOR_MIN_VOICES 8        // Mai baixar d'aquí
+#define GOVERNOR_HIGH_LOAD_PCT 85    // Per sobre: retallar veus abans del deadline
+#define GOVERNOR_TARGET_LOAD_PCT 70  // Càrrega objectiu en retallar
+#define GOVERNOR_LOW_LOAD_PCT 50     // Per sota: recuperar veus
+#define GOVERNOR_RECOVER_BLOCKS 64   // Blocs tranquils abans de pujar el límit
+#define RENDER_HIST_BINS 12          // 10% del budget per bin, l'últim = >110%
+
+// Dual-core render: Core 0 renderitza la meitat dels busos (pads) per bloc
+#define DUALCORE_WORKER_PRIORITY 22  // Per sota de la tasca WiFi (23): si la xarxa carrega, arriba tard
+#define DUALCORE_LATE_START_US 250   // Worker que comença més tard d'això = Core 0 ocupat
+#define DUALCORE_LATE_LIMIT 8        // Blocs tard (dins la finestra) abans de tornar a single-core
+#define DUALCORE_WINDOW_BLOCKS 344   // Finestra de ~1s per comptar blocs tard
+#define DUALCORE_COOLDOWN_BLOCKS 1720 // ~5s en single-core abans de reintentar
+#define DUALCORE_CANCEL_US 600       // Si el worker no ha començat, Core 1 fa la seva meitat
+
+// Prefetch: còpia per veu del proper bloc PSRAM -> SRAM interna (async memcpy / GDMA)
+#define PREFETCH_ALIGN 16            // Alineació (bytes) que demana la GDMA amb PSRAM
+#define PREFETCH_STAGE_LEN (DMA_BUF_LEN + PREFETCH_ALIGN)  // Bloc + marge d'alineació, en mostres
+#define PREFETCH_WAIT_US 500         // Espera màxima de les còpies pendents a l'inici del bloc
+
+// Alliberament diferit: un buffer retirat es pot alliberar quan el core d'àudio
+// ha parat les veus que el llegeixen i han passat RETIRE_GRACE_BLOCKS blocs
+#define RETIRE_SLOTS 32
+#define RETIRE_GRACE_BLOCKS 2
+
+// Bancs de pads: el kit que sona i el que es carrega en segon pla (canvi sense silenci)
+#define PAD_BANKS 2
+
+// Triggers del sequencer amb timestamp: Core 0 els encua per endavant i el core
+// d'àudio arrenca cada veu al frame exacte dins del bloc
+#define SCHEDULE_QUEUE_LEN 128       // SPSC Core 0 -> Core 1 (potència de 2); 8 tracks x 8 ratchets per step
+#define SCHEDULE_PENDING_LEN 128     // Esperant el seu bloc al core d'àudio (ratchets espaiats: diversos steps)
+#define SCHEDULE_MAX_AHEAD SAMPLE_RATE  // Més lluny d'això = rellotge incoherent, es descarta
+#define LIVE_QUEUE_LEN 32            // Pads live (web, MIDI, UDP) -> core d'àudio (potència de 2)
+
+// Panoramització per track: llei de potència constant, taula precalculada (Q14)
+// Centre = 1.0 a cada canal: un mix tot al centre sona igual que abans
+#define PAN_STEPS 129                // Índex 0 = esquerra, 64 = centre, 128 = dreta
+#define PAN_CENTER 64
+#define PAN_SHIFT 14
+#define PAN_UNLOCKED 0xFF            // Voice::pan: la del bus
+
+// Parameter locks a la veu (taules fetes al constructor, res es calcula per step)
+#define PITCH_UNITY (1 << 16)        // Voice::pitchStep Q16
+#define LOCK_DECAY_FLOOR 0.001f      // -60 dB: the voice stops
+
 // Constants for filter management
 static constexpr int MAX_AUDIO_TRACKS = 8;  // For per-track filters
 static constexpr int MAX_PADS = 8;           // For per-pad filters
@@ -51,7 +103,7 @@ struct BiquadCoeffs {
   float a1, a2;      // Denominator coefficients (a0 normalized to 1)
 };
 
-// Filter state (for stereo)
+// Filter state (one per channel)
 struct FilterState {
   float x1, x2;  // Input history
   float y1, y2;  // Output history
@@ -69,6 +121,7 @@ struct FXParams {
   
   BiquadCoeffs coeffs;
   FilterState state;
+  FilterState stateR;    // Right channel of stereo voices
   
   // Sample rate reducer state
   int32_t srHold;
@@ -77,9 +130,17 @@ struct FXParams {
 
 // Voice structure
 struct Voice {
-  int16_t* buffer;        // Pointer to sample data in PSRAM
-  uint32_t position;      // Current playback position
-  uint32_t length;        // Sample length in samples
+  int16_t* buffer;        // Pointer to sample data in PSRAM (encoded bytes if format != PCM16)
+  SampleFormat format;    // Storage format of buffer
+  uint8_t channels;       // 2 = interleaved stereo frames (PCM16, resident only)
+  uint32_t decodedBlock;  // Codec block held in the voice's decode buffer (UINT32_MAX = none)
+  const int16_t* head;    // Attack copy in internal SRAM (nullptr = not cached)
+  uint32_t headLength;    // Frames available in head
+  uint32_t position;      // Current playback position (frames)
+  uint32_t length;        // Sample length in frames
+  uint32_t residentLength;  // Samples held in buffer (< length: the rest streams from flash)
+  int streamSlot;         // SampleStreamer slot (-1 = not streaming)
+  uint32_t streamRead;    // Streamed samples consumed from the slot's ring
   bool active;            // Is voice playing?
   uint8_t velocity;       // MIDI velocity (0-127)
   uint8_t volume;         // Volume scale (0-100)
@@ -89,6 +150,106 @@ struct Voice {
   uint32_t loopEnd;       // Loop end point
   int padIndex;           // Which pad is playing (-1 if none)
   bool isLivePad;         // True if triggered from live pad, false if from sequencer
+  uint32_t startOrder;    // Trigger order (for voice stealing: older = lower priority)
+  uint16_t startDelay;    // Silent frames before the first sample (scheduled trigger, one block)
+  // Parameter locks (scheduled triggers), reset by startVoice
+  uint32_t pitchStep;     // Q16 frames per output frame (PITCH_UNITY = as recorded)
+  uint32_t pitchFrac;
+  float envGain;          // Decay envelope
+  float envMul;           // Per-frame factor, 0 = no envelope
+  uint8_t pan;            // PAN index, PAN_UNLOCKED = the bus pan
+  uint8_t svfMode;        // Locked filter (FilterType), FILTER_NONE = the track filter
+  float svfA1, svfA2, svfA3, svfK;  // TPT state-variable coefficients
+  float svfIc1, svfIc2, svfIc1R, svfIc2R;
+  // Live trigger timing: measured at the first block that sees the voice
+  uint32_t requestUs;     // micros() when the trigger was received
+  uint8_t timingSource;   // TimingSource, TIMING_NONE = already measured / not live
+  const int16_t* staged;  // Next block prefetched into internal SRAM
+  const int16_t* stagedSrc;  // Buffer the staged block was copied from
+  uint32_t stagedStart;   // Sample position of staged[0]
+  uint32_t stagedCount;   // Valid samples in staged (0 = read PSRAM directly)
+};
+
+// One pad of a bank: what a voice copies at trigger time
+struct PadSample {
+  int16_t* buffer;            // PSRAM sample data (encoded bytes if format != PCM16)
+  uint32_t length;            // Total samples (> resident when streamed)
+  const int16_t* head;        // Attack copy in internal SRAM
+  uint32_t headLength;
+  SampleFormat format;
+  uint32_t resident;          // Samples in buffer
+  uint8_t channels;           // 2 = interleaved stereo, lengths in frames
+};
+
+// Sequencer trigger for a given frame
+struct ScheduledTrigger {
+  uint32_t frame;             // getFramePosition() timeline (wraps)
+  uint8_t pad;
+  uint8_t velocity;
+  uint8_t bank;               // Bank when scheduled: a bar's kit swap doesn't reach the previous bar's tail
+  ParamLock lock;             // params = 0: none
+};
+
+// Live pad trigger: queued by any Core 0 task, started by the audio core at the next block
+struct LiveTrigger {
+  uint8_t pad;
+  uint8_t velocity;
+  uint8_t source;             // TimingSource, TIMING_SEQUENCER = unscheduled sequencer trigger
+  uint32_t requestUs;
+};
+
+// Render timing / governor statistics
+struct RenderStats {
+  uint32_t lastRenderUs;      // Last block render time
+  uint32_t peakRenderUs;      // Peak since last reset
+  uint32_t budgetUs;          // Block deadline
+  uint32_t deadlineMisses;    // Blocks that took longer than the budget
+  uint32_t voiceSteals;       // Voices stolen on trigger (no free slot under cap)
+  uint32_t governorDrops;     // Voices shed by the governor under load
+  int voiceCap;               // Current effective voice limit
+  float voiceCostUs;          // Smoothed render cost per active voice
+  uint32_t headHits;          // Triggers whose attack was in the SRAM head cache
+  uint32_t headMisses;        // Triggers that started straight from PSRAM
+  uint32_t scheduledTriggers; // Sequencer triggers started at their frame
+  uint32_t lateTriggers;      // ... whose frame had already been rendered (started at the block start)
+  uint32_t scheduleDrops;     // Queue full or frame out of range
+  uint32_t liveDrops;         // Live queue full
+  uint32_t histogram[RENDER_HIST_BINS];
+};
+
+// Dual-core render statistics
+struct DualCoreStats {
+  bool enabled;               // Requested by user
+  bool active;                // Currently rendering on both cores (false during fallback)
+  uint32_t dualBlocks;        // Blocks rendered with the fork/join
+  uint32_t lateStarts;        // Blocks where the Core 0 worker started late
+  uint32_t fallbacks;         // Times it fell back to single-core
+  uint32_t workerStartUs;     // Last worker start latency
+  uint32_t joinWaitUs;        // Last time Core 1 spent waiting at the join
+  float singleCostUs;         // Smoothed per-voice render cost, single-core
+  float dualCostUs;           // Smoothed per-voice render cost, dual-core
+};
+
+// Block prefetch statistics
+struct PrefetchStats {
+  bool enabled;               // Requested by user
+  bool dma;                   // Copies go through async memcpy (false = memcpy on Core 1)
+  uint32_t copies;            // Voice blocks staged
+  uint32_t bytes;             // Bytes copied PSRAM -> SRAM
+  uint32_t dmaErrors;         // Copies the DMA refused (done with memcpy instead)
+  uint32_t timeouts;          // Blocks that started before the copies finished
+  uint32_t waitUs;            // Last wait for pending copies at block start
+  float onCostUs;             // Smoothed per-voice render cost, prefetch on
+  float offCostUs;            // Smoothed per-voice render cost, prefetch off
+};
+
+// Deferred reclamation statistics
+struct RetireStats {
+  uint32_t retired;           // Buffers posted for retirement
+  uint32_t voicesStopped;     // Voices the audio core stopped because their buffer was retired
+  uint32_t queueFull;         // Posts rejected (no free slot)
+  uint32_t lastWaitMs;        // Last time SampleManager waited to free
+  uint32_t peakWaitMs;
 };
 
 class AudioEngine {
@@ -100,12 +261,30 @@ public:
   bool begin(int bckPin, int wsPin, int dataPin);
   
   // Sample management
-  bool setSampleBuffer(int padIndex, int16_t* buffer, uint32_t length);
+  bool setSampleBuffer(int padIndex, int16_t* buffer, uint32_t length, SampleFormat format = SAMPLE_PCM16,
+                       uint8_t channels = 1);
+  void setSampleHead(int padIndex, const int16_t* head, uint32_t headLength);
+  void setSampleStreamLength(int padIndex, uint32_t totalLength);  // Beyond the buffer: SampleStreamer
+  bool ownsStream(int voiceIndex, uint32_t token, int slot);
+  
+  // Pad banks: the setters above write the active bank. A kit is loaded into the
+  // standby bank while the active one plays, then swapBank() switches every pad at once
+  bool setBankSample(int bank, int padIndex, int16_t* buffer, uint32_t length, SampleFormat format = SAMPLE_PCM16,
+                     uint8_t channels = 1);
+  void setBankHead(int bank, int padIndex, const int16_t* head, uint32_t headLength);
+  void setBankStreamLength(int bank, int padIndex, uint32_t totalLength);
+  int getActiveBank() { return activeBank.load(std::memory_order_acquire); }
+  int getStandbyBank() { return getActiveBank() ^ 1; }
+  void swapBank();
   
   // Playback control
   void triggerSample(int padIndex, uint8_t velocity);
   void triggerSampleSequencer(int padIndex, uint8_t velocity);
-  void triggerSampleLive(int padIndex, uint8_t velocity);
+  bool scheduleSampleSequencer(int padIndex, uint8_t velocity, uint32_t frame,
+                               const ParamLock* lock = nullptr);  // One producer (sequencer clock task)
+  uint32_t getFramePosition() { return getBlockEpoch() * DMA_BUF_LEN; }          // First frame of the next block
+  void triggerSampleLive(int padIndex, uint8_t velocity, uint8_t source = TIMING_LIVE,
+                         uint32_t requestUs = 0);  // requestUs 0 = now
   void stopSample(int padIndex);
   void stopAll();
   
@@ -137,6 +316,10 @@ public:
   static const FilterPreset* getFilterPreset(FilterType type);
   static const char* getFilterName(FilterType type);
   
+  // Per-track pan (bus = pad): -100 = left, 0 = centre, +100 = right
+  void setTrackPan(int track, int pan);
+  int getTrackPan(int track);
+  
   // Volume Control
   void setMasterVolume(uint8_t volume); // 0-150
   uint8_t getMasterVolume();
@@ -151,22 +334,100 @@ public:
   // Statistics
   int getActiveVoices();
   float getCpuLoad();
+  int getVoiceCap();
+  void getRenderStats(RenderStats& out);
+  void resetRenderStats();
+  
+  // Dual-core render (fork/join per bloc amb Core 0)
+  bool setDualCoreRender(bool enabled);
+  bool isDualCoreRender();
+  void getDualCoreStats(DualCoreStats& out);
+  
+  // Block prefetch (PSRAM -> SRAM per veu, solapat amb i2s_write)
+  bool setPrefetch(bool enabled);
+  bool isPrefetch();
+  void getPrefetchStats(PrefetchStats& out);
+  
+  // Deferred reclamation (Core 0 posts, the audio core acknowledges at a block boundary)
+  int retireBuffer(const void* buffer);       // Retire slot, -1 if the table is full
+  bool isRetireComplete(int slot);            // No voice can read the buffer any more
+  void releaseRetireSlot(int slot);
+  uint32_t getBlockEpoch() { return blockEpoch.load(std::memory_order_acquire); }
+  void noteReclaimWait(uint32_t waitMs);
+  void getRetireStats(RetireStats& out);
   
   // Audio data capture for visualization
   void captureAudioData(uint8_t* spectrum, uint8_t* waveform);
   
 private:
   Voice voices[MAX_VOICES];
-  int16_t* sampleBuffers[16];  // Pointers to PSRAM sample data
-  uint32_t sampleLengths[16];
+  PadSample padBanks[PAD_BANKS][16];  // Triggers read padBanks[activeBank]
+  std::atomic<uint8_t> activeBank;
   
   i2s_port_t i2sPort;
   int16_t mixBuffer[DMA_BUF_LEN * 2]; // Stereo buffer
+  int32_t mixAcc[DMA_BUF_LEN * 2];    // 32-bit accumulator (Core 1)
+  int32_t workerAcc[DMA_BUF_LEN * 2]; // 32-bit accumulator (Core 0 worker)
   
   uint32_t processCount;
   uint32_t lastCpuCheck;
   float cpuLoad;
   
+  // Voice governor
+  RenderStats stats;
+  volatile int voiceCap;
+  uint32_t quietBlocks;
+  uint32_t voiceOrderCounter;
+  
+  // Dual-core render
+  TaskHandle_t workerTaskHandle;
+  DualCoreStats dualStats;
+  volatile bool dualCoreRequested;
+  bool dualCoreActive;              // Rendering on both cores this block
+  uint32_t workerPadMask;           // Buses assigned to the worker this block
+  size_t workerSamples;
+  volatile uint32_t workerKickUs;   // When Core 1 notified the worker
+  volatile uint32_t workerStartUs;  // Worker start latency (written by Core 0)
+  std::atomic<uint8_t> workerState; // WORKER_IDLE / POSTED / RUNNING / DONE
+  uint32_t lateInWindow;
+  uint32_t windowBlocks;
+  uint32_t cooldownBlocks;
+  
+  // Block prefetch
+  alignas(PREFETCH_ALIGN) int16_t stageBuffers[MAX_VOICES][PREFETCH_STAGE_LEN];
+  void* prefetchDma;                // async_memcpy_t (nullptr = memcpy)
+  volatile bool prefetchEnabled;
+  bool stagesValid;                 // Some voice still points at a staged block
+  std::atomic<int> prefetchPending; // Copies in flight (decremented from the DMA ISR)
+  PrefetchStats prefetchStats;
+  
+  // Deferred reclamation
+  struct RetireSlot {
+    std::atomic<uint8_t> state;     // RETIRE_FREE / CLAIMING / PENDING / ACKED
+    const void* buffer;
+    uint32_t ackEpoch;              // Block in which the audio core stopped its voices
+  };
+  RetireSlot retireSlots[RETIRE_SLOTS];
+  std::atomic<int> retirePending;   // Slots PENDING or ACKED (audio core skips the scan at 0)
+  std::atomic<uint32_t> blockEpoch; // Blocks rendered
+  RetireStats retireStats;
+  
+  // Scheduled sequencer triggers
+  ScheduledTrigger scheduleQueue[SCHEDULE_QUEUE_LEN];
+  std::atomic<uint32_t> scheduleHead;  // Producer
+  std::atomic<uint32_t> scheduleTail;  // Audio core
+  ScheduledTrigger pendingTriggers[SCHEDULE_PENDING_LEN];  // Audio core only
+  int pendingCount;
+  
+  // Live pad triggers: several producers (web, UDP/MIDI) behind liveMux, one consumer
+  LiveTrigger liveQueue[LIVE_QUEUE_LEN];
+  std::atomic<uint32_t> liveHead;      // Producers, under liveMux
+  std::atomic<uint32_t> liveTail;      // Audio core
+  portMUX_TYPE liveMux = portMUX_INITIALIZER_UNLOCKED;
+  
+  // Compressed samples: each voice decodes one codec block at a time here
+  int16_t decodeBuffers[MAX_VOICES][CODEC_BLOCK_SAMPLES];
+  
   FXParams fx;
   uint8_t masterVolume; // 0-100
   uint8_t sequencerVolume; // 0-100
@@ -178,19 +439,55 @@ private:
   FXParams padFilters[MAX_PADS];            // Filters for live pads
   bool padFilterActive[MAX_PADS];
   
+  // Pan: Q14 gains per position {L, R} and the position of each bus
+  int16_t panGains[PAN_STEPS][2];
+  volatile uint8_t busPan[16];
+  
+  // Parameter lock tables (0-127 values -> voice parameters)
+  float lockCutoffG[LOCK_VALUE_MAX + 1];        // tan(pi * fc / fs)
+  float lockResonanceK[LOCK_VALUE_MAX + 1];     // 1 / Q
+  float lockDecayMul[LOCK_VALUE_MAX + 1];
+  uint32_t lockPitchStep[2 * LOCK_PITCH_RANGE + 1];
+  float trackSvfG[MAX_AUDIO_TRACKS];            // The track filter's cutoff/Q, for partial locks
+  float trackSvfK[MAX_AUDIO_TRACKS];
+  
   // Visualization buffers
   int16_t captureBuffer[256];
   uint8_t captureIndex;
   
   void fillBuffer(int16_t* buffer, size_t samples);
+  void renderVoices(int32_t* acc, size_t samples, uint32_t padMask);
+  void renderMonoVoice(int v, int32_t* acc, size_t samples, int bus);
+  void renderStereoVoice(int v, int32_t* acc, size_t samples, int bus);
+  FXParams* voiceFilter(const Voice& voice);
+  uint32_t partitionBuses();
+  void updateDualCore(uint32_t workerStartUs, bool late);
+  static void renderWorkerTask(void* arg);
+  void issuePrefetch();
+  void waitPrefetch();
+  void clearStages();
+  void scanRetired();
+  void startScheduled(uint32_t blockStart, size_t samples);
+  bool queueLive(int padIndex, uint8_t velocity, uint8_t source, uint32_t requestUs);
+  void startLive();
+  bool copyToStage(int16_t* dst, const void* src, size_t bytes);
   int findFreeVoice();
+  int findVoiceToSteal();
+  int allocateVoice();
+  void startVoice(int voiceIndex, int padIndex, const PadSample& sample);
+  int countActiveVoices();
+  uint32_t voicePriority(const Voice& voice);
+  void updateGovernor(uint32_t renderUs, int activeVoices);
   void resetVoice(int voiceIndex);
+  void applyLock(int voiceIndex, int track, const ParamLock& lock);
   
   // FX processing functions (optimized)
   void calculateBiquadCoeffs();
   void calculateBiquadCoeffs(FXParams& fx);  // Calculate for specific filter
   inline int16_t applyFilter(int16_t input);
   inline int16_t applyFilter(int16_t input, FXParams& fx);  // Apply specific filter
+  inline int16_t applyFilter(int16_t input, FXParams& fx, FilterState& state);
+  inline int16_t applyLockFilter(const Voice& voice, int16_t input, float& ic1, float& ic2);
   inline int16_t applyBitCrush(int16_t input);
   inline int16_t applyDistortion(int16_t input);
   inline int16_t processFX(int16_t input);
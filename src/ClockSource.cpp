@@ -0,0 +1,192 @@
+/*
+ * ClockSource.cpp
+ * Ticks del rellotge -> cua -> tasca del seqüenciador
+ */
+
+#include "ClockSource.h"
+#include "Sequencer.h"
+
+extern Sequencer sequencer;
+
+static const uint32_t clockHistEdges[CLOCK_HIST_BINS - 1] = {25, 50, 100, 200, 500, 1000, 2000};
+
+// ============= CLOCK SOURCES =============
+
+EspTimerClock::~EspTimerClock() {
+  stop();
+}
+
+bool EspTimerClock::start(uint32_t period, ClockTickHandler tickHandler, void* tickContext) {
+  stop();
+  periodUs = period;
+  sequence = 0;
+  handler = tickHandler;
+  context = tickContext;
+
+  esp_timer_create_args_t args = {};
+  args.callback = onTimer;
+  args.arg = this;
+  args.dispatch_method = ESP_TIMER_TASK;
+  args.name = "seq_clock";
+  args.skip_unhandled_events = true;  // Timer task held up: one tick, not a burst
+  if (esp_timer_create(&args, &timer) != ESP_OK) {
+    timer = nullptr;
+    Serial.println("[Clock] ERROR: esp_timer_create failed");
+    return false;
+  }
+  if (esp_timer_start_periodic(timer, periodUs) != ESP_OK) {
+    esp_timer_delete(timer);
+    timer = nullptr;
+    Serial.println("[Clock] ERROR: esp_timer_start_periodic failed");
+    return false;
+  }
+  return true;
+}
+
+void EspTimerClock::stop() {
+  if (timer == nullptr) return;
+  esp_timer_stop(timer);
+  esp_timer_delete(timer);
+  timer = nullptr;
+}
+
+void EspTimerClock::onTimer(void* arg) {
+  EspTimerClock* self = (EspTimerClock*)arg;
+  self->emit(esp_timer_get_time());
+}
+
+bool SimulatedClock::start(uint32_t period, ClockTickHandler tickHandler, void* tickContext) {
+  if (period == 0) return false;
+  periodUs = period;
+  sequence = 0;
+  handler = tickHandler;
+  context = tickContext;
+  nextTick = now + periodUs;
+  running = true;
+  return true;
+}
+
+void SimulatedClock::advance(uint32_t us, uint32_t lateUs) {
+  int64_t end = now + us;
+  while (running && nextTick + lateUs <= end) {
+    now = nextTick + lateUs;
+    emit(now);
+    nextTick += periodUs;
+  }
+  now = end;
+}
+
+// ============= JITTER =============
+
+void ClockJitter::reset(uint32_t periodUs) {
+  portENTER_CRITICAL(&mux);
+  memset(&stats, 0, sizeof(stats));
+  stats.periodUs = periodUs;
+  stats.intervalMinUs = UINT32_MAX;
+  lastTickUs = -1;
+  delaySum = 0;
+  portEXIT_CRITICAL(&mux);
+}
+
+void ClockJitter::noteDropped() {
+  portENTER_CRITICAL(&mux);
+  stats.dropped++;
+  portEXIT_CRITICAL(&mux);
+}
+
+void ClockJitter::getStats(ClockJitterStats& out) {
+  portENTER_CRITICAL(&mux);
+  out = stats;
+  portEXIT_CRITICAL(&mux);
+}
+
+void ClockJitter::record(const ClockTick& tick, int64_t wakeUs, uint32_t workUs) {
+  uint32_t delay = wakeUs > tick.timeUs ? (uint32_t)(wakeUs - tick.timeUs) : 0;
+  portENTER_CRITICAL(&mux);
+  if (lastTickUs >= 0) {
+    uint32_t interval = (uint32_t)(tick.timeUs - lastTickUs);
+    if (interval < stats.intervalMinUs) stats.intervalMinUs = interval;
+    if (interval > stats.intervalMaxUs) stats.intervalMaxUs = interval;
+  }
+  lastTickUs = tick.timeUs;
+
+  stats.ticks++;
+  stats.lastDelayUs = delay;
+  if (delay > stats.peakDelayUs) stats.peakDelayUs = delay;
+  delaySum += delay;
+  stats.meanDelayUs = (uint32_t)(delaySum / stats.ticks);
+  if (workUs > stats.peakWorkUs) stats.peakWorkUs = workUs;
+
+  int bin = 0;
+  while (bin < CLOCK_HIST_BINS - 1 && delay >= clockHistEdges[bin]) bin++;
+  stats.histogram[bin]++;
+  portEXIT_CRITICAL(&mux);
+}
+
+// ============= SEQUENCER CLOCK =============
+
+SequencerClock::SequencerClock() : source(nullptr), queue(nullptr), taskHandle(nullptr) {
+}
+
+SequencerClock::~SequencerClock() {
+  if (source) source->stop();
+  if (taskHandle) vTaskDelete(taskHandle);
+  if (queue) vQueueDelete(queue);
+}
+
+bool SequencerClock::begin(ClockSource* clockSource, uint32_t periodUs) {
+  source = clockSource;
+  jitter.reset(periodUs);
+  queue = xQueueCreate(CLOCK_QUEUE_LEN, sizeof(ClockTick));
+  if (queue == nullptr) {
+    Serial.println("[Clock] ERROR: No memory for the tick queue");
+    return false;
+  }
+
+  BaseType_t ok = xTaskCreatePinnedToCore(
+    clockTask,
+    "SeqClock",
+    CLOCK_TASK_STACK,
+    this,
+    CLOCK_TASK_PRIORITY,
+    &taskHandle,
+    0       // CORE 0: el core d'àudio no es toca
+  );
+  if (ok != pdPASS) {
+    taskHandle = nullptr;
+    vQueueDelete(queue);
+    queue = nullptr;
+    Serial.println("[Clock] ERROR: Failed to create sequencer clock task");
+    return false;
+  }
+
+  // Source failed: nothing will send, the task and its queue go (SystemTask keeps scheduling)
+  if (!source->start(periodUs, onTick, this)) {
+    vTaskDelete(taskHandle);
+    taskHandle = nullptr;
+    vQueueDelete(queue);
+    queue = nullptr;
+    Serial.printf("[Clock] ERROR: Clock source %s did not start\n", source->name());
+    return false;
+  }
+  Serial.printf("[Clock] Sequencer clock: %s, %u us\n", source->name(), (unsigned)periodUs);
+  return true;
+}
+
+// Source side (esp_timer task): never blocks
+void SequencerClock::onTick(void* context, const ClockTick& tick) {
+  SequencerClock* self = (SequencerClock*)context;
+  if (xQueueSend(self->queue, &tick, 0) != pdTRUE) self->jitter.noteDropped();
+}
+
+void SequencerClock::clockTask(void* arg) {
+  SequencerClock* self = (SequencerClock*)arg;
+  Serial.printf("[Task] Sequencer Clock iniciada en Core 0 (Prioridad: %d)\n", CLOCK_TASK_PRIORITY);
+  ClockTick tick;
+  while (true) {
+    if (xQueueReceive(self->queue, &tick, portMAX_DELAY) != pdTRUE) continue;
+    int64_t wake = self->source->nowUs();
+    sequencer.schedule();
+    self->jitter.record(tick, wake, (uint32_t)(self->source->nowUs() - wake));
+  }
+}
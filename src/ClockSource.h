@@ -0,0 +1,138 @@
+/*
+ * ClockSource.h
+ * Rellotge del seqüenciador independent del loop de SystemTask
+ *
+ * Una ClockSource genera un tick periòdic; la SequencerClock el passa per una
+ * cua a una tasca d'alta prioritat que només fa Sequencer::schedule(). La web,
+ * l'UDP, el MIDI i el LED es queden a SystemTask i ja no retarden els steps.
+ * EspTimerClock fa servir esp_timer; SimulatedClock avança a mà (proves al host)
+ */
+
+#ifndef CLOCKSOURCE_H
+#define CLOCKSOURCE_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <freertos/queue.h>
+
+#define CLOCK_PERIOD_US 2000          // Tick: schedule() every 2 ms, well inside SEQ_LOOKAHEAD_FRAMES
+#define CLOCK_QUEUE_LEN 8
+#define CLOCK_TASK_PRIORITY 10        // Per sobre de SystemTask (5) i del streamer (6)
+#define CLOCK_TASK_STACK 4096
+#define CLOCK_HIST_BINS 8             // Tick -> task delay: <25, <50, <100, <200, <500, <1000, <2000, more (us)
+
+// One tick of a clock source
+struct ClockTick {
+  uint32_t sequence;          // Consecutive from start(): a gap = ticks lost
+  int64_t timeUs;             // When the source fired (ClockSource::nowUs time base)
+};
+
+typedef void (*ClockTickHandler)(void* context, const ClockTick& tick);
+
+class ClockSource {
+public:
+  virtual ~ClockSource() {}
+  virtual bool start(uint32_t periodUs, ClockTickHandler handler, void* context) = 0;
+  virtual void stop() = 0;
+  virtual int64_t nowUs() = 0;
+  virtual const char* name() = 0;
+  uint32_t getPeriodUs() { return periodUs; }
+
+protected:
+  ClockSource() : periodUs(0), sequence(0), handler(nullptr), context(nullptr) {}
+  void emit(int64_t timeUs) {
+    ClockTick tick = {sequence++, timeUs};
+    if (handler != nullptr) handler(context, tick);
+  }
+
+  uint32_t periodUs;
+  uint32_t sequence;
+  ClockTickHandler handler;
+  void* context;
+};
+
+// Periodic esp_timer (dispatched from the esp_timer task, priority 22)
+class EspTimerClock : public ClockSource {
+public:
+  EspTimerClock() : timer(nullptr) {}
+  ~EspTimerClock();
+  bool start(uint32_t periodUs, ClockTickHandler handler, void* context) override;
+  void stop() override;
+  int64_t nowUs() override { return esp_timer_get_time(); }
+  const char* name() override { return "esp_timer"; }
+
+private:
+  esp_timer_handle_t timer;
+  static void onTimer(void* arg);
+};
+
+// Time only moves with advance(): every tick crossed is emitted, `lateUs` after its nominal time
+class SimulatedClock : public ClockSource {
+public:
+  SimulatedClock() : now(0), nextTick(0), running(false) {}
+  bool start(uint32_t periodUs, ClockTickHandler handler, void* context) override;
+  void stop() override { running = false; }
+  int64_t nowUs() override { return now; }
+  const char* name() override { return "simulated"; }
+  void advance(uint32_t us, uint32_t lateUs = 0);
+
+private:
+  int64_t now;
+  int64_t nextTick;
+  bool running;
+};
+
+// Observed timing of the clock ticks
+struct ClockJitterStats {
+  uint32_t ticks;             // Handled by the sequencer task
+  uint32_t dropped;           // Queue full (task stalled), tick lost
+  uint32_t periodUs;
+  uint32_t intervalMinUs;     // Between consecutive ticks at the source
+  uint32_t intervalMaxUs;
+  uint32_t lastDelayUs;       // Tick -> sequencer task running
+  uint32_t meanDelayUs;
+  uint32_t peakDelayUs;
+  uint32_t peakWorkUs;        // Longest schedule()
+  uint32_t histogram[CLOCK_HIST_BINS];  // Delay
+};
+
+// Jitter meter, fed by whoever consumes the ticks (SequencerClock task or a host test).
+// The web task reads and resets it while the clock writes: every access under mux
+class ClockJitter {
+public:
+  ClockJitter() { reset(0); }
+  void reset(uint32_t periodUs);
+  void record(const ClockTick& tick, int64_t wakeUs, uint32_t workUs);
+  void noteDropped();
+  void getStats(ClockJitterStats& out);
+
+private:
+  portMUX_TYPE mux = portMUX_INITIALIZER_UNLOCKED;
+  ClockJitterStats stats;
+  int64_t lastTickUs;
+  uint64_t delaySum;
+};
+
+// Consumer: queue + high-priority task that runs Sequencer::schedule() on every tick
+class SequencerClock {
+public:
+  SequencerClock();
+  ~SequencerClock();
+
+  bool begin(ClockSource* clockSource, uint32_t periodUs = CLOCK_PERIOD_US);
+  bool isRunning() { return taskHandle != nullptr; }  // false: SystemTask keeps scheduling
+  const char* sourceName() { return source != nullptr ? source->name() : "none"; }
+  void getStats(ClockJitterStats& out) { jitter.getStats(out); }
+  void resetStats() { jitter.reset(source != nullptr ? source->getPeriodUs() : 0); }
+
+private:
+  ClockSource* source;
+  QueueHandle_t queue;
+  TaskHandle_t taskHandle;
+  ClockJitter jitter;
+
+  static void onTick(void* context, const ClockTick& tick);
+  static void clockTask(void* arg);
+};
+
+#endif // CLOCKSOURCE_H
@@ -4,17 +4,36 @@
  */
 
 #include "KitManager.h"
+#include "Sequencer.h"
+#include "SampleLibrary.h"
 
 extern SampleManager sampleManager;
+extern AudioEngine audioEngine;
+extern Sequencer sequencer;
+extern SampleLibrary sampleLibrary;
 
-KitManager::KitManager() : kitCount(0), currentKit(-1) {
+// Loader lifecycle: loadKit posts, the loader fills the standby bank, the
+// sequencer (or update() when stopped) switches, the loader frees the old kit
+enum KitLoadState : uint8_t {
+  KIT_IDLE = 0,
+  KIT_LOADING = 1,
+  KIT_READY = 2,       // Waiting for the bar boundary
+  KIT_RELEASING = 3    // Switched: old kit tails, then freed
+};
+
+KitManager::KitManager() : kitCount(0), currentKit(-1), loaderTaskHandle(nullptr),
+                           loadState(KIT_IDLE), pendingKit(-1), readyMs(0) {
   for (int i = 0; i < MAX_KITS; i++) {
     memset(kits[i].name, 0, 32);
     kits[i].sampleCount = 0;
   }
+  memset(&loadStats, 0, sizeof(loadStats));
 }
 
 KitManager::~KitManager() {
+  if (loaderTaskHandle) {
+    vTaskDelete(loaderTaskHandle);
+  }
 }
 
 bool KitManager::begin() {
@@ -49,41 +68,24 @@ int KitManager::scanKits() {
   strncpy(kit.name, "RED808 16-Track", 31);
   kit.sampleCount = 0;
 
-  // Cargar primer sample de cada carpeta
+  // Primer WAV (por nombre) de cada carpeta, desde el índice de la biblioteca
   for (int i = 0; i < 16 && kit.sampleCount < MAX_SAMPLES_PER_KIT; i++) {
-    File dir = LittleFS.open(folders[i]);
-    if (!dir || !dir.isDirectory()) {
-      Serial.printf("  ⚠️  Carpeta %s no encontrada\n", folders[i]);
+    LibraryEntry entry;
+    if (!sampleLibrary.getFirst(SampleLibrary::familyIndex(folders[i] + 1), entry, true)) {
+      Serial.printf("  ⚠️  Track %02d (%s): sin samples\n", i, folders[i]);
       continue;
     }
     
-    // Buscar primer archivo .wav o .WAV
-    File file = dir.openNextFile();
-    bool found = false;
-    while (file && !found) {
-      String filename = file.name();
-      filename.toUpperCase();
-      
-      if (!file.isDirectory() && filename.endsWith(".WAV")) {
-        // Construir path completo
-        char fullPath[128];
-        snprintf(fullPath, 127, "%s/%s", folders[i], file.name());
-        
-        // Agregar al kit
-        kit.samples[kit.sampleCount].padIndex = i;
-        strncpy(kit.samples[kit.sampleCount].filename, fullPath, 63);
-        kit.sampleCount++;
-        
-        Serial.printf("  ✓ Track %02d: %s\n", i, fullPath);
-        found = true;
-      }
-      
-      file = dir.openNextFile();
-    }
+    // Construir path completo
+    char fullPath[128];
+    snprintf(fullPath, 127, "%s/%s", folders[i], entry.name);
     
-    if (!found) {
-      Serial.printf("  ⚠️  Track %02d (%s): sin samples\n", i, folders[i]);
-    }
+    // Agregar al kit
+    kit.samples[kit.sampleCount].padIndex = i;
+    strncpy(kit.samples[kit.sampleCount].filename, fullPath, 63);
+    kit.sampleCount++;
+    
+    Serial.printf("  ✓ Track %02d: %s\n", i, fullPath);
   }
   
   if (kit.sampleCount > 0) {
@@ -157,16 +159,63 @@ bool KitManager::loadKit(int kitIndex) {
     Serial.printf("Error: Kit %d no existe\n", kitIndex);
     return false;
   }
+  if (!startLoader()) return false;
+  
+  uint8_t expected = KIT_IDLE;
+  if (!loadState.compare_exchange_strong(expected, KIT_LOADING)) {
+    Serial.printf("[Kit] Busy loading kit %d, request for kit %d ignored\n", pendingKit, kitIndex);
+    return false;
+  }
+  pendingKit = kitIndex;
+  xTaskNotifyGive(loaderTaskHandle);
+  return true;
+}
+
+bool KitManager::startLoader() {
+  if (loaderTaskHandle != nullptr) return true;
+  
+  BaseType_t ok = xTaskCreatePinnedToCore(
+    loaderTask,
+    "KitLoader",
+    KIT_LOADER_STACK,
+    this,
+    KIT_LOADER_PRIORITY,
+    &loaderTaskHandle,
+    0       // CORE 0: LittleFS fora del core d'àudio
+  );
+  if (ok != pdPASS) {
+    loaderTaskHandle = nullptr;
+    Serial.println("[Kit] ERROR: Failed to create loader task");
+    return false;
+  }
+  return true;
+}
+
+void KitManager::loaderTask(void* arg) {
+  KitManager* manager = static_cast<KitManager*>(arg);
+  Serial.printf("[Task] Kit Loader iniciada en Core 0 (Prioridad: %d)\n", KIT_LOADER_PRIORITY);
   
-  currentKit = kitIndex;
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    if (manager->loadState.load() == KIT_LOADING) {
+      manager->loadPending();
+    }
+  }
+}
+
+void KitManager::loadPending() {
+  int kitIndex = pendingKit;
   Kit& kit = kits[kitIndex];
+  int bank = audioEngine.getStandbyBank();
   
-  Serial.printf("\n========== CARGANDO KIT %d: %s ==========\n", kitIndex, kit.name);
+  Serial.printf("\n========== CARGANDO KIT %d: %s (banco %d) ==========\n", kitIndex, kit.name, bank);
   
-  // Unload current samples
-  sampleManager.unloadAll();
+  // Leftovers of an aborted load
+  sampleManager.clearBank(bank);
+  sampleManager.resetArenaPeak();
+  uint32_t start = millis();
   
-  // Load all samples from this kit
+  // Load all samples from this kit while the current one keeps playing
   int loaded = 0;
   for (int i = 0; i < kit.sampleCount; i++) {
     int padIndex = kit.samples[i].padIndex;
@@ -174,7 +223,7 @@ bool KitManager::loadKit(int kitIndex) {
     
     Serial.printf("  Pad %d -> %s\n", padIndex, filename);
     
-    if (sampleManager.loadSample(filename, padIndex)) {
+    if (sampleManager.loadSampleToBank(filename, bank, padIndex, sampleManager.getDefaultFormat())) {
       loaded++;
       Serial.printf("    OK\n");
     } else {
@@ -182,9 +231,68 @@ bool KitManager::loadKit(int kitIndex) {
     }
   }
   
-  Serial.printf("========== KIT CARGADO: %d/%d samples ==========\n\n", loaded, kit.sampleCount);
+  loadStats.loadMs = millis() - start;
+  loadStats.lastLoaded = loaded;
+  loadStats.lastTotal = kit.sampleCount;
+  
+  if (loaded == 0) {
+    sampleManager.clearBank(bank);
+    loadStats.failures++;
+    loadState.store(KIT_IDLE);
+    Serial.printf("========== KIT %d SIN SAMPLES: se mantiene el actual ==========\n\n", kitIndex);
+    return;
+  }
+  
+  // Switch at the next bar (onBar / update), then let the old kit ring out
+  readyMs = millis();
+  loadState.store(KIT_READY);
+  while (loadState.load() == KIT_READY) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+  vTaskDelay(pdMS_TO_TICKS(KIT_TAIL_MS));
+  
+  sampleManager.clearBank(audioEngine.getStandbyBank());
+  loadStats.peakArenaBytes = sampleManager.getArenaPeak();
+  loadStats.loads++;
+  loadState.store(KIT_IDLE);
+  
+  Serial.printf("========== KIT CARGADO: %d/%d samples en %d ms, cambio tras %d ms (%d us), pico arena %d bytes ==========\n\n",
+                loaded, kit.sampleCount, loadStats.loadMs, loadStats.swapWaitMs, loadStats.swapUs,
+                loadStats.peakArenaBytes);
+}
+
+void KitManager::onBar() {
+  if (loadState.load() == KIT_READY) swapNow();
+}
+
+void KitManager::update() {
+  if (loadState.load() == KIT_READY && !sequencer.isPlaying()) swapNow();
+}
+
+// Every pad switches in one atomic store; voices already sounding keep the old kit.
+// onBar (SequencerClock task) and update (SystemTask) may both see READY: one of them swaps.
+// SampleManager busy: back to READY, the next bar (or update) tries again
+void KitManager::swapNow() {
+  uint8_t expected = KIT_READY;
+  if (!loadState.compare_exchange_strong(expected, KIT_RELEASING)) return;
+  
+  uint32_t start = micros();
+  if (!sampleManager.swapBank()) {
+    loadStats.deferredSwaps++;
+    loadState.store(KIT_READY);
+    return;
+  }
+  loadStats.swapUs = micros() - start;
+  loadStats.swapWaitMs = millis() - readyMs;
+  currentKit = pendingKit;
   
-  return loaded > 0;
+  xTaskNotifyGive(loaderTaskHandle);
+}
+
+void KitManager::getLoadStats(KitLoadStats& out) {
+  out = loadStats;
+  out.state = loadState.load();
+  out.pendingKit = out.state != KIT_IDLE ? pendingKit : -1;
 }
 
 const char* KitManager::getKitName(int kitIndex) {
@@ -9,11 +9,32 @@
 #include <Arduino.h>
 #include <LittleFS.h>
 #include <FS.h>
+#include <atomic>
 #include "SampleManager.h"
 
 #define MAX_KITS 8
 #define MAX_SAMPLES_PER_KIT 16
 
+// Càrrega en segon pla: el kit nou s'omple al banc de reserva mentre l'actual sona
+#define KIT_LOADER_PRIORITY 2     // Per sota de SystemTask (5) i del streamer (6)
+#define KIT_LOADER_STACK 6144
+#define KIT_TAIL_MS 300           // Cues del kit anterior abans d'alliberar-lo
+
+// Background kit load statistics
+struct KitLoadStats {
+  int state;                  // KIT_IDLE / LOADING / READY / RELEASING
+  int pendingKit;             // Kit being loaded (-1 = none)
+  uint32_t loads;             // Completed kit switches
+  uint32_t failures;          // Loads that produced no sample
+  int lastLoaded;             // Samples loaded / listed in the last kit
+  int lastTotal;
+  uint32_t loadMs;            // LittleFS -> PSRAM time of the last kit
+  uint32_t swapWaitMs;        // Ready -> bar boundary
+  uint32_t swapUs;            // Cost of the switch itself
+  uint32_t deferredSwaps;     // Bars skipped because SampleManager was busy (upload, unload)
+  size_t peakArenaBytes;      // Arena use with both kits resident
+};
+
 struct KitSample {
   char filename[64];
   int padIndex;
@@ -35,7 +56,11 @@ public:
   
   // Kit management
   int scanKits();
-  bool loadKit(int kitIndex);
+  bool loadKit(int kitIndex);      // Queues the load; the switch happens at the next bar
+  bool isLoading() { return loadState.load() != 0; }
+  void onBar();                    // Sequencer, before the triggers of step 0
+  void update();                   // SystemTask: switches at once if the sequencer is stopped
+  void getLoadStats(KitLoadStats& out);
   int getKitCount() { return kitCount; }
   int getCurrentKit() { return currentKit; }
   const char* getKitName(int kitIndex);
@@ -54,7 +79,18 @@ private:
   int kitCount;
   int currentKit;
   
+  // Background loader
+  TaskHandle_t loaderTaskHandle;
+  std::atomic<uint8_t> loadState;
+  volatile int pendingKit;
+  uint32_t readyMs;
+  KitLoadStats loadStats;
+  
   bool parseKitFile(const char* filename, int kitIndex);
+  bool startLoader();
+  static void loaderTask(void* arg);
+  void loadPending();
+  void swapNow();
 };
 
 #endif // KITMANAGER_H
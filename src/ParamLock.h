@@ -0,0 +1,35 @@
+/*
+ * ParamLock.h
+ * Parameter locks per step (motion sequencing): valors que el step imposa a la
+ * veu que dispara. El Sequencer els guarda (només els steps amb locks) i
+ * l'AudioEngine els aplica al frame d'inici de la veu, amb taules precalculades
+ */
+
+#ifndef PARAMLOCK_H
+#define PARAMLOCK_H
+
+#include <stdint.h>
+
+// Locked parameters (bits of ParamLock::params)
+#define LOCK_CUTOFF     0x01    // 0-127: 20 Hz - 20 kHz, logarithmic
+#define LOCK_RESONANCE  0x02    // 0-127: Q 0.5 - 20, logarithmic
+#define LOCK_PITCH      0x04    // ±LOCK_PITCH_RANGE semitones
+#define LOCK_DECAY      0x08    // 0-127: 10 ms - 2 s to -60 dB
+#define LOCK_PAN        0x10    // -100 (left) .. +100 (right)
+#define LOCK_SLOT       0x20    // Pad whose sample plays (the track keeps its bus, filter and mute)
+#define LOCK_ALL        0x3F
+
+#define LOCK_VALUE_MAX 127
+#define LOCK_PITCH_RANGE 24
+
+struct ParamLock {
+  uint8_t params;         // LOCK_* bits set
+  uint8_t cutoff;
+  uint8_t resonance;
+  int8_t pitch;
+  uint8_t decay;
+  int8_t pan;
+  uint8_t slot;
+};
+
+#endif // PARAMLOCK_H
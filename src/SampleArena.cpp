@@ -0,0 +1,137 @@
+/*
+ * SampleArena.cpp
+ * Arena de PSRAM amb handles i compactació
+ */
+
+#include "SampleArena.h"
+#include <string.h>
+
+SampleArena::SampleArena() : base(nullptr), regionSize(0), usedBytes(0), liveCount(0), compactions(0) {
+  for (int i = 0; i < ARENA_MAX_HANDLES; i++) {
+    entries[i].offset = 0;
+    entries[i].size = 0;
+    entries[i].used = false;
+    order[i] = ARENA_INVALID_HANDLE;
+  }
+}
+
+bool SampleArena::begin(void* memory, size_t size) {
+  if (memory == nullptr || size < ARENA_ALIGN) return false;
+
+  // Align the region start; the lost bytes come off the end
+  uintptr_t start = ((uintptr_t)memory + ARENA_ALIGN - 1) & ~(uintptr_t)(ARENA_ALIGN - 1);
+  base = (uint8_t*)start;
+  regionSize = (size - (start - (uintptr_t)memory)) & ~(size_t)(ARENA_ALIGN - 1);
+  usedBytes = 0;
+  liveCount = 0;
+  return true;
+}
+
+bool SampleArena::isLive(ArenaHandle handle) {
+  return handle >= 0 && handle < ARENA_MAX_HANDLES && entries[handle].used;
+}
+
+ArenaHandle SampleArena::allocate(size_t bytes) {
+  if (base == nullptr || bytes == 0 || liveCount >= ARENA_MAX_HANDLES) return ARENA_INVALID_HANDLE;
+  size_t aligned = (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+  if (aligned > freeBytes()) return ARENA_INVALID_HANDLE;
+
+  // First gap (in address order) that fits: before order[i], or after the last block
+  uint32_t cursor = 0;
+  int position = liveCount;
+  for (int i = 0; i < liveCount; i++) {
+    const Entry& e = entries[order[i]];
+    if (e.offset - cursor >= aligned) {
+      position = i;
+      break;
+    }
+    cursor = e.offset + e.size;
+  }
+  if (position == liveCount && regionSize - cursor < aligned) return ARENA_INVALID_HANDLE;
+
+  ArenaHandle handle = ARENA_INVALID_HANDLE;
+  for (int h = 0; h < ARENA_MAX_HANDLES; h++) {
+    if (!entries[h].used) {
+      handle = (ArenaHandle)h;
+      break;
+    }
+  }
+  if (handle == ARENA_INVALID_HANDLE) return ARENA_INVALID_HANDLE;
+
+  entries[handle].offset = cursor;
+  entries[handle].size = aligned;
+  entries[handle].used = true;
+
+  // Keep `order` sorted by offset
+  for (int i = liveCount; i > position; i--) {
+    order[i] = order[i - 1];
+  }
+  order[position] = handle;
+  liveCount++;
+  usedBytes += aligned;
+  return handle;
+}
+
+void SampleArena::release(ArenaHandle handle) {
+  if (!isLive(handle)) return;
+
+  for (int i = 0; i < liveCount; i++) {
+    if (order[i] == handle) {
+      for (int j = i; j < liveCount - 1; j++) {
+        order[j] = order[j + 1];
+      }
+      break;
+    }
+  }
+  liveCount--;
+  order[liveCount] = ARENA_INVALID_HANDLE;
+  usedBytes -= entries[handle].size;
+  entries[handle].used = false;
+}
+
+void* SampleArena::ptr(ArenaHandle handle) {
+  if (!isLive(handle)) return nullptr;
+  return base + entries[handle].offset;
+}
+
+size_t SampleArena::size(ArenaHandle handle) {
+  if (!isLive(handle)) return 0;
+  return entries[handle].size;
+}
+
+size_t SampleArena::compact(const bool* pinned) {
+  size_t moved = 0;
+  uint32_t cursor = 0;
+  for (int i = 0; i < liveCount; i++) {
+    Entry& e = entries[order[i]];
+    if (pinned != nullptr && pinned[order[i]]) {
+      cursor = e.offset;    // Stays put; the next ones pack after it
+    } else if (e.offset != cursor) {
+      memmove(base + cursor, base + e.offset, e.size);
+      e.offset = cursor;
+      moved += e.size;
+    }
+    cursor += e.size;
+  }
+  compactions++;
+  return moved;
+}
+
+size_t SampleArena::largestFree() {
+  if (base == nullptr) return 0;
+  size_t largest = 0;
+  uint32_t cursor = 0;
+  for (int i = 0; i < liveCount; i++) {
+    const Entry& e = entries[order[i]];
+    if (e.offset - cursor > largest) largest = e.offset - cursor;
+    cursor = e.offset + e.size;
+  }
+  if (regionSize - cursor > largest) largest = regionSize - cursor;
+  return largest;
+}
+
+float SampleArena::fragmentation() {
+  size_t free = freeBytes();
+  if (free == 0) return 0.0f;
+  return 1.0f - (float)largestFree() / (float)free;
+}
@@ -0,0 +1,67 @@
+/*
+ * SampleArena.h
+ * Arena de PSRAM per als buffers de samples: handles en lloc de punters,
+ * first-fit sobre els forats entre blocs i compactació quan es fragmenta
+ * Sense dependències d'Arduino: es pot provar a Linux
+ */
+
+#ifndef SAMPLEARENA_H
+#define SAMPLEARENA_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ARENA_ALIGN 16          // Alineació dels blocs (GDMA del prefetch)
+#define ARENA_MAX_HANDLES 64    // Samples + heads de codec + temporals de càrrega
+
+typedef int16_t ArenaHandle;    // -1 = invalid
+#define ARENA_INVALID_HANDLE ((ArenaHandle)-1)
+
+class SampleArena {
+public:
+  SampleArena();
+
+  // Takes ownership of an already allocated region
+  bool begin(void* memory, size_t size);
+  bool isReady() { return base != nullptr; }
+
+  // First-fit in the gaps between live blocks (free space is always coalesced)
+  ArenaHandle allocate(size_t bytes);
+  void release(ArenaHandle handle);
+
+  // Pointers are only valid until the next compact()
+  void* ptr(ArenaHandle handle);
+  size_t size(ArenaHandle handle);
+
+  // Slide every block to the start of the region. Returns bytes moved.
+  // pinned[handle] = true: the block stays put and the rest slide up to it
+  size_t compact(const bool* pinned = nullptr);
+
+  // Metrics
+  size_t capacity() { return regionSize; }
+  size_t used() { return usedBytes; }
+  size_t freeBytes() { return regionSize - usedBytes; }
+  size_t largestFree();
+  float fragmentation();        // 1 - largestFree / free (0 = one single hole)
+  int handleCount() { return liveCount; }
+  uint32_t getCompactions() { return compactions; }
+
+private:
+  struct Entry {
+    uint32_t offset;
+    uint32_t size;              // Aligned size
+    bool used;
+  };
+
+  uint8_t* base;
+  size_t regionSize;
+  size_t usedBytes;
+  Entry entries[ARENA_MAX_HANDLES];
+  ArenaHandle order[ARENA_MAX_HANDLES];  // Live handles sorted by offset
+  int liveCount;
+  uint32_t compactions;
+
+  bool isLive(ArenaHandle handle);
+};
+
+#endif // SAMPLEARENA_H
@@ -0,0 +1,62 @@
+/*
+ * SampleBank.h
+ * Format del paquet de samples (un sol fitxer, generat per pack_samples.py)
+ *
+ *   [SampleBankHeader][SampleBankEntry x count][padding][PCM][PCM]...
+ *
+ * PCM 16-bit mono little-endian, cada payload alineat a SAMPLE_BANK_ALIGN:
+ * es copia tal qual a l'arena (o es mapeja) sense parsejar cap WAV
+ * Sense dependències d'Arduino: es pot provar a Linux
+ */
+
+#ifndef SAMPLEBANK_H
+#define SAMPLEBANK_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#define SAMPLE_BANK_PATH "/samples.bank"
+#define SAMPLE_BANK_MAGIC "R808BNK1"      // 8 bytes, sense terminador
+#define SAMPLE_BANK_VERSION 1
+#define SAMPLE_BANK_ALIGN 16              // Payloads: alineació de l'arena i de la GDMA
+#define SAMPLE_BANK_MAX_ENTRIES 256
+#define SAMPLE_BANK_NO_PAD 0xFF           // Entrada que no es carrega a l'arrencada
+
+struct SampleBankHeader {
+  char magic[8];
+  uint16_t version;
+  uint16_t count;             // Entries in the index
+  uint32_t entrySize;         // sizeof(SampleBankEntry) when packed
+  uint32_t dataOffset;        // First payload
+  uint32_t totalSize;         // Whole file
+} __attribute__((packed));
+
+struct SampleBankEntry {
+  char name[32];              // File name (BD0000.WAV)
+  char family[4];             // Folder (BD, SD, ...), zero padded
+  uint8_t pad;                // Boot pad, SAMPLE_BANK_NO_PAD = library only
+  uint8_t channels;           // Always 1 (the packer mixes stereo down)
+  uint16_t bitsPerSample;     // Always 16
+  uint32_t sampleRate;        // Source rate (the engine plays at SAMPLE_RATE)
+  uint32_t offset;            // Payload offset in the file
+  uint32_t length;            // Samples
+} __attribute__((packed));
+
+// Header sanity against the real file size
+static inline bool sampleBankValid(const SampleBankHeader& header, size_t fileSize) {
+  return memcmp(header.magic, SAMPLE_BANK_MAGIC, 8) == 0 &&
+         header.version == SAMPLE_BANK_VERSION &&
+         header.entrySize == sizeof(SampleBankEntry) &&
+         header.count <= SAMPLE_BANK_MAX_ENTRIES &&
+         header.dataOffset >= sizeof(SampleBankHeader) + header.count * sizeof(SampleBankEntry) &&
+         header.totalSize == fileSize;
+}
+
+static inline bool sampleBankEntryValid(const SampleBankEntry& entry, const SampleBankHeader& header) {
+  return entry.channels == 1 && entry.bitsPerSample == 16 &&
+         (entry.offset % SAMPLE_BANK_ALIGN) == 0 && entry.offset >= header.dataOffset &&
+         (uint64_t)entry.offset + (uint64_t)entry.length * 2 <= header.totalSize;
+}
+
+#endif // SAMPLEBANK_H
@@ -0,0 +1,107 @@
+/*
+ * SampleCache.cpp
+ * Taula de samples en cache amb LRU
+ */
+
+#include "SampleCache.h"
+#include <string.h>
+
+SampleCache::SampleCache() : budget(SAMPLE_CACHE_DEFAULT_BUDGET), clock(0) {
+  for (int i = 0; i < SAMPLE_CACHE_ENTRIES; i++) {
+    entries[i].used = false;
+    entries[i].handle = ARENA_INVALID_HANDLE;
+    entries[i].refs = 0;
+  }
+  memset(&stats, 0, sizeof(stats));
+}
+
+int SampleCache::find(const char* path, uint32_t mtime, uint32_t fileSize, SampleFormat format) {
+  for (int i = 0; i < SAMPLE_CACHE_ENTRIES; i++) {
+    const CachedSample& e = entries[i];
+    if (e.used && e.mtime == mtime && e.fileSize == fileSize && e.format == format &&
+        strcmp(e.path, path) == 0) {
+      stats.hits++;
+      return i;
+    }
+  }
+  stats.misses++;
+  return -1;
+}
+
+int SampleCache::insert(const CachedSample& sample) {
+  for (int i = 0; i < SAMPLE_CACHE_ENTRIES; i++) {
+    if (entries[i].used) continue;
+    entries[i] = sample;
+    entries[i].used = true;
+    entries[i].refs = 0;
+    entries[i].lastUse = ++clock;
+    return i;
+  }
+  return -1;
+}
+
+void SampleCache::acquire(int index) {
+  if (index < 0 || index >= SAMPLE_CACHE_ENTRIES || !entries[index].used) return;
+  entries[index].refs++;
+  entries[index].lastUse = ++clock;
+}
+
+void SampleCache::release(int index) {
+  if (index < 0 || index >= SAMPLE_CACHE_ENTRIES || !entries[index].used) return;
+  if (entries[index].refs > 0) entries[index].refs--;
+  entries[index].lastUse = ++clock;
+}
+
+void SampleCache::remove(int index) {
+  if (index < 0 || index >= SAMPLE_CACHE_ENTRIES) return;
+  entries[index].used = false;
+  entries[index].handle = ARENA_INVALID_HANDLE;
+  entries[index].refs = 0;
+}
+
+int SampleCache::pickVictim(uint32_t skipMask) {
+  int victim = -1;
+  for (int i = 0; i < SAMPLE_CACHE_ENTRIES; i++) {
+    const CachedSample& e = entries[i];
+    if (!e.used || e.refs > 0 || (skipMask & (1UL << i))) continue;
+    if (victim < 0 || (int32_t)(e.lastUse - entries[victim].lastUse) < 0) victim = i;
+  }
+  return victim;
+}
+
+bool SampleCache::isFull() {
+  for (int i = 0; i < SAMPLE_CACHE_ENTRIES; i++) {
+    if (!entries[i].used) return false;
+  }
+  return true;
+}
+
+size_t SampleCache::bytesCached() {
+  size_t total = 0;
+  for (int i = 0; i < SAMPLE_CACHE_ENTRIES; i++) {
+    if (entries[i].used) total += entries[i].bytes;
+  }
+  return total;
+}
+
+size_t SampleCache::bytesReferenced() {
+  size_t total = 0;
+  for (int i = 0; i < SAMPLE_CACHE_ENTRIES; i++) {
+    if (entries[i].used && entries[i].refs > 0) total += entries[i].bytes;
+  }
+  return total;
+}
+
+void SampleCache::getStats(SampleCacheStats& out) {
+  out = stats;
+  out.entries = 0;
+  out.referenced = 0;
+  for (int i = 0; i < SAMPLE_CACHE_ENTRIES; i++) {
+    if (!entries[i].used) continue;
+    out.entries++;
+    if (entries[i].refs > 0) out.referenced++;
+  }
+  out.bytesCached = bytesCached();
+  out.bytesIdle = out.bytesCached - bytesReferenced();
+  out.budget = budget;
+}
@@ -0,0 +1,81 @@
+/*
+ * SampleCache.h
+ * Cache de samples carregats (clau: path + mtime + mida + format)
+ * Els kits que comparteixen fitxers o tornen a carregar-se no llegeixen LittleFS
+ * Només la taula i el LRU: l'arena i l'alliberament diferit són de SampleManager
+ * Sense dependències d'Arduino: es pot provar a Linux
+ */
+
+#ifndef SAMPLECACHE_H
+#define SAMPLECACHE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "SampleCodec.h"
+#include "SampleArena.h"
+#include "WavDecoder.h"
+
+#define SAMPLE_CACHE_ENTRIES 32                       // > SAMPLE_SLOTS: sempre hi ha una entrada lliure o inactiva
+#define SAMPLE_CACHE_DEFAULT_BUDGET (4 * 1024 * 1024) // Bytes en cache (en ús + inactius)
+
+// A loaded sample as stored in the arena, shared by every slot that plays it
+struct CachedSample {
+  bool used;
+  char path[64];
+  uint32_t mtime;             // File::getLastWrite()
+  uint32_t fileSize;
+  SampleFormat format;        // Requested storage format (part of the key)
+  ArenaHandle handle;
+  size_t bytes;               // Arena bytes
+  uint32_t length;            // Total samples
+  uint32_t resident;          // Samples in memory (< length: streamed)
+  uint32_t dataOffset;        // Stream info (file offset of the PCM data)
+  WavFormat wav;              // Stream info (encoding of the data chunk)
+  uint8_t channels;           // In memory: 2 = interleaved stereo frames
+  CodecReport report;
+  int refs;                   // Slots using it (0 = idle, evictable)
+  uint32_t lastUse;           // LRU clock
+};
+
+// Cache statistics
+struct SampleCacheStats {
+  uint32_t hits;              // Loads served from memory
+  uint32_t misses;            // Loads that read LittleFS
+  uint32_t evictions;         // Idle entries freed (budget or arena pressure)
+  int entries;
+  int referenced;             // Entries in use by some pad
+  size_t bytesCached;         // All entries
+  size_t bytesIdle;           // Entries no pad uses (what the budget trims)
+  size_t budget;
+};
+
+class SampleCache {
+public:
+  SampleCache();
+
+  int find(const char* path, uint32_t mtime, uint32_t fileSize, SampleFormat format);  // -1 = miss
+  int insert(const CachedSample& sample);   // -1 = table full of referenced entries
+  void acquire(int index);
+  void release(int index);
+  void remove(int index);
+  CachedSample& entry(int index) { return entries[index]; }
+
+  // Eviction candidates: least recently used idle entry not in skipMask (-1 = none)
+  int pickVictim(uint32_t skipMask = 0);
+  bool isFull();
+
+  void setBudget(size_t bytes) { budget = bytes; }
+  size_t getBudget() { return budget; }
+  size_t bytesCached();
+  size_t bytesReferenced();
+  void noteEviction() { stats.evictions++; }
+  void getStats(SampleCacheStats& out);
+
+private:
+  CachedSample entries[SAMPLE_CACHE_ENTRIES];
+  size_t budget;
+  uint32_t clock;
+  SampleCacheStats stats;
+};
+
+#endif // SAMPLECACHE_H
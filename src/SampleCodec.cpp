@@ -0,0 +1,253 @@
+/*
+ * SampleCodec.cpp
+ * IMA-ADPCM (blocs amb punt de seek) i G.711 µ-law
+ */
+
+#include "SampleCodec.h"
+#include <string.h>
+#include <math.h>
+
+static const int16_t imaStepTable[89] = {
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+  253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+  1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+  3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442,
+  11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794,
+  32767
+};
+
+static const int8_t imaIndexTable[8] = { -1, -1, -1, -1, 2, 4, 6, 8 };
+
+#define ULAW_BIAS 0x84
+#define ULAW_CLIP 32635
+
+// µ-law decode table, built once at startup
+static int16_t ulawTable[256];
+
+static struct UlawTableInit {
+  UlawTableInit() {
+    for (int i = 0; i < 256; i++) {
+      ulawTable[i] = SampleCodec::decodeUlaw((uint8_t)i);
+    }
+  }
+} ulawTableInit;
+
+static inline int16_t clamp16(int32_t value) {
+  if (value > 32767) return 32767;
+  if (value < -32768) return -32768;
+  return (int16_t)value;
+}
+
+// One IMA-ADPCM step: returns the nibble and advances predictor/index
+static inline uint8_t adpcmEncodeNibble(int16_t sample, int32_t& predictor, int& index) {
+  int32_t diff = (int32_t)sample - predictor;
+  uint8_t code = 0;
+  if (diff < 0) {
+    code = 8;
+    diff = -diff;
+  }
+
+  int32_t step = imaStepTable[index];
+  int32_t delta = step >> 3;
+  if (diff >= step) { code |= 4; diff -= step; delta += step; }
+  step >>= 1;
+  if (diff >= step) { code |= 2; diff -= step; delta += step; }
+  step >>= 1;
+  if (diff >= step) { code |= 1; delta += step; }
+
+  predictor = clamp16((code & 8) ? predictor - delta : predictor + delta);
+  index += imaIndexTable[code & 7];
+  if (index < 0) index = 0;
+  else if (index > 88) index = 88;
+  return code;
+}
+
+static inline int16_t adpcmDecodeNibble(uint8_t code, int32_t& predictor, int& index) {
+  int32_t step = imaStepTable[index];
+  int32_t delta = step >> 3;
+  if (code & 4) delta += step;
+  if (code & 2) delta += step >> 1;
+  if (code & 1) delta += step >> 2;
+
+  predictor = clamp16((code & 8) ? predictor - delta : predictor + delta);
+  index += imaIndexTable[code & 7];
+  if (index < 0) index = 0;
+  else if (index > 88) index = 88;
+  return (int16_t)predictor;
+}
+
+size_t SampleCodec::encodedSize(SampleFormat format, uint32_t samples) {
+  switch (format) {
+    case SAMPLE_ADPCM:
+      return ((samples + CODEC_BLOCK_SAMPLES - 1) / CODEC_BLOCK_SAMPLES) * ADPCM_BLOCK_BYTES;
+    case SAMPLE_ULAW:
+      return samples;
+    default:
+      return samples * sizeof(int16_t);
+  }
+}
+
+void SampleCodec::encode(SampleFormat format, const int16_t* in, uint32_t samples, uint8_t* out) {
+  if (format == SAMPLE_ULAW) {
+    for (uint32_t i = 0; i < samples; i++) {
+      out[i] = encodeUlaw(in[i]);
+    }
+    return;
+  }
+
+  if (format != SAMPLE_ADPCM) {
+    memcpy(out, in, samples * sizeof(int16_t));
+    return;
+  }
+
+  // Each block restarts from its first sample (exact seek point); the step index carries over
+  int index = 0;
+  uint32_t blocks = (samples + CODEC_BLOCK_SAMPLES - 1) / CODEC_BLOCK_SAMPLES;
+  for (uint32_t b = 0; b < blocks; b++) {
+    uint32_t first = b * CODEC_BLOCK_SAMPLES;
+    uint32_t count = samples - first;
+    if (count > CODEC_BLOCK_SAMPLES) count = CODEC_BLOCK_SAMPLES;
+
+    uint8_t* block = out + b * ADPCM_BLOCK_BYTES;
+    int32_t predictor = in[first];
+    block[0] = (uint8_t)(predictor & 0xFF);
+    block[1] = (uint8_t)((predictor >> 8) & 0xFF);
+    block[2] = (uint8_t)index;
+    block[3] = 0;
+    memset(block + ADPCM_BLOCK_HEADER, 0, CODEC_BLOCK_SAMPLES / 2);
+
+    for (uint32_t i = 0; i < count; i++) {
+      uint8_t code = adpcmEncodeNibble(in[first + i], predictor, index);
+      block[ADPCM_BLOCK_HEADER + (i >> 1)] |= (i & 1) ? (code << 4) : code;
+    }
+  }
+}
+
+void SampleCodec::decodeBlock(SampleFormat format, const uint8_t* data, uint32_t block,
+                              uint32_t count, int16_t* out) {
+  if (count > CODEC_BLOCK_SAMPLES) count = CODEC_BLOCK_SAMPLES;
+
+  if (format == SAMPLE_ULAW) {
+    const uint8_t* src = data + block * CODEC_BLOCK_SAMPLES;
+    for (uint32_t i = 0; i < count; i++) {
+      out[i] = ulawTable[src[i]];
+    }
+    return;
+  }
+
+  if (format != SAMPLE_ADPCM) {
+    memcpy(out, (const int16_t*)data + block * CODEC_BLOCK_SAMPLES, count * sizeof(int16_t));
+    return;
+  }
+
+  const uint8_t* src = data + block * ADPCM_BLOCK_BYTES;
+  int32_t predictor = (int16_t)(src[0] | (src[1] << 8));
+  int index = src[2] > 88 ? 88 : src[2];
+  const uint8_t* nibbles = src + ADPCM_BLOCK_HEADER;
+
+  // Two samples per byte, low nibble first
+  uint32_t i = 0;
+  for (; i + 1 < count; i += 2) {
+    uint8_t byte = nibbles[i >> 1];
+    out[i] = adpcmDecodeNibble(byte & 0x0F, predictor, index);
+    out[i + 1] = adpcmDecodeNibble(byte >> 4, predictor, index);
+  }
+  if (i < count) {
+    out[i] = adpcmDecodeNibble(nibbles[i >> 1] & 0x0F, predictor, index);
+  }
+}
+
+void SampleCodec::decodeRange(SampleFormat format, const uint8_t* data, uint32_t start,
+                              uint32_t count, int16_t* out) {
+  if (format == SAMPLE_PCM16) {
+    memcpy(out, (const int16_t*)data + start, count * sizeof(int16_t));
+    return;
+  }
+  if (format == SAMPLE_ULAW) {
+    for (uint32_t i = 0; i < count; i++) {
+      out[i] = ulawTable[data[start + i]];
+    }
+    return;
+  }
+
+  // ADPCM: decode whole blocks and keep the requested part
+  int16_t block[CODEC_BLOCK_SAMPLES];
+  uint32_t done = 0;
+  while (done < count) {
+    uint32_t position = start + done;
+    uint32_t blockIndex = position / CODEC_BLOCK_SAMPLES;
+    uint32_t offset = position % CODEC_BLOCK_SAMPLES;
+    uint32_t n = CODEC_BLOCK_SAMPLES - offset;
+    if (n > count - done) n = count - done;
+
+    decodeBlock(format, data, blockIndex, offset + n, block);
+    memcpy(out + done, block + offset, n * sizeof(int16_t));
+    done += n;
+  }
+}
+
+void SampleCodec::accumulateError(const int16_t* ref, const int16_t* test, uint32_t count,
+                                  double& signal, double& noise) {
+  for (uint32_t i = 0; i < count; i++) {
+    double s = ref[i];
+    double e = (double)ref[i] - (double)test[i];
+    signal += s * s;
+    noise += e * e;
+  }
+}
+
+float SampleCodec::snrDb(double signal, double noise) {
+  if (signal <= 0.0) return 0.0f;
+  if (noise <= 0.0) return 99.0f;  // Lossless
+  return (float)(10.0 * log10(signal / noise));
+}
+
+const char* SampleCodec::formatName(SampleFormat format) {
+  switch (format) {
+    case SAMPLE_ADPCM: return "adpcm";
+    case SAMPLE_ULAW: return "ulaw";
+    default: return "pcm";
+  }
+}
+
+bool SampleCodec::parseFormat(const char* name, SampleFormat& format) {
+  if (name == nullptr) return false;
+  if (strcmp(name, "pcm") == 0 || strcmp(name, "pcm16") == 0) {
+    format = SAMPLE_PCM16;
+  } else if (strcmp(name, "adpcm") == 0) {
+    format = SAMPLE_ADPCM;
+  } else if (strcmp(name, "ulaw") == 0 || strcmp(name, "mulaw") == 0) {
+    format = SAMPLE_ULAW;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// G.711 µ-law
+uint8_t SampleCodec::encodeUlaw(int16_t sample) {
+  int32_t value = sample;
+  uint8_t sign = 0;
+  if (value < 0) {
+    sign = 0x80;
+    value = -value;
+  }
+  if (value > ULAW_CLIP) value = ULAW_CLIP;
+  value += ULAW_BIAS;
+
+  int exponent = 7;
+  for (int32_t mask = 0x4000; (value & mask) == 0 && exponent > 0; mask >>= 1) {
+    exponent--;
+  }
+  uint8_t mantissa = (value >> (exponent + 3)) & 0x0F;
+  return (uint8_t)~(sign | (exponent << 4) | mantissa);
+}
+
+int16_t SampleCodec::decodeUlaw(uint8_t value) {
+  value = ~value;
+  int exponent = (value >> 4) & 0x07;
+  int32_t magnitude = ((((int32_t)(value & 0x0F)) << 3) + ULAW_BIAS) << exponent;
+  magnitude -= ULAW_BIAS;
+  return (int16_t)((value & 0x80) ? -magnitude : magnitude);
+}
@@ -0,0 +1,60 @@
+/*
+ * SampleCodec.h
+ * Formats comprimits per als samples en PSRAM (IMA-ADPCM 4:1, µ-law 2:1)
+ * Sense dependències d'Arduino: es pot compilar i provar a Linux
+ */
+
+#ifndef SAMPLECODEC_H
+#define SAMPLECODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define CODEC_BLOCK_SAMPLES 256   // Mostres per bloc (cada bloc és un punt de seek)
+#define ADPCM_BLOCK_HEADER 4      // Predictor int16 + step index + reservat
+#define ADPCM_BLOCK_BYTES (ADPCM_BLOCK_HEADER + CODEC_BLOCK_SAMPLES / 2)
+
+// In-memory storage format of a sample
+enum SampleFormat : uint8_t {
+  SAMPLE_PCM16 = 0,   // int16 sense comprimir
+  SAMPLE_ADPCM = 1,   // IMA-ADPCM, blocs independents de 256 mostres
+  SAMPLE_ULAW = 2     // G.711 µ-law, 8 bits per mostra
+};
+
+// Load-time report: memory saved, decode cost and quality
+struct CodecReport {
+  SampleFormat format;
+  uint32_t pcmBytes;          // Size as int16
+  uint32_t storedBytes;       // Size actually held in PSRAM
+  float snrDb;                // Decoded vs original (0 = not measured / PCM)
+  float decodeCyclesPerFrame; // CPU cycles per decoded sample
+};
+
+class SampleCodec {
+public:
+  // Bytes needed to store `samples` mono samples in `format`
+  static size_t encodedSize(SampleFormat format, uint32_t samples);
+
+  static void encode(SampleFormat format, const int16_t* in, uint32_t samples, uint8_t* out);
+
+  // Decode `count` (<= CODEC_BLOCK_SAMPLES) samples of block `block`
+  static void decodeBlock(SampleFormat format, const uint8_t* data, uint32_t block,
+                          uint32_t count, int16_t* out);
+
+  // Decode an arbitrary range (crosses blocks; used to build the SRAM head)
+  static void decodeRange(SampleFormat format, const uint8_t* data, uint32_t start,
+                          uint32_t count, int16_t* out);
+
+  // SNR helpers: accumulate over blocks, then convert to dB
+  static void accumulateError(const int16_t* ref, const int16_t* test, uint32_t count,
+                              double& signal, double& noise);
+  static float snrDb(double signal, double noise);
+
+  static const char* formatName(SampleFormat format);
+  static bool parseFormat(const char* name, SampleFormat& format);
+
+  static uint8_t encodeUlaw(int16_t sample);
+  static int16_t decodeUlaw(uint8_t value);
+};
+
+#endif // SAMPLECODEC_H
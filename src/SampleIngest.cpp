@@ -0,0 +1,244 @@
+/*
+ * SampleIngest.cpp
+ * Parser de WAV incremental + decodificació + remostreig lineal
+ */
+
+#include "SampleIngest.h"
+#include <string.h>
+
+static inline uint32_t readLE32(const uint8_t* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+SampleIngest::SampleIngest() {
+  reset(44100, nullptr, nullptr, nullptr);
+}
+
+void SampleIngest::reset(uint32_t outputRate, IngestFormatFn onFormat, IngestFramesFn onFrames, void* ctx,
+                         uint32_t streamBytes) {
+  state = STATE_RIFF;
+  outRate = outputRate;
+  formatFn = onFormat;
+  framesFn = onFrames;
+  context = ctx;
+  errorText = "";
+  fieldLen = 0;
+  fieldNeed = 12;
+  skipBytes = 0;
+  chunkSize = 0;
+  haveFmt = false;
+  memset(&source, 0, sizeof(source));
+  dataLeft = 0;
+  streamLimit = streamBytes;
+  received = 0;
+  totalOut = 0;
+  emitted = 0;
+  carryLen = 0;
+  step = 1 << 16;
+  phase = 1 << 16;
+  prev[0] = prev[1] = 0;
+}
+
+bool SampleIngest::fail(const char* text) {
+  state = STATE_ERROR;
+  errorText = text;
+  return false;
+}
+
+// Collects fieldNeed bytes into `field`; false = wait for the next upload chunk
+bool SampleIngest::gather(const uint8_t*& data, size_t& len) {
+  uint32_t take = fieldNeed - fieldLen;
+  if (take > len) take = len;
+  memcpy(field + fieldLen, data, take);
+  fieldLen += take;
+  data += take;
+  len -= take;
+  return fieldLen == fieldNeed;
+}
+
+bool SampleIngest::feed(const uint8_t* data, size_t len) {
+  received += len;
+  while (len > 0) {
+    switch (state) {
+      case STATE_RIFF:
+        if (!gather(data, len)) return true;
+        if (memcmp(field, "RIFF", 4) != 0 || memcmp(field + 8, "WAVE", 4) != 0) return fail("Not a RIFF/WAVE file");
+        state = STATE_CHUNK;
+        fieldLen = 0;
+        fieldNeed = 8;
+        break;
+
+      case STATE_CHUNK: {
+        if (!gather(data, len)) return true;
+        // Upload bytes after this chunk header (len = what is left of this piece)
+        uint32_t consumed = received - len;
+        uint32_t streamLeft = streamLimit == 0 ? UINT32_MAX : consumed < streamLimit ? streamLimit - consumed : 0;
+        if (!parseField(streamLeft)) return false;
+        break;
+      }
+
+      case STATE_FMT:
+        if (!gather(data, len)) return true;
+        if (!WavDecoder::parseFmt(field, fieldLen, source)) {
+          return fail("Unsupported format (PCM 8/16/24/32-bit or float 32, mono/stereo)");
+        }
+        haveFmt = true;
+        state = STATE_SKIP;
+        break;
+
+      case STATE_SKIP: {
+        uint32_t take = skipBytes < len ? skipBytes : len;
+        skipBytes -= take;
+        data += take;
+        len -= take;
+        break;
+      }
+
+      case STATE_DATA: {
+        uint32_t take = dataLeft < len ? dataLeft : len;
+        if (!consumeData(data, take)) return false;
+        dataLeft -= take;
+        data += take;
+        len -= take;
+        if (dataLeft == 0) state = STATE_DONE;
+        break;
+      }
+
+      case STATE_DONE:
+        return true;  // Chunks after the data (LIST...) are not needed
+
+      case STATE_ERROR:
+        return false;
+    }
+
+    // A skip can end without more bytes
+    if (state == STATE_SKIP && skipBytes == 0) {
+      state = STATE_CHUNK;
+      fieldLen = 0;
+      fieldNeed = 8;
+    }
+  }
+  return state != STATE_ERROR;
+}
+
+// Chunk header: id + size
+bool SampleIngest::parseField(uint32_t streamLeft) {
+  chunkSize = readLE32(field + 4);
+  if (memcmp(field, "fmt ", 4) == 0) {
+    fieldNeed = chunkSize < WAV_FMT_MAX_BYTES ? chunkSize : WAV_FMT_MAX_BYTES;
+    if (fieldNeed < 16) return fail("Bad fmt chunk");
+    skipBytes = chunkSize - fieldNeed + (chunkSize & 1);
+    fieldLen = 0;
+    state = STATE_FMT;
+    return true;
+  }
+  if (memcmp(field, "data", 4) == 0) {
+    if (!haveFmt) return fail("data chunk before fmt");
+    dataLeft = chunkSize < streamLeft ? chunkSize : streamLeft;
+    return startData();
+  }
+  // LIST, INFO... (odd sizes carry a pad byte)
+  skipBytes = chunkSize + (chunkSize & 1);
+  state = STATE_SKIP;
+  return true;
+}
+
+bool SampleIngest::startData() {
+  if (source.sampleRate < INGEST_MIN_RATE || source.sampleRate > INGEST_MAX_RATE) {
+    return fail("Unsupported sample rate");
+  }
+  uint32_t frames = dataLeft / WavDecoder::frameBytes(source);
+  totalOut = source.sampleRate == outRate ? frames : (uint32_t)((uint64_t)frames * outRate / source.sampleRate);
+  if (totalOut == 0) return fail("Empty data chunk");
+
+  step = (uint32_t)(((uint64_t)source.sampleRate << 16) / outRate);
+  phase = 1 << 16;  // v[1] = first frame
+  prev[0] = prev[1] = 0;
+  carryLen = 0;
+  emitted = 0;
+  state = dataLeft > 0 ? STATE_DATA : STATE_DONE;
+
+  if (formatFn && !formatFn(context, source, totalOut)) return fail("Rejected");
+  return true;
+}
+
+bool SampleIngest::consumeData(const uint8_t* data, size_t len) {
+  uint32_t bytesPerFrame = WavDecoder::frameBytes(source);
+
+  // Complete the frame left over from the previous chunk
+  if (carryLen > 0) {
+    uint32_t take = bytesPerFrame - carryLen;
+    if (take > len) take = len;
+    memcpy(carry + carryLen, data, take);
+    carryLen += take;
+    data += take;
+    len -= take;
+    if (carryLen < bytesPerFrame) return true;
+    carryLen = 0;
+    if (!pushFrames(carry, 1)) return false;
+  }
+
+  uint32_t frames = len / bytesPerFrame;
+  while (frames > 0) {
+    uint32_t block = frames < INGEST_BLOCK_FRAMES ? frames : INGEST_BLOCK_FRAMES;
+    if (!pushFrames(data, block)) return false;
+    data += block * bytesPerFrame;
+    len -= block * bytesPerFrame;
+    frames -= block;
+  }
+
+  memcpy(carry, data, len);
+  carryLen = len;
+  return true;
+}
+
+bool SampleIngest::pushFrames(const uint8_t* raw, uint32_t frames) {
+  int ch = source.channels;
+  WavDecoder::convert(source, raw, frames, decoded, true);
+  if (source.sampleRate == outRate) return emit(decoded, frames);
+
+  // Interpolate between v[idx] and v[idx + 1], v[0] = prev, v[i] = decoded[i - 1]
+  uint32_t count = 0;
+  while ((phase >> 16) + 1 <= frames) {
+    uint32_t idx = phase >> 16;
+    int32_t frac = (phase & 0xFFFF) >> 1;  // Q15: (b - a) * frac fits in 32 bits
+    for (int c = 0; c < ch; c++) {
+      int32_t a = idx == 0 ? prev[c] : decoded[(idx - 1) * ch + c];
+      int32_t b = decoded[idx * ch + c];
+      resampled[count * ch + c] = (int16_t)(a + (((b - a) * frac) >> 15));
+    }
+    phase += step;
+    if (++count == INGEST_BLOCK_FRAMES) {
+      if (!emit(resampled, count)) return false;
+      count = 0;
+    }
+  }
+  phase -= frames << 16;
+  for (int c = 0; c < ch; c++) prev[c] = decoded[(frames - 1) * ch + c];
+  return count == 0 || emit(resampled, count);
+}
+
+// Never past the length announced in onFormat
+bool SampleIngest::emit(const int16_t* frames, uint32_t count) {
+  if (count > totalOut - emitted) count = totalOut - emitted;
+  if (count == 0) return true;
+  if (framesFn && !framesFn(context, frames, count)) return fail("Rejected");
+  emitted += count;
+  return true;
+}
+
+// Fills up to outputFrames: the last frame for the resampler tail, silence if the data was cut short
+bool SampleIngest::finish() {
+  if (state == STATE_ERROR) return false;
+  if (!headerReady()) return fail("No data chunk");
+
+  int ch = source.channels;
+  bool truncated = dataLeft > 0;
+  for (int i = 0; i < INGEST_BLOCK_FRAMES; i++) {
+    for (int c = 0; c < ch; c++) resampled[i * ch + c] = truncated ? 0 : prev[c];
+  }
+  if (source.sampleRate == outRate && !truncated) return true;
+  while (emitted < totalOut) {
+    if (!emit(resampled, INGEST_BLOCK_FRAMES)) return false;
+  }
+  state = STATE_DONE;
+  return true;
+}
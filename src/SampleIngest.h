@@ -0,0 +1,89 @@
+/*
+ * SampleIngest.h
+ * WAV rebut per trossos (pujada HTTP): la capçalera es parseja del primer
+ * tros i el PCM es decodifica (i es remostreja a la freqüència del motor)
+ * a mesura que arriba, sense passar per LittleFS
+ *
+ * Sense dependències d'Arduino: es pot compilar i provar a Linux
+ */
+
+#ifndef SAMPLEINGEST_H
+#define SAMPLEINGEST_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "WavDecoder.h"
+
+#define INGEST_BLOCK_FRAMES 512       // Frames per decode / resample pass
+#define INGEST_MIN_RATE 8000
+#define INGEST_MAX_RATE 192000
+
+// Header parsed: `frames` at the output rate. false aborts the ingest
+typedef bool (*IngestFormatFn)(void* context, const WavFormat& source, uint32_t frames);
+// Interleaved int16 frames (source channel count) at the output rate. false aborts
+typedef bool (*IngestFramesFn)(void* context, const int16_t* frames, uint32_t count);
+
+class SampleIngest {
+public:
+  SampleIngest();
+
+  // streamBytes: size of the whole upload (0 = unknown). The data chunk never runs past
+  // it: streaming writers leave the size at 0xFFFFFFFF
+  void reset(uint32_t outputRate, IngestFormatFn onFormat, IngestFramesFn onFrames, void* context,
+             uint32_t streamBytes = 0);
+  bool feed(const uint8_t* data, size_t len);  // Upload bytes in order. false = error() says why
+  bool finish();                               // Pads the resampler tail (silence if the data was cut short)
+
+  bool headerReady() const { return state == STATE_DATA || state == STATE_DONE; }
+  const WavFormat& sourceFormat() const { return source; }
+  uint32_t outputFrames() const { return totalOut; }
+  uint32_t emittedFrames() const { return emitted; }
+  const char* error() const { return errorText; }
+
+private:
+  enum State : uint8_t { STATE_RIFF, STATE_CHUNK, STATE_FMT, STATE_SKIP, STATE_DATA, STATE_DONE, STATE_ERROR };
+
+  State state;
+  uint32_t outRate;
+  IngestFormatFn formatFn;
+  IngestFramesFn framesFn;
+  void* context;
+  const char* errorText;
+
+  // Header fields gathered across chunks
+  uint8_t field[WAV_FMT_MAX_BYTES];
+  uint32_t fieldLen;
+  uint32_t fieldNeed;
+  uint32_t skipBytes;              // Rest of an unknown (or long fmt) chunk
+  uint32_t chunkSize;
+  bool haveFmt;
+
+  WavFormat source;
+  uint32_t dataLeft;               // Data chunk bytes still to come
+  uint32_t streamLimit;            // Upload size (0 = unknown)
+  uint32_t received;               // Bytes passed to feed()
+  uint32_t totalOut;
+  uint32_t emitted;
+
+  // A frame split between two upload chunks
+  uint8_t carry[8];
+  uint32_t carryLen;
+
+  // Linear resampler (Q16 position, v[0] = last frame of the previous block)
+  uint32_t step;
+  uint32_t phase;
+  int16_t prev[2];
+
+  int16_t decoded[INGEST_BLOCK_FRAMES * 2];
+  int16_t resampled[INGEST_BLOCK_FRAMES * 2];
+
+  bool fail(const char* text);
+  bool gather(const uint8_t*& data, size_t& len);
+  bool parseField(uint32_t streamLeft);
+  bool startData();
+  bool consumeData(const uint8_t* data, size_t len);
+  bool pushFrames(const uint8_t* raw, uint32_t frames);
+  bool emit(const int16_t* frames, uint32_t count);
+};
+
+#endif // SAMPLEINGEST_H
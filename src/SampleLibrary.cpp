@@ -0,0 +1,383 @@
+/*
+ * SampleLibrary.cpp
+ * Índex persistent de samples
+ */
+
+#include "SampleLibrary.h"
+
+// Mateix ordre que sampleCounts a la web
+static const char* FAMILIES[LIBRARY_FAMILIES] = {
+  "BD", "SD", "CH", "OH", "CP", "CB", "RS", "CL",
+  "MA", "CY", "HT", "LT", "MC", "MT", "HC", "LC"
+};
+
+static size_t readFile(void* context, uint8_t* dst, size_t bytes) {
+  return ((fs::File*)context)->read(dst, bytes);
+}
+
+static bool isSampleName(const char* name, LibraryFormat& format) {
+  String lower = String(name);
+  lower.toLowerCase();
+  if (lower.endsWith(".wav")) {
+    format = LIBRARY_WAV;
+    return true;
+  }
+  if (lower.endsWith(".raw")) {
+    format = LIBRARY_RAW;
+    return true;
+  }
+  return false;
+}
+
+// LittleFS may return the name with its folder
+static const char* baseName(const char* path) {
+  const char* slash = strrchr(path, '/');
+  return slash ? slash + 1 : path;
+}
+
+SampleLibrary::SampleLibrary() : entries(nullptr), count(0), revision(0), lock(nullptr) {
+}
+
+SampleLibrary::~SampleLibrary() {
+  if (entries) free(entries);
+}
+
+bool SampleLibrary::begin() {
+  lock = xSemaphoreCreateMutex();
+  entries = (LibraryEntry*)ps_malloc(LIBRARY_MAX_ENTRIES * sizeof(LibraryEntry));
+  if (entries == nullptr) {
+    Serial.println("[Library] ERROR: index allocation failed");
+    return false;
+  }
+
+  uint32_t start = millis();
+  if (loadIndex()) {
+    Serial.printf("[Library] %d samples from %s in %d ms\n", count, LIBRARY_INDEX_PATH, millis() - start);
+    return true;
+  }
+
+  Serial.println("[Library] No valid index, scanning folders...");
+  return rebuild() >= 0;
+}
+
+const char* SampleLibrary::familyName(int family) {
+  return (family >= 0 && family < LIBRARY_FAMILIES) ? FAMILIES[family] : "";
+}
+
+int SampleLibrary::familyIndex(const char* name) {
+  if (name == nullptr) return -1;
+  for (int i = 0; i < LIBRARY_FAMILIES; i++) {
+    if (strcmp(FAMILIES[i], name) == 0) return i;
+  }
+  return -1;
+}
+
+bool SampleLibrary::readWavLayout(fs::File& file, WavFormat& format, uint32_t& dataOffset, uint32_t& dataBytes) {
+  file.seek(0);
+  uint8_t riff[12];
+  if (file.read(riff, 12) != 12) return false;
+  if (memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) return false;
+
+  bool foundFmt = false;
+  while (file.available() >= 8) {
+    char chunkId[4];
+    uint32_t chunkSize;
+    if (file.read((uint8_t*)chunkId, 4) != 4) break;
+    if (file.read((uint8_t*)&chunkSize, 4) != 4) break;
+
+    if (memcmp(chunkId, "fmt ", 4) == 0) {
+      uint8_t fmt[WAV_FMT_MAX_BYTES];
+      uint32_t fmtBytes = chunkSize < sizeof(fmt) ? chunkSize : sizeof(fmt);
+      uint32_t next = file.position() + chunkSize + (chunkSize & 1);
+      if (file.read(fmt, fmtBytes) != fmtBytes || !WavDecoder::parseFmt(fmt, fmtBytes, format)) return false;
+      foundFmt = true;
+      file.seek(next);
+    } else if (memcmp(chunkId, "data", 4) == 0) {
+      if (!foundFmt) return false;
+      dataOffset = file.position();
+      dataBytes = chunkSize;
+      if (dataBytes > file.size() - dataOffset) dataBytes = file.size() - dataOffset;
+      return true;
+    } else {
+      file.seek(file.position() + chunkSize + (chunkSize & 1));
+    }
+  }
+  return false;
+}
+
+// Header, then one pass over the PCM for the peak
+bool SampleLibrary::analyze(fs::File& file, int family, const char* filename, LibraryEntry& out,
+                            int16_t* samples, uint8_t* scratch) {
+  LibraryFormat kind;
+  if (!isSampleName(filename, kind) || strlen(filename) >= LIBRARY_NAME_LEN) return false;
+
+  memset(&out, 0, sizeof(out));
+  strncpy(out.name, filename, LIBRARY_NAME_LEN - 1);
+  out.size = file.size();
+  out.mtime = (uint32_t)file.getLastWrite();
+  out.family = family;
+  out.format = kind;
+
+  WavFormat format = {WAV_PCM16, 1, 2, 44100};
+  uint32_t dataBytes = out.size & ~1u;
+  if (kind == LIBRARY_WAV) {
+    uint32_t dataOffset = 0;
+    if (!readWavLayout(file, format, dataOffset, dataBytes)) return false;
+  } else {
+    file.seek(0);
+  }
+  out.rate = format.sampleRate;
+  out.channels = format.channels;
+  out.bits = format.bytesPerSample * 8;
+  out.frames = dataBytes / WavDecoder::frameBytes(format);
+
+  // Both channels count for the peak: decode interleaved
+  uint32_t framesPerRead = LIBRARY_SCAN_SAMPLES / format.channels;
+  size_t scratchBytes = framesPerRead * WavDecoder::frameBytes(format);
+  uint32_t remaining = out.frames;
+  int32_t peak = 0;
+  while (remaining > 0) {
+    uint32_t want = remaining < framesPerRead ? remaining : framesPerRead;
+    uint32_t got = WavDecoder::decode(format, readFile, &file, want, samples, scratch, scratchBytes, true);
+    for (uint32_t i = 0; i < got * format.channels; i++) {
+      int32_t v = samples[i] < 0 ? -(int32_t)samples[i] : samples[i];
+      if (v > peak) peak = v;
+    }
+    remaining -= got;
+    if (got < want) break;
+    yield();
+  }
+  out.peak = peak > 32767 ? 32767 : peak;
+  return true;
+}
+
+int SampleLibrary::rebuild() {
+  if (entries == nullptr) return -1;
+  int16_t* samples = (int16_t*)malloc(LIBRARY_SCAN_SAMPLES * sizeof(int16_t));
+  uint8_t* scratch = (uint8_t*)malloc(LIBRARY_SCAN_SAMPLES * 4);  // 32-bit mono / 16-bit stereo
+  if (samples == nullptr || scratch == nullptr) {
+    free(samples);
+    free(scratch);
+    Serial.println("[Library] ERROR: scan buffers");
+    return -1;
+  }
+
+  uint32_t start = millis();
+  xSemaphoreTake(lock, portMAX_DELAY);
+  count = 0;
+  int skipped = 0;
+  for (int family = 0; family < LIBRARY_FAMILIES; family++) {
+    String path = String("/") + FAMILIES[family];
+    File dir = LittleFS.open(path);
+    if (!dir || !dir.isDirectory()) continue;
+
+    File file = dir.openNextFile();
+    while (file) {
+      if (!file.isDirectory()) {
+        LibraryEntry entry;
+        const char* name = baseName(file.name());
+        if (count >= LIBRARY_MAX_ENTRIES) {
+          skipped++;
+        } else if (analyze(file, family, name, entry, samples, scratch)) {
+          insert(entry);
+        } else {
+          LibraryFormat kind;
+          if (isSampleName(name, kind)) {
+            Serial.printf("[Library] Skipping %s/%s (unsupported or name too long)\n", FAMILIES[family], name);
+          }
+        }
+      }
+      file.close();
+      file = dir.openNextFile();
+    }
+    dir.close();
+    yield();
+  }
+  revision++;
+  int indexed = count;
+  xSemaphoreGive(lock);
+
+  free(samples);
+  free(scratch);
+  if (skipped > 0) {
+    Serial.printf("[Library] WARN: %d samples over the %d entry limit\n", skipped, LIBRARY_MAX_ENTRIES);
+  }
+  Serial.printf("[Library] Indexed %d samples in %d ms\n", indexed, millis() - start);
+  saveIndex();
+  return indexed;
+}
+
+bool SampleLibrary::loadIndex() {
+  File file = LittleFS.open(LIBRARY_INDEX_PATH, "r");
+  if (!file) return false;
+
+  LibraryIndexHeader header;
+  bool ok = file.read((uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+            memcmp(header.magic, LIBRARY_MAGIC, 8) == 0 && header.version == LIBRARY_VERSION &&
+            header.entrySize == sizeof(LibraryEntry) && header.count <= LIBRARY_MAX_ENTRIES;
+  if (ok) {
+    size_t bytes = header.count * sizeof(LibraryEntry);
+    ok = file.read((uint8_t*)entries, bytes) == bytes;
+  }
+  file.close();
+  if (!ok) return false;
+
+  // The file was written sorted; reject anything else rather than serve it
+  for (uint32_t i = 0; i < header.count; i++) {
+    const LibraryEntry& e = entries[i];
+    if (e.family >= LIBRARY_FAMILIES || e.name[LIBRARY_NAME_LEN - 1] != '\0' || e.channels < 1 || e.channels > 2) return false;
+    if (i > 0 && (entries[i - 1].family > e.family ||
+                  (entries[i - 1].family == e.family && strcmp(entries[i - 1].name, e.name) >= 0))) return false;
+  }
+  count = header.count;
+  revision++;
+  return true;
+}
+
+// Written aside and renamed: a reset mid-write leaves the old index
+bool SampleLibrary::saveIndex() {
+  xSemaphoreTake(lock, portMAX_DELAY);
+  LibraryIndexHeader header;
+  memcpy(header.magic, LIBRARY_MAGIC, 8);
+  header.version = LIBRARY_VERSION;
+  header.entrySize = sizeof(LibraryEntry);
+  header.count = count;
+
+  bool ok = false;
+  File file = LittleFS.open(LIBRARY_INDEX_TMP, "w");
+  if (file) {
+    size_t bytes = count * sizeof(LibraryEntry);
+    ok = file.write((const uint8_t*)&header, sizeof(header)) == sizeof(header) &&
+         file.write((const uint8_t*)entries, bytes) == bytes;
+    file.close();
+  }
+  xSemaphoreGive(lock);
+
+  if (ok) {
+    LittleFS.remove(LIBRARY_INDEX_PATH);
+    ok = LittleFS.rename(LIBRARY_INDEX_TMP, LIBRARY_INDEX_PATH);
+  }
+  if (!ok) Serial.println("[Library] ERROR: could not write the index");
+  return ok;
+}
+
+// First entry not below (family, filename)
+int SampleLibrary::lowerBound(int family, const char* filename) {
+  int lo = 0, hi = count;
+  while (lo < hi) {
+    int mid = (lo + hi) / 2;
+    const LibraryEntry& e = entries[mid];
+    if (e.family < family || (e.family == family && strcmp(e.name, filename) < 0)) lo = mid + 1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+int SampleLibrary::find(int family, const char* filename) {
+  int i = lowerBound(family, filename);
+  return (i < count && entries[i].family == family && strcmp(entries[i].name, filename) == 0) ? i : -1;
+}
+
+// Caller holds the lock and has checked the capacity
+void SampleLibrary::insert(const LibraryEntry& entry) {
+  int i = lowerBound(entry.family, entry.name);
+  if (i < count && entries[i].family == entry.family && strcmp(entries[i].name, entry.name) == 0) {
+    entries[i] = entry;
+    return;
+  }
+  memmove(&entries[i + 1], &entries[i], (count - i) * sizeof(LibraryEntry));
+  entries[i] = entry;
+  count++;
+}
+
+bool SampleLibrary::addFile(const char* family, const char* filename) {
+  int f = familyIndex(family);
+  if (entries == nullptr || f < 0 || filename == nullptr) return false;
+
+  String path = String("/") + family + "/" + filename;
+  File file = LittleFS.open(path, "r");
+  if (!file) return false;
+
+  int16_t* samples = (int16_t*)malloc(LIBRARY_SCAN_SAMPLES * sizeof(int16_t));
+  uint8_t* scratch = (uint8_t*)malloc(LIBRARY_SCAN_SAMPLES * 4);
+  LibraryEntry entry;
+  bool ok = samples && scratch && analyze(file, f, filename, entry, samples, scratch);
+  file.close();
+  free(samples);
+  free(scratch);
+  if (!ok) {
+    Serial.printf("[Library] Could not index %s\n", path.c_str());
+    return false;
+  }
+  return addEntry(entry);
+}
+
+bool SampleLibrary::addEntry(const LibraryEntry& entry) {
+  if (entries == nullptr || entry.family >= LIBRARY_FAMILIES || entry.name[0] == '\0' ||
+      entry.name[LIBRARY_NAME_LEN - 1] != '\0') return false;
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+  bool ok = count < LIBRARY_MAX_ENTRIES || find(entry.family, entry.name) >= 0;
+  if (ok) {
+    insert(entry);
+    revision++;
+  }
+  xSemaphoreGive(lock);
+  if (!ok) {
+    Serial.printf("[Library] Index full (%d entries)\n", LIBRARY_MAX_ENTRIES);
+    return false;
+  }
+  return saveIndex();
+}
+
+bool SampleLibrary::removeFile(const char* family, const char* filename) {
+  int f = familyIndex(family);
+  if (entries == nullptr || f < 0 || filename == nullptr) return false;
+
+  xSemaphoreTake(lock, portMAX_DELAY);
+  int i = find(f, filename);
+  if (i >= 0) {
+    memmove(&entries[i], &entries[i + 1], (count - i - 1) * sizeof(LibraryEntry));
+    count--;
+    revision++;
+  }
+  xSemaphoreGive(lock);
+  return i >= 0 && saveIndex();
+}
+
+int SampleLibrary::getFamilyCount(int family) {
+  if (entries == nullptr || family < 0 || family >= LIBRARY_FAMILIES) return 0;
+  xSemaphoreTake(lock, portMAX_DELAY);
+  int n = lowerBound(family + 1, "") - lowerBound(family, "");
+  xSemaphoreGive(lock);
+  return n;
+}
+
+int SampleLibrary::getPage(int family, int offset, int limit, LibraryEntry* out) {
+  if (entries == nullptr || family < 0 || family >= LIBRARY_FAMILIES || offset < 0 || limit <= 0) return 0;
+  xSemaphoreTake(lock, portMAX_DELAY);
+  int first = lowerBound(family, "");
+  int end = lowerBound(family + 1, "");
+  if (offset > end - first) offset = end - first;  // first + INT_MAX would overflow
+  int n = 0;
+  for (int i = first + offset; i < end && n < limit; i++) {
+    out[n++] = entries[i];
+  }
+  xSemaphoreGive(lock);
+  return n;
+}
+
+bool SampleLibrary::getFirst(int family, LibraryEntry& out, bool wavOnly) {
+  if (entries == nullptr || family < 0 || family >= LIBRARY_FAMILIES) return false;
+  bool found = false;
+  xSemaphoreTake(lock, portMAX_DELAY);
+  for (int i = lowerBound(family, ""); i < count && entries[i].family == family; i++) {
+    if (!wavOnly || entries[i].format == LIBRARY_WAV) {
+      out = entries[i];
+      found = true;
+      break;
+    }
+  }
+  xSemaphoreGive(lock);
+  return found;
+}
@@ -0,0 +1,100 @@
+/*
+ * SampleLibrary.h
+ * Índex de la biblioteca de samples (carpetes de família a LittleFS)
+ *
+ * Es construeix un cop (o quan falta el fitxer d'índex) i després
+ * s'actualitza en pujar o esborrar samples. Les consultes de la web i dels
+ * kits es serveixen des de RAM, sense obrir directoris ni capçaleres WAV
+ */
+
+#ifndef SAMPLELIBRARY_H
+#define SAMPLELIBRARY_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <FS.h>
+#include "WavDecoder.h"
+
+#define LIBRARY_INDEX_PATH "/library.idx"
+#define LIBRARY_INDEX_TMP "/library.tmp"
+#define LIBRARY_MAGIC "R808LIB1"
+#define LIBRARY_VERSION 1
+#define LIBRARY_FAMILIES 16
+#define LIBRARY_MAX_ENTRIES 512       // 72 bytes each, in PSRAM
+#define LIBRARY_NAME_LEN 48
+#define LIBRARY_PAGE_DEFAULT 16
+#define LIBRARY_PAGE_MAX 32
+#define LIBRARY_SCAN_SAMPLES 1024     // Peak scan: int16 per read
+
+enum LibraryFormat : uint8_t {
+  LIBRARY_RAW = 0,
+  LIBRARY_WAV = 1
+};
+
+// One sample file (stored as-is in the index file)
+struct LibraryEntry {
+  char name[LIBRARY_NAME_LEN];  // File name, no folder
+  uint32_t size;                // File bytes
+  uint32_t rate;
+  uint32_t frames;
+  uint32_t mtime;               // getLastWrite at indexing
+  uint16_t peak;                // Highest |sample| (0..32767)
+  uint8_t family;               // Index in SampleLibrary::familyName
+  uint8_t channels;
+  uint8_t bits;
+  uint8_t format;               // LibraryFormat
+  uint8_t reserved[2];
+};
+
+struct LibraryIndexHeader {
+  char magic[8];
+  uint16_t version;
+  uint16_t entrySize;
+  uint32_t count;
+};
+
+class SampleLibrary {
+public:
+  SampleLibrary();
+  ~SampleLibrary();
+
+  bool begin();                    // Loads the index, rebuilds it if missing or invalid
+  int rebuild();                   // Full scan of the family folders (slow), then saved
+
+  // Incremental updates (upload / delete); the index file is rewritten
+  bool addFile(const char* family, const char* filename);
+  bool addEntry(const LibraryEntry& entry);   // Already analysed (SampleUpload)
+  bool removeFile(const char* family, const char* filename);
+
+  // Served from RAM
+  int getCount() { return count; }
+  int getFamilyCount(int family);
+  int getPage(int family, int offset, int limit, LibraryEntry* out);  // Entries copied, sorted by name
+  bool getFirst(int family, LibraryEntry& out, bool wavOnly = false);
+  uint32_t getRevision() { return revision; }  // Bumped on every change
+
+  static const char* familyName(int family);
+  static int familyIndex(const char* name);  // -1 = unknown
+  static uint32_t durationMs(const LibraryEntry& entry) {
+    return entry.rate ? (uint32_t)((uint64_t)entry.frames * 1000 / entry.rate) : 0;
+  }
+
+  // WAV "fmt " and "data" chunks (others skipped); file left at the start of the data
+  static bool readWavLayout(fs::File& file, WavFormat& format, uint32_t& dataOffset, uint32_t& dataBytes);
+
+private:
+  LibraryEntry* entries;           // Sorted by (family, name)
+  int count;
+  uint32_t revision;
+  SemaphoreHandle_t lock;          // Boot / web task / kit scan
+
+  bool loadIndex();
+  bool saveIndex();
+  bool analyze(fs::File& file, int family, const char* filename, LibraryEntry& out,
+               int16_t* samples, uint8_t* scratch);
+  int find(int family, const char* filename);
+  int lowerBound(int family, const char* filename);
+  void insert(const LibraryEntry& entry);
+};
+
+#endif // SAMPLELIBRARY_H
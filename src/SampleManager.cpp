@@ -4,14 +4,36 @@
  */
 
 #include "SampleManager.h"
+#include "SampleStreamer.h"
 
 extern AudioEngine audioEngine;
+extern SampleStreamer sampleStreamer;
 
-SampleManager::SampleManager() {
-  for (int i = 0; i < MAX_SAMPLES; i++) {
+// .raw: 16-bit mono sense capçalera
+static const WavFormat RAW_FORMAT = {WAV_PCM16, 1, 2, SAMPLE_RATE};
+
+static size_t readFile(void* context, uint8_t* dst, size_t bytes) {
+  return ((fs::File*)context)->read(dst, bytes);
+}
+
+SampleManager::SampleManager() : headCacheMs(HEAD_CACHE_DEFAULT_MS), defaultFormat(SAMPLE_PCM16),
+                                 wavChunkBytes(WAV_CHUNK_DEFAULT_BYTES), arenaFailures(0), arenaPeak(0), loadingSlot(-1), ingestSlot(-1),
+                                 ingestHandle(ARENA_INVALID_HANDLE), ingestFrames(0), ingestChannels(1), lock(nullptr) {
+  for (int i = 0; i < SAMPLE_SLOTS; i++) {
     sampleBuffers[i] = nullptr;
+    sampleHandles[i] = ARENA_INVALID_HANDLE;
     sampleLengths[i] = 0;
+    residentLengths[i] = 0;
+    sampleChannels[i] = 1;
     memset(sampleNames[i], 0, 32);
+    headBuffers[i] = nullptr;
+    headLengths[i] = 0;
+    memset(&codecReports[i], 0, sizeof(CodecReport));
+    streamPaths[i][0] = '\0';
+    streamOffsets[i] = 0;
+    streamFormats[i] = RAW_FORMAT;
+    cacheIndex[i] = -1;
+    mappedSlots[i] = false;
   }
 }
 
@@ -26,18 +48,51 @@ bool SampleManager::begin() {
   }
   
   Serial.printf("PSRAM available: %d bytes\n", ESP.getFreePsram());
+  
+  lock = xSemaphoreCreateRecursiveMutex();
+  
+  // Una sola regió per a tots els samples: els forats es reaprofiten i es compacten
+  size_t arenaBytes = ESP.getMaxAllocPsram();
+  arenaBytes = arenaBytes > SAMPLE_ARENA_RESERVE ? arenaBytes - SAMPLE_ARENA_RESERVE : 0;
+  void* region = arenaBytes > 0 ? ps_malloc(arenaBytes) : nullptr;
+  if (region == nullptr || !arena.begin(region, arenaBytes)) {
+    Serial.printf("ERROR: Sample arena allocation failed (%d bytes)\n", arenaBytes);
+    return false;
+  }
+  
+  Serial.printf("Sample arena: %d bytes (%.1fMB), %d left outside\n",
+                arena.capacity(), arena.capacity() / (1024.0 * 1024.0), ESP.getFreePsram());
   return true;
 }
 
 bool SampleManager::loadSample(const char* filename, int padIndex) {
+  return loadSample(filename, padIndex, defaultFormat);
+}
+
+bool SampleManager::loadSample(const char* filename, int padIndex, SampleFormat format) {
   if (padIndex < 0 || padIndex >= MAX_SAMPLES) {
     Serial.println("Invalid pad index");
     return false;
   }
-  
-  // Unload existing sample if any
-  if (sampleBuffers[padIndex] != nullptr) {
-    unloadSample(padIndex);
+  return loadSampleToBank(filename, audioEngine.getActiveBank(), padIndex, format);
+}
+
+bool SampleManager::loadSampleToBank(const char* filename, int bank, int padIndex, SampleFormat format) {
+  if (bank < 0 || bank >= PAD_BANKS || padIndex < 0 || padIndex >= MAX_SAMPLES) {
+    Serial.println("Invalid pad index");
+    return false;
+  }
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  bool ok = loadSlot(filename, bank * MAX_SAMPLES + padIndex, format);
+  if (lock) xSemaphoreGiveRecursive(lock);
+  return ok;
+}
+
+bool SampleManager::loadSlot(const char* filename, int slot, SampleFormat format) {
+  // Unload existing sample if any (it stays in the cache)
+  if (sampleBuffers[slot] != nullptr) {
+    retireSlots(1 << slot);
+    freeSampleBuffer(slot);
   }
   
   // Open file
@@ -47,6 +102,116 @@ bool SampleManager::loadSample(const char* filename, int padIndex) {
     return false;
   }
   
+  // Same file, same contents, same format: reuse the copy in PSRAM
+  uint32_t mtime = (uint32_t)file.getLastWrite();
+  uint32_t fileSize = file.size();
+  int cached = cache.find(filename, mtime, fileSize, format);
+  if (cached >= 0) {
+    file.close();
+    attachCached(slot, cached);
+    Serial.printf("[SampleManager] Cache hit: %s (sin I/O)\n", filename);
+  } else {
+    loadingSlot = slot;
+    bool success = readSample(file, slot, filename, format);
+    file.close();
+    loadingSlot = -1;
+    if (!success) {
+      if (bankOf(slot) == audioEngine.getActiveBank()) sampleStreamer.unregisterPad(padOf(slot));
+      streamPaths[slot][0] = '\0';
+      sampleLengths[slot] = 0;
+      residentLengths[slot] = 0;
+      trimCache();
+      Serial.printf("❌ FAILED to load: %s\n", filename);
+      return false; 
+    }
+    cacheSlot(slot, filename, mtime, fileSize, format);
+  }
+  
+  // Store sample name
+  const char* name = strrchr(filename, '/');
+  if (name) name++; // Skip '/'
+  else name = filename;
+  finishLoad(slot, name);
+  
+  Serial.printf("[SampleManager] ✓ Sample loaded: %s (%d samples) -> Pad %d (bank %d)\n", 
+                sampleNames[slot], sampleLengths[slot], padOf(slot), bankOf(slot));
+  Serial.printf("[SampleManager]   Buffer address: %p, Arena free: %d bytes (largest %d)\n",
+                sampleBuffers[slot], arena.freeBytes(), arena.largestFree());
+  
+  return true;
+}
+
+// The old sample stops now: the buffer is reserved before the first PCM arrives
+bool SampleManager::beginIngest(int padIndex, uint32_t frames, uint8_t channels) {
+  if (padIndex < 0 || padIndex >= MAX_SAMPLES || frames == 0 || channels < 1 || channels > 2) return false;
+  size_t bytes = (size_t)frames * channels * sizeof(int16_t);
+  if (bytes > MAX_SAMPLE_SIZE) return false;
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  if (ingestSlot >= 0) abortIngest();
+  // The old sample stays in the slot (and playing) until finishIngest
+  ArenaHandle handle = allocateArena(bytes);
+  bool ok = handle != ARENA_INVALID_HANDLE;
+  if (ok) {
+    ingestSlot = activeSlot(padIndex);
+    ingestHandle = handle;
+    ingestFrames = frames;
+    ingestChannels = channels;
+  }
+  if (lock) xSemaphoreGiveRecursive(lock);
+  return ok;
+}
+
+// Under the lock: compaction may move the buffer between two chunks
+bool SampleManager::writeIngest(uint32_t frameOffset, const int16_t* data, uint32_t frames) {
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  bool ok = ingestSlot >= 0 && frameOffset + frames <= ingestFrames;
+  if (ok) {
+    memcpy((int16_t*)arena.ptr(ingestHandle) + frameOffset * ingestChannels, data,
+           frames * ingestChannels * sizeof(int16_t));
+  }
+  if (lock) xSemaphoreGiveRecursive(lock);
+  return ok;
+}
+
+bool SampleManager::finishIngest(const char* name, SampleFormat format) {
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  int slot = ingestSlot;
+  if (slot >= 0) {
+    ingestSlot = -1;
+    if (sampleBuffers[slot] != nullptr) {
+      retireSlots(1 << slot);
+      freeSampleBuffer(slot);
+    }
+    sampleHandles[slot] = ingestHandle;
+    sampleBuffers[slot] = (int16_t*)arena.ptr(ingestHandle);
+    sampleLengths[slot] = ingestFrames;
+    residentLengths[slot] = ingestFrames;
+    sampleChannels[slot] = ingestChannels;
+    ingestHandle = ARENA_INVALID_HANDLE;
+    loadingSlot = slot;  // applyFormat may compact: not published half-compressed
+    applyFormat(slot, format);
+    loadingSlot = -1;
+    finishLoad(slot, name);
+    Serial.printf("[SampleManager] ✓ Sample ingested: %s (%d frames, %d ch) -> Pad %d\n",
+                  sampleNames[slot], sampleLengths[slot], sampleChannels[slot], padOf(slot));
+  }
+  if (lock) xSemaphoreGiveRecursive(lock);
+  return slot >= 0;
+}
+
+// Never published: no voice can be reading it, and the pad still has its old sample
+void SampleManager::abortIngest() {
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  if (ingestSlot >= 0) {
+    arena.release(ingestHandle);
+    ingestHandle = ARENA_INVALID_HANDLE;
+    ingestSlot = -1;
+  }
+  if (lock) xSemaphoreGiveRecursive(lock);
+}
+
+// File -> arena (RAW or WAV), then compress if requested
+bool SampleManager::readSample(fs::File& file, int slot, const char* filename, SampleFormat format) {
   bool success = false;
   String fname = String(filename);
 
@@ -57,50 +222,209 @@ bool SampleManager::loadSample(const char* filename, int padIndex) {
     Serial.printf("[SampleManager] Reading RAW file %s (%d bytes)...\n", filename, fileSize);
     
     uint32_t numSamples = fileSize / 2; // 16-bit = 2 bytes per sample
+    uint32_t resident = planResident(slot, filename, 0, RAW_FORMAT, numSamples);
     
-    if (allocateSampleBuffer(padIndex, numSamples)) {
-      size_t bytesRead = file.read((uint8_t*)sampleBuffers[padIndex], fileSize);
-      if (bytesRead == fileSize) {
-        sampleLengths[padIndex] = numSamples;
+    if (resident > 0 && allocateSampleBuffer(slot, resident)) {
+      size_t bytesRead = file.read((uint8_t*)sampleBuffers[slot], resident * 2);
+      if (bytesRead == resident * 2) {
+        sampleLengths[slot] = numSamples;
+        residentLengths[slot] = resident;
         success = true;
       } else {
         Serial.println("Failed to read RAW data");
-        freeSampleBuffer(padIndex);
+        freeSampleBuffer(slot);
       }
     }
   } else {
     // --- LOAD WAV (With Header Parsing) ---
     // Parse WAV file
-    success = parseWavFile(file, padIndex);
+    success = parseWavFile(file, slot, filename, format);
   }
   
-  file.close();
+  if (!success) return false;
+  applyFormat(slot, format);
+  return true;
+}
+
+// Record the PCM size, then compress if requested (on failure keep PCM)
+void SampleManager::applyFormat(int slot, SampleFormat format) {
+  codecReports[slot].format = SAMPLE_PCM16;
+  codecReports[slot].pcmBytes = residentLengths[slot] * sampleChannels[slot] * sizeof(int16_t);
+  codecReports[slot].storedBytes = codecReports[slot].pcmBytes;
+  codecReports[slot].snrDb = 0.0f;
+  codecReports[slot].decodeCyclesPerFrame = 0.0f;
+  if (format != SAMPLE_PCM16 && residentLengths[slot] < sampleLengths[slot]) {
+    Serial.printf("[SampleManager] Pad %d streams from flash, stored as PCM\n", padOf(slot));
+  } else if (format != SAMPLE_PCM16 && !compressSample(slot, format)) {
+    Serial.printf("[SampleManager] Compression to %s failed, pad %d stays PCM\n",
+                  SampleCodec::formatName(format), padOf(slot));
+  }
+}
+
+// Register with audio engine (body in PSRAM, attack copy in SRAM)
+void SampleManager::finishLoad(int slot, const char* name) {
+  strncpy(sampleNames[slot], name, 31);
+  publishPad(slot);
+  allocateHead(slot);
+  trimCache();
+}
+
+// ============= PACKED SAMPLE BANK =============
+
+// Boot pads from a pack_samples.py file: one read for the index, one per payload,
+// straight into the arena. Returns the pads loaded (-1 = no valid bank)
+int SampleManager::loadSampleBank(const char* path) {
+  fs::File file = LittleFS.open(path, "r");
+  if (!file) return -1;
   
-  if (!success) {
-    Serial.printf("❌ FAILED to load: %s\n", filename);
-    return false; 
+  uint32_t start = millis();
+  SampleBankHeader header;
+  size_t fileSize = file.size();
+  if (file.read((uint8_t*)&header, sizeof(header)) != sizeof(header) || !sampleBankValid(header, fileSize)) {
+    Serial.printf("[SampleBank] %s: invalid header, ignored\n", path);
+    file.close();
+    return -1;
   }
   
-  // Store sample name
-  const char* name = strrchr(filename, '/');
-  if (name) name++; // Skip '/'
-  else name = filename;
-  strncpy(sampleNames[padIndex], name, 31);
+  size_t indexBytes = header.count * sizeof(SampleBankEntry);
+  SampleBankEntry* index = (SampleBankEntry*)ps_malloc(indexBytes > 0 ? indexBytes : 1);
+  if (index == nullptr || file.read((uint8_t*)index, indexBytes) != indexBytes) {
+    Serial.printf("[SampleBank] %s: failed to read index (%d entries)\n", path, header.count);
+    free(index);
+    file.close();
+    return -1;
+  }
+  
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  uint32_t mtime = (uint32_t)file.getLastWrite();
+  size_t bytesRead = 0;
+  int loaded = 0;
+  
+  for (int i = 0; i < header.count; i++) {
+    const SampleBankEntry& entry = index[i];
+    if (entry.pad >= MAX_SAMPLES) continue;
+    if (!sampleBankEntryValid(entry, header)) {
+      Serial.printf("[SampleBank] Entry %d (%.32s) out of bounds, skipped\n", i, entry.name);
+      continue;
+    }
+    
+    int slot = activeSlot(entry.pad);
+    if (sampleBuffers[slot] != nullptr) {
+      retireSlots(1 << slot);
+      freeSampleBuffer(slot);
+    }
+    
+    // Cache key: the bank path plus the entry (same bank file = same contents)
+    char key[64];
+    snprintf(key, sizeof(key), "%s#%d", path, i);
+    int cached = cache.find(key, mtime, entry.length, defaultFormat);
+    if (cached >= 0) {
+      attachCached(slot, cached);
+    } else {
+      // Bank entries are always resident; bigger samples go as WAV (streaming)
+      if ((size_t)entry.length * sizeof(int16_t) > STREAM_THRESHOLD_BYTES) {
+        Serial.printf("[SampleBank] %.32s too large for the bank, load it as WAV\n", entry.name);
+        continue;
+      }
+      // Like loadSlot: a compaction in the allocations must not publish the half-built pad
+      loadingSlot = slot;
+      bool success = allocateSampleBuffer(slot, entry.length);
+      if (success) {
+        file.seek(entry.offset);
+        size_t bytes = entry.length * sizeof(int16_t);
+        if (file.read((uint8_t*)sampleBuffers[slot], bytes) != bytes) {
+          Serial.printf("[SampleBank] Short read on %.32s\n", entry.name);
+          freeSampleBuffer(slot);
+          success = false;
+        } else {
+          bytesRead += bytes;
+          sampleLengths[slot] = entry.length;
+          residentLengths[slot] = entry.length;
+          applyFormat(slot, defaultFormat);
+        }
+      }
+      loadingSlot = -1;
+      if (!success) continue;
+      cacheSlot(slot, key, mtime, entry.length, defaultFormat);
+    }
+    
+    char name[33];
+    memcpy(name, entry.name, 32);
+    name[32] = '\0';
+    finishLoad(slot, name);
+    loaded++;
+  }
+  if (lock) xSemaphoreGiveRecursive(lock);
   
-  // Register with audio engine
-  audioEngine.setSampleBuffer(padIndex, sampleBuffers[padIndex], sampleLengths[padIndex]);
+  free(index);
+  file.close();
   
-  Serial.printf("[SampleManager] ✓ Sample loaded: %s (%d samples) -> Pad %d\n", 
-                sampleNames[padIndex], sampleLengths[padIndex], padIndex);
-  Serial.printf("[SampleManager]   Buffer address: %p, Free PSRAM: %d bytes\n",
-                sampleBuffers[padIndex], ESP.getFreePsram());
+  uint32_t elapsed = millis() - start;
+  Serial.printf("[SampleBank] %s: %d pads, %d bytes in %d ms (%.1f KB/s)\n", path, loaded, bytesRead, elapsed,
+                elapsed > 0 ? bytesRead / 1.024f / elapsed : 0.0f);
+  return loaded;
+}
+
+// Boot pads straight from the `samples` partition (Linux: a bank file). Voices read
+// the PCM through the flash cache; PSRAM stays for uploaded and edited samples.
+// Returns the pads mapped (-1 = no valid bank)
+int SampleManager::mapSampleBank(const char* source) {
+  uint32_t start = millis();
+#ifdef ESP_PLATFORM
+  bool open = flashBank.isOpen() || flashBank.openPartition(source);
+#else
+  bool open = flashBank.isOpen() || flashBank.openFile(source);
+#endif
+  if (!open) return -1;
   
-  return true;
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  int mapped = 0;
+  for (int i = 0; i < flashBank.count(); i++) {
+    const SampleBankEntry* entry = flashBank.entry(i);
+    if (entry == nullptr || entry->pad >= MAX_SAMPLES) continue;
+    
+    int slot = activeSlot(entry->pad);
+    if (sampleBuffers[slot] != nullptr) {
+      retireSlots(1 << slot);
+      freeSampleBuffer(slot);
+    }
+    attachMapped(slot, i);
+    
+    char name[33];
+    memcpy(name, entry->name, 32);
+    name[32] = '\0';
+    finishLoad(slot, name);
+    mapped++;
+  }
+  if (lock) xSemaphoreGiveRecursive(lock);
+  
+  if (defaultFormat != SAMPLE_PCM16) {
+    Serial.println("[SampleMap] Mapped samples play as PCM (no compression in flash)");
+  }
+  Serial.printf("[SampleMap] %s: %d pads mapped, %d KB in flash, 0 bytes PSRAM, %d ms\n",
+                source, mapped, flashBank.mappedBytes() / 1024, millis() - start);
+  return mapped;
 }
 
-bool SampleManager::parseWavFile(fs::File& file, int padIndex) {
-  WavHeader header;
+// The slot plays the entry in place: no handle, no cache entry, no stream
+void SampleManager::attachMapped(int slot, int entryIndex) {
+  const SampleBankEntry* entry = flashBank.entry(entryIndex);
+  mappedSlots[slot] = true;
+  cacheIndex[slot] = -1;
+  sampleHandles[slot] = ARENA_INVALID_HANDLE;
+  sampleBuffers[slot] = (int16_t*)flashBank.samples(entryIndex);
+  sampleLengths[slot] = entry->length;
+  residentLengths[slot] = entry->length;
+  sampleChannels[slot] = 1;  // The packer mixes stereo down
+  streamPaths[slot][0] = '\0';
   
+  memset(&codecReports[slot], 0, sizeof(CodecReport));
+  codecReports[slot].format = SAMPLE_PCM16;
+  codecReports[slot].pcmBytes = entry->length * sizeof(int16_t);
+  codecReports[slot].storedBytes = codecReports[slot].pcmBytes;
+}
+
+bool SampleManager::parseWavFile(fs::File& file, int slot, const char* filename, SampleFormat storage) {
   size_t fileSize = file.size();
   Serial.printf("[SampleManager] Leyendo %s (Flash Size: %d bytes)...\n", file.name(), (int)fileSize);
 
@@ -111,34 +435,21 @@ bool SampleManager::parseWavFile(fs::File& file, int padIndex) {
 
   // Asegurarnos de estar al principio del archivo
   file.seek(0);
-  size_t readSize = file.read((uint8_t*)&header, 44);
-
-  if (readSize != 44) {
-    Serial.printf("❌ Fallo leyendo header: leídos %d de 44\n", (int)readSize);
+  uint8_t riff[12];
+  if (file.read(riff, 12) != 12) {
+    Serial.println("❌ Fallo leyendo header RIFF");
     return false;
   }
   
   // Verify RIFF/WAVE (algunos archivos pueden tener "RIFFX")
-  if (memcmp(header.riff, "RIFF", 4) != 0 || memcmp(header.wave, "WAVE", 4) != 0) {
-    Serial.printf("❌ No es un WAV válido (Header: %.4s %.4s)\n", header.riff, header.wave);
+  if (memcmp(riff, "RIFF", 4) != 0 || memcmp(riff + 8, "WAVE", 4) != 0) {
+    Serial.printf("❌ No es un WAV válido (Header: %.4s %.4s)\n", riff, riff + 8);
     return false;
   }
   
-  // Check format
-  if (header.audioFormat != 1) {
-    Serial.println("Only PCM WAV files supported");
-    return false;
-  }
-  
-  // Check bits per sample
-  if (header.bitsPerSample != 16) {
-    Serial.println("Only 16-bit WAV files supported");
-    return false;
-  }
-  
-  // ===== BUSCAR EL CHUNK "data" (puede no estar en posición 44) =====
-  file.seek(36); // Empezar después del header básico RIFF/WAVE/fmt
-  
+  // ===== RECORRER CHUNKS: "fmt " (puede ser extensible, > 16 bytes) y "data" =====
+  WavFormat format;
+  bool foundFmt = false;
   uint32_t actualDataSize = 0;
   bool foundDataChunk = false;
   
@@ -149,67 +460,127 @@ bool SampleManager::parseWavFile(fs::File& file, int padIndex) {
     if (file.read((uint8_t*)chunkId, 4) != 4) break;
     if (file.read((uint8_t*)&chunkSize, 4) != 4) break;
     
-    if (memcmp(chunkId, "data", 4) == 0) {
+    if (memcmp(chunkId, "fmt ", 4) == 0) {
+      uint8_t fmt[WAV_FMT_MAX_BYTES];
+      uint32_t fmtBytes = chunkSize < sizeof(fmt) ? chunkSize : sizeof(fmt);
+      uint32_t next = file.position() + chunkSize + (chunkSize & 1);
+      if (file.read(fmt, fmtBytes) != fmtBytes || !WavDecoder::parseFmt(fmt, fmtBytes, format)) {
+        Serial.println("❌ Formato no soportado (PCM 8/16/24/32 bits o float 32, mono/stereo)");
+        return false;
+      }
+      foundFmt = true;
+      file.seek(next);
+    } else if (memcmp(chunkId, "data", 4) == 0) {
       actualDataSize = chunkSize;
       foundDataChunk = true;
       Serial.printf("✓ Data chunk encontrado en posición %d, tamaño: %d bytes\n", file.position() - 8, chunkSize);
       break;
     } else {
-      // Skip this chunk (puede ser LIST, INFO, etc.)
+      // Skip this chunk (puede ser LIST, INFO, etc.; los impares llevan un byte de relleno)
       Serial.printf("  Saltando chunk '%.4s' (%d bytes)\n", chunkId, chunkSize);
-      file.seek(file.position() + chunkSize);
+      file.seek(file.position() + chunkSize + (chunkSize & 1));
     }
   }
   
-  if (!foundDataChunk) {
-    Serial.println("❌ No se encontró el chunk 'data' en el WAV");
+  if (!foundFmt || !foundDataChunk) {
+    Serial.println("❌ No se encontró el chunk 'fmt ' o 'data' en el WAV");
     return false;
   }
   
-  // Calculate sample length usando el tamaño REAL del data chunk
-  uint32_t numSamples = actualDataSize / (header.bitsPerSample / 8);
+  // Calculate sample length usando el tamaño REAL del data chunk (stereo se mezcla a mono)
+  uint32_t dataOffset = file.position();
+  if (actualDataSize > fileSize - dataOffset) actualDataSize = fileSize - dataOffset;
+  uint32_t numSamples = actualDataSize / WavDecoder::frameBytes(format);
   
-  // If stereo, we'll mix down to mono
-  if (header.numChannels == 2) {
-    numSamples /= 2;
+  Serial.printf("WAV Info: %d Hz, %d channels, %s, %d samples\n",
+                format.sampleRate, format.channels, WavDecoder::encodingName(format.encoding), numSamples);
+  
+  // Too big for PSRAM: only the first part is loaded, the rest streams
+  uint32_t resident = planResident(slot, filename, dataOffset, format, numSamples);
+  if (resident == 0) {
+    return false;
   }
   
-  Serial.printf("WAV Info: %d Hz, %d channels, %d bits, %d samples\n",
-                header.sampleRate, header.numChannels, header.bitsPerSample, numSamples);
+  // Stereo stays interleaved when it fits whole as PCM (streams and codecs are mono)
+  bool stereo = format.channels == 2 && resident == numSamples && storage == SAMPLE_PCM16 &&
+                (size_t)numSamples * 2 * sizeof(int16_t) <= STREAM_THRESHOLD_BYTES;
   
   // Allocate PSRAM buffer
-  if (!allocateSampleBuffer(padIndex, numSamples)) {
+  if (!allocateSampleBuffer(slot, resident * (stereo ? 2 : 1))) {
     return false;
   }
+  sampleChannels[slot] = stereo ? 2 : 1;
   
-  // Read sample data (file está posicionado justo después del header del data chunk)
-  if (header.numChannels == 1) {
-    // Mono - direct read
-    size_t bytesRead = file.read((uint8_t*)sampleBuffers[padIndex], numSamples * 2);
-    if (bytesRead != numSamples * 2) {
-      Serial.println("Failed to read sample data");
-      freeSampleBuffer(padIndex);
+  // Read sample data in chunks through an SRAM scratch buffer (16-bit: one direct read)
+  uint8_t* scratch = nullptr;
+  if (format.encoding != WAV_PCM16 || (format.channels != 1 && !stereo)) {
+    scratch = (uint8_t*)heap_caps_malloc(wavChunkBytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (scratch == nullptr) {
+      Serial.printf("❌ Sin SRAM para el buffer de lectura (%d bytes)\n", wavChunkBytes);
+      freeSampleBuffer(slot);
       return false;
     }
-  } else if (header.numChannels == 2) {
-    // Stereo - mix down to mono
-    int16_t stereoBuffer[2];
-    for (uint32_t i = 0; i < numSamples; i++) {
-      if (file.read((uint8_t*)stereoBuffer, 4) != 4) {
-        Serial.println("Failed to read stereo data");
-        freeSampleBuffer(padIndex);
-        return false;
-      }
-      // Mix: (L + R) / 2
-      sampleBuffers[padIndex][i] = (stereoBuffer[0] / 2) + (stereoBuffer[1] / 2);
-    }
   }
   
-  sampleLengths[padIndex] = numSamples;
+  uint32_t start = micros();
+  uint32_t decoded = WavDecoder::decode(format, readFile, &file, resident, sampleBuffers[slot],
+                                        scratch, wavChunkBytes, stereo);
+  uint32_t elapsed = micros() - start;
+  size_t chunk = scratch ? wavChunkBytes : resident * sampleChannels[slot] * sizeof(int16_t);
+  heap_caps_free(scratch);
+  
+  if (decoded != resident) {
+    Serial.printf("Failed to read sample data (%d of %d samples)\n", decoded, resident);
+    freeSampleBuffer(slot);
+    return false;
+  }
+  
+  size_t bytes = resident * WavDecoder::frameBytes(format);
+  Serial.printf("[SampleManager] Decoded %d KB in %d ms (%.0f KB/s, chunk %d)\n", bytes / 1024, elapsed / 1000,
+                elapsed > 0 ? bytes * 1000000.0f / 1024.0f / elapsed : 0.0f, chunk);
+  
+  sampleLengths[slot] = numSamples;
+  residentLengths[slot] = resident;
   return true;
 }
 
-bool SampleManager::allocateSampleBuffer(int padIndex, uint32_t size) {
+// Samples to keep in PSRAM; above STREAM_THRESHOLD_BYTES the pad streams the rest (0 = can't load)
+uint32_t SampleManager::planResident(int slot, const char* filename, uint32_t dataOffset,
+                                     const WavFormat& format, uint32_t numSamples) {
+  bool active = bankOf(slot) == audioEngine.getActiveBank();
+  if (active) sampleStreamer.unregisterPad(padOf(slot));
+  streamPaths[slot][0] = '\0';
+  if ((size_t)numSamples * sizeof(int16_t) <= STREAM_THRESHOLD_BYTES) {
+    return numSamples;
+  }
+  
+  uint32_t resident = ((uint32_t)SAMPLE_RATE * STREAM_HEAD_MS) / 1000;
+  if (strlen(filename) >= sizeof(streamPaths[slot])) {
+    Serial.printf("❌ Sample demasiado grande y sin streaming: %d samples\n", numSamples);
+    return 0;
+  }
+  strncpy(streamPaths[slot], filename, sizeof(streamPaths[slot]));
+  streamOffsets[slot] = dataOffset;
+  streamFormats[slot] = format;
+  sampleLengths[slot] = numSamples;
+  residentLengths[slot] = resident;
+  
+  // Standby bank: the streamer still serves the kit that is playing, register at the swap
+  if (active && !registerStream(slot)) {
+    streamPaths[slot][0] = '\0';
+    Serial.printf("❌ Sample demasiado grande y sin streaming: %d samples\n", numSamples);
+    return 0;
+  }
+  return resident;
+}
+
+bool SampleManager::registerStream(int slot) {
+  if (streamPaths[slot][0] == '\0') return false;
+  return sampleStreamer.registerPad(padOf(slot), streamPaths[slot], streamOffsets[slot], streamFormats[slot],
+                                    sampleLengths[slot], residentLengths[slot]);
+}
+
+bool SampleManager::allocateSampleBuffer(int slot, uint32_t size) {
   size_t bytes = size * sizeof(int16_t);
   
   if (bytes > MAX_SAMPLE_SIZE) {
@@ -218,95 +589,594 @@ bool SampleManager::allocateSampleBuffer(int padIndex, uint32_t size) {
     return false;
   }
   
-  // Verificar PSRAM disponible
-  size_t freePsram = ESP.getFreePsram();
-  size_t minRequired = bytes + (100 * 1024); // +100KB margen de seguridad
-  
-  if (freePsram < minRequired) {
-    Serial.printf("❌ PSRAM insuficiente: necesita %d bytes, disponible %d bytes\n", 
-                  minRequired, freePsram);
+  // Allocate in the PSRAM sample arena
+  ArenaHandle handle = allocateArena(bytes);
+  if (handle == ARENA_INVALID_HANDLE) {
+    Serial.printf("❌ Arena sin espacio: necesita %d bytes, libre %d bytes\n", bytes, arena.freeBytes());
     return false;
   }
+  sampleHandles[slot] = handle;
+  sampleBuffers[slot] = (int16_t*)arena.ptr(handle);
+  
+  Serial.printf("✅ Alocados %d bytes (%.1fKB) en PSRAM para pad %d (libre: %d bytes)\n", 
+                bytes, bytes / 1024.0, padOf(slot) + 1, arena.freeBytes());
+  return true;
+}
+
+// Arena allocation. Idle cached samples make room first (LRU); if the free
+// space is there but split in holes, compact and retry
+ArenaHandle SampleManager::allocateArena(size_t bytes) {
+  ArenaHandle handle = arena.allocate(bytes);
+  while (handle == ARENA_INVALID_HANDLE && arena.freeBytes() < bytes) {
+    int victim = cache.pickVictim();
+    if (victim < 0) break;
+    evictEntries(&victim, 1);
+    handle = arena.allocate(bytes);
+  }
+  if (handle == ARENA_INVALID_HANDLE && arena.freeBytes() >= bytes && arena.handleCount() > 0) {
+    compactArena();
+    handle = arena.allocate(bytes);
+  }
+  if (handle == ARENA_INVALID_HANDLE) arenaFailures++;
+  if (arena.used() > arenaPeak) arenaPeak = arena.used();
+  return handle;
+}
+
+// Compaction moves sample data: detach every pad from the engine, let the current
+// block finish, move, then publish the new addresses.
+// Kit preload (loading into the standby bank): the playing kit must not notice,
+// so its buffers and every cached one stay put and only the standby bank's own move
+void SampleManager::compactArena() {
+  uint32_t start = millis();
+  const void* buffers[RECLAIM_MAX_BUFFERS];
+  int count = 0;
+  int liveBank = audioEngine.getActiveBank();
+  bool preload = loadingSlot >= 0 && bankOf(loadingSlot) != liveBank;
+  bool pinned[ARENA_MAX_HANDLES] = {};
+  for (int i = 0; i < SAMPLE_SLOTS; i++) {
+    if (sampleBuffers[i] == nullptr || mappedSlots[i]) continue;  // Flash doesn't move
+    if (preload && bankOf(i) == liveBank) {
+      pinned[sampleHandles[i]] = true;
+      continue;
+    }
+    audioEngine.setBankSample(bankOf(i), padOf(i), nullptr, 0);
+    if (cacheIndex[i] < 0) buffers[count++] = sampleBuffers[i];
+  }
+  // Idle cached samples move too: old voices may still be playing them
+  for (int i = 0; i < SAMPLE_CACHE_ENTRIES; i++) {
+    if (!cache.entry(i).used) continue;
+    if (preload) {  // Shared with the standby bank too: it reads the same address
+      pinned[cache.entry(i).handle] = true;
+    } else {
+      buffers[count++] = arena.ptr(cache.entry(i).handle);
+    }
+  }
+  reclaim(buffers, count);
   
-  // Allocate in PSRAM
-  sampleBuffers[padIndex] = (int16_t*)ps_malloc(bytes);
+  size_t moved = arena.compact(preload ? pinned : nullptr);
   
-  if (sampleBuffers[padIndex] == nullptr) {
-    Serial.printf("❌ Fallo al alocar %d bytes en PSRAM (libre: %d bytes)\n", bytes, freePsram);
-    return false;
+  for (int i = 0; i < SAMPLE_SLOTS; i++) {
+    if (sampleHandles[i] == ARENA_INVALID_HANDLE) continue;
+    if (preload && bankOf(i) == liveBank) continue;  // Never detached
+    sampleBuffers[i] = (int16_t*)arena.ptr(sampleHandles[i]);
+    if (i != loadingSlot) publishPad(i);
   }
   
-  Serial.printf("✅ Alocados %d bytes (%.1fKB) en PSRAM para pad %d (libre: %d bytes)\n", 
-                bytes, bytes / 1024.0, padIndex + 1, ESP.getFreePsram());
-  return true;
+  Serial.printf("[SampleManager] Arena compacted%s: %d bytes moved in %d ms, largest free %d bytes\n",
+                preload ? " (kit preload, playing bank pinned)" : "", moved, millis() - start, arena.largestFree());
+}
+
+void SampleManager::publishPad(int slot) {
+  int bank = bankOf(slot);
+  int pad = padOf(slot);
+  audioEngine.setBankSample(bank, pad, sampleBuffers[slot], residentLengths[slot], codecReports[slot].format,
+                            sampleChannels[slot]);
+  if (residentLengths[slot] < sampleLengths[slot]) {
+    audioEngine.setBankStreamLength(bank, pad, sampleLengths[slot]);
+  }
+  if (headBuffers[slot] != nullptr) {
+    audioEngine.setBankHead(bank, pad, headBuffers[slot], headLengths[slot]);
+  }
 }
 
-void SampleManager::freeSampleBuffer(int padIndex) {
-  if (sampleBuffers[padIndex] != nullptr) {
-    free(sampleBuffers[padIndex]);
-    sampleBuffers[padIndex] = nullptr;
-    sampleLengths[padIndex] = 0;
-    memset(sampleNames[padIndex], 0, 32);
+// Caller guarantees no voice reads the pad any more (retireSlots / never published)
+void SampleManager::freeSampleBuffer(int slot) {
+  releaseHead(slot);
+  if (slot == ingestSlot) abortIngest();  // Kit swap / unload under an upload: writes stop
+  if (sampleBuffers[slot] != nullptr) {
+    // Mapped: nothing to free. Cached: the entry goes idle and trimCache() frees it if over budget
+    if (mappedSlots[slot]) {
+      mappedSlots[slot] = false;
+    } else if (cacheIndex[slot] >= 0) {
+      cache.release(cacheIndex[slot]);
+      cacheIndex[slot] = -1;
+    } else {
+      arena.release(sampleHandles[slot]);
+    }
+    sampleHandles[slot] = ARENA_INVALID_HANDLE;
+    sampleBuffers[slot] = nullptr;
+    sampleLengths[slot] = 0;
+    residentLengths[slot] = 0;
+    sampleChannels[slot] = 1;
+    memset(sampleNames[slot], 0, 32);
+    memset(&codecReports[slot], 0, sizeof(CodecReport));
+    streamPaths[slot][0] = '\0';
   }
 }
 
+int SampleManager::activeSlot(int padIndex) {
+  return audioEngine.getActiveBank() * MAX_SAMPLES + padIndex;
+}
+
 bool SampleManager::unloadSample(int padIndex) {
   if (padIndex < 0 || padIndex >= MAX_SAMPLES) return false;
   
-  freeSampleBuffer(padIndex);
-  audioEngine.setSampleBuffer(padIndex, nullptr, 0);
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  int slot = activeSlot(padIndex);
+  retireSlots(1 << slot);
+  freeSampleBuffer(slot);
+  trimCache();
+  if (lock) xSemaphoreGiveRecursive(lock);
   
   Serial.printf("Sample unloaded from pad %d\n", padIndex + 1);
   return true;
 }
 
 void SampleManager::unloadAll() {
-  for (int i = 0; i < MAX_SAMPLES; i++) {
-    if (sampleBuffers[i] != nullptr) {
-      unloadSample(i);
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  uint32_t slotMask = 0;
+  for (int i = 0; i < SAMPLE_SLOTS; i++) {
+    if (sampleBuffers[i] != nullptr) slotMask |= (1 << i);
+  }
+  if (slotMask != 0) {
+    // One wait for all the pads
+    retireSlots(slotMask);
+    for (int i = 0; i < SAMPLE_SLOTS; i++) {
+      if (slotMask & (1 << i)) freeSampleBuffer(i);
+    }
+    trimCache();
+    Serial.printf("All samples unloaded (mask 0x%04X)\n", slotMask);
+  }
+  if (lock) xSemaphoreGiveRecursive(lock);
+}
+
+// ============= KIT BANKS =============
+
+void SampleManager::clearBank(int bank) {
+  if (bank < 0 || bank >= PAD_BANKS) return;
+  
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  uint32_t slotMask = 0;
+  for (int pad = 0; pad < MAX_SAMPLES; pad++) {
+    int slot = bank * MAX_SAMPLES + pad;
+    if (sampleBuffers[slot] != nullptr) slotMask |= (1 << slot);
+  }
+  if (slotMask != 0) {
+    retireSlots(slotMask);
+    for (int i = 0; i < SAMPLE_SLOTS; i++) {
+      if (slotMask & (1 << i)) freeSampleBuffer(i);
     }
+    trimCache();
+    Serial.printf("[SampleManager] Bank %d cleared, arena free %d bytes\n", bank, arena.freeBytes());
   }
+  if (lock) xSemaphoreGiveRecursive(lock);
+}
+
+// Flip the engine to the standby bank. Streamed pads move with it: the old
+// kit's streams stop (its voices are about to be retired), the new ones register.
+// A streamed pad triggered between the flip and its registration plays the resident part
+// Called from the SequencerClock task at a bar: a load or unload holding the lock
+// could take hundreds of ms, so the swap doesn't wait for it and moves to the next bar
+bool SampleManager::swapBank() {
+  if (lock && xSemaphoreTakeRecursive(lock, 0) != pdTRUE) return false;
+  int oldBank = audioEngine.getActiveBank();
+  int newBank = oldBank ^ 1;
+  for (int pad = 0; pad < MAX_SAMPLES; pad++) {
+    sampleStreamer.unregisterPad(pad);
+  }
+  audioEngine.swapBank();
+  for (int pad = 0; pad < MAX_SAMPLES; pad++) {
+    int slot = newBank * MAX_SAMPLES + pad;
+    if (sampleBuffers[slot] != nullptr && residentLengths[slot] < sampleLengths[slot]) {
+      registerStream(slot);
+    }
+  }
+  if (lock) xSemaphoreGiveRecursive(lock);
+  return true;
+}
+
+int SampleManager::getBankLoadedCount(int bank) {
+  if (bank < 0 || bank >= PAD_BANKS) return 0;
+  int count = 0;
+  for (int pad = 0; pad < MAX_SAMPLES; pad++) {
+    if (sampleBuffers[bank * MAX_SAMPLES + pad] != nullptr) count++;
+  }
+  return count;
+}
+
+// ============= SAMPLE CACHE =============
+
+void SampleManager::attachCached(int slot, int index) {
+  CachedSample& e = cache.entry(index);
+  cache.acquire(index);
+  cacheIndex[slot] = index;
+  sampleHandles[slot] = e.handle;
+  sampleBuffers[slot] = (int16_t*)arena.ptr(e.handle);
+  sampleLengths[slot] = e.length;
+  residentLengths[slot] = e.resident;
+  sampleChannels[slot] = e.channels;
+  codecReports[slot] = e.report;
+  
+  streamPaths[slot][0] = '\0';
+  if (e.resident < e.length) {
+    strncpy(streamPaths[slot], e.path, sizeof(streamPaths[slot]));
+    streamOffsets[slot] = e.dataOffset;
+    streamFormats[slot] = e.wav;
+    if (bankOf(slot) == audioEngine.getActiveBank()) registerStream(slot);
+  }
+}
+
+// Hand the slot's freshly loaded buffer to the cache (the slot keeps a reference)
+void SampleManager::cacheSlot(int slot, const char* filename, uint32_t mtime, uint32_t fileSize,
+                              SampleFormat format) {
+  cacheIndex[slot] = -1;
+  if (strlen(filename) >= sizeof(((CachedSample*)nullptr)->path)) return;
+  
+  if (cache.isFull()) {
+    int victim = cache.pickVictim();
+    if (victim < 0) return;
+    evictEntries(&victim, 1);
+  }
+  
+  CachedSample e;
+  memset(&e, 0, sizeof(e));
+  strncpy(e.path, filename, sizeof(e.path));
+  e.mtime = mtime;
+  e.fileSize = fileSize;
+  e.format = format;
+  e.handle = sampleHandles[slot];
+  e.bytes = arena.size(sampleHandles[slot]);
+  e.length = sampleLengths[slot];
+  e.resident = residentLengths[slot];
+  e.dataOffset = streamOffsets[slot];
+  e.wav = streamFormats[slot];
+  e.channels = sampleChannels[slot];
+  e.report = codecReports[slot];
+  
+  int index = cache.insert(e);
+  if (index < 0) return;
+  cache.acquire(index);
+  cacheIndex[slot] = index;
+}
+
+// Idle entries can still be playing in old voices: one reclaim wait for the batch
+void SampleManager::evictEntries(const int* indices, int count) {
+  const void* buffers[SAMPLE_CACHE_ENTRIES];
+  for (int i = 0; i < count; i++) {
+    buffers[i] = arena.ptr(cache.entry(indices[i]).handle);
+  }
+  reclaim(buffers, count);
+  
+  for (int i = 0; i < count; i++) {
+    CachedSample& e = cache.entry(indices[i]);
+    Serial.printf("[SampleCache] Evicted %s (%d bytes)\n", e.path, e.bytes);
+    arena.release(e.handle);
+    cache.remove(indices[i]);
+    cache.noteEviction();
+  }
+}
+
+// Least recently used idle samples out until the cache fits its budget
+void SampleManager::trimCache() {
+  int victims[SAMPLE_CACHE_ENTRIES];
+  int count = 0;
+  uint32_t chosen = 0;
+  size_t cached = cache.bytesCached();
+  while (cached > cache.getBudget()) {
+    int victim = cache.pickVictim(chosen);
+    if (victim < 0) break;
+    cached -= cache.entry(victim).bytes;
+    chosen |= (1UL << victim);
+    victims[count++] = victim;
+  }
+  if (count > 0) evictEntries(victims, count);
+}
+
+void SampleManager::setCacheBudget(size_t bytes) {
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  cache.setBudget(bytes);
+  trimCache();
+  if (lock) xSemaphoreGiveRecursive(lock);
+  Serial.printf("[SampleCache] Budget %d bytes, %d cached\n", bytes, cache.bytesCached());
+}
+
+// ============= DEFERRED RECLAMATION =============
+
+// Take the slots out of the engine and wait until no voice can read their memory.
+// Cached and flash-mapped buffers stay alive, so only the heads and arena buffers need the wait
+void SampleManager::retireSlots(uint32_t slotMask) {
+  const void* buffers[SAMPLE_SLOTS * 2];
+  int count = 0;
+  int active = audioEngine.getActiveBank();
+  for (int i = 0; i < SAMPLE_SLOTS; i++) {
+    if (!(slotMask & (1 << i))) continue;
+    audioEngine.setBankSample(bankOf(i), padOf(i), nullptr, 0);  // Also drops the head
+    if (bankOf(i) == active) sampleStreamer.unregisterPad(padOf(i));
+    if (sampleBuffers[i] != nullptr && cacheIndex[i] < 0 && !mappedSlots[i]) buffers[count++] = sampleBuffers[i];
+    if (headBuffers[i] != nullptr) buffers[count++] = headBuffers[i];
+  }
+  reclaim(buffers, count);
+}
+
+// Block until the audio core has stopped every voice reading `buffers` and
+// RETIRE_GRACE_BLOCKS blocks have passed. The audio side never blocks.
+// Compaction can retire more buffers than RETIRE_SLOTS: en tandes, cada una
+// espera el seu ack abans de la següent (el lock garanteix un sol reclaim)
+void SampleManager::reclaim(const void* const* buffers, int count) {
+  for (int done = 0; done < count; done += RETIRE_SLOTS) {
+    int batch = count - done < RETIRE_SLOTS ? count - done : RETIRE_SLOTS;
+    reclaimBatch(buffers + done, batch);
+  }
+}
+
+void SampleManager::reclaimBatch(const void* const* buffers, int count) {
+  if (count <= 0) return;
+  
+  int slots[RETIRE_SLOTS];
+  bool tableFull = false;
+  for (int i = 0; i < count; i++) {
+    slots[i] = audioEngine.retireBuffer(buffers[i]);
+    if (slots[i] < 0) tableFull = true;
+  }
+  // Only if a slot leaked (every batch fits the table): stop everything and still wait the block edge
+  if (tableFull) audioEngine.stopAll();
+  
+  uint32_t start = millis();
+  uint32_t startEpoch = audioEngine.getBlockEpoch();
+  while (true) {
+    bool done = !tableFull || (audioEngine.getBlockEpoch() - startEpoch) >= RETIRE_GRACE_BLOCKS;
+    for (int i = 0; i < count && done; i++) {
+      if (slots[i] >= 0 && !audioEngine.isRetireComplete(slots[i])) done = false;
+    }
+    if (done) break;
+    
+    // Audio task not rendering (boot, before it starts): nobody can be reading
+    if (audioEngine.getBlockEpoch() == startEpoch && (millis() - start) > RECLAIM_IDLE_MS) break;
+    if ((millis() - start) > RECLAIM_TIMEOUT_MS) {
+      Serial.println("[SampleManager] WARNING: audio core did not acknowledge retire, freeing anyway");
+      break;
+    }
+    delay(1);
+  }
+  
+  for (int i = 0; i < count; i++) {
+    audioEngine.releaseRetireSlot(slots[i]);
+  }
+  audioEngine.noteReclaimWait(millis() - start);
 }
 
 bool SampleManager::isSampleLoaded(int padIndex) {
   if (padIndex < 0 || padIndex >= MAX_SAMPLES) return false;
-  return sampleBuffers[padIndex] != nullptr;
+  return sampleBuffers[activeSlot(padIndex)] != nullptr;
 }
 
 uint32_t SampleManager::getSampleLength(int padIndex) {
   if (padIndex < 0 || padIndex >= MAX_SAMPLES) return 0;
-  return sampleLengths[padIndex];
+  return sampleLengths[activeSlot(padIndex)];
 }
 
 const char* SampleManager::getSampleName(int padIndex) {
   if (padIndex < 0 || padIndex >= MAX_SAMPLES) return "";
-  return sampleNames[padIndex];
+  return sampleNames[activeSlot(padIndex)];
 }
 
+// Both banks (during a kit change the two kits are resident); a sample
+// shared by several pads counts once. Idle cache entries are not included
 size_t SampleManager::getTotalPSRAMUsed() {
-  size_t total = 0;
-  for (int i = 0; i < MAX_SAMPLES; i++) {
-    if (sampleBuffers[i] != nullptr) {
-      total += sampleLengths[i] * sizeof(int16_t);
+  size_t total = cache.bytesReferenced();
+  for (int i = 0; i < SAMPLE_SLOTS; i++) {
+    if (sampleBuffers[i] != nullptr && cacheIndex[i] < 0 && !mappedSlots[i]) {
+      total += codecReports[i].storedBytes;
     }
   }
   return total;
 }
 
+size_t SampleManager::getMemorySaved() {
+  size_t saved = 0;
+  for (int i = 0; i < SAMPLE_SLOTS; i++) {
+    if (sampleBuffers[i] != nullptr) {
+      saved += codecReports[i].pcmBytes - codecReports[i].storedBytes;
+    }
+  }
+  return saved;
+}
+
 size_t SampleManager::getFreePSRAM() {
-  return ESP.getFreePsram();
+  return arena.freeBytes();
 }
 
 int SampleManager::getLoadedSamplesCount() {
+  return getBankLoadedCount(audioEngine.getActiveBank());
+}
+
+size_t SampleManager::getTotalMemoryUsed() {
+  return getTotalPSRAMUsed();
+}
+
+// ============= SRAM HEAD CACHE =============
+
+void SampleManager::allocateHead(int slot) {
+  freeHead(slot);
+  if (headCacheMs == 0 || sampleBuffers[slot] == nullptr) return;
+  
+  uint32_t headSamples = ((uint32_t)SAMPLE_RATE * headCacheMs) / 1000;
+  if (headSamples > residentLengths[slot]) headSamples = residentLengths[slot];
+  size_t bytes = headSamples * sampleChannels[slot] * sizeof(int16_t);
+  
+  if (getHeadCacheUsed() + bytes > HEAD_CACHE_BUDGET) {
+    Serial.printf("[SampleManager] Head cache full, pad %d plays from PSRAM\n", padOf(slot));
+    return;
+  }
+  
+  int16_t* head = (int16_t*)heap_caps_malloc(bytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  if (head == nullptr) {
+    Serial.printf("[SampleManager] No internal RAM for head of pad %d (%d bytes)\n", padOf(slot), bytes);
+    return;
+  }
+  
+  // Heads are always PCM (compressed samples are decoded here); stereo heads are interleaved
+  SampleCodec::decodeRange(codecReports[slot].format, (const uint8_t*)sampleBuffers[slot],
+                           0, headSamples * sampleChannels[slot], head);
+  headBuffers[slot] = head;
+  headLengths[slot] = headSamples;
+  audioEngine.setBankHead(bankOf(slot), padOf(slot), head, headSamples);
+}
+
+void SampleManager::freeHead(int slot) {
+  if (headBuffers[slot] != nullptr) {
+    audioEngine.setBankHead(bankOf(slot), padOf(slot), nullptr, 0);
+    const void* head = headBuffers[slot];
+    reclaim(&head, 1);
+    releaseHead(slot);
+  }
+}
+
+void SampleManager::releaseHead(int slot) {
+  if (headBuffers[slot] != nullptr) {
+    heap_caps_free(headBuffers[slot]);
+    headBuffers[slot] = nullptr;
+    headLengths[slot] = 0;
+  }
+}
+
+void SampleManager::setHeadCacheMs(uint16_t ms) {
+  if (lock) xSemaphoreTakeRecursive(lock, portMAX_DELAY);
+  headCacheMs = constrain(ms, 0, HEAD_CACHE_MAX_MS);
+  
+  // Voices keep the head pointer: detach all heads, wait once, then free
+  const void* heads[SAMPLE_SLOTS];
   int count = 0;
-  for (int i = 0; i < MAX_SAMPLES; i++) {
-    if (sampleBuffers[i] != nullptr) {
-      count++;
+  for (int i = 0; i < SAMPLE_SLOTS; i++) {
+    if (headBuffers[i] == nullptr) continue;
+    audioEngine.setBankHead(bankOf(i), padOf(i), nullptr, 0);
+    heads[count++] = headBuffers[i];
+  }
+  reclaim(heads, count);
+  
+  // Rebuild heads for loaded samples with the new size (active bank first)
+  for (int i = 0; i < SAMPLE_SLOTS; i++) {
+    releaseHead(i);
+  }
+  for (int i = 0; i < SAMPLE_SLOTS; i++) {
+    allocateHead((activeSlot(0) + i) % SAMPLE_SLOTS);
+  }
+  if (lock) xSemaphoreGiveRecursive(lock);
+  
+  Serial.printf("[SampleManager] Head cache: %d ms, %d/%d samples cached, %d bytes SRAM\n",
+                headCacheMs, getHeadCachedCount(), getLoadedSamplesCount(), getHeadCacheUsed());
+}
+
+size_t SampleManager::getHeadCacheUsed() {
+  size_t total = 0;
+  for (int i = 0; i < SAMPLE_SLOTS; i++) {
+    if (headBuffers[i] != nullptr) {
+      total += headLengths[i] * sampleChannels[i] * sizeof(int16_t);
     }
   }
+  return total;
+}
+
+bool SampleManager::isStreamed(int padIndex) {
+  if (padIndex < 0 || padIndex >= MAX_SAMPLES) return false;
+  int slot = activeSlot(padIndex);
+  return sampleBuffers[slot] != nullptr && residentLengths[slot] < sampleLengths[slot];
+}
+
+bool SampleManager::isStereo(int padIndex) {
+  if (padIndex < 0 || padIndex >= MAX_SAMPLES) return false;
+  return sampleChannels[activeSlot(padIndex)] == 2;
+}
+
+bool SampleManager::isFlashMapped(int padIndex) {
+  if (padIndex < 0 || padIndex >= MAX_SAMPLES) return false;
+  return mappedSlots[activeSlot(padIndex)];
+}
+
+int SampleManager::getHeadCachedCount() {
+  int count = 0;
+  for (int pad = 0; pad < MAX_SAMPLES; pad++) {
+    if (headBuffers[activeSlot(pad)] != nullptr) count++;
+  }
   return count;
 }
 
-size_t SampleManager::getTotalMemoryUsed() {
-  return getTotalPSRAMUsed();
+// ============= COMPRESSED STORAGE =============
+
+// Encode the loaded PCM into `format`, measure decode cost and SNR, then free the PCM
+bool SampleManager::compressSample(int slot, SampleFormat format) {
+  uint32_t samples = residentLengths[slot];
+  if (sampleBuffers[slot] == nullptr || samples == 0 || sampleChannels[slot] != 1) return false;
+  
+  size_t bytes = SampleCodec::encodedSize(format, samples);
+  ArenaHandle encodedHandle = allocateArena(bytes);
+  if (encodedHandle == ARENA_INVALID_HANDLE) {
+    Serial.printf("❌ Fallo al alocar %d bytes en PSRAM para %s\n", bytes, SampleCodec::formatName(format));
+    return false;
+  }
+  // Pointers after the allocation (it may have compacted the arena)
+  int16_t* pcm = sampleBuffers[slot];
+  uint8_t* encoded = (uint8_t*)arena.ptr(encodedHandle);
+  SampleCodec::encode(format, pcm, samples, encoded);
+  
+  // Decode block by block, as the mixer does, timing it and comparing with the original
+  int16_t decoded[CODEC_BLOCK_SAMPLES];
+  double signal = 0.0;
+  double noise = 0.0;
+  uint32_t cycles = 0;
+  uint32_t blocks = (samples + CODEC_BLOCK_SAMPLES - 1) / CODEC_BLOCK_SAMPLES;
+  for (uint32_t b = 0; b < blocks; b++) {
+    uint32_t first = b * CODEC_BLOCK_SAMPLES;
+    uint32_t count = samples - first;
+    if (count > CODEC_BLOCK_SAMPLES) count = CODEC_BLOCK_SAMPLES;
+    
+    uint32_t start = ESP.getCycleCount();
+    SampleCodec::decodeBlock(format, encoded, b, count, decoded);
+    cycles += ESP.getCycleCount() - start;
+    
+    SampleCodec::accumulateError(pcm + first, decoded, count, signal, noise);
+  }
+  
+  arena.release(sampleHandles[slot]);
+  sampleHandles[slot] = encodedHandle;
+  sampleBuffers[slot] = (int16_t*)encoded;
+  
+  CodecReport& report = codecReports[slot];
+  report.format = format;
+  report.storedBytes = bytes;
+  report.snrDb = SampleCodec::snrDb(signal, noise);
+  report.decodeCyclesPerFrame = (float)cycles / samples;
+  
+  Serial.printf("[SampleManager] Pad %d -> %s: %d -> %d bytes (%.1f%%), SNR %.1f dB, %.1f cycles/frame\n",
+                padOf(slot), SampleCodec::formatName(format), report.pcmBytes, report.storedBytes,
+                100.0f * report.storedBytes / report.pcmBytes, report.snrDb, report.decodeCyclesPerFrame);
+  return true;
+}
+
+SampleFormat SampleManager::getSampleFormat(int padIndex) {
+  if (padIndex < 0 || padIndex >= MAX_SAMPLES) return SAMPLE_PCM16;
+  return codecReports[activeSlot(padIndex)].format;
+}
+
+void SampleManager::setWavChunkBytes(size_t bytes) {
+  wavChunkBytes = constrain(bytes, WAV_CHUNK_MIN_BYTES, WAV_CHUNK_MAX_BYTES);
+  Serial.printf("[SampleManager] WAV read chunk: %d bytes\n", wavChunkBytes);
+}
+
+bool SampleManager::getCodecReport(int padIndex, CodecReport& out) {
+  if (padIndex < 0 || padIndex >= MAX_SAMPLES) return false;
+  int slot = activeSlot(padIndex);
+  if (sampleBuffers[slot] == nullptr) return false;
+  out = codecReports[slot];
+  return true;
 }
@@ -10,26 +10,26 @@
 #include <LittleFS.h>
 #include <FS.h>
 #include "AudioEngine.h"
+#include "SampleCodec.h"
+#include "SampleArena.h"
+#include "SampleCache.h"
+#include "SampleBank.h"
+#include "SampleMap.h"
+#include "WavDecoder.h"
 
 #define MAX_SAMPLES 8
+#define SAMPLE_SLOTS (MAX_SAMPLES * PAD_BANKS)  // slot = bank * MAX_SAMPLES + pad
 #define MAX_SAMPLE_SIZE (2 * 1024 * 1024) // 2MB per sample (suficiente para samples largos)
+#define STREAM_THRESHOLD_BYTES MAX_SAMPLE_SIZE // Més gran: head en PSRAM i la resta en streaming
+#define SAMPLE_ARENA_RESERVE (512 * 1024)     // PSRAM fora de l'arena (rings de streaming, WiFi, JSON)
+#define RECLAIM_IDLE_MS 20                     // Sense blocs renderitzats en aquest temps: àudio aturat
+#define RECLAIM_TIMEOUT_MS 200
+#define RECLAIM_MAX_BUFFERS (SAMPLE_CACHE_ENTRIES + SAMPLE_SLOTS * 2)  // Compaction: every cached sample + heads
 
-// WAV file header structure
-struct WavHeader {
-  char riff[4];           // "RIFF"
-  uint32_t fileSize;
-  char wave[4];           // "WAVE"
-  char fmt[4];            // "fmt "
-  uint32_t fmtSize;
-  uint16_t audioFormat;
-  uint16_t numChannels;
-  uint32_t sampleRate;
-  uint32_t byteRate;
-  uint16_t blockAlign;
-  uint16_t bitsPerSample;
-  char data[4];           // "data"
-  uint32_t dataSize;
-} __attribute__((packed));
+// Head cache: primers ms de cada sample copiats a SRAM interna (atac sense latència PSRAM)
+#define HEAD_CACHE_DEFAULT_MS 20
+#define HEAD_CACHE_MAX_MS 100
+#define HEAD_CACHE_BUDGET (96 * 1024)     // Bytes màxims de SRAM interna per a tots els heads
 
 class SampleManager {
 public:
@@ -40,29 +40,130 @@ public:
   bool begin();
   
   // Sample loading
-  bool loadSample(const char* filename, int padIndex);
+  bool loadSample(const char* filename, int padIndex);  // Uses the default storage format
+  bool loadSample(const char* filename, int padIndex, SampleFormat format);
   bool unloadSample(int padIndex);
-  void unloadAll();
+  void unloadAll();                // Both banks
+  int loadSampleBank(const char* path);  // Packed bank (pack_samples.py): pads loaded, -1 = none
+  int mapSampleBank(const char* source);  // Same format, played in place from flash (no PSRAM copy)
+  
+  // Upload ingest (SampleUpload): PCM written in pieces as it is decoded into a buffer of
+  // its own. The pad keeps its old sample until finish; abort leaves it as it was.
+  // frames at SAMPLE_RATE, channels 1/2
+  bool beginIngest(int padIndex, uint32_t frames, uint8_t channels);
+  bool writeIngest(uint32_t frameOffset, const int16_t* data, uint32_t frames);
+  bool finishIngest(const char* name, SampleFormat format);
+  void abortIngest();
+  
+  // Kit banks (KitManager): load into the standby bank while the active one plays,
+  // swap at a bar boundary, then clear the old one
+  bool loadSampleToBank(const char* filename, int bank, int padIndex, SampleFormat format);
+  void clearBank(int bank);
+  bool swapBank();                 // Never waits: false if the lock is busy (retry at the next bar)
+  int getBankLoadedCount(int bank);
   
   // Sample info
   bool isSampleLoaded(int padIndex);
   uint32_t getSampleLength(int padIndex);
   const char* getSampleName(int padIndex);
+  bool isStreamed(int padIndex);   // Only the first STREAM_HEAD_MS are in PSRAM
+  bool isFlashMapped(int padIndex);  // Plays from the mapped sample partition
+  bool isStereo(int padIndex);     // Interleaved L/R in memory (PCM, not streamed)
   int getLoadedSamplesCount();
   
   // Memory info
   size_t getTotalPSRAMUsed();
   size_t getTotalMemoryUsed(); // Alias para compatibilidad
-  size_t getFreePSRAM();
+  size_t getFreePSRAM();       // Free bytes in the sample arena
+  SampleArena& getArena() { return arena; }
+  uint32_t getArenaFailures() { return arenaFailures; }
+  size_t getMemorySaved();     // PCM bytes minus stored bytes (compressed samples)
+  size_t getArenaPeak() { return arenaPeak; }
+  size_t getFlashMappedBytes() { return flashBank.mappedBytes(); }
+  
+  // Sample cache across kits (LRU over idle samples, byte budget)
+  void setCacheBudget(size_t bytes);
+  size_t getCacheBudget() { return cache.getBudget(); }
+  void getCacheStats(SampleCacheStats& out) { cache.getStats(out); }
+  void resetArenaPeak() { arenaPeak = arena.used(); }
+  
+  // Compressed storage (IMA-ADPCM / µ-law), chosen per sample at load
+  void setDefaultFormat(SampleFormat format) { defaultFormat = format; }
+  SampleFormat getDefaultFormat() { return defaultFormat; }
+  SampleFormat getSampleFormat(int padIndex);
+  
+  // WAV decode: bytes per read (scratch buffer in internal SRAM)
+  void setWavChunkBytes(size_t bytes);
+  size_t getWavChunkBytes() { return wavChunkBytes; }
+  bool getCodecReport(int padIndex, CodecReport& out);
+  
+  // SRAM head cache
+  void setHeadCacheMs(uint16_t ms);
+  uint16_t getHeadCacheMs() { return headCacheMs; }
+  size_t getHeadCacheUsed();
+  int getHeadCachedCount();
   
 private:
-  int16_t* sampleBuffers[MAX_SAMPLES];
-  uint32_t sampleLengths[MAX_SAMPLES];
-  char sampleNames[MAX_SAMPLES][32];
+  // Per slot (both banks); the public per-pad getters read the active bank
+  int16_t* sampleBuffers[SAMPLE_SLOTS];   // Cached arena pointers (refreshed after compaction)
+  ArenaHandle sampleHandles[SAMPLE_SLOTS];
+  uint32_t sampleLengths[SAMPLE_SLOTS];
+  uint32_t residentLengths[SAMPLE_SLOTS];  // Samples in sampleBuffers (< length when streamed)
+  uint8_t sampleChannels[SAMPLE_SLOTS];    // 2 = interleaved stereo (lengths are frames)
+  char sampleNames[SAMPLE_SLOTS][32];
+  int16_t* headBuffers[SAMPLE_SLOTS];   // Internal SRAM copies of the attack
+  uint32_t headLengths[SAMPLE_SLOTS];
+  uint16_t headCacheMs;
+  SampleFormat defaultFormat;
+  size_t wavChunkBytes;
+  CodecReport codecReports[SAMPLE_SLOTS];  // Format, stored size, SNR, decode cost
+  SampleArena arena;
+  uint32_t arenaFailures;
+  size_t arenaPeak;                         // Highest arena use (both kits resident during a swap)
+  int loadingSlot;                          // Slot being loaded (not yet published to the engine)
+  int ingestSlot;                           // Slot an upload will replace (-1 = none)
+  ArenaHandle ingestHandle;                 // Upload PCM, attached to ingestSlot at finish
+  uint32_t ingestFrames;
+  uint8_t ingestChannels;
+  SemaphoreHandle_t lock;                   // Kit loader task vs web/UDP commands
+  SampleCache cache;
+  int cacheIndex[SAMPLE_SLOTS];             // Cache entry the slot plays (-1 = owns its handle)
+  SampleMap flashBank;                      // Mapped for the whole run: never unmapped under a voice
+  bool mappedSlots[SAMPLE_SLOTS];           // Buffer points into flashBank (no handle, never freed)
+  
+  // Streamed samples of the standby bank register with SampleStreamer at the swap
+  char streamPaths[SAMPLE_SLOTS][64];
+  uint32_t streamOffsets[SAMPLE_SLOTS];
+  WavFormat streamFormats[SAMPLE_SLOTS];
   
-  bool parseWavFile(fs::File& file, int padIndex);
-  bool allocateSampleBuffer(int padIndex, uint32_t size);
-  void freeSampleBuffer(int padIndex);
+  static int bankOf(int slot) { return slot / MAX_SAMPLES; }
+  static int padOf(int slot) { return slot % MAX_SAMPLES; }
+  int activeSlot(int padIndex);
+  bool loadSlot(const char* filename, int slot, SampleFormat format);
+  bool readSample(fs::File& file, int slot, const char* filename, SampleFormat format);
+  void applyFormat(int slot, SampleFormat format);
+  void finishLoad(int slot, const char* name);
+  void attachCached(int slot, int index);
+  void attachMapped(int slot, int entryIndex);
+  void cacheSlot(int slot, const char* filename, uint32_t mtime, uint32_t fileSize, SampleFormat format);
+  void evictEntries(const int* indices, int count);
+  void trimCache();
+  bool parseWavFile(fs::File& file, int slot, const char* filename, SampleFormat format);
+  uint32_t planResident(int slot, const char* filename, uint32_t dataOffset,
+                        const WavFormat& format, uint32_t numSamples);
+  bool registerStream(int slot);
+  bool allocateSampleBuffer(int slot, uint32_t size);
+  void freeSampleBuffer(int slot);
+  bool compressSample(int slot, SampleFormat format);
+  ArenaHandle allocateArena(size_t bytes);
+  void compactArena();
+  void publishPad(int slot);
+  void allocateHead(int slot);
+  void freeHead(int slot);
+  void releaseHead(int slot);
+  void retireSlots(uint32_t slotMask);
+  void reclaim(const void* const* buffers, int count);
+  void reclaimBatch(const void* const* buffers, int count);
 };
 
 #endif // SAMPLEMANAGER_H
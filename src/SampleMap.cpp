@@ -0,0 +1,104 @@
+/*
+ * SampleMap.cpp
+ * Banc de samples mapejat (partició de flash o fitxer)
+ */
+
+#include "SampleMap.h"
+
+#ifndef ESP_PLATFORM
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+SampleMap::SampleMap() : base(nullptr), size(0), header(nullptr) {
+#ifdef ESP_PLATFORM
+  handle = 0;
+#endif
+}
+
+SampleMap::~SampleMap() {
+  close();
+}
+
+// The bank may be shorter than the region (a partition is bigger than its contents)
+bool SampleMap::attach(const void* memory, size_t bytes) {
+  base = (const uint8_t*)memory;
+  size = bytes;
+  if (bytes < sizeof(SampleBankHeader)) return false;
+  const SampleBankHeader* h = (const SampleBankHeader*)base;
+  if (h->totalSize > bytes || !sampleBankValid(*h, h->totalSize)) return false;
+  header = h;
+  return true;
+}
+
+#ifdef ESP_PLATFORM
+bool SampleMap::openPartition(const char* label) {
+  close();
+  const esp_partition_t* partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA,
+                                                              ESP_PARTITION_SUBTYPE_ANY, label);
+  if (partition == nullptr) return false;
+
+  // Only map what the header says is used: the MMU window is shared with the code
+  SampleBankHeader h;
+  if (esp_partition_read(partition, 0, &h, sizeof(h)) != ESP_OK) return false;
+  if (h.totalSize > partition->size || !sampleBankValid(h, h.totalSize)) return false;
+
+  const void* memory = nullptr;
+  if (esp_partition_mmap(partition, 0, h.totalSize, ESP_PARTITION_MMAP_DATA, &memory, &handle) != ESP_OK) {
+    handle = 0;
+    return false;
+  }
+  if (!attach(memory, h.totalSize)) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void SampleMap::close() {
+  if (base != nullptr) spi_flash_munmap(handle);
+  handle = 0;
+  base = nullptr;
+  size = 0;
+  header = nullptr;
+}
+#else
+bool SampleMap::openFile(const char* path) {
+  close();
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+    ::close(fd);
+    return false;
+  }
+  void* memory = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);  // The mapping keeps the file
+  if (memory == MAP_FAILED) return false;
+  if (!attach(memory, st.st_size)) {
+    close();
+    return false;
+  }
+  return true;
+}
+
+void SampleMap::close() {
+  if (base != nullptr) munmap((void*)base, size);
+  base = nullptr;
+  size = 0;
+  header = nullptr;
+}
+#endif
+
+const SampleBankEntry* SampleMap::entry(int index) const {
+  if (header == nullptr || index < 0 || index >= header->count) return nullptr;
+  const SampleBankEntry* e = (const SampleBankEntry*)(base + sizeof(SampleBankHeader)) + index;
+  return sampleBankEntryValid(*e, *header) ? e : nullptr;
+}
+
+const int16_t* SampleMap::samples(int index) const {
+  const SampleBankEntry* e = entry(index);
+  return e ? (const int16_t*)(base + e->offset) : nullptr;
+}
@@ -0,0 +1,54 @@
+/*
+ * SampleMap.h
+ * Banc de samples mapejat en memòria (format SampleBank.h), sense còpia:
+ * les veus llegeixen el PCM directament a través de la cache de flash
+ *
+ *   ESP32: partició `samples` (esp_partition_mmap)
+ *   Linux: fitxer normal (mmap POSIX), per provar el loader fora del dispositiu
+ *
+ * Sense dependències d'Arduino
+ */
+
+#ifndef SAMPLEMAP_H
+#define SAMPLEMAP_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include "SampleBank.h"
+
+#ifdef ESP_PLATFORM
+#include "esp_partition.h"
+#endif
+
+#define SAMPLE_PARTITION_LABEL "samples"
+
+class SampleMap {
+public:
+  SampleMap();
+  ~SampleMap();
+
+#ifdef ESP_PLATFORM
+  bool openPartition(const char* label);
+#else
+  bool openFile(const char* path);
+#endif
+  void close();
+
+  bool isOpen() const { return header != nullptr; }
+  int count() const { return header ? header->count : 0; }
+  size_t mappedBytes() const { return header ? header->totalSize : 0; }
+  const SampleBankEntry* entry(int index) const;  // nullptr = out of range or invalid
+  const int16_t* samples(int index) const;        // PCM inside the mapping
+
+private:
+  const uint8_t* base;
+  size_t size;                      // Mapped bytes (partition/file, >= totalSize)
+  const SampleBankHeader* header;   // nullptr until validated
+#ifdef ESP_PLATFORM
+  spi_flash_mmap_handle_t handle;
+#endif
+
+  bool attach(const void* memory, size_t bytes);
+};
+
+#endif // SAMPLEMAP_H
@@ -0,0 +1,311 @@
+/*
+ * SampleStreamer.cpp
+ * Reader de Core 0: omple els rings de les veus en streaming (read-ahead)
+ */
+
+#include "SampleStreamer.h"
+#include "AudioEngine.h"
+
+extern AudioEngine audioEngine;
+
+// Slot lifecycle: the trigger claims, the reader opens/closes
+enum StreamSlotState : uint8_t {
+  STREAM_FREE = 0,
+  STREAM_CLAIMING = 1,   // Trigger filling in the slot
+  STREAM_CLAIMED = 2,    // Waiting for the reader to open the file
+  STREAM_RUNNING = 3,
+  STREAM_RELEASED = 4    // Voice retriggered: reader closes it
+};
+
+SampleStreamer::SampleStreamer() : ringMemory(nullptr), readerTaskHandle(nullptr),
+                                   windowBytes(0), windowStartMs(0) {
+  for (int i = 0; i < 16; i++) {
+    pads[i].valid = false;
+  }
+  for (int i = 0; i < STREAM_SLOTS; i++) {
+    slots[i].state.store(STREAM_FREE);
+    slots[i].pad = -1;
+    slots[i].voice = -1;
+    slots[i].token = 0;
+    slots[i].claimedMs = 0;
+    slots[i].ring = nullptr;
+    slots[i].written.store(0);
+    slots[i].consumed.store(0);
+    slots[i].filePos = 0;
+    slots[i].loop = false;
+    slots[i].loopStart = 0;
+    slots[i].eof = true;
+  }
+  memset(&stats, 0, sizeof(stats));
+}
+
+SampleStreamer::~SampleStreamer() {
+  if (readerTaskHandle) {
+    vTaskDelete(readerTaskHandle);
+  }
+  if (ringMemory) {
+    free(ringMemory);
+  }
+}
+
+bool SampleStreamer::begin() {
+  // Rings in PSRAM: sequential access, the cache is shared by both cores
+  ringMemory = (int16_t*)ps_malloc(STREAM_SLOTS * STREAM_RING_SAMPLES * sizeof(int16_t));
+  if (ringMemory == nullptr) {
+    Serial.println("[Streamer] ERROR: No PSRAM for stream rings");
+    return false;
+  }
+  for (int i = 0; i < STREAM_SLOTS; i++) {
+    slots[i].ring = ringMemory + i * STREAM_RING_SAMPLES;
+  }
+
+  BaseType_t ok = xTaskCreatePinnedToCore(
+    readerTask,
+    "SampleStreamer",
+    4096,
+    this,
+    STREAM_TASK_PRIORITY,
+    &readerTaskHandle,
+    0       // CORE 0: I/O de LittleFS fora del core d'àudio
+  );
+  if (ok != pdPASS) {
+    readerTaskHandle = nullptr;
+    Serial.println("[Streamer] ERROR: Failed to create reader task");
+    return false;
+  }
+
+  Serial.printf("[Streamer] ✓ %d stream slots, ring %d samples, chunk %d samples\n",
+                STREAM_SLOTS, STREAM_RING_SAMPLES, STREAM_CHUNK_SAMPLES);
+  return true;
+}
+
+// ============= PAD REGISTRY =============
+
+bool SampleStreamer::registerPad(int padIndex, const char* path, uint32_t dataOffset, const WavFormat& format,
+                                 uint32_t length, uint32_t resident) {
+  if (padIndex < 0 || padIndex >= 16 || ringMemory == nullptr) return false;
+  if (strlen(path) >= sizeof(pads[padIndex].path)) {
+    Serial.printf("[Streamer] Path too long: %s\n", path);
+    return false;
+  }
+
+  StreamPad& pad = pads[padIndex];
+  strncpy(pad.path, path, sizeof(pad.path));
+  pad.dataOffset = dataOffset;
+  pad.format = format;
+  pad.length = length;
+  pad.resident = resident;
+  pad.valid = true;
+
+  Serial.printf("[Streamer] Pad %d streams %s: %d samples (%d resident)\n", padIndex, path, length, resident);
+  return true;
+}
+
+void SampleStreamer::unregisterPad(int padIndex) {
+  if (padIndex < 0 || padIndex >= 16) return;
+  // Slots already playing this pad stop reading; the reader frees them when the voice ends
+  pads[padIndex].valid = false;
+}
+
+bool SampleStreamer::isStreamed(int padIndex) {
+  if (padIndex < 0 || padIndex >= 16) return false;
+  return pads[padIndex].valid;
+}
+
+// ============= SLOTS =============
+
+int SampleStreamer::open(int padIndex, int voiceIndex, uint32_t token) {
+  if (!isStreamed(padIndex) || ringMemory == nullptr) return -1;
+
+  for (int i = 0; i < STREAM_SLOTS; i++) {
+    uint8_t expected = STREAM_FREE;
+    if (!slots[i].state.compare_exchange_strong(expected, STREAM_CLAIMING, std::memory_order_acq_rel)) {
+      continue;
+    }
+    StreamSlot& slot = slots[i];
+    slot.pad = padIndex;
+    slot.voice = voiceIndex;
+    slot.token = token;
+    slot.claimedMs = millis();
+    slot.written.store(0, std::memory_order_relaxed);
+    slot.consumed.store(0, std::memory_order_relaxed);
+    slot.loop = false;
+    slot.loopStart = 0;
+    slot.eof = false;
+    slot.state.store(STREAM_CLAIMED, std::memory_order_release);
+
+    if (readerTaskHandle) xTaskNotifyGive(readerTaskHandle);
+    return i;
+  }
+
+  stats.denied++;
+  return -1;
+}
+
+void SampleStreamer::release(int slot, int voiceIndex, uint32_t token) {
+  if (slot < 0 || slot >= STREAM_SLOTS) return;
+  StreamSlot& s = slots[slot];
+  if (s.voice != voiceIndex || s.token != token) return;  // Ja reciclat per una altra veu
+
+  uint8_t state = s.state.load(std::memory_order_acquire);
+  if ((state == STREAM_CLAIMED || state == STREAM_RUNNING) &&
+      s.state.compare_exchange_strong(state, STREAM_RELEASED, std::memory_order_acq_rel)) {
+    if (readerTaskHandle) xTaskNotifyGive(readerTaskHandle);
+  }
+}
+
+void SampleStreamer::setLoop(int slot, bool loop, uint32_t loopStart) {
+  if (slot < 0 || slot >= STREAM_SLOTS) return;
+  slots[slot].loopStart = loopStart;
+  slots[slot].loop = loop;
+}
+
+// ============= READER TASK =============
+
+void SampleStreamer::readerTask(void* arg) {
+  SampleStreamer* streamer = static_cast<SampleStreamer*>(arg);
+  Serial.printf("[Task] Sample Streamer iniciada en Core 0 (Prioridad: %d)\n", STREAM_TASK_PRIORITY);
+
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(STREAM_POLL_MS));
+    streamer->serviceSlots();
+  }
+}
+
+void SampleStreamer::serviceSlots() {
+  int active = 0;
+
+  // Open new streams, close the ones whose voice is gone
+  for (int i = 0; i < STREAM_SLOTS; i++) {
+    StreamSlot& slot = slots[i];
+    uint8_t state = slot.state.load(std::memory_order_acquire);
+
+    if (state == STREAM_CLAIMED) {
+      openSlot(slot);
+      state = STREAM_RUNNING;
+    }
+
+    bool orphaned = state == STREAM_RUNNING &&
+                    !audioEngine.ownsStream(slot.voice, slot.token, i) &&
+                    (millis() - slot.claimedMs) > STREAM_GRACE_MS;
+    if (state == STREAM_RELEASED || orphaned) {
+      closeSlot(slot);
+      continue;
+    }
+    if (state == STREAM_RUNNING) active++;
+  }
+  stats.activeStreams = active;
+
+  // Read-ahead: one chunk at a time to the emptiest ring, until all are full
+  while (true) {
+    StreamSlot* target = nullptr;
+    uint32_t lowest = STREAM_RING_SAMPLES;
+    for (int i = 0; i < STREAM_SLOTS; i++) {
+      StreamSlot& slot = slots[i];
+      if (slot.state.load(std::memory_order_acquire) != STREAM_RUNNING || slot.eof) continue;
+      uint32_t buffered = slot.written.load(std::memory_order_relaxed) -
+                          slot.consumed.load(std::memory_order_acquire);
+      if (STREAM_RING_SAMPLES - buffered < STREAM_CHUNK_SAMPLES) continue;
+      if (buffered < lowest) {
+        lowest = buffered;
+        target = &slot;
+      }
+    }
+    if (target == nullptr || !fillChunk(*target)) break;
+  }
+
+  // Throughput over a 1s window
+  uint32_t now = millis();
+  if (now - windowStartMs >= 1000) {
+    stats.readKBps = (windowBytes * 1000UL / (now - windowStartMs)) / 1024;
+    windowBytes = 0;
+    windowStartMs = now;
+  }
+}
+
+void SampleStreamer::openSlot(StreamSlot& slot) {
+  slot.state.store(STREAM_RUNNING, std::memory_order_release);
+
+  StreamPad& pad = pads[slot.pad];
+  if (!pad.valid) {
+    slot.eof = true;
+    return;
+  }
+
+  slot.file = LittleFS.open(pad.path, "r");
+  if (!slot.file) {
+    Serial.printf("[Streamer] Failed to open %s\n", pad.path);
+    slot.eof = true;
+    return;
+  }
+
+  // The stream starts where the resident part ends
+  slot.filePos = pad.resident;
+  slot.file.seek(pad.dataOffset + pad.resident * WavDecoder::frameBytes(pad.format));
+}
+
+void SampleStreamer::closeSlot(StreamSlot& slot) {
+  if (slot.file) slot.file.close();
+  slot.eof = true;
+  slot.voice = -1;
+  slot.state.store(STREAM_FREE, std::memory_order_release);
+}
+
+bool SampleStreamer::fillChunk(StreamSlot& slot) {
+  StreamPad& pad = pads[slot.pad];
+  if (!pad.valid || !slot.file) {
+    slot.eof = true;
+    return true;
+  }
+
+  size_t frameBytes = WavDecoder::frameBytes(pad.format);
+  uint32_t frames = pad.length - slot.filePos;
+  if (frames > STREAM_CHUNK_SAMPLES) frames = STREAM_CHUNK_SAMPLES;
+  if (frames > STREAM_READ_BYTES / frameBytes) frames = STREAM_READ_BYTES / frameBytes;
+
+  uint32_t readStart = micros();
+  size_t bytes = slot.file.read(readBuffer, frames * frameBytes);
+  uint32_t readUs = micros() - readStart;
+
+  stats.chunks++;
+  stats.bytesRead += bytes;
+  windowBytes += bytes;
+  if (readUs > stats.peakReadUs) stats.peakReadUs = readUs;
+
+  frames = bytes / frameBytes;
+  if (frames == 0) {
+    Serial.printf("[Streamer] Read failed on %s at sample %d\n", pad.path, slot.filePos);
+    slot.eof = true;
+    return true;
+  }
+
+  // Into the ring in two runs (up to the wrap, then from the start), converted as in SampleManager
+  uint32_t written = slot.written.load(std::memory_order_relaxed);
+  uint32_t start = written & STREAM_RING_MASK;
+  uint32_t first = STREAM_RING_SAMPLES - start;
+  if (first > frames) first = frames;
+  WavDecoder::convert(pad.format, readBuffer, first, slot.ring + start);
+  WavDecoder::convert(pad.format, readBuffer + first * frameBytes, frames - first, slot.ring);
+  slot.written.store(written + frames, std::memory_order_release);
+  slot.filePos += frames;
+
+  // End of file: the voice wraps to loopStart (the resident part plays from memory)
+  if (slot.filePos >= pad.length) {
+    if (slot.loop) {
+      uint32_t restart = slot.loopStart > pad.resident ? slot.loopStart : pad.resident;
+      slot.filePos = restart;
+      slot.file.seek(pad.dataOffset + restart * frameBytes);
+    } else {
+      slot.eof = true;
+    }
+  }
+  return true;
+}
+
+void SampleStreamer::getStats(StreamStats& out) {
+  out = stats;
+  out.registeredPads = 0;
+  for (int i = 0; i < 16; i++) {
+    if (pads[i].valid) out.registeredPads++;
+  }
+}
@@ -0,0 +1,106 @@
+/*
+ * SampleStreamer.h
+ * Streaming de samples grans des de LittleFS
+ * El head queda en PSRAM; una tasca a Core 0 omple un ring per veu amb la resta
+ */
+
+#ifndef SAMPLESTREAMER_H
+#define SAMPLESTREAMER_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <FS.h>
+#include <atomic>
+#include "WavDecoder.h"
+
+#define STREAM_SLOTS 4                // Veus en streaming simultànies
+#define STREAM_CHUNK_SAMPLES 2048     // Mostres per lectura de LittleFS (~46ms)
+#define STREAM_READ_BYTES (STREAM_CHUNK_SAMPLES * 2 * sizeof(int16_t))  // 24/32 bits: menys mostres per chunk
+#define STREAM_RING_SAMPLES 8192      // Ring per veu (4 chunks, ~186ms de read-ahead). Potència de 2
+#define STREAM_RING_MASK (STREAM_RING_SAMPLES - 1)
+#define STREAM_HEAD_MS 300            // Part resident: cobreix obrir el fitxer i el primer chunk
+#define STREAM_POLL_MS 5              // Període del reader si ningú el desperta
+#define STREAM_GRACE_MS 50            // Un slot reclamat encara no té la veu activa
+#define STREAM_TASK_PRIORITY 6        // Per sobre de SystemTask (5), per sota de WiFi
+
+// Streaming statistics
+struct StreamStats {
+  int registeredPads;         // Pads whose sample streams from flash
+  int activeStreams;          // Slots in use
+  uint32_t underruns;         // Voice blocks that caught up with the reader
+  uint32_t denied;            // Triggers with no free slot (played the resident part only)
+  uint32_t chunks;            // Chunks read
+  uint32_t bytesRead;         // Bytes read from LittleFS
+  uint32_t readKBps;          // Read throughput over the last second
+  uint32_t peakReadUs;        // Slowest chunk read
+};
+
+class SampleStreamer {
+public:
+  SampleStreamer();
+  ~SampleStreamer();
+
+  bool begin();
+
+  // Pad registry (SampleManager): the first `resident` samples are already in memory
+  bool registerPad(int padIndex, const char* path, uint32_t dataOffset, const WavFormat& format,
+                   uint32_t length, uint32_t resident);
+  void unregisterPad(int padIndex);
+  bool isStreamed(int padIndex);
+
+  // Trigger side: claim / release a slot for a voice (-1 = none free)
+  int open(int padIndex, int voiceIndex, uint32_t token);
+  void release(int slot, int voiceIndex, uint32_t token);
+  void setLoop(int slot, bool loop, uint32_t loopStart);
+
+  // Audio core side (single consumer per slot, lock-free)
+  inline uint32_t available(int slot) { return slots[slot].written.load(std::memory_order_acquire); }
+  inline const int16_t* ring(int slot) { return slots[slot].ring; }
+  inline void consume(int slot, uint32_t consumed) { slots[slot].consumed.store(consumed, std::memory_order_release); }
+  inline void noteUnderrun() { stats.underruns++; }
+
+  void getStats(StreamStats& out);
+
+private:
+  struct StreamPad {
+    bool valid;
+    char path[64];
+    uint32_t dataOffset;      // Byte offset of the PCM data in the file
+    WavFormat format;         // Es converteix a int16 mono, com a la càrrega
+    uint32_t length;          // Total samples
+    uint32_t resident;        // Samples held in memory
+  };
+
+  struct StreamSlot {
+    std::atomic<uint8_t> state;     // STREAM_FREE / CLAIMING / CLAIMED / RUNNING / RELEASED
+    int pad;
+    int voice;
+    uint32_t token;                 // Voice startOrder when claimed
+    uint32_t claimedMs;
+    int16_t* ring;
+    std::atomic<uint32_t> written;  // Samples produced (monotonic, reader)
+    std::atomic<uint32_t> consumed; // Samples consumed (monotonic, audio core)
+    uint32_t filePos;               // Next sample to read from the file
+    volatile bool loop;
+    volatile uint32_t loopStart;
+    bool eof;
+    fs::File file;
+  };
+
+  StreamPad pads[16];
+  StreamSlot slots[STREAM_SLOTS];
+  int16_t* ringMemory;
+  uint8_t readBuffer[STREAM_READ_BYTES];  // Un chunk stereo de 16 bits
+  TaskHandle_t readerTaskHandle;
+  StreamStats stats;
+  uint32_t windowBytes;
+  uint32_t windowStartMs;
+
+  static void readerTask(void* arg);
+  void serviceSlots();
+  void openSlot(StreamSlot& slot);
+  void closeSlot(StreamSlot& slot);
+  bool fillChunk(StreamSlot& slot);
+};
+
+#endif // SAMPLESTREAMER_H
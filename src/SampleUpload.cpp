@@ -0,0 +1,287 @@
+/*
+ * SampleUpload.cpp
+ * Pujada -> PSRAM directament, escriptura a LittleFS en segon pla
+ */
+
+#include "SampleUpload.h"
+#include "SampleManager.h"
+
+extern SampleManager sampleManager;
+extern SampleLibrary sampleLibrary;
+
+static void putLE16(uint8_t* p, uint16_t v) { p[0] = v; p[1] = v >> 8; }
+static void putLE32(uint8_t* p, uint32_t v) { p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24; }
+
+SampleUpload::SampleUpload() : active(false), errorText(""), pad(-1), storage(SAMPLE_PCM16), channels(1),
+                               padChannels(1), resident(false), framesWritten(0), startMs(0), peak(0),
+                               writerTaskHandle(nullptr), stage(nullptr), stageMemory(nullptr),
+                               writeBuffer(nullptr), writerIdle(nullptr), closing(false), aborted(false) {
+  memset(&stats, 0, sizeof(stats));
+  family[0] = '\0';
+  filename[0] = '\0';
+  path[0] = '\0';
+}
+
+SampleUpload::~SampleUpload() {
+  if (writerTaskHandle) vTaskDelete(writerTaskHandle);
+  if (stageMemory) free(stageMemory);
+  if (writeBuffer) free(writeBuffer);
+}
+
+bool SampleUpload::begin() {
+  stageMemory = (uint8_t*)ps_malloc(UPLOAD_STAGE_BYTES + 1);  // The stream buffer needs one spare byte
+  writeBuffer = (uint8_t*)heap_caps_malloc(UPLOAD_WRITE_BYTES, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+  writerIdle = xSemaphoreCreateBinary();
+  if (stageMemory == nullptr || writeBuffer == nullptr || writerIdle == nullptr) {
+    Serial.println("[Upload] ERROR: No memory for the upload stage");
+    return false;
+  }
+  stage = xStreamBufferCreateStatic(UPLOAD_STAGE_BYTES, 1, stageMemory, &stageStruct);
+  xSemaphoreGive(writerIdle);
+
+  BaseType_t ok = xTaskCreatePinnedToCore(
+    writerTask,
+    "UploadWriter",
+    UPLOAD_WRITER_STACK,
+    this,
+    UPLOAD_WRITER_PRIORITY,
+    &writerTaskHandle,
+    0       // CORE 0: escriptura a LittleFS fora del core d'àudio
+  );
+  if (ok != pdPASS) {
+    writerTaskHandle = nullptr;
+    Serial.println("[Upload] ERROR: Failed to create writer task");
+    return false;
+  }
+  return true;
+}
+
+bool SampleUpload::fail(const char* text) {
+  errorText = text;
+  return false;
+}
+
+bool SampleUpload::start(int padIndex, const char* familyName, const char* name, SampleFormat format,
+                         uint32_t uploadBytes) {
+  if (active) abort();
+  if (writerTaskHandle == nullptr) return fail("Upload writer not running");
+
+  // The previous file may still be going to flash
+  if (xSemaphoreTake(writerIdle, pdMS_TO_TICKS(UPLOAD_WRITER_WAIT_MS)) != pdTRUE) {
+    return fail("Previous upload still writing to flash");
+  }
+  if (strlen(name) >= sizeof(filename) || strlen(familyName) >= sizeof(family)) {
+    xSemaphoreGive(writerIdle);
+    return fail("File name too long");
+  }
+
+  pad = padIndex;
+  storage = format;
+  strncpy(family, familyName, sizeof(family));
+  strncpy(filename, name, sizeof(filename));
+  snprintf(path, sizeof(path), "/%s/%s", family, filename);
+  resident = false;
+  framesWritten = 0;
+  peak = 0;
+  startMs = millis();
+  errorText = "";
+  closing = false;
+  aborted = false;
+  memset(&pendingEntry, 0, sizeof(pendingEntry));
+  stats.bytesIn = 0;
+  stats.stageWaits = 0;
+
+  ingest.reset(SAMPLE_RATE, formatThunk, framesThunk, this, uploadBytes);
+  xStreamBufferReset(stage);
+  active = true;
+  xTaskNotifyGive(writerTaskHandle);  // Opens the file and drains the stage until `closing`
+  return true;
+}
+
+bool SampleUpload::write(const uint8_t* data, size_t len) {
+  if (!active) return fail(errorText[0] ? errorText : "No upload in progress");
+  stats.bytesIn += len;
+  if (ingest.feed(data, len)) return true;
+  // Our callbacks set errorText; otherwise it is the WAV itself
+  if (errorText[0] == '\0') errorText = ingest.error();
+  const char* reason = errorText;
+  abort();
+  return fail(reason);
+}
+
+bool SampleUpload::finish() {
+  if (!active) return fail(errorText[0] ? errorText : "No upload in progress");
+  if (!ingest.finish()) {
+    const char* reason = errorText[0] ? errorText : ingest.error();
+    abort();
+    return fail(reason);
+  }
+
+  // From here the file completes on its own
+  closing = true;
+  active = false;
+
+  bool ok;
+  if (resident) {
+    ok = sampleManager.finishIngest(filename, storage);
+    if (!ok) errorText = "Pad changed during the upload";
+  } else {
+    // Too big for PSRAM (or no room): play it from the converted file, streaming if needed
+    ok = xSemaphoreTake(writerIdle, pdMS_TO_TICKS(UPLOAD_FLUSH_TIMEOUT_MS)) == pdTRUE;
+    if (ok) {
+      xSemaphoreGive(writerIdle);
+      ok = sampleManager.loadSample(path, pad, storage);
+    }
+    if (!ok) errorText = "Failed to load sample";
+  }
+
+  stats.framesOut = ingest.emittedFrames();
+  stats.resampled = ingest.sourceFormat().sampleRate != SAMPLE_RATE;
+  stats.resident = resident;
+  stats.ingestMs = millis() - startMs;
+  if (ok) stats.uploads++;
+  else stats.failures++;
+  Serial.printf("[Upload] %s: %d KB in, %d frames%s, playable after %d ms (%s)\n", filename, stats.bytesIn / 1024,
+                stats.framesOut, stats.resampled ? " (resampled)" : "", stats.ingestMs,
+                resident ? "decoded to PSRAM" : "loaded from flash");
+  return ok;
+}
+
+void SampleUpload::abort() {
+  if (!active) return;
+  active = false;
+  stats.failures++;
+  if (resident) sampleManager.abortIngest();
+  resident = false;
+  aborted = true;
+  closing = true;   // The writer drops what is staged and removes the file
+}
+
+// Blocks only when the writer is UPLOAD_STAGE_BYTES behind
+bool SampleUpload::stageBytes(const void* data, size_t bytes) {
+  const uint8_t* p = (const uint8_t*)data;
+  size_t sent = xStreamBufferSend(stage, p, bytes, 0);
+  if (sent < bytes) {
+    stats.stageWaits++;
+    sent += xStreamBufferSend(stage, p + sent, bytes - sent, pdMS_TO_TICKS(UPLOAD_STAGE_TIMEOUT_MS));
+  }
+  return sent == bytes || fail("Flash write too slow");
+}
+
+bool SampleUpload::formatThunk(void* context, const WavFormat& source, uint32_t frames) {
+  return ((SampleUpload*)context)->onFormat(source, frames);
+}
+
+bool SampleUpload::framesThunk(void* context, const int16_t* frames, uint32_t count) {
+  return ((SampleUpload*)context)->onFrames(frames, count);
+}
+
+// Header known: the file gets a canonical header, the pad gets its PSRAM buffer
+bool SampleUpload::onFormat(const WavFormat& source, uint32_t frames) {
+  channels = source.channels;
+  uint32_t dataBytes = frames * channels * sizeof(int16_t);
+  uint8_t header[44];
+  memcpy(header, "RIFF", 4);
+  putLE32(header + 4, 36 + dataBytes);
+  memcpy(header + 8, "WAVEfmt ", 8);
+  putLE32(header + 16, 16);
+  putLE16(header + 20, 1);  // PCM
+  putLE16(header + 22, channels);
+  putLE32(header + 24, SAMPLE_RATE);
+  putLE32(header + 28, SAMPLE_RATE * channels * sizeof(int16_t));
+  putLE16(header + 32, channels * sizeof(int16_t));
+  putLE16(header + 34, 16);
+  memcpy(header + 36, "data", 4);
+  putLE32(header + 40, dataBytes);
+  if (!stageBytes(header, sizeof(header))) return false;
+
+  // Same rules as SampleManager::parseWavFile: stereo stays interleaved only as whole PCM
+  bool fits = (size_t)frames * sizeof(int16_t) <= STREAM_THRESHOLD_BYTES;
+  bool stereo = channels == 2 && storage == SAMPLE_PCM16 && (size_t)dataBytes <= STREAM_THRESHOLD_BYTES;
+  padChannels = stereo ? 2 : 1;
+  resident = fits && sampleManager.beginIngest(pad, frames, padChannels);
+  Serial.printf("[Upload] %s: %d Hz %d ch %s -> %d frames @ %d Hz (%s)\n", filename, source.sampleRate, channels,
+                WavDecoder::encodingName(source.encoding), frames, SAMPLE_RATE,
+                resident ? "straight to PSRAM" : "via flash");
+
+  pendingEntry.size = sizeof(header) + dataBytes;
+  pendingEntry.rate = SAMPLE_RATE;
+  pendingEntry.frames = frames;
+  pendingEntry.channels = channels;
+  pendingEntry.bits = 16;
+  pendingEntry.format = LIBRARY_WAV;
+  return true;
+}
+
+bool SampleUpload::onFrames(const int16_t* frames, uint32_t count) {
+  if (!stageBytes(frames, count * channels * sizeof(int16_t))) return false;
+
+  for (uint32_t i = 0; i < count * channels; i++) {
+    int32_t v = frames[i] < 0 ? -(int32_t)frames[i] : frames[i];
+    if (v > peak) peak = v;
+  }
+
+  if (resident) {
+    const int16_t* pcm = frames;
+    if (padChannels != channels) {
+      // Stereo -> mono, as the file loader does
+      for (uint32_t i = 0; i < count; i++) {
+        mixBuffer[i] = (frames[i * 2] / 2) + (frames[i * 2 + 1] / 2);
+      }
+      pcm = mixBuffer;
+    }
+    if (!sampleManager.writeIngest(framesWritten, pcm, count)) {
+      resident = false;
+      return fail("Pad changed during the upload");
+    }
+  }
+  framesWritten += count;
+  return true;
+}
+
+void SampleUpload::writerTask(void* arg) {
+  SampleUpload* self = (SampleUpload*)arg;
+  Serial.printf("[Task] Upload Writer iniciada en Core 0 (Prioridad: %d)\n", UPLOAD_WRITER_PRIORITY);
+  while (true) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    self->writeFile();
+    xSemaphoreGive(self->writerIdle);
+  }
+}
+
+// Drains the stage into the file until the upload side is done with it
+void SampleUpload::writeFile() {
+  uint32_t start = millis();
+  String dir = String("/") + family;
+  if (!LittleFS.exists(dir)) LittleFS.mkdir(dir);
+  File file = LittleFS.open(path, "w");
+  bool ok = (bool)file;
+  if (!ok) Serial.printf("[Upload] ERROR: Failed to create %s\n", path);
+
+  while (true) {
+    size_t n = xStreamBufferReceive(stage, writeBuffer, UPLOAD_WRITE_BYTES, pdMS_TO_TICKS(50));
+    if (n > 0 && ok && !aborted) {
+      ok = file.write(writeBuffer, n) == n;
+      if (!ok) Serial.printf("[Upload] ERROR: Write failed on %s\n", path);
+    }
+    // `closing` is set after the last send: nothing left once a receive comes back empty
+    if (n == 0 && closing) break;
+  }
+  if (file) file.close();
+
+  if (!ok || aborted) {
+    LittleFS.remove(path);
+    return;
+  }
+
+  stats.flashMs = millis() - start;
+  File check = LittleFS.open(path, "r");
+  pendingEntry.mtime = check ? (uint32_t)check.getLastWrite() : 0;
+  if (check) check.close();
+  strncpy(pendingEntry.name, filename, LIBRARY_NAME_LEN - 1);
+  pendingEntry.family = SampleLibrary::familyIndex(family);
+  pendingEntry.peak = peak > 32767 ? 32767 : peak;
+  sampleLibrary.addEntry(pendingEntry);
+  Serial.printf("[Upload] ✓ %s written in the background (%d KB, %d ms)\n", path, pendingEntry.size / 1024,
+                stats.flashMs);
+}
@@ -0,0 +1,100 @@
+/*
+ * SampleUpload.h
+ * Pujada de samples en un sol pas: cada tros HTTP es decodifica directament
+ * a la PSRAM del pad (SampleIngest) i es copia a un buffer d'staging que una
+ * tasca de Core 0 escriu a LittleFS en segon pla.
+ * El pad sona quan arriba l'últim tros, sense rellegir el fitxer
+ *
+ * A flash es guarda el WAV ja convertit (16-bit, SAMPLE_RATE, mateixos canals):
+ * en tornar-lo a carregar sona igual que el que s'ha pujat
+ */
+
+#ifndef SAMPLEUPLOAD_H
+#define SAMPLEUPLOAD_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include <FS.h>
+#include <freertos/stream_buffer.h>
+#include "SampleIngest.h"
+#include "SampleCodec.h"
+#include "SampleLibrary.h"
+
+#define UPLOAD_STAGE_BYTES (128 * 1024)   // PSRAM: a typical one-shot fits whole, the HTTP side never waits
+#define UPLOAD_WRITE_BYTES 4096           // Per LittleFS write (internal SRAM)
+#define UPLOAD_STAGE_TIMEOUT_MS 2000      // Stage full this long: flash too slow, upload fails
+#define UPLOAD_WRITER_WAIT_MS 2000        // Previous file still being written
+#define UPLOAD_FLUSH_TIMEOUT_MS 10000     // Sample too big for PSRAM: wait for the file before loading it
+#define UPLOAD_WRITER_PRIORITY 2          // Com el KitLoader: per sota de SystemTask (5)
+#define UPLOAD_WRITER_STACK 4096
+
+// Last upload, for the log and /api/sysinfo
+struct UploadStats {
+  uint32_t uploads;
+  uint32_t failures;
+  uint32_t bytesIn;           // WAV bytes received
+  uint32_t framesOut;         // Frames at SAMPLE_RATE
+  bool resampled;
+  bool resident;              // Decoded straight to PSRAM (false: loaded from the file afterwards)
+  uint32_t ingestMs;          // First chunk -> playable
+  uint32_t flashMs;           // Background write of the file
+  uint32_t stageWaits;        // Chunks that found the stage full
+};
+
+class SampleUpload {
+public:
+  SampleUpload();
+  ~SampleUpload();
+
+  bool begin();
+
+  // One upload at a time. `path` = /FAMILY/name.wav. uploadBytes = Content-Length (0 = unknown)
+  bool start(int padIndex, const char* family, const char* filename, SampleFormat storage, uint32_t uploadBytes);
+  bool write(const uint8_t* data, size_t len);   // false: see error()
+  bool finish();                                 // true: the pad plays the new sample
+  void abort();
+  bool isActive() { return active; }
+  const char* error() { return errorText; }
+  void getStats(UploadStats& out) { out = stats; }
+
+private:
+  SampleIngest ingest;
+  bool active;
+  const char* errorText;
+  UploadStats stats;
+
+  int pad;
+  SampleFormat storage;
+  char family[4];
+  char filename[LIBRARY_NAME_LEN];
+  char path[80];
+  uint8_t channels;           // Source channels (the file keeps them)
+  uint8_t padChannels;        // PSRAM: 1 when stereo is mixed down
+  bool resident;
+  uint32_t framesWritten;
+  uint32_t startMs;
+  int32_t peak;
+  int16_t mixBuffer[INGEST_BLOCK_FRAMES];
+
+  // Background writer
+  TaskHandle_t writerTaskHandle;
+  StreamBufferHandle_t stage;
+  StaticStreamBuffer_t stageStruct;
+  uint8_t* stageMemory;
+  uint8_t* writeBuffer;
+  SemaphoreHandle_t writerIdle;  // Given when the file is closed
+  volatile bool closing;         // No more data after what is staged
+  volatile bool aborted;         // Remove the file instead of indexing it
+  LibraryEntry pendingEntry;     // Indexed once the file is complete
+
+  bool fail(const char* text);
+  bool stageBytes(const void* data, size_t bytes);
+  bool onFormat(const WavFormat& source, uint32_t frames);
+  bool onFrames(const int16_t* frames, uint32_t count);
+  static bool formatThunk(void* context, const WavFormat& source, uint32_t frames);
+  static bool framesThunk(void* context, const int16_t* frames, uint32_t count);
+  static void writerTask(void* arg);
+  void writeFile();
+};
+
+#endif // SAMPLEUPLOAD_H
@@ -1,6 +1,6 @@
 /*
  * Sequencer.cpp
- * Implementació del sequencer de 16 steps
+ * Implementació del sequencer (patterns d'1 a 64 steps, polimetria per track)
  */
 
 #include "Sequencer.h"
@@ -10,136 +10,191 @@ Sequencer::Sequencer() :
   currentPattern(0), 
   currentStep(0), 
   tempo(120.0f),
-  lastStepTime(0),
+  swing(SWING_MIN),
+  frameClock(nullptr),
+  frameRate(SEQ_DEFAULT_FRAME_RATE),
+  tickRemainder(0),
+  nextTickFrame(0),
+  cursorTick(0),
+  uiPending(false),
+  uiStep(0),
+  uiFrame(0),
+  uiPattern(-1),
+  uiNextPattern(-1),
+  queuedPattern(-1),
+  songLength(0),
+  songMode(false),
+  songPosition(0),
+  songRepeat(0),
+  mutedTracks(0),
   stepCallback(nullptr),
-  stepChangeCallback(nullptr) {
+  stepChangeCallback(nullptr),
+  barCallback(nullptr),
+  patternChangeCallback(nullptr) {
   
-  // Initialize all patterns
-  for (int p = 0; p < MAX_PATTERNS; p++) {
-    for (int t = 0; t < MAX_TRACKS; t++) {
-      for (int s = 0; s < STEPS_PER_PATTERN; s++) {
-        steps[p][t][s] = false;
-        velocities[p][t][s] = 127;
-      }
-      if (p == 0) {
-        trackMuted[t] = false;
-        loopActive[t] = false;
-        loopPaused[t] = false;
-      }
-    }
+  // Initialize all patterns (empty: no events in the pool)
+  events.clear();
+  ratchets.clear();
+  conditions.clear();
+  locks.clear();
+  for (int p = 0; p < MAX_PATTERNS; p++) patternSeed[p] = 0x9E3779B9u * (p + 1);
+  memset(patternLength, STEPS_PER_PATTERN, sizeof(patternLength));
+  memset(trackLength, 0, sizeof(trackLength));
+  memset(trackDivider, 1, sizeof(trackDivider));
+  memset(trackStep, 0, sizeof(trackStep));
+  memset(trackPulse, 0, sizeof(trackPulse));
+  memset(trackCycle, 0, sizeof(trackCycle));
+  preFired = 0;
+  rngState = patternSeed[0];
+  fill = false;
+  memset(song, 0, sizeof(song));
+  for (int t = 0; t < MAX_TRACKS; t++) {
+    loopActive[t] = false;
+    loopPaused[t] = false;
   }
   
   // Patrón 0: Ritmo básico 808 con dinámicas variadas
   // BD (0): Kick en 1,5,9,13 - acentos en 1 y 9
-  steps[0][0][0] = true; velocities[0][0][0] = 127;  // Acento fuerte
-  steps[0][0][4] = true; velocities[0][0][4] = 100;  // Medio
-  steps[0][0][8] = true; velocities[0][0][8] = 127;  // Acento fuerte
-  steps[0][0][12] = true; velocities[0][0][12] = 90;  // Suave
+  writeStep(0, 0, 0, true, 127);  // Acento fuerte
+  writeStep(0, 0, 4, true, 100);  // Medio
+  writeStep(0, 0, 8, true, 127);  // Acento fuerte
+  writeStep(0, 0, 12, true, 90);  // Suave
   
   // SD (1): Snare en 4,12 - ghost notes en 6,14
-  steps[0][1][4] = true; velocities[0][1][4] = 127;   // Acento fuerte
-  steps[0][1][6] = true; velocities[0][1][6] = 60;    // Ghost note
-  steps[0][1][12] = true; velocities[0][1][12] = 127; // Acento fuerte
-  steps[0][1][14] = true; velocities[0][1][14] = 70;  // Ghost note suave
+  writeStep(0, 1, 4, true, 127);   // Acento fuerte
+  writeStep(0, 1, 6, true, 60);    // Ghost note
+  writeStep(0, 1, 12, true, 127); // Acento fuerte
+  writeStep(0, 1, 14, true, 70);  // Ghost note suave
   
   // CH (2): Hi-hat 16ths con swing y acentos
   for (int s = 0; s < 16; s++) {
-    steps[0][2][s] = true;
-    if (s % 4 == 0) velocities[0][2][s] = 110;      // Tiempo fuerte
-    else if (s % 2 == 0) velocities[0][2][s] = 85;  // Off-beat
-    else velocities[0][2][s] = 65;                  // 16ths suaves
+    if (s % 4 == 0) writeStep(0, 2, s, true, 110);      // Tiempo fuerte
+    else if (s % 2 == 0) writeStep(0, 2, s, true, 85);  // Off-beat
+    else writeStep(0, 2, s, true, 65);                  // 16ths suaves
   }
   
   // OH (3): Open hat en off-beats asincopados
-  steps[0][3][2] = true; velocities[0][3][2] = 90;
-  steps[0][3][6] = true; velocities[0][3][6] = 100;
-  steps[0][3][10] = true; velocities[0][3][10] = 80;
-  steps[0][3][14] = true; velocities[0][3][14] = 95;
+  writeStep(0, 3, 2, true, 90);
+  writeStep(0, 3, 6, true, 100);
+  writeStep(0, 3, 10, true, 80);
+  writeStep(0, 3, 14, true, 95);
   
   // CP (4): Clap en 4,12 con doble tap
-  steps[0][4][4] = true; velocities[0][4][4] = 110;
-  steps[0][4][12] = true; velocities[0][4][12] = 110;
+  writeStep(0, 4, 4, true, 110);
+  writeStep(0, 4, 12, true, 110);
   
   // RS (5): Rimshot asincopado
-  steps[0][5][3] = true; velocities[0][5][3] = 80;
-  steps[0][5][7] = true; velocities[0][5][7] = 70;
-  steps[0][5][11] = true; velocities[0][5][11] = 90;
-  steps[0][5][15] = true; velocities[0][5][15] = 75;
+  writeStep(0, 5, 3, true, 80);
+  writeStep(0, 5, 7, true, 70);
+  writeStep(0, 5, 11, true, 90);
+  writeStep(0, 5, 15, true, 75);
   
   // Patrón 1: Ritmo Afro-Cuban / Tresillo
   // BD: Patrón 3-3-2
-  steps[1][0][0] = true; velocities[1][0][0] = 127;
-  steps[1][0][3] = true; velocities[1][0][3] = 100;
-  steps[1][0][6] = true; velocities[1][0][6] = 120;
-  steps[1][0][8] = true; velocities[1][0][8] = 110;
-  steps[1][0][11] = true; velocities[1][0][11] = 95;
-  steps[1][0][14] = true; velocities[1][0][14] = 115;
+  writeStep(1, 0, 0, true, 127);
+  writeStep(1, 0, 3, true, 100);
+  writeStep(1, 0, 6, true, 120);
+  writeStep(1, 0, 8, true, 110);
+  writeStep(1, 0, 11, true, 95);
+  writeStep(1, 0, 14, true, 115);
   
   // SD: Clave pattern
-  steps[1][1][0] = true; velocities[1][1][0] = 110;
-  steps[1][1][3] = true; velocities[1][1][3] = 100;
-  steps[1][1][6] = true; velocities[1][1][6] = 90;
-  steps[1][1][10] = true; velocities[1][1][10] = 105;
-  steps[1][1][12] = true; velocities[1][1][12] = 95;
+  writeStep(1, 1, 0, true, 110);
+  writeStep(1, 1, 3, true, 100);
+  writeStep(1, 1, 6, true, 90);
+  writeStep(1, 1, 10, true, 105);
+  writeStep(1, 1, 12, true, 95);
   
   // CH: Patrón sincopado
   for (int s = 0; s < 16; s++) {
     if (s % 3 == 0) {
-      steps[1][2][s] = true;
-      velocities[1][2][s] = (s % 6 == 0) ? 100 : 75;
+      writeStep(1, 2, s, true, (s % 6 == 0) ? 100 : 75);
     }
   }
   
   // Patrón 2: Breakbeat con shuffle
   // BD: Groovy pattern
-  steps[2][0][0] = true; velocities[2][0][0] = 127;
-  steps[2][0][2] = true; velocities[2][0][2] = 70;   // Ghost
-  steps[2][0][5] = true; velocities[2][0][5] = 95;
-  steps[2][0][7] = true; velocities[2][0][7] = 85;
-  steps[2][0][10] = true; velocities[2][0][10] = 100;
-  steps[2][0][13] = true; velocities[2][0][13] = 75;
-  steps[2][0][15] = true; velocities[2][0][15] = 90;
+  writeStep(2, 0, 0, true, 127);
+  writeStep(2, 0, 2, true, 70);   // Ghost
+  writeStep(2, 0, 5, true, 95);
+  writeStep(2, 0, 7, true, 85);
+  writeStep(2, 0, 10, true, 100);
+  writeStep(2, 0, 13, true, 75);
+  writeStep(2, 0, 15, true, 90);
   
   // SD: Backbeat con flams
-  steps[2][1][3] = true; velocities[2][1][3] = 60;   // Flam ghost
-  steps[2][1][4] = true; velocities[2][1][4] = 127;  // Backbeat
-  steps[2][1][11] = true; velocities[2][1][11] = 65; // Flam ghost
-  steps[2][1][12] = true; velocities[2][1][12] = 127;// Backbeat
+  writeStep(2, 1, 3, true, 60);   // Flam ghost
+  writeStep(2, 1, 4, true, 127);  // Backbeat
+  writeStep(2, 1, 11, true, 65); // Flam ghost
+  writeStep(2, 1, 12, true, 127);// Backbeat
   
   // CH: Shuffle pattern (swing)
   for (int s = 0; s < 16; s += 2) {
-    steps[2][2][s] = true;
-    velocities[2][2][s] = (s % 4 == 0) ? 100 : 70;
+    writeStep(2, 2, s, true, (s % 4 == 0) ? 100 : 70);
     if (s < 15) {
-      steps[2][2][s+1] = true;
-      velocities[2][2][s+1] = 50; // Shuffle note suave
+      writeStep(2, 2, s+1, true, 50); // Shuffle note suave
     }
   }
   
   // OH: Acentos en off-beats
-  steps[2][3][6] = true; velocities[2][3][6] = 95;
-  steps[2][3][14] = true; velocities[2][3][14] = 100;
+  writeStep(2, 3, 6, true, 95);
+  writeStep(2, 3, 14, true, 100);
   
-  calculateStepInterval();
+  calculateTickRate();
 }
 
 Sequencer::~Sequencer() {
 }
 
+// Web / UDP (Core 1) while schedule() runs on SeqClock (Core 0): the state is reset
+// under patternMux and `playing` set last, so schedule() never sees a stale tick clock
 void Sequencer::start() {
+  // First step MICRO_TIMING_MAX ticks after now: a step played early still lands in the future
+  uint32_t now = clockNow();
+  portENTER_CRITICAL(&patternMux);
+  if (songMode && songLength > 0) {
+    // La cadena empieza por su primera entrada
+    songPosition = 0;
+    songRepeat = 0;
+    queuedPattern = -1;
+    currentPattern = songEntryPattern(song[0]);
+    currentStep = 0;
+    enterPattern();
+  }
+  rngState = patternSeed[currentPattern];  // Same seed, same run of probabilities
+  nextTickFrame = now;
+  tickRemainder = 0;
+  cursorTick = 0;
+  uiPending = false;
+  uiNextPattern = -1;
   playing = true;
-  lastStepTime = micros();
+  portEXIT_CRITICAL(&patternMux);
   Serial.println("Sequencer started");
 }
 
 void Sequencer::stop() {
+  portENTER_CRITICAL(&patternMux);
   playing = false;
+  uiPending = false;
+  uiPattern = -1;
+  uiNextPattern = -1;
+  if (queuedPattern >= 0) {
+    currentPattern = queuedPattern;  // Never reached its pattern end
+    queuedPattern = -1;
+  }
+  portEXIT_CRITICAL(&patternMux);
   Serial.println("Sequencer stopped");
 }
 
 void Sequencer::reset() {
+  uint32_t now = clockNow();
+  portENTER_CRITICAL(&patternMux);
   currentStep = 0;
-  lastStepTime = micros();
+  enterPattern();
+  nextTickFrame = now;
+  tickRemainder = 0;
+  cursorTick = 0;
+  portEXIT_CRITICAL(&patternMux);
 }
 
 bool Sequencer::isPlaying() {
@@ -151,7 +206,7 @@ void Sequencer::setTempo(float bpm) {
   if (bpm > 300.0f) bpm = 300.0f;
   
   tempo = bpm;
-  calculateStepInterval();
+  calculateTickRate();
   
   Serial.printf("Tempo set to %.1f BPM\n", tempo);
 }
@@ -160,90 +215,359 @@ float Sequencer::getTempo() {
   return tempo;
 }
 
-void Sequencer::calculateStepInterval() {
-  // 16th notes
-  // 1 beat = 60/BPM seconds
-  // 1 16th note = (60/BPM) / 4 seconds
-  // Convert to microseconds
-  stepInterval = (uint32_t)((60.0f / tempo / 4.0f) * 1000000.0f);
+void Sequencer::setSwing(int percent) {
+  swing = constrain(percent, SWING_MIN, SWING_MAX);
+  Serial.printf("Swing set to %d%%\n", swing);
+}
+
+void Sequencer::setFrameClock(FrameClock clock, uint32_t rate) {
+  frameClock = clock;
+  frameRate = rate ? rate : SEQ_DEFAULT_FRAME_RATE;
+  calculateTickRate();
+  if (playing) reset();
+}
+
+// 1 tick = 60 / (BPM * PPQN) s = frameRate * 60000 / (milliBPM * PPQN) frames.
+// The division is kept as quotient + remainder: no rounding error accumulates
+// Under patternMux: advanceTick() on SeqClock never mixes the old and new rate
+void Sequencer::calculateTickRate() {
+  uint32_t milliBpm = (uint32_t)(tempo * 1000.0f + 0.5f);
+  uint64_t num = (uint64_t)frameRate * 60000ULL;
+  uint64_t den = (uint64_t)milliBpm * SEQ_PPQN;
+  portENTER_CRITICAL(&patternMux);
+  frameNum = num;
+  frameDen = den;
+  framesPerTick = (uint32_t)(num / den);
+  frameRemainder = (uint32_t)(num % den);
+  tickRemainder = 0;  // Tempo change: the grid restarts from the next tick
+  portEXIT_CRITICAL(&patternMux);
+}
+
+uint32_t Sequencer::clockNow() {
+  if (frameClock != nullptr) return frameClock();
+  // Sin reloj de audio: micros() en frames (salta al dar la vuelta, cada ~71 min: un resync)
+  return (uint32_t)((uint64_t)micros() * frameRate / 1000000ULL);
+}
+
+void Sequencer::advanceTick() {
+  nextTickFrame += framesPerTick;
+  tickRemainder += frameRemainder;
+  if (tickRemainder >= frameDen) {
+    tickRemainder -= frameDen;
+    nextTickFrame++;
+  }
+  if (++cursorTick >= TICKS_PER_STEP) cursorTick = 0;
+}
+
+uint32_t Sequencer::ticksToFrames(int32_t ticksQ4) {
+  if (ticksQ4 <= 0) return 0;
+  return (uint32_t)(((uint64_t)ticksQ4 * frameNum) / (frameDen * 16));
 }
 
 void Sequencer::update() {
+  schedule();
+  updateUi();
+}
+
+void Sequencer::schedule() {
   if (!playing) return;
   
-  uint32_t now = micros();
+  uint32_t now = clockNow();
   
-  // Check if it's time for next step
-  if (now - lastStepTime >= stepInterval) {
-    lastStepTime = now;
-    
-    // PRIMERO: Notificar el step ACTUAL (antes de avanzar)
-    // Esto sincroniza la visualización con el audio
-    if (stepChangeCallback != nullptr) {
-      stepChangeCallback(currentStep);
-    }
-    
-    // SEGUNDO: Procesar el audio del step actual
-    processStep();
-    
-    // TERCERO: Avanzar al siguiente step para la próxima iteración
-    currentStep++;
-    if (currentStep >= STEPS_PER_PATTERN) {
-      currentStep = 0;
+  // Every tick inside the lookahead window; a step is scheduled MICRO_TIMING_MAX ticks
+  // before its grid position so that negative micro-timing can still be honoured.
+  // Task stalled (flash, WiFi): the missed steps are skipped instead of fired all at once
+  // The tick clock moves under patternMux (start / stop / tempo come from another core);
+  // the step itself is scheduled outside it (callbacks, bar changes)
+  uint32_t horizon = now + SEQ_LOOKAHEAD_FRAMES;
+  while (true) {
+    portENTER_CRITICAL(&patternMux);
+    bool due = playing && (int32_t)(nextTickFrame - horizon) <= 0;
+    uint32_t frame = nextTickFrame;
+    bool stepTick = cursorTick == 0;
+    if (due) advanceTick();
+    portEXIT_CRITICAL(&patternMux);
+    if (!due) break;
+    if (stepTick) scheduleStep(frame, (int32_t)(now - frame) > SEQ_RESYNC_FRAMES);
+  }
+}
+
+// Visualización: el step cambia cuando su frame llega al motor de audio.
+// Corre en otra tarea que schedule(): los callbacks (WebSocket) no retrasan el reloj
+void Sequencer::updateUi() {
+  if (!playing || !uiPending) return;
+  if ((int32_t)(clockNow() - uiFrame) >= 0) firePendingUi();
+}
+
+void Sequencer::firePendingUi() {
+  portENTER_CRITICAL(&patternMux);
+  bool pending = uiPending;
+  int step = uiStep;
+  int pattern = uiPattern;
+  uiPending = false;
+  uiPattern = -1;
+  portEXIT_CRITICAL(&patternMux);
+  
+  if (!pending) return;
+  if (pattern >= 0 && patternChangeCallback != nullptr) patternChangeCallback(pattern);
+  if (stepChangeCallback != nullptr) stepChangeCallback(step);
+}
+
+// `frame` = cursor tick, MICRO_TIMING_MAX ticks before the step's grid position
+void Sequencer::scheduleStep(uint32_t frame, bool silent) {
+  // Inicio de compás: cambios pendientes (kit) antes de los triggers del step 0
+  if (currentStep == 0 && barCallback != nullptr) {
+    barCallback();
+  }
+  
+  // PRIMERO: Notificar el step ACTUAL (antes de avanzar), al llegar su frame.
+  // Si el anterior aún no se ha mostrado se sustituye (un cambio de patrón no se pierde)
+  portENTER_CRITICAL(&patternMux);
+  uiPending = true;
+  uiStep = currentStep;
+  uiFrame = frame + ticksToFrames(MICRO_TIMING_MAX * 16);
+  if (currentStep == 0 && uiNextPattern >= 0) {
+    uiPattern = uiNextPattern;
+    uiNextPattern = -1;
+  }
+  portEXIT_CRITICAL(&patternMux);
+  
+  // SEGUNDO: Procesar el audio del step actual
+  if (!silent) processStep(frame);
+  
+  // TERCERO: Avanzar al siguiente step para la próxima iteración
+  // (los tracks con longitud o divisor propios siguen su propio ciclo)
+  advanceTracks();
+  currentStep++;
+  if (currentStep >= patternLength[currentPattern]) {
+    currentStep = 0;
+    endOfPattern();
+  }
+}
+
+// Last step of the pattern just scheduled: the next one scheduled is step 0 of whatever
+// comes next, on the following grid tick (no step lost or repeated)
+void Sequencer::endOfPattern() {
+  int next = currentPattern;
+  int queued = queuedPattern;
+  
+  if (queued >= 0) {
+    next = queued;
+    queuedPattern = -1;
+  } else if (songMode) {
+    portENTER_CRITICAL(&patternMux);
+    if (songLength > 0) {
+      if (songPosition >= songLength) songPosition = 0;  // Song edited while playing
+      if (++songRepeat >= songEntryRepeats(song[songPosition])) {
+        songRepeat = 0;
+        songPosition = (songPosition + 1) % songLength;
+      }
+      next = songEntryPattern(song[songPosition]);
     }
+    portEXIT_CRITICAL(&patternMux);
   }
+  
+  if (next == currentPattern) return;
+  currentPattern = next;
+  enterPattern();
+  uiNextPattern = next;  // Reported with the step 0 of the new pattern
+}
+
+// Pattern starts from its step 0: track positions, cycles (conditions) and its PRNG seed
+void Sequencer::enterPattern() {
+  memset(trackStep, 0, sizeof(trackStep));
+  memset(trackPulse, 0, sizeof(trackPulse));
+  memset(trackCycle, 0, sizeof(trackCycle));
+  preFired = 0;
+  rngState = patternSeed[currentPattern];
 }
 
-void Sequencer::processStep() {
+void Sequencer::processStep(uint32_t frame) {
+  // Grid position of this step, swing included (odd 16ths late), in 1/16 ticks from `frame`
+  int32_t gridQ4 = MICRO_TIMING_MAX * 16;
+  if (currentStep & 1) gridQ4 += (swing - SWING_MIN) * 2 * TICKS_PER_STEP * 16 / 100;
+  
   // First: Process looped tracks
-  processLoops();
+  processLoops(frame + ticksToFrames(gridQ4));
+  
+  // Tracks due on this step (divider) with their own step set: one bit test per track,
+  // then only the hits are visited
+  StepEvent trackEvent[MAX_TRACKS];
+  StepRatchet trackRatchet[MAX_TRACKS];
+  StepCondition trackCondition[MAX_TRACKS];
+  ParamLock trackLock[MAX_TRACKS];
+  uint32_t hits = 0;
+  uint32_t rolls = 0;
+  uint32_t locked = 0;
+  uint32_t conditional = 0;
   
-  // Trigger all active tracks at current step
+  portENTER_CRITICAL(&patternMux);
   for (int track = 0; track < MAX_TRACKS; track++) {
-    // Check sequencer steps
-    if (steps[currentPattern][track][currentStep] && !trackMuted[track]) {
-      uint8_t velocity = velocities[currentPattern][track][currentStep];
-      
-      // Call callback if set
-      if (stepCallback != nullptr) {
-        stepCallback(track, velocity);
-      }
+    if (trackPulse[track] != 0) continue;
+    if (trackStep[track] >= getTrackLength(currentPattern, track)) trackStep[track] = 0;  // Shortened while playing
+    if (events.has(currentPattern, track, trackStep[track])) hits |= 1u << track;
+  }
+  for (uint32_t pending = hits; pending; pending &= pending - 1) {
+    int track = __builtin_ctz(pending);
+    if (conditions.has(currentPattern, track, trackStep[track])) {
+      trackCondition[track] = conditions.at(currentPattern, track, trackStep[track]);
+      conditional |= 1u << track;
+    }
+  }
+  hits &= ~mutedTracks;
+  for (uint32_t pending = hits; pending; pending &= pending - 1) {
+    int track = __builtin_ctz(pending);
+    trackEvent[track] = events.at(currentPattern, track, trackStep[track]);
+    if (ratchets.has(currentPattern, track, trackStep[track])) {
+      trackRatchet[track] = ratchets.at(currentPattern, track, trackStep[track]);
+      rolls |= 1u << track;
+    }
+    if (locks.has(currentPattern, track, trackStep[track])) {
+      trackLock[track] = locks.at(currentPattern, track, trackStep[track]);
+      locked |= 1u << track;
+    }
+  }
+  portEXIT_CRITICAL(&patternMux);
+  
+  // Conditions: only the steps that have one, in track order, muted tracks included
+  // (muting never changes what the other tracks draw from the PRNG)
+  for (uint32_t pending = conditional; pending; pending &= pending - 1) {
+    int track = __builtin_ctz(pending);
+    if (!evaluateCondition(track, trackCondition[track])) hits &= ~(1u << track);
+  }
+  
+  if (stepCallback == nullptr) return;
+  for (; hits; hits &= hits - 1) {
+    int track = __builtin_ctz(hits);
+    int32_t startQ4 = gridQ4 + trackEvent[track].microTiming * 16;
+    const ParamLock* lock = (locked & (1u << track)) ? &trackLock[track] : nullptr;
+    if (!(rolls & (1u << track))) {
+      stepCallback(track, trackEvent[track].velocity, frame + ticksToFrames(startQ4), lock);
+      continue;
+    }
+    
+    // Ratchet: every hit on its own frame (1/16 tick resolution), velocity ramped
+    int count = (trackRatchet[track].shape & 0x07) + 1;
+    int spacing = trackRatchet[track].shape >> 3;
+    int32_t spacingQ4 = spacing ? spacing * 16 : TICKS_PER_STEP * 16 / count;
+    for (int i = 0; i < count; i++) {
+      int velocity = constrain(trackEvent[track].velocity + i * trackRatchet[track].ramp, 1, 127);
+      stepCallback(track, velocity, frame + ticksToFrames(startQ4 + i * spacingQ4), lock);
     }
   }
 }
 
-void Sequencer::setStep(int track, int step, bool active, uint8_t velocity) {
-  if (track < 0 || track >= MAX_TRACKS) return;
-  if (step < 0 || step >= STEPS_PER_PATTERN) return;
+// Each track moves every `divider` steps and wraps at its own length
+void Sequencer::advanceTracks() {
+  for (int track = 0; track < MAX_TRACKS; track++) {
+    if (++trackPulse[track] < trackDivider[currentPattern][track]) continue;
+    trackPulse[track] = 0;
+    if (++trackStep[track] >= getTrackLength(currentPattern, track)) {
+      trackStep[track] = 0;
+      trackCycle[track]++;
+    }
+  }
+}
+
+// Condition first (no PRNG draw if it fails), then probability. The result feeds PRE
+bool Sequencer::evaluateCondition(int track, StepCondition condition) {
+  bool pass;
+  uint8_t c = condition.condition;
+  if (c & COND_RATIO) {
+    int a = ((c >> 3) & 0x07) + 1;
+    int b = (c & 0x07) + 1;
+    pass = trackCycle[track] % b == a - 1;
+  } else {
+    bool first = trackCycle[track] == 0;
+    bool pre = (preFired >> track) & 1;
+    switch (c) {
+      case COND_FILL:      pass = fill; break;
+      case COND_NOT_FILL:  pass = !fill; break;
+      case COND_FIRST:     pass = first; break;
+      case COND_NOT_FIRST: pass = !first; break;
+      case COND_PRE:       pass = pre; break;
+      case COND_NOT_PRE:   pass = !pre; break;
+      default:             pass = true; break;
+    }
+  }
+  
+  if (pass && condition.probability < 100) {
+    // xorshift32, scaled to 0-99 without a division
+    rngState ^= rngState << 13;
+    rngState ^= rngState >> 17;
+    rngState ^= rngState << 5;
+    pass = (uint32_t)(((uint64_t)rngState * 100) >> 32) < condition.probability;
+  }
   
-  steps[currentPattern][track][step] = active;
-  velocities[currentPattern][track][step] = velocity;
+  if (pass) preFired |= 1u << track;
+  else preFired &= ~(1u << track);
+  return pass;
 }
 
-bool Sequencer::getStep(int track, int step) {
+// ============= STEP POOL =============
+
+// false = pool full (step not added). Turning a step off drops its ratchet, condition and locks
+bool Sequencer::writeStep(int pattern, int track, int step, bool active, uint8_t velocity) {
+  if (!active) {
+    events.erase(pattern, track, step);
+    ratchets.erase(pattern, track, step);
+    conditions.erase(pattern, track, step);
+    locks.erase(pattern, track, step);
+    return true;
+  }
+  
+  StepEvent* event = events.add(pattern, track, step);  // New: micro-timing 0
+  if (event == nullptr) return false;
+  event->velocity = velocity;
+  return true;
+}
+
+// ============= PATTERN EDITING =============
+
+bool Sequencer::setStep(int track, int step, bool active, uint8_t velocity) {
   if (track < 0 || track >= MAX_TRACKS) return false;
-  if (step < 0 || step >= STEPS_PER_PATTERN) return false;
+  if (step < 0 || step >= MAX_STEPS) return false;
+  
+  portENTER_CRITICAL(&patternMux);
+  bool ok = writeStep(currentPattern, track, step, active, velocity);
+  portEXIT_CRITICAL(&patternMux);
   
-  return steps[currentPattern][track][step];
+  if (!ok) {
+    Serial.printf("[Sequencer] Step pool full (%d steps), step %d/%d not set\n", STEP_POOL_SIZE, track, step);
+  }
+  return ok;
+}
+
+bool Sequencer::getStep(int track, int step) {
+  return getStep(currentPattern, track, step);
 }
 
 bool Sequencer::getStep(int pattern, int track, int step) {
   if (pattern < 0 || pattern >= MAX_PATTERNS) return false;
   if (track < 0 || track >= MAX_TRACKS) return false;
-  if (step < 0 || step >= STEPS_PER_PATTERN) return false;
+  if (step < 0 || step >= MAX_STEPS) return false;
+  
+  return events.has(pattern, track, step);
+}
+
+StepMask Sequencer::getTrackSteps(int pattern, int track) {
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return 0;
+  if (track < 0 || track >= MAX_TRACKS) return 0;
   
-  return steps[pattern][track][step];
+  return events.mask[pattern][track];
 }
 
 void Sequencer::clearPattern(int pattern) {
   if (pattern < 0 || pattern >= MAX_PATTERNS) return;
   
+  portENTER_CRITICAL(&patternMux);
   for (int t = 0; t < MAX_TRACKS; t++) {
-    for (int s = 0; s < STEPS_PER_PATTERN; s++) {
-      steps[pattern][t][s] = false;
-      velocities[pattern][t][s] = 127;
-    }
+    events.clearTrack(pattern, t);
+    ratchets.clearTrack(pattern, t);
+    conditions.clearTrack(pattern, t);
+    locks.clearTrack(pattern, t);
   }
+  portEXIT_CRITICAL(&patternMux);
   
   Serial.printf("Pattern %d cleared\n", pattern);
 }
@@ -255,9 +579,12 @@ void Sequencer::clearPattern() {
 void Sequencer::clearTrack(int track) {
   if (track < 0 || track >= MAX_TRACKS) return;
   
-  for (int s = 0; s < STEPS_PER_PATTERN; s++) {
-    steps[currentPattern][track][s] = false;
-  }
+  portENTER_CRITICAL(&patternMux);
+  events.clearTrack(currentPattern, track);
+  ratchets.clearTrack(currentPattern, track);
+  conditions.clearTrack(currentPattern, track);
+  locks.clearTrack(currentPattern, track);
+  portEXIT_CRITICAL(&patternMux);
   
   Serial.printf("Track %d cleared\n", track);
 }
@@ -265,60 +592,403 @@ void Sequencer::clearTrack(int track) {
 // ============= VELOCITY EDITING =============
 
 void Sequencer::setStepVelocity(int track, int step, uint8_t velocity) {
-  if (track < 0 || track >= MAX_TRACKS) return;
-  if (step < 0 || step >= STEPS_PER_PATTERN) return;
-  
-  velocities[currentPattern][track][step] = constrain(velocity, 1, 127);
-  Serial.printf("Pattern %d, Track %d, Step %d velocity set to %d\n", 
-                currentPattern, track, step, velocity);
+  setStepVelocity(currentPattern, track, step, velocity);
 }
 
+// Only active steps carry a velocity
 void Sequencer::setStepVelocity(int pattern, int track, int step, uint8_t velocity) {
   if (pattern < 0 || pattern >= MAX_PATTERNS) return;
   if (track < 0 || track >= MAX_TRACKS) return;
-  if (step < 0 || step >= STEPS_PER_PATTERN) return;
+  if (step < 0 || step >= MAX_STEPS) return;
   
-  velocities[pattern][track][step] = constrain(velocity, 1, 127);
+  velocity = constrain(velocity, 1, 127);
+  bool active;
+  portENTER_CRITICAL(&patternMux);
+  active = events.has(pattern, track, step);
+  if (active) events.at(pattern, track, step).velocity = velocity;
+  portEXIT_CRITICAL(&patternMux);
+  
+  if (!active) {
+    Serial.printf("Pattern %d, Track %d, Step %d is off: velocity ignored\n", pattern, track, step);
+    return;
+  }
   Serial.printf("Pattern %d, Track %d, Step %d velocity set to %d\n", 
                 pattern, track, step, velocity);
 }
 
 uint8_t Sequencer::getStepVelocity(int track, int step) {
-  if (track < 0 || track >= MAX_TRACKS) return 127;
-  if (step < 0 || step >= STEPS_PER_PATTERN) return 127;
-  
-  return velocities[currentPattern][track][step];
+  return getStepVelocity(currentPattern, track, step);
 }
 
 uint8_t Sequencer::getStepVelocity(int pattern, int track, int step) {
-  if (pattern < 0 || pattern >= MAX_PATTERNS) return 127;
-  if (track < 0 || track >= MAX_TRACKS) return 127;
-  if (step < 0 || step >= STEPS_PER_PATTERN) return 127;
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return DEFAULT_VELOCITY;
+  if (track < 0 || track >= MAX_TRACKS) return DEFAULT_VELOCITY;
+  if (step < 0 || step >= MAX_STEPS) return DEFAULT_VELOCITY;
   
-  return velocities[pattern][track][step];
+  uint8_t velocity = DEFAULT_VELOCITY;
+  portENTER_CRITICAL(&patternMux);
+  if (events.has(pattern, track, step)) velocity = events.at(pattern, track, step).velocity;
+  portEXIT_CRITICAL(&patternMux);
+  return velocity;
+}
+
+// ============= MICRO-TIMING =============
+
+void Sequencer::setStepMicroTiming(int pattern, int track, int step, int ticks) {
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return;
+  if (track < 0 || track >= MAX_TRACKS) return;
+  if (step < 0 || step >= MAX_STEPS) return;
+  
+  ticks = constrain(ticks, -MICRO_TIMING_MAX, MICRO_TIMING_MAX);
+  bool active;
+  portENTER_CRITICAL(&patternMux);
+  active = events.has(pattern, track, step);
+  if (active) events.at(pattern, track, step).microTiming = ticks;
+  portEXIT_CRITICAL(&patternMux);
+  
+  if (active) {
+    Serial.printf("Pattern %d, Track %d, Step %d micro-timing: %+d ticks\n", pattern, track, step, ticks);
+  }
+}
+
+int Sequencer::getStepMicroTiming(int pattern, int track, int step) {
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return 0;
+  if (track < 0 || track >= MAX_TRACKS) return 0;
+  if (step < 0 || step >= MAX_STEPS) return 0;
+  
+  int ticks = 0;
+  portENTER_CRITICAL(&patternMux);
+  if (events.has(pattern, track, step)) ticks = events.at(pattern, track, step).microTiming;
+  portEXIT_CRITICAL(&patternMux);
+  return ticks;
+}
+
+// ============= RATCHETS =============
+
+bool Sequencer::setStepRatchet(int pattern, int track, int step, int hits, int spacing, int ramp) {
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return false;
+  if (track < 0 || track >= MAX_TRACKS) return false;
+  if (step < 0 || step >= MAX_STEPS) return false;
+  
+  hits = constrain(hits, 1, RATCHET_MAX_HITS);
+  spacing = constrain(spacing, 0, TICKS_PER_STEP);
+  ramp = constrain(ramp, -127, 127);
+  bool active, ok = true;
+  
+  portENTER_CRITICAL(&patternMux);
+  active = events.has(pattern, track, step);
+  if (!active || hits == 1) {
+    ratchets.erase(pattern, track, step);
+  } else {
+    StepRatchet* ratchet = ratchets.add(pattern, track, step);
+    ok = ratchet != nullptr;
+    if (ok) {
+      ratchet->shape = (hits - 1) | (spacing << 3);
+      ratchet->ramp = ramp;
+    }
+  }
+  portEXIT_CRITICAL(&patternMux);
+  
+  if (!ok) {
+    Serial.printf("[Sequencer] Ratchet pool full (%d), step %d/%d not set\n", RATCHET_POOL_SIZE, track, step);
+    return false;
+  }
+  if (active) {
+    Serial.printf("Pattern %d, Track %d, Step %d ratchet: %d hits, spacing %d, ramp %+d\n",
+                  pattern, track, step, hits, spacing, ramp);
+  }
+  return true;
+}
+
+int Sequencer::getStepRatchet(int pattern, int track, int step, int* spacing, int* ramp) {
+  if (spacing) *spacing = 0;
+  if (ramp) *ramp = 0;
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return 1;
+  if (track < 0 || track >= MAX_TRACKS) return 1;
+  if (step < 0 || step >= MAX_STEPS) return 1;
+  
+  int hits = 1;
+  portENTER_CRITICAL(&patternMux);
+  if (ratchets.has(pattern, track, step)) {
+    StepRatchet ratchet = ratchets.at(pattern, track, step);
+    hits = (ratchet.shape & 0x07) + 1;
+    if (spacing) *spacing = ratchet.shape >> 3;
+    if (ramp) *ramp = ratchet.ramp;
+  }
+  portEXIT_CRITICAL(&patternMux);
+  return hits;
+}
+
+StepMask Sequencer::getTrackRatchets(int pattern, int track) {
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return 0;
+  if (track < 0 || track >= MAX_TRACKS) return 0;
+  
+  return ratchets.mask[pattern][track];
+}
+
+// ============= PROBABILITY / CONDITIONS =============
+
+bool Sequencer::setStepCondition(int pattern, int track, int step, int probability, uint8_t condition) {
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return false;
+  if (track < 0 || track >= MAX_TRACKS) return false;
+  if (step < 0 || step >= MAX_STEPS) return false;
+  if (condition > COND_NOT_PRE && !(condition & COND_RATIO)) return false;
+  
+  probability = constrain(probability, 1, 100);
+  bool active, ok = true;
+  
+  portENTER_CRITICAL(&patternMux);
+  active = events.has(pattern, track, step);
+  if (!active || (probability == 100 && condition == COND_NONE)) {
+    conditions.erase(pattern, track, step);
+  } else {
+    StepCondition* entry = conditions.add(pattern, track, step);
+    ok = entry != nullptr;
+    if (ok) {
+      entry->probability = probability;
+      entry->condition = condition;
+    }
+  }
+  portEXIT_CRITICAL(&patternMux);
+  
+  if (!ok) {
+    Serial.printf("[Sequencer] Condition pool full (%d), step %d/%d not set\n", CONDITION_POOL_SIZE, track, step);
+    return false;
+  }
+  if (active) {
+    char name[8];
+    conditionName(condition, name, sizeof(name));
+    Serial.printf("Pattern %d, Track %d, Step %d: %d%% %s\n", pattern, track, step, probability, name);
+  }
+  return true;
+}
+
+int Sequencer::getStepCondition(int pattern, int track, int step, uint8_t* condition) {
+  if (condition) *condition = COND_NONE;
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return 100;
+  if (track < 0 || track >= MAX_TRACKS) return 100;
+  if (step < 0 || step >= MAX_STEPS) return 100;
+  
+  int probability = 100;
+  portENTER_CRITICAL(&patternMux);
+  if (conditions.has(pattern, track, step)) {
+    StepCondition entry = conditions.at(pattern, track, step);
+    probability = entry.probability;
+    if (condition) *condition = entry.condition;
+  }
+  portEXIT_CRITICAL(&patternMux);
+  return probability;
+}
+
+StepMask Sequencer::getTrackConditions(int pattern, int track) {
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return 0;
+  if (track < 0 || track >= MAX_TRACKS) return 0;
+  
+  return conditions.mask[pattern][track];
+}
+
+static const char* const conditionNames[] = {"", "fill", "!fill", "first", "!first", "pre", "!pre"};
+
+bool Sequencer::parseCondition(const char* text, uint8_t& condition) {
+  if (text == nullptr) return false;
+  int a, b;
+  char extra;
+  if (sscanf(text, "%d:%d%c", &a, &b, &extra) == 2) {
+    if (a < 1 || b < 1 || a > b || b > CONDITION_RATIO_MAX) return false;
+    condition = makeRatioCondition(a, b);
+    return true;
+  }
+  for (int i = COND_NONE; i <= COND_NOT_PRE; i++) {
+    if (strcmp(text, conditionNames[i]) == 0) {
+      condition = i;
+      return true;
+    }
+  }
+  return false;
+}
+
+void Sequencer::conditionName(uint8_t condition, char* out, size_t size) {
+  if (condition & COND_RATIO) {
+    snprintf(out, size, "%d:%d", ((condition >> 3) & 0x07) + 1, (condition & 0x07) + 1);
+  } else {
+    snprintf(out, size, "%s", condition <= COND_NOT_PRE ? conditionNames[condition] : "");
+  }
+}
+
+void Sequencer::setPatternSeed(int pattern, uint32_t seed) {
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return;
+  patternSeed[pattern] = seed ? seed : 0x9E3779B9u * (pattern + 1);  // xorshift32 never leaves 0
+  Serial.printf("Pattern %d seed: %08X\n", pattern, patternSeed[pattern]);
+}
+
+uint32_t Sequencer::getPatternSeed(int pattern) {
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return 0;
+  return patternSeed[pattern];
+}
+
+// ============= PARAMETER LOCKS =============
+
+bool Sequencer::setStepLock(int pattern, int track, int step, uint8_t param, int value) {
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return false;
+  if (track < 0 || track >= MAX_TRACKS) return false;
+  if (step < 0 || step >= MAX_STEPS) return false;
+  if (param == 0 || (param & (param - 1)) || (param & ~LOCK_ALL)) return false;  // One parameter
+  
+  bool active, ok = true;
+  
+  portENTER_CRITICAL(&patternMux);
+  active = events.has(pattern, track, step);
+  ParamLock* lock = active ? locks.add(pattern, track, step) : nullptr;
+  ok = !active || lock != nullptr;
+  if (lock) {
+    lock->params |= param;
+    switch (param) {
+      case LOCK_CUTOFF:    lock->cutoff = constrain(value, 0, LOCK_VALUE_MAX); break;
+      case LOCK_RESONANCE: lock->resonance = constrain(value, 0, LOCK_VALUE_MAX); break;
+      case LOCK_PITCH:     lock->pitch = constrain(value, -LOCK_PITCH_RANGE, LOCK_PITCH_RANGE); break;
+      case LOCK_DECAY:     lock->decay = constrain(value, 0, LOCK_VALUE_MAX); break;
+      case LOCK_PAN:       lock->pan = constrain(value, -100, 100); break;
+      case LOCK_SLOT:      lock->slot = constrain(value, 0, MAX_TRACKS - 1); break;
+    }
+  }
+  portEXIT_CRITICAL(&patternMux);
+  
+  if (!ok) {
+    Serial.printf("[Sequencer] Lock pool full (%d), step %d/%d not locked\n", LOCK_POOL_SIZE, track, step);
+    return false;
+  }
+  if (!active) {
+    Serial.printf("Pattern %d, Track %d, Step %d is off: lock ignored\n", pattern, track, step);
+    return false;
+  }
+  return true;
+}
+
+void Sequencer::clearStepLock(int pattern, int track, int step, uint8_t params) {
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return;
+  if (track < 0 || track >= MAX_TRACKS) return;
+  if (step < 0 || step >= MAX_STEPS) return;
+  
+  portENTER_CRITICAL(&patternMux);
+  if (locks.has(pattern, track, step)) {
+    ParamLock& lock = locks.at(pattern, track, step);
+    lock.params &= ~params;
+    if (lock.params == 0) locks.erase(pattern, track, step);
+  }
+  portEXIT_CRITICAL(&patternMux);
+}
+
+bool Sequencer::getStepLock(int pattern, int track, int step, ParamLock& out) {
+  memset(&out, 0, sizeof(out));
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return false;
+  if (track < 0 || track >= MAX_TRACKS) return false;
+  if (step < 0 || step >= MAX_STEPS) return false;
+  
+  bool found;
+  portENTER_CRITICAL(&patternMux);
+  found = locks.has(pattern, track, step);
+  if (found) out = locks.at(pattern, track, step);
+  portEXIT_CRITICAL(&patternMux);
+  return found;
+}
+
+StepMask Sequencer::getTrackLocks(int pattern, int track) {
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return 0;
+  if (track < 0 || track >= MAX_TRACKS) return 0;
+  
+  return locks.mask[pattern][track];
 }
 
 void Sequencer::selectPattern(int pattern) {
   if (pattern < 0 || pattern >= MAX_PATTERNS) return;
   
+  portENTER_CRITICAL(&patternMux);
   currentPattern = pattern;
+  portEXIT_CRITICAL(&patternMux);
   Serial.printf("Pattern %d selected\n", pattern);
 }
 
 void Sequencer::muteTrack(int track, bool muted) {
   if (track >= 0 && track < MAX_TRACKS) {
-    trackMuted[track] = muted;
+    if (muted) mutedTracks |= 1u << track;
+    else mutedTracks &= ~(1u << track);
     Serial.printf("Track %d %s\n", track, muted ? "MUTED" : "UNMUTED");
   }
 }
 
 bool Sequencer::isTrackMuted(int track) {
   if (track >= 0 && track < MAX_TRACKS) {
-    return trackMuted[track];
+    return (mutedTracks >> track) & 1;
   }
   return false;
 }
 
+void Sequencer::queuePattern(int pattern) {
+  if (pattern >= MAX_PATTERNS) return;
+  if (!playing && pattern >= 0) {
+    selectPattern(pattern);  // Parado: no hay final de patrón que esperar
+    return;
+  }
+  queuedPattern = pattern < 0 ? -1 : pattern;
+  Serial.printf("Pattern %d queued\n", pattern);
+}
+
+// ============= SONG MODE =============
+
+bool Sequencer::setSong(const SongEntry* entries, int count) {
+  if (count < 0 || count > SONG_MAX_ENTRIES) return false;
+  portENTER_CRITICAL(&patternMux);
+  memcpy(song, entries, count * sizeof(SongEntry));
+  songLength = count;
+  portEXIT_CRITICAL(&patternMux);
+  Serial.printf("[Song] %d entries\n", count);
+  return true;
+}
+
+bool Sequencer::appendSongEntry(int pattern, int repeats) {
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return false;
+  if (repeats < 1 || repeats > SONG_MAX_REPEATS) return false;
+  bool ok;
+  portENTER_CRITICAL(&patternMux);
+  ok = songLength < SONG_MAX_ENTRIES;
+  if (ok) song[songLength++] = makeSongEntry(pattern, repeats);
+  portEXIT_CRITICAL(&patternMux);
+  if (!ok) Serial.printf("[Song] Full (%d entries)\n", SONG_MAX_ENTRIES);
+  return ok;
+}
+
+void Sequencer::clearSong() {
+  portENTER_CRITICAL(&patternMux);
+  songLength = 0;
+  songPosition = 0;
+  songRepeat = 0;
+  portEXIT_CRITICAL(&patternMux);
+  Serial.println("[Song] Cleared");
+}
+
+SongEntry Sequencer::getSongEntry(int index) {
+  if (index < 0 || index >= songLength) return 0;
+  return song[index];
+}
+
+// Playing: the first entry comes in at the end of the current pattern
+void Sequencer::setSongMode(bool enabled) {
+  portENTER_CRITICAL(&patternMux);
+  songMode = enabled;
+  songPosition = 0;
+  songRepeat = 0;
+  if (enabled && songLength > 0) {
+    int first = songEntryPattern(song[0]);
+    if (playing) {
+      queuedPattern = first;  // Takes over at the end of the current pattern
+    } else {
+      currentPattern = first;
+    }
+  }
+  portEXIT_CRITICAL(&patternMux);
+  Serial.printf("[Song] Mode %s (%d entries)\n", enabled ? "ON" : "OFF", songLength);
+}
+
 int Sequencer::getCurrentPattern() {
   return currentPattern;
 }
@@ -326,14 +996,31 @@ int Sequencer::getCurrentPattern() {
 void Sequencer::copyPattern(int src, int dst) {
   if (src < 0 || src >= MAX_PATTERNS) return;
   if (dst < 0 || dst >= MAX_PATTERNS) return;
+  if (src == dst) return;
   
-  for (int t = 0; t < MAX_TRACKS; t++) {
-    for (int s = 0; s < STEPS_PER_PATTERN; s++) {
-      steps[dst][t][s] = steps[src][t][s];
-      velocities[dst][t][s] = velocities[src][t][s];
+  bool ok = true;
+  portENTER_CRITICAL(&patternMux);
+  if (!events.fitsCopy(src, dst) || !ratchets.fitsCopy(src, dst) ||
+      !conditions.fitsCopy(src, dst) || !locks.fitsCopy(src, dst)) {
+    ok = false;
+  } else {
+    events.copyPattern(src, dst);
+    ratchets.copyPattern(src, dst);
+    conditions.copyPattern(src, dst);
+    locks.copyPattern(src, dst);
+    for (int t = 0; t < MAX_TRACKS; t++) {
+      trackLength[dst][t] = trackLength[src][t];
+      trackDivider[dst][t] = trackDivider[src][t];
     }
+    patternLength[dst] = patternLength[src];
+    patternSeed[dst] = patternSeed[src];
   }
+  portEXIT_CRITICAL(&patternMux);
   
+  if (!ok) {
+    Serial.printf("[Sequencer] Step pool full, pattern %d not copied to %d\n", src, dst);
+    return;
+  }
   Serial.printf("Pattern %d copied to %d\n", src, dst);
 }
 
@@ -341,6 +1028,59 @@ int Sequencer::getCurrentStep() {
   return currentStep;
 }
 
+int Sequencer::getTrackStep(int track) {
+  if (track < 0 || track >= MAX_TRACKS) return 0;
+  return trackStep[track];
+}
+
+// ============= LENGTHS / POLYMETER =============
+
+// Steps past the length are kept (and come back if the pattern grows again)
+void Sequencer::setPatternLength(int pattern, int length) {
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return;
+  patternLength[pattern] = constrain(length, 1, MAX_STEPS);
+  Serial.printf("Pattern %d length: %d steps\n", pattern, patternLength[pattern]);
+}
+
+int Sequencer::getPatternLength(int pattern) {
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return STEPS_PER_PATTERN;
+  return patternLength[pattern];
+}
+
+void Sequencer::setTrackLength(int pattern, int track, int length) {
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return;
+  if (track < 0 || track >= MAX_TRACKS) return;
+  trackLength[pattern][track] = length <= 0 ? 0 : constrain(length, 1, MAX_STEPS);
+  Serial.printf("Pattern %d, Track %d length: %d steps\n", pattern, track, getTrackLength(pattern, track));
+}
+
+int Sequencer::getTrackLength(int pattern, int track) {
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return STEPS_PER_PATTERN;
+  if (track < 0 || track >= MAX_TRACKS) return patternLength[pattern];
+  return trackLength[pattern][track] ? trackLength[pattern][track] : patternLength[pattern];
+}
+
+void Sequencer::setTrackDivider(int pattern, int track, int divider) {
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return;
+  if (track < 0 || track >= MAX_TRACKS) return;
+  trackDivider[pattern][track] = constrain(divider, 1, MAX_DIVIDER);
+  Serial.printf("Pattern %d, Track %d clock divider: /%d\n", pattern, track, trackDivider[pattern][track]);
+}
+
+int Sequencer::getTrackDivider(int pattern, int track) {
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return 1;
+  if (track < 0 || track >= MAX_TRACKS) return 1;
+  return trackDivider[pattern][track];
+}
+
+bool Sequencer::hasTrackTiming(int pattern) {
+  if (pattern < 0 || pattern >= MAX_PATTERNS) return false;
+  for (int t = 0; t < MAX_TRACKS; t++) {
+    if (trackLength[pattern][t] != 0 || trackDivider[pattern][t] != 1) return true;
+  }
+  return false;
+}
+
 void Sequencer::setStepCallback(StepCallback callback) {
   stepCallback = callback;
 }
@@ -349,6 +1089,14 @@ void Sequencer::setStepChangeCallback(StepChangeCallback callback) {
   stepChangeCallback = callback;
 }
 
+void Sequencer::setBarCallback(BarCallback callback) {
+  barCallback = callback;
+}
+
+void Sequencer::setPatternChangeCallback(PatternChangeCallback callback) {
+  patternChangeCallback = callback;
+}
+
 // ============= LOOP SYSTEM =============
 
 void Sequencer::toggleLoop(int track) {
@@ -382,12 +1130,12 @@ bool Sequencer::isLoopPaused(int track) {
   return false;
 }
 
-void Sequencer::processLoops() {
+void Sequencer::processLoops(uint32_t frame) {
   // Process looped tracks every step
   for (int track = 0; track < MAX_TRACKS; track++) {
-    if (loopActive[track] && !loopPaused[track] && !trackMuted[track]) {
+    if (loopActive[track] && !loopPaused[track] && !isTrackMuted(track)) {
       if (stepCallback != nullptr) {
-        stepCallback(track, 100); // Loop triggers at consistent velocity
+        stepCallback(track, 100, frame, nullptr); // Loop triggers at consistent velocity
       }
     }
   }
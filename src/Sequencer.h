@@ -1,6 +1,15 @@
 /*
  * Sequencer.h
- * Sequencer de 16 steps per Drum Machine (8 tracks)
+ * Sequencer per Drum Machine (8 tracks), patterns d'1 a 64 steps
+ * Cada track pot tenir la seva llargada i divisor de clock (polimetria)
+ * Rellotge de ticks a 96 PPQN sobre frames d'àudio: swing, micro-timing per step
+ * i triggers amb timestamp de frame (l'AudioEngine els arrenca al frame exacte)
+ * Mode cançó: cadena de patrons amb repeticions; els canvis (cançó o encuats des
+ * de la web) entren just al final del patró, sense perdre ni repetir cap step
+ * Ratchets per step (2-8 cops, amb espaiat i rampa de velocity) a resolució de tick
+ * Probabilitat i condicions per step (A:B, fill, first, pre) amb un xorshift32
+ * sembrat per patró: la mateixa reproducció dona exactament els mateixos triggers
+ * Parameter locks per step (filtre, pitch, decay, pan, slot): viatgen amb el trigger
  * (OPCIONAL - per afegir funcionalitat de sequencer)
  */
 
@@ -8,10 +17,155 @@
 #define SEQUENCER_H
 
 #include <Arduino.h>
+#include "ParamLock.h"
 
 #define MAX_PATTERNS 16
-#define STEPS_PER_PATTERN 16
+#define STEPS_PER_PATTERN 16    // Default pattern length
+#define MAX_STEPS 64            // Longest pattern / track
 #define MAX_TRACKS 8
+#define MAX_DIVIDER 16          // Track advances every N sequencer steps
+#define STEP_POOL_SIZE 2048     // Active steps of the whole bank (velocity per step)
+#define DEFAULT_VELOCITY 127
+#define RATCHET_MAX_HITS 8
+#define RATCHET_POOL_SIZE 256   // Steps with a ratchet in the whole bank (2 bytes each)
+#define CONDITION_POOL_SIZE 256 // Steps with probability/condition (2 bytes each)
+#define CONDITION_RATIO_MAX 8   // A:B, B up to 8 cycles
+#define LOCK_POOL_SIZE 256      // Steps with parameter locks (7 bytes each)
+
+// Tick clock
+#define SEQ_PPQN 96
+#define TICKS_PER_STEP (SEQ_PPQN / 4)             // 16th note
+#define MICRO_TIMING_MAX (TICKS_PER_STEP / 2)     // Per-step offset: ±ticks
+#define SWING_MIN 50                              // % (50 = straight)
+#define SWING_MAX 75
+#define SEQ_DEFAULT_FRAME_RATE 44100
+#define SEQ_LOOKAHEAD_FRAMES 512                  // ~11.6 ms: > clock period (2 ms) or SystemTask period (5 ms) with margin
+#define SEQ_RESYNC_FRAMES 4410                    // 100 ms behind (task stalled): skip instead of bursting
+
+// Song: one byte per entry, bits 0-3 pattern, bits 4-7 repeats - 1 (1-16)
+#define SONG_MAX_ENTRIES 256
+#define SONG_MAX_REPEATS 16
+typedef uint8_t SongEntry;
+
+// One bit per step (bit s = step s)
+typedef uint64_t StepMask;
+
+// Data of one active step, packed in the pool in (pattern, track, step) order
+struct StepEvent {
+  uint8_t velocity;
+  int8_t microTiming;     // Ticks, ±MICRO_TIMING_MAX
+};
+
+// Ratchet of one step: only steps that have one use space, in their own pool
+struct StepRatchet {
+  uint8_t shape;          // Bits 0-2: hits - 1, bits 3-7: ticks between hits (0 = even over the step)
+  int8_t ramp;            // Velocity change per hit
+};
+
+// Trig conditions: A:B = bit 6 set, bits 3-5 A - 1, bits 0-2 B - 1 (plays on cycle A of every B)
+enum TrigCondition : uint8_t {
+  COND_NONE = 0,
+  COND_FILL,              // Only while fill is held
+  COND_NOT_FILL,
+  COND_FIRST,             // First cycle of the track since the pattern started
+  COND_NOT_FIRST,
+  COND_PRE,               // The previous conditional step of the track played
+  COND_NOT_PRE,
+  COND_RATIO = 0x40
+};
+
+struct StepCondition {
+  uint8_t probability;    // 1-100 %
+  uint8_t condition;      // TrigCondition
+};
+
+// Per-step data kept only for the steps that have it: a mask per [pattern][track] and one
+// entry per set bit, packed in (pattern, track, step) order, block after block from
+// start[pattern * MAX_TRACKS + track]. Caller holds patternMux
+template<typename T, int N>
+struct StepPool {
+  StepMask mask[MAX_PATTERNS][MAX_TRACKS];
+  uint16_t start[MAX_PATTERNS * MAX_TRACKS];
+  T data[N];
+  uint16_t used;
+  
+  void clear() {
+    memset(mask, 0, sizeof(mask));
+    memset(start, 0, sizeof(start));
+    used = 0;
+  }
+  
+  bool has(int pattern, int track, int step) const { return (mask[pattern][track] >> step) & 1; }
+  int count(int pattern, int track) const { return __builtin_popcountll(mask[pattern][track]); }
+  
+  // Position of the step's entry (or where it goes): block start + entries before it
+  int index(int pattern, int track, int step) const {
+    StepMask before = mask[pattern][track] & (StepMask)(((StepMask)1 << step) - 1);
+    return start[pattern * MAX_TRACKS + track] + __builtin_popcountll(before);
+  }
+  T& at(int pattern, int track, int step) { return data[index(pattern, track, step)]; }
+  
+  // Entry of the step, zeroed if it had none. nullptr = pool full
+  T* add(int pattern, int track, int step) {
+    int pos = index(pattern, track, step);
+    if (!has(pattern, track, step)) {
+      if (!insert(pattern * MAX_TRACKS + track, pos, 1)) return nullptr;
+      mask[pattern][track] |= (StepMask)1 << step;
+      memset(&data[pos], 0, sizeof(T));
+    }
+    return &data[pos];
+  }
+  
+  void erase(int pattern, int track, int step) {
+    if (!has(pattern, track, step)) return;
+    remove(pattern * MAX_TRACKS + track, index(pattern, track, step), 1);
+    mask[pattern][track] &= ~((StepMask)1 << step);
+  }
+  
+  void clearTrack(int pattern, int track) {
+    int key = pattern * MAX_TRACKS + track;
+    remove(key, start[key], count(pattern, track));
+    mask[pattern][track] = 0;
+  }
+  
+  // Room to replace pattern dst with a copy of src
+  bool fitsCopy(int src, int dst) const {
+    int total = used;
+    for (int t = 0; t < MAX_TRACKS; t++) total += count(src, t) - count(dst, t);
+    return total <= N;
+  }
+  
+  // After fitsCopy(): pattern dst becomes a copy of src. dst is emptied first, so the
+  // pool never holds both copies at once
+  void copyPattern(int src, int dst) {
+    for (int t = 0; t < MAX_TRACKS; t++) clearTrack(dst, t);
+    for (int t = 0; t < MAX_TRACKS; t++) {
+      int srcKey = src * MAX_TRACKS + t;
+      int dstKey = dst * MAX_TRACKS + t;
+      int n = count(src, t);
+      // The source block is never inside the gap: its start is already shifted
+      insert(dstKey, start[dstKey], n);
+      memcpy(&data[start[dstKey]], &data[start[srcKey]], n * sizeof(T));
+      mask[dst][t] = mask[src][t];
+    }
+  }
+  
+  // Opens `n` entries at `pos` inside block `key`
+  bool insert(int key, int pos, int n) {
+    if (used + n > N) return false;
+    memmove(&data[pos + n], &data[pos], (used - pos) * sizeof(T));
+    used += n;
+    for (int k = key + 1; k < MAX_PATTERNS * MAX_TRACKS; k++) start[k] += n;
+    return true;
+  }
+  
+  void remove(int key, int pos, int n) {
+    if (n == 0) return;
+    memmove(&data[pos], &data[pos + n], (used - pos - n) * sizeof(T));
+    used -= n;
+    for (int k = key + 1; k < MAX_PATTERNS * MAX_TRACKS; k++) start[k] -= n;
+  }
+};
 
 class Sequencer {
 public:
@@ -27,10 +181,20 @@ public:
   // Timing
   void setTempo(float bpm);
   float getTempo();
-  void update(); // Call from loop
+  void update(); // Call from loop: schedule() + updateUi()
+  void schedule(); // Steps up to SEQ_LOOKAHEAD_FRAMES ahead of the frame clock (SequencerClock task)
+  void updateUi(); // Step / pattern change callbacks once their frame is playing (SystemTask)
+  
+  // Swing (odd 16ths late), 50-75%
+  void setSwing(int percent);
+  int getSwing() { return swing; }
+  
+  // Frame clock: audio frames rendered so far (wraps). Without one, micros() is used
+  typedef uint32_t (*FrameClock)();
+  void setFrameClock(FrameClock clock, uint32_t frameRate);
   
   // Pattern editing
-  void setStep(int track, int step, bool active, uint8_t velocity = 127);
+  bool setStep(int track, int step, bool active, uint8_t velocity = 127);  // false = step pool full
   bool getStep(int track, int step);
   bool getStep(int pattern, int track, int step);  // Get step from specific pattern
   void clearPattern(int pattern);
@@ -43,53 +207,181 @@ public:
   uint8_t getStepVelocity(int track, int step);
   uint8_t getStepVelocity(int pattern, int track, int step);
   
+  // Micro-timing per step (active steps only), in ticks
+  void setStepMicroTiming(int pattern, int track, int step, int ticks);
+  int getStepMicroTiming(int pattern, int track, int step);
+  
+  // Ratchets (active steps only): hits 2-8, spacing 0-TICKS_PER_STEP ticks (0 = even over
+  // the step), ramp = velocity change per hit. hits 1 removes it. false = pool full
+  bool setStepRatchet(int pattern, int track, int step, int hits, int spacing = 0, int ramp = 0);
+  int getStepRatchet(int pattern, int track, int step, int* spacing = nullptr, int* ramp = nullptr);  // Hits (1 = none)
+  StepMask getTrackRatchets(int pattern, int track);
+  
+  // Probability (1-100 %) and condition (active steps only); 100 % + COND_NONE removes it
+  bool setStepCondition(int pattern, int track, int step, int probability, uint8_t condition);
+  int getStepCondition(int pattern, int track, int step, uint8_t* condition = nullptr);  // Probability
+  StepMask getTrackConditions(int pattern, int track);
+  static uint8_t makeRatioCondition(int a, int b) {
+    return COND_RATIO | (((a - 1) & 0x07) << 3) | ((b - 1) & 0x07);
+  }
+  static bool parseCondition(const char* text, uint8_t& condition);  // "", "1:2", "fill", "!fill", "first", "!first", "pre", "!pre"
+  static void conditionName(uint8_t condition, char* out, size_t size);
+  
+  // Fill (conditions) and PRNG seed per pattern (reseeded when the pattern starts)
+  void setFill(bool enabled) { fill = enabled; }
+  bool isFill() { return fill; }
+  void setPatternSeed(int pattern, uint32_t seed);
+  uint32_t getPatternSeed(int pattern);
+  
+  // Parameter locks (active steps only). param = one LOCK_* bit; clearing the last one frees the step
+  bool setStepLock(int pattern, int track, int step, uint8_t param, int value);
+  void clearStepLock(int pattern, int track, int step, uint8_t params = LOCK_ALL);
+  bool getStepLock(int pattern, int track, int step, ParamLock& out);  // false = no locks
+  StepMask getTrackLocks(int pattern, int track);
+  
   // Pattern management
-  void selectPattern(int pattern);
+  void selectPattern(int pattern);           // Now (mid-bar)
+  void queuePattern(int pattern);            // At the end of the current pattern (-1 = cancel)
+  int getQueuedPattern() { return queuedPattern; }
   int getCurrentPattern();
   void copyPattern(int src, int dst);
   
+  // Song mode (pattern chain)
+  bool setSong(const SongEntry* entries, int count);
+  bool appendSongEntry(int pattern, int repeats);
+  void clearSong();
+  int getSongLength() { return songLength; }
+  SongEntry getSongEntry(int index);
+  void setSongMode(bool enabled);            // Starts the chain from its first entry
+  bool isSongMode() { return songMode; }
+  int getSongPosition() { return songPosition; }
+  int getSongRepeat() { return songRepeat; }
+  static SongEntry makeSongEntry(int pattern, int repeats) {
+    return (SongEntry)((pattern & 0x0F) | (((repeats - 1) & 0x0F) << 4));
+  }
+  static int songEntryPattern(SongEntry entry) { return entry & 0x0F; }
+  static int songEntryRepeats(SongEntry entry) { return (entry >> 4) + 1; }
+  
+  // Lengths (1-MAX_STEPS). Track length 0 = follows the pattern length
+  void setPatternLength(int pattern, int length);
+  int getPatternLength(int pattern);
+  int getPatternLength() { return patternLength[currentPattern]; }
+  void setTrackLength(int pattern, int track, int length);
+  int getTrackLength(int pattern, int track);      // Effective length
+  void setTrackDivider(int pattern, int track, int divider);
+  int getTrackDivider(int pattern, int track);
+  bool hasTrackTiming(int pattern);                // Any track with its own length or divider
+  
   // Mute tracks
   void muteTrack(int track, bool muted);
   bool isTrackMuted(int track);
   
   // Playback
   int getCurrentStep();
+  int getTrackStep(int track);  // Own position of a track (polymeter)
   
   // Loop system for live pads
   void toggleLoop(int track);
   void pauseLoop(int track);
   bool isLooping(int track);
   bool isLoopPaused(int track);
-  void processLoops(); // Called internally
+  void processLoops(uint32_t frame); // Called internally
   
   // Callbacks
-  typedef void (*StepCallback)(int track, uint8_t velocity);
+  // frame: when it must sound; lock: the step's parameter locks (nullptr = none), valid during the call
+  typedef void (*StepCallback)(int track, uint8_t velocity, uint32_t frame, const ParamLock* lock);
   typedef void (*StepChangeCallback)(int newStep);
+  typedef void (*BarCallback)();
+  typedef void (*PatternChangeCallback)(int pattern);
   void setStepCallback(StepCallback callback);
   void setStepChangeCallback(StepChangeCallback callback);
+  void setBarCallback(BarCallback callback);  // Before the triggers of step 0
+  void setPatternChangeCallback(PatternChangeCallback callback);  // Queue/song switch, with its step 0
+  
+  // Bank usage (active steps in the pool)
+  int getUsedSteps() { return events.used; }
+  int getUsedRatchets() { return ratchets.used; }
+  int getUsedConditions() { return conditions.used; }
+  int getUsedLocks() { return locks.used; }
+  StepMask getTrackSteps(int pattern, int track);
   
 private:
-  // Pattern data: [pattern][track][step]
-  bool steps[MAX_PATTERNS][MAX_TRACKS][STEPS_PER_PATTERN];
-  uint8_t velocities[MAX_PATTERNS][MAX_TRACKS][STEPS_PER_PATTERN];
+  // Pattern data: the active steps of each [pattern][track] are events.mask, and
+  // ratchets / conditions / locks hold subsets of them, same layout
+  StepPool<StepEvent, STEP_POOL_SIZE> events;
+  StepPool<StepRatchet, RATCHET_POOL_SIZE> ratchets;
+  StepPool<StepCondition, CONDITION_POOL_SIZE> conditions;
+  StepPool<ParamLock, LOCK_POOL_SIZE> locks;
+  uint8_t patternLength[MAX_PATTERNS];
+  uint8_t trackLength[MAX_PATTERNS][MAX_TRACKS];   // 0 = pattern length
+  uint8_t trackDivider[MAX_PATTERNS][MAX_TRACKS];
+  uint32_t patternSeed[MAX_PATTERNS];
+  portMUX_TYPE patternMux = portMUX_INITIALIZER_UNLOCKED;  // Edits (web) vs processStep (SystemTask)
   
-  bool playing;
+  volatile bool playing;    // Written under patternMux, after the state it guards
   int currentPattern;
   int currentStep;
   float tempo; // BPM
-  uint32_t lastStepTime;
-  uint32_t stepInterval; // microseconds
-  bool trackMuted[MAX_TRACKS];
+  int swing;     // %
+  
+  // Tick clock: frames per tick = frameNum / frameDen, accumulated exactly (integer +
+  // remainder), so the grid never drifts from the frame clock
+  FrameClock frameClock;
+  uint32_t frameRate;
+  uint64_t frameNum;        // frameRate * 60000
+  uint64_t frameDen;        // milli-BPM * SEQ_PPQN
+  uint32_t framesPerTick;
+  uint32_t frameRemainder;
+  uint32_t tickRemainder;   // Accumulated remainder (< frameDen)
+  uint32_t nextTickFrame;
+  int cursorTick;           // 0..TICKS_PER_STEP-1; 0 = schedule the next step
+  
+  // Step change for the UI, fired when its frame is reached (steps are scheduled ahead)
+  bool uiPending;
+  int uiStep;
+  uint32_t uiFrame;
+  int uiPattern;            // Pattern switched on this step (-1 = none)
+  int uiNextPattern;        // Switched at the pattern end: reported with the next step 0
+  
+  // Song / queue
+  volatile int queuedPattern;
+  SongEntry song[SONG_MAX_ENTRIES];
+  int songLength;
+  bool songMode;
+  int songPosition;
+  int songRepeat;           // Repeats of the current entry already played
+  uint32_t mutedTracks;  // Bit per track
+  
+  // Track positions: trackStep advances when trackPulse reaches the divider
+  uint8_t trackStep[MAX_TRACKS];
+  uint8_t trackPulse[MAX_TRACKS];
+  uint16_t trackCycle[MAX_TRACKS];   // Wraps of each track since the pattern started (A:B, first)
+  uint32_t preFired;                 // Bit per track: its last conditional step played
+  uint32_t rngState;                 // xorshift32 of the current pattern
+  volatile bool fill;
   
   StepCallback stepCallback;
   StepChangeCallback stepChangeCallback;
+  BarCallback barCallback;
+  PatternChangeCallback patternChangeCallback;
   
   // Loop system
   bool loopActive[MAX_TRACKS];
   bool loopPaused[MAX_TRACKS];
   
-  void calculateStepInterval();
-  void processStep();
+  void calculateTickRate();
+  uint32_t clockNow();
+  void advanceTick();
+  uint32_t ticksToFrames(int32_t ticksQ4);  // 1/16 tick units, >= 0
+  void scheduleStep(uint32_t frame, bool silent);
+  void processStep(uint32_t frame);
+  void advanceTracks();
+  void endOfPattern();
+  void enterPattern();
+  bool evaluateCondition(int track, StepCondition condition);
+  void firePendingUi();
+  
+  bool writeStep(int pattern, int track, int step, bool active, uint8_t velocity);  // Caller holds patternMux
 };
 
 #endif // SEQUENCER_H
@@ -0,0 +1,101 @@
+/*
+ * TriggerTiming.cpp
+ * Histogrames de retard dels triggers per font
+ */
+
+#include "TriggerTiming.h"
+
+// Upper bin edges (us): fine around one audio block (2.9 ms), coarse for stalls
+static const uint32_t timingEdges[TIMING_BINS - 1] = {
+  1, 25, 50, 100, 250, 500, 1000, 1500, 2000, 3000,
+  4000, 6000, 8000, 12000, 16000, 25000, 50000, 100000, 250000
+};
+
+static const char* timingNames[TIMING_SOURCES] = {"sequencer", "live", "midi", "udp"};
+
+void TriggerTiming::reset() {
+  for (int i = 0; i < TIMING_SOURCES; i++) clear(starts[i]);
+  clear(lead);
+}
+
+void TriggerTiming::clear(TimingHistogram& h) {
+  memset(&h, 0, sizeof(h));
+  h.windowMin = h.lastMin = UINT32_MAX;
+}
+
+void TriggerTiming::recordStart(uint8_t source, uint32_t lateUs) {
+  if (source >= TIMING_SOURCES) return;
+  record(starts[source], lateUs);
+}
+
+void TriggerTiming::recordLead(uint32_t leadUs) {
+  record(lead, leadUs);
+}
+
+// One writer per histogram (audio core for starts, clock task for lead); readers copy
+void TriggerTiming::record(TimingHistogram& h, uint32_t us) {
+  int bin = 0;
+  while (bin < TIMING_BINS - 1 && us >= timingEdges[bin]) bin++;
+  h.bins[bin]++;
+  h.count++;
+  h.total++;
+  if (us < h.windowMin) h.windowMin = us;
+  if (us > h.windowMax) h.windowMax = us;
+
+  // Rolling: halve the counts, the window's extremes become the previous window's
+  if (h.count >= TIMING_WINDOW) {
+    h.count = 0;
+    for (int i = 0; i < TIMING_BINS; i++) {
+      h.bins[i] >>= 1;
+      h.count += h.bins[i];
+    }
+    h.lastMin = h.windowMin;
+    h.lastMax = h.windowMax;
+    h.windowMin = UINT32_MAX;
+    h.windowMax = 0;
+  }
+}
+
+// Edge of the bin that holds the permille-th sample, on the pessimistic side: upper for
+// lateness (p50/p99), lower for the lead margin (p1). Clamped to the observed min/max
+uint32_t TriggerTiming::percentile(const TimingHistogram& h, uint32_t permille, bool upper) {
+  if (h.count == 0) return 0;
+  uint32_t target = (uint32_t)(((uint64_t)h.count * permille + 999) / 1000);
+  if (target == 0) target = 1;
+  uint32_t minUs = h.windowMin < h.lastMin ? h.windowMin : h.lastMin;
+  uint32_t maxUs = h.windowMax > h.lastMax ? h.windowMax : h.lastMax;
+  uint32_t seen = 0;
+  for (int bin = 0; bin < TIMING_BINS; bin++) {
+    seen += h.bins[bin];
+    if (seen < target) continue;
+    if (bin == 0) return 0;                           // Only exact zeros (on time) fall here
+    uint32_t edge = upper ? binEdge(bin) : timingEdges[bin - 1];
+    if (edge > maxUs) edge = maxUs;
+    if (edge < minUs) edge = minUs;
+    return edge;
+  }
+  return maxUs;
+}
+
+void TriggerTiming::report(const TimingHistogram& h, TimingReport& out) {
+  out.total = h.total;
+  out.p1Us = percentile(h, 10, false);
+  out.p50Us = percentile(h, 500, true);
+  out.p99Us = percentile(h, 990, true);
+  uint32_t minUs = h.windowMin < h.lastMin ? h.windowMin : h.lastMin;
+  out.minUs = minUs == UINT32_MAX ? 0 : minUs;
+  out.maxUs = h.windowMax > h.lastMax ? h.windowMax : h.lastMax;
+}
+
+void TriggerTiming::getHistogram(uint8_t source, uint32_t* out) {
+  const TimingHistogram& h = starts[source < TIMING_SOURCES ? source : 0];
+  memcpy(out, h.bins, sizeof(h.bins));
+}
+
+uint32_t TriggerTiming::binEdge(int bin) {
+  return bin < TIMING_BINS - 1 ? timingEdges[bin] : UINT32_MAX;
+}
+
+const char* TriggerTiming::sourceName(uint8_t source) {
+  return source < TIMING_SOURCES ? timingNames[source] : "none";
+}
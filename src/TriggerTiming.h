@@ -0,0 +1,73 @@
+/*
+ * TriggerTiming.h
+ * Quan sona de debò cada trigger respecte de quan tocava
+ *
+ * Per font (seqüenciador, pad de la web, MIDI, UDP) un histograma del retard
+ * entre el moment demanat i el bloc DMA on comença la veu. Del seqüenciador
+ * també l'avançament amb què arriba el callback (marge abans del seu frame).
+ * Els histogrames es divideixen per dos cada TIMING_WINDOW mostres: els
+ * percentils segueixen el que passa ara, no des de l'arrencada
+ */
+
+#ifndef TRIGGERTIMING_H
+#define TRIGGERTIMING_H
+
+#include <Arduino.h>
+
+enum TimingSource : uint8_t {
+  TIMING_SEQUENCER = 0,       // Scheduled frame -> frame the voice started
+  TIMING_LIVE = 1,            // Web pad (WS / HTTP) received -> block the voice starts in
+  TIMING_MIDI = 2,
+  TIMING_UDP = 3,
+  TIMING_SOURCES = 4,
+  TIMING_NONE = 0xFF
+};
+
+#define TIMING_BINS 20
+#define TIMING_WINDOW 1024    // Samples before the counts are halved
+
+// Bin i holds values below its edge (us); bin 0 = on time, the last one everything above
+struct TimingHistogram {
+  uint32_t bins[TIMING_BINS];
+  uint32_t count;             // In the histogram (decays with the bins)
+  uint32_t total;             // Since boot / reset
+  uint32_t windowMin, windowMax;
+  uint32_t lastMin, lastMax;  // Previous window
+};
+
+struct TimingReport {
+  uint32_t total;
+  uint32_t p1Us;
+  uint32_t p50Us;
+  uint32_t p99Us;
+  uint32_t minUs;
+  uint32_t maxUs;
+};
+
+class TriggerTiming {
+public:
+  TriggerTiming() { reset(); }
+  void reset();
+
+  // Audio core: how late a voice started (0 = on its frame)
+  void recordStart(uint8_t source, uint32_t lateUs);
+  // Sequencer callback: how far ahead of its frame the step was handed over
+  void recordLead(uint32_t leadUs);
+
+  void getReport(uint8_t source, TimingReport& out) { report(starts[source < TIMING_SOURCES ? source : 0], out); }
+  void getLeadReport(TimingReport& out) { report(lead, out); }
+  void getHistogram(uint8_t source, uint32_t* out);   // TIMING_BINS counts
+  static uint32_t binEdge(int bin);                    // Upper edge in us (last: UINT32_MAX)
+  static const char* sourceName(uint8_t source);
+
+private:
+  TimingHistogram starts[TIMING_SOURCES];
+  TimingHistogram lead;
+
+  static void clear(TimingHistogram& h);
+  static void record(TimingHistogram& h, uint32_t us);
+  static void report(const TimingHistogram& h, TimingReport& out);
+  static uint32_t percentile(const TimingHistogram& h, uint32_t permille, bool upper);
+};
+
+#endif // TRIGGERTIMING_H
@@ -0,0 +1,136 @@
+/*
+ * WavDecoder.cpp
+ * Conversió de WAV a int16 mono per blocs
+ */
+
+#include "WavDecoder.h"
+#include <string.h>
+
+#define WAVE_FORMAT_PCM 1
+#define WAVE_FORMAT_IEEE_FLOAT 3
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
+
+static inline uint16_t readLE16(const uint8_t* p) { return p[0] | (p[1] << 8); }
+static inline uint32_t readLE32(const uint8_t* p) { return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24); }
+
+bool WavDecoder::parseFmt(const uint8_t* fmt, uint32_t size, WavFormat& out) {
+  if (size < 16) return false;
+  uint16_t tag = readLE16(fmt);
+  uint16_t channels = readLE16(fmt + 2);
+  uint16_t bits = readLE16(fmt + 14);
+
+  // Extensible: the real tag is the first two bytes of the subformat GUID
+  if (tag == WAVE_FORMAT_EXTENSIBLE) {
+    if (size < 26) return false;
+    tag = readLE16(fmt + 24);
+  }
+  if (channels < 1 || channels > 2) return false;
+
+  if (tag == WAVE_FORMAT_PCM) {
+    switch (bits) {
+      case 8:  out.encoding = WAV_PCM8; break;
+      case 16: out.encoding = WAV_PCM16; break;
+      case 24: out.encoding = WAV_PCM24; break;
+      case 32: out.encoding = WAV_PCM32; break;
+      default: return false;
+    }
+  } else if (tag == WAVE_FORMAT_IEEE_FLOAT && bits == 32) {
+    out.encoding = WAV_FLOAT32;
+  } else {
+    return false;
+  }
+  out.channels = channels;
+  out.bytesPerSample = bits / 8;
+  out.sampleRate = readLE32(fmt + 4);
+  return true;
+}
+
+// One sample of each encoding as int16 (24/32 bits keep the top 16)
+static inline int16_t fromPcm8(const uint8_t* p) { return (int16_t)((p[0] - 128) << 8); }
+static inline int16_t fromPcm16(const uint8_t* p) { return (int16_t)(p[0] | (p[1] << 8)); }
+static inline int16_t fromPcm24(const uint8_t* p) { return (int16_t)(p[1] | (p[2] << 8)); }
+static inline int16_t fromPcm32(const uint8_t* p) { return (int16_t)(p[2] | (p[3] << 8)); }
+static inline int16_t fromFloat32(const uint8_t* p) {
+  float v;
+  memcpy(&v, p, sizeof(v));
+  v *= 32767.0f;
+  if (v > 32767.0f) v = 32767.0f;
+  if (v < -32768.0f) v = -32768.0f;
+  return (int16_t)v;
+}
+
+// Tight loops with a fixed stride per encoding: no per-sample switch
+template <int16_t (*Sample)(const uint8_t*), int Bytes>
+static void convertMono(const uint8_t* __restrict in, uint32_t frames, int16_t* __restrict out) {
+  for (uint32_t i = 0; i < frames; i++) {
+    out[i] = Sample(in + i * Bytes);
+  }
+}
+
+template <int16_t (*Sample)(const uint8_t*), int Bytes>
+static void convertStereo(const uint8_t* __restrict in, uint32_t frames, int16_t* __restrict out) {
+  for (uint32_t i = 0; i < frames; i++) {
+    out[i] = (Sample(in + i * 2 * Bytes) / 2) + (Sample(in + i * 2 * Bytes + Bytes) / 2);
+  }
+}
+
+void WavDecoder::convert(const WavFormat& format, const uint8_t* in, uint32_t frames, int16_t* out,
+                         bool interleaved) {
+  // Interleaved stereo out is the mono loop over every value
+  bool stereo = format.channels == 2;
+  if (stereo && interleaved) {
+    frames *= 2;
+    stereo = false;
+  }
+  switch (format.encoding) {
+    case WAV_PCM8:
+      stereo ? convertStereo<fromPcm8, 1>(in, frames, out) : convertMono<fromPcm8, 1>(in, frames, out);
+      break;
+    case WAV_PCM16:
+      if (stereo) convertStereo<fromPcm16, 2>(in, frames, out);
+      else memcpy(out, in, frames * sizeof(int16_t));
+      break;
+    case WAV_PCM24:
+      stereo ? convertStereo<fromPcm24, 3>(in, frames, out) : convertMono<fromPcm24, 3>(in, frames, out);
+      break;
+    case WAV_PCM32:
+      stereo ? convertStereo<fromPcm32, 4>(in, frames, out) : convertMono<fromPcm32, 4>(in, frames, out);
+      break;
+    case WAV_FLOAT32:
+      stereo ? convertStereo<fromFloat32, 4>(in, frames, out) : convertMono<fromFloat32, 4>(in, frames, out);
+      break;
+  }
+}
+
+uint32_t WavDecoder::decode(const WavFormat& format, WavReadFn read, void* context, uint32_t frames,
+                            int16_t* out, uint8_t* scratch, size_t scratchBytes, bool interleaved) {
+  uint32_t bytesPerFrame = frameBytes(format);
+  if (format.encoding == WAV_PCM16 && (format.channels == 1 || interleaved)) {
+    return read(context, (uint8_t*)out, frames * bytesPerFrame) / bytesPerFrame;
+  }
+
+  uint32_t framesPerChunk = scratchBytes / bytesPerFrame;
+  if (framesPerChunk == 0) return 0;
+
+  uint32_t done = 0;
+  while (done < frames) {
+    uint32_t want = frames - done;
+    if (want > framesPerChunk) want = framesPerChunk;
+    uint32_t got = read(context, scratch, want * bytesPerFrame) / bytesPerFrame;
+    convert(format, scratch, got, out + done * (interleaved ? format.channels : 1), interleaved);
+    done += got;
+    if (got < want) break;
+  }
+  return done;
+}
+
+const char* WavDecoder::encodingName(WavEncoding encoding) {
+  switch (encoding) {
+    case WAV_PCM8: return "8-bit";
+    case WAV_PCM16: return "16-bit";
+    case WAV_PCM24: return "24-bit";
+    case WAV_PCM32: return "32-bit";
+    case WAV_FLOAT32: return "32-bit float";
+  }
+  return "?";
+}
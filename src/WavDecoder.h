@@ -0,0 +1,59 @@
+/*
+ * WavDecoder.h
+ * Decodificador de WAV per blocs: llegeix chunks grans a un buffer temporal
+ * i converteix 8/16/24/32 bits i float 32, mono o stereo, a int16
+ * (mono, o stereo entrellaçat si es vol conservar)
+ * Sense dependències d'Arduino: es pot compilar i provar a Linux
+ */
+
+#ifndef WAVDECODER_H
+#define WAVDECODER_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define WAV_CHUNK_DEFAULT_BYTES 8192
+#define WAV_CHUNK_MIN_BYTES 1024
+#define WAV_CHUNK_MAX_BYTES (16 * 1024)
+#define WAV_FMT_MAX_BYTES 40          // WAVE_FORMAT_EXTENSIBLE
+
+// Sample encoding inside the data chunk
+enum WavEncoding : uint8_t {
+  WAV_PCM8 = 0,     // unsigned
+  WAV_PCM16 = 1,
+  WAV_PCM24 = 2,
+  WAV_PCM32 = 3,
+  WAV_FLOAT32 = 4
+};
+
+struct WavFormat {
+  WavEncoding encoding;
+  uint8_t channels;           // 1 o 2
+  uint8_t bytesPerSample;
+  uint32_t sampleRate;
+};
+
+// Reads up to `bytes` into `dst`, returns the bytes read (File::read, fread...)
+typedef size_t (*WavReadFn)(void* context, uint8_t* dst, size_t bytes);
+
+class WavDecoder {
+public:
+  // "fmt " chunk body -> format. false = not PCM/float or unsupported depth/channels
+  static bool parseFmt(const uint8_t* fmt, uint32_t size, WavFormat& out);
+
+  static uint32_t frameBytes(const WavFormat& format) { return format.channels * format.bytesPerSample; }
+
+  // `frames` frames of `in` -> int16. Stereo is mixed to mono ((L / 2) + (R / 2))
+  // unless `interleaved`, which keeps L/R pairs (2 * frames values in `out`)
+  static void convert(const WavFormat& format, const uint8_t* in, uint32_t frames, int16_t* out,
+                      bool interleaved = false);
+
+  // Read and convert `frames` frames through `scratch` (whole frames per read).
+  // 16-bit that needs no conversion is read straight into `out`. Returns the frames decoded
+  static uint32_t decode(const WavFormat& format, WavReadFn read, void* context, uint32_t frames,
+                         int16_t* out, uint8_t* scratch, size_t scratchBytes, bool interleaved = false);
+
+  static const char* encodingName(WavEncoding encoding);
+};
+
+#endif // WAVDECODER_H
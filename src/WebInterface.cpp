@@ -8,6 +8,10 @@
 #include "Sequencer.h"
 #include "KitManager.h"
 #include "SampleManager.h"
+#include "SampleStreamer.h"
+#include "SampleLibrary.h"
+#include "SampleUpload.h"
+#include "ClockSource.h"
 #include <map>
 
 // Timeout para clientes UDP (30 segundos sin actividad)
@@ -17,15 +21,14 @@ extern AudioEngine audioEngine;
 extern Sequencer sequencer;
 extern KitManager kitManager;
 extern SampleManager sampleManager;
-extern void triggerPadWithLED(int track, uint8_t velocity);  // Función que enciende LED
+extern SampleStreamer sampleStreamer;
+extern SampleLibrary sampleLibrary;
+extern SampleUpload sampleUpload;
+extern SequencerClock sequencerClock;
+extern void triggerPadWithLED(int track, uint8_t velocity, uint8_t source, uint32_t requestUs);  // Función que enciende LED
+extern TriggerTiming triggerTiming;
 extern void setLedMonoMode(bool enabled);
 
-static bool isSupportedSampleFile(const String& filename) {
-  String lower = filename;
-  lower.toLowerCase();
-  return lower.endsWith(".raw") || lower.endsWith(".wav");
-}
-
 static const char* detectSampleFormat(const char* filename) {
   if (!filename) {
     return "";
@@ -40,20 +43,120 @@ static const char* detectSampleFormat(const char* filename) {
   return "";
 }
 
-static bool readWavInfo(File& file, uint32_t& rate, uint16_t& channels, uint16_t& bits) {
-  if (!file) return false;
-  file.seek(0, SeekSet);
-  uint8_t header[44];
-  if (file.read(header, sizeof(header)) != sizeof(header)) {
-    return false;
+// Nombres de los parameter locks en el protocolo WS (bit LOCK_*), 0 = desconocido
+static uint8_t lockParamFromName(const char* name) {
+  if (name == nullptr) return 0;
+  if (strcmp(name, "cutoff") == 0) return LOCK_CUTOFF;
+  if (strcmp(name, "resonance") == 0) return LOCK_RESONANCE;
+  if (strcmp(name, "pitch") == 0) return LOCK_PITCH;
+  if (strcmp(name, "decay") == 0) return LOCK_DECAY;
+  if (strcmp(name, "pan") == 0) return LOCK_PAN;
+  if (strcmp(name, "slot") == 0) return LOCK_SLOT;
+  return 0;
+}
+
+// [track, step, params, cutoff, resonance, pitch, decay, pan, slot]
+static void addLockEntry(JsonArray entry, int track, int step, const ParamLock& lock) {
+  entry.add(track);
+  entry.add(step);
+  entry.add(lock.params);
+  entry.add(lock.cutoff);
+  entry.add(lock.resonance);
+  entry.add(lock.pitch);
+  entry.add(lock.decay);
+  entry.add(lock.pan);
+  entry.add(lock.slot);
+}
+
+// Matriz del patrón (steps + velocities), cada track con su longitud (1-64)
+static size_t patternDocumentSize(int pattern) {
+  size_t slots = 4 * MAX_TRACKS + 16;
+  for (int track = 0; track < MAX_TRACKS; track++) {
+    slots += 2 * (sequencer.getTrackLength(pattern, track) + 1);
+    slots += 6 * __builtin_popcountll(sequencer.getTrackRatchets(pattern, track));
+    slots += 5 * __builtin_popcountll(sequencer.getTrackConditions(pattern, track));
+    slots += 10 * __builtin_popcountll(sequencer.getTrackLocks(pattern, track));
+  }
+  return 512 + slots * 16;
+}
+
+static void populatePatternDocument(JsonDocument& doc, int pattern) {
+  doc["type"] = "pattern";
+  doc["index"] = pattern;
+  doc["length"] = sequencer.getPatternLength(pattern);
+  
+  JsonArray lengths = doc.createNestedArray("trackLength");
+  JsonArray dividers = doc.createNestedArray("trackDivider");
+  for (int track = 0; track < MAX_TRACKS; track++) {
+    lengths.add(sequencer.getTrackLength(pattern, track));
+    dividers.add(sequencer.getTrackDivider(pattern, track));
   }
-  if (memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) {
-    return false;
+  
+  for (int track = 0; track < MAX_TRACKS; track++) {
+    JsonArray trackSteps = doc.createNestedArray(String(track));
+    int length = sequencer.getTrackLength(pattern, track);
+    for (int step = 0; step < length; step++) {
+      trackSteps.add(sequencer.getStep(pattern, track, step));
+    }
+  }
+  
+  JsonObject velocitiesObj = doc.createNestedObject("velocities");
+  for (int track = 0; track < MAX_TRACKS; track++) {
+    JsonArray trackVels = velocitiesObj.createNestedArray(String(track));
+    int length = sequencer.getTrackLength(pattern, track);
+    for (int step = 0; step < length; step++) {
+      trackVels.add(sequencer.getStepVelocity(pattern, track, step));
+    }
+  }
+  
+  // Ratchets: solo los steps que tienen, [track, step, hits, spacing, ramp]
+  JsonArray ratchetsArray = doc.createNestedArray("ratchets");
+  for (int track = 0; track < MAX_TRACKS; track++) {
+    StepMask mask = sequencer.getTrackRatchets(pattern, track);
+    for (; mask; mask &= mask - 1) {
+      int step = __builtin_ctzll(mask);
+      int spacing, ramp;
+      int hits = sequencer.getStepRatchet(pattern, track, step, &spacing, &ramp);
+      JsonArray entry = ratchetsArray.createNestedArray();
+      entry.add(track);
+      entry.add(step);
+      entry.add(hits);
+      entry.add(spacing);
+      entry.add(ramp);
+    }
+  }
+  
+  // Probabilidad / condiciones: [track, step, probability, condition]
+  JsonArray conditionsArray = doc.createNestedArray("conditions");
+  for (int track = 0; track < MAX_TRACKS; track++) {
+    StepMask mask = sequencer.getTrackConditions(pattern, track);
+    for (; mask; mask &= mask - 1) {
+      int step = __builtin_ctzll(mask);
+      uint8_t condition;
+      int probability = sequencer.getStepCondition(pattern, track, step, &condition);
+      char name[8];
+      Sequencer::conditionName(condition, name, sizeof(name));
+      JsonArray entry = conditionsArray.createNestedArray();
+      entry.add(track);
+      entry.add(step);
+      entry.add(probability);
+      entry.add(String(name));
+    }
+  }
+  doc["seed"] = sequencer.getPatternSeed(pattern);
+  
+  // Parameter locks: solo los steps que tienen
+  JsonArray locksArray = doc.createNestedArray("locks");
+  for (int track = 0; track < MAX_TRACKS; track++) {
+    StepMask mask = sequencer.getTrackLocks(pattern, track);
+    for (; mask; mask &= mask - 1) {
+      int step = __builtin_ctzll(mask);
+      ParamLock lock;
+      if (sequencer.getStepLock(pattern, track, step, lock)) {
+        addLockEntry(locksArray.createNestedArray(), track, step, lock);
+      }
+    }
   }
-  channels = header[22] | (header[23] << 8);
-  rate = header[24] | (header[25] << 8) | (header[26] << 16) | (header[27] << 24);
-  bits = header[34] | (header[35] << 8);
-  return true;
 }
 
 static void populateStateDocument(StaticJsonDocument<6144>& doc) {
@@ -62,6 +165,13 @@ static void populateStateDocument(StaticJsonDocument<6144>& doc) {
   doc["tempo"] = sequencer.getTempo();
   doc["pattern"] = sequencer.getCurrentPattern();
   doc["step"] = sequencer.getCurrentStep();
+  doc["patternLength"] = sequencer.getPatternLength();
+  doc["swing"] = sequencer.getSwing();
+  doc["queuedPattern"] = sequencer.getQueuedPattern();
+  doc["fill"] = sequencer.isFill();
+  doc["songMode"] = sequencer.isSongMode();
+  doc["songLength"] = sequencer.getSongLength();
+  doc["songPosition"] = sequencer.getSongPosition();
   doc["sequencerVolume"] = audioEngine.getSequencerVolume();
   doc["liveVolume"] = audioEngine.getLiveVolume();
   doc["samplesLoaded"] = sampleManager.getLoadedSamplesCount();
@@ -95,100 +205,84 @@ static void populateStateDocument(StaticJsonDocument<6144>& doc) {
   }
 }
 
+// Song como texto compacto "patrón:repeticiones,..." ("0:4,1:2,0")
+// 256 entradas no caben como arrays en el documento de 512 bytes de los comandos
+static String buildSongString() {
+  String out;
+  int count = sequencer.getSongLength();
+  out.reserve(count * 5);
+  for (int i = 0; i < count; i++) {
+    SongEntry entry = sequencer.getSongEntry(i);
+    if (i > 0) out += ',';
+    out += Sequencer::songEntryPattern(entry);
+    int repeats = Sequencer::songEntryRepeats(entry);
+    if (repeats > 1) {
+      out += ':';
+      out += repeats;
+    }
+  }
+  return out;
+}
+
+// Repeticiones opcionales (1 por defecto); -1 si hay una entrada no válida
+static int parseSongString(const char* text, SongEntry* out) {
+  int count = 0;
+  const char* p = text;
+  while (*p) {
+    char* end;
+    long pattern = strtol(p, &end, 10);
+    if (end == p || pattern < 0 || pattern >= MAX_PATTERNS) return -1;
+    long repeats = 1;
+    p = end;
+    if (*p == ':') {
+      repeats = strtol(p + 1, &end, 10);
+      if (end == p + 1 || repeats < 1 || repeats > SONG_MAX_REPEATS) return -1;
+      p = end;
+    }
+    if (count >= SONG_MAX_ENTRIES) return -1;
+    out[count++] = Sequencer::makeSongEntry(pattern, repeats);
+    if (*p == ',') p++;
+    else if (*p) return -1;
+  }
+  return count;
+}
+
+static void populateSongDocument(JsonDocument& doc) {
+  doc["type"] = "song";
+  doc["song"] = buildSongString();
+  doc["length"] = sequencer.getSongLength();
+  doc["mode"] = sequencer.isSongMode();
+  doc["position"] = sequencer.getSongPosition();
+  doc["repeat"] = sequencer.getSongRepeat();
+}
+
 static bool isClientReady(AsyncWebSocketClient* client) {
   return client != nullptr && client->status() == WS_CONNECTED;
 }
 
-static void sendSampleCounts(AsyncWebSocketClient* client) {
-  if (!client || !isClientReady(client)) {
-    Serial.println("[sendSampleCounts] Client not ready");
-    return;
-  }
-  
-  // Verificar que LittleFS está montado
-  if (!LittleFS.begin(false)) {
-    Serial.println("[sendSampleCounts] ERROR: LittleFS not mounted!");
-    return;
-  }
-  
+// Conteos por familia desde el índice en RAM (sin recorrer LittleFS)
+static String buildSampleCounts() {
   StaticJsonDocument<512> sampleCountDoc;
   sampleCountDoc["type"] = "sampleCounts";
-  const char* families[] = {"BD", "SD", "CH", "OH", "CP", "CB", "RS", "CL", "MA", "CY", "HT", "LT", "MC", "MT", "HC", "LC"};
-  
-  Serial.println("[SampleCount] === Counting samples in LittleFS ===");
-  int totalFiles = 0;
-  
-  for (int i = 0; i < 16; i++) {
-    String path = String("/") + String(families[i]);
-    int count = 0;
-    
-    File dir = LittleFS.open(path);
-    if (!dir) {
-      Serial.printf("[SampleCount] WARN: Cannot open %s\n", path.c_str());
-      sampleCountDoc[families[i]] = 0;
-      yield(); // Yield inmediato si hay error
-      continue;
-    }
-    
-    if (!dir.isDirectory()) {
-      Serial.printf("[SampleCount] WARN: %s is not a directory\n", path.c_str());
-      dir.close();
-      sampleCountDoc[families[i]] = 0;
-      yield();
-      continue;
-    }
-    
-    // Iterar archivos en el directorio
-    File file = dir.openNextFile();
-    int fileCount = 0;
-    while (file) {
-      fileCount++;
-      if (!file.isDirectory()) {
-        // Obtener nombre del archivo
-        String fullName = file.name();
-        String fileName = fullName;
-        
-        // Extraer solo el nombre del archivo si incluye ruta
-        int lastSlash = fullName.lastIndexOf('/');
-        if (lastSlash >= 0) {
-          fileName = fullName.substring(lastSlash + 1);
-        }
-        
-        // Verificar si es un archivo de audio soportado
-        if (isSupportedSampleFile(fileName)) {
-          count++;
-        }
-      }
-      file.close();
-      
-      // Yield cada 5 archivos para evitar watchdog
-      if (fileCount % 5 == 0) {
-        yield();
-      }
-      
-      file = dir.openNextFile();
-    }
-    dir.close();
-    
-    sampleCountDoc[families[i]] = count;
-    totalFiles += count;
-    Serial.printf("[SampleCount] %s: %d files\n", families[i], count);
-    
-    // Yield después de cada familia
-    yield();
+  for (int i = 0; i < LIBRARY_FAMILIES; i++) {
+    sampleCountDoc[SampleLibrary::familyName(i)] = sampleLibrary.getFamilyCount(i);
   }
-  
-  Serial.printf("[SampleCount] === TOTAL: %d samples ===\n", totalFiles);
+  sampleCountDoc["total"] = sampleLibrary.getCount();
+  sampleCountDoc["revision"] = sampleLibrary.getRevision();
   
   String countOutput;
   serializeJson(sampleCountDoc, countOutput);
-  
-  if (isClientReady(client)) {
-    client->text(countOutput);
-    Serial.printf("[SampleCount] Sent to client %u\n", client->id());
-  } else {
-    Serial.println("[sendSampleCounts] Client disconnected before sending data");
+  return countOutput;
+}
+
+static void sendSampleCounts(AsyncWebSocketClient* client) {
+  if (!client || !isClientReady(client)) {
+    Serial.println("[sendSampleCounts] Client not ready");
+    return;
   }
+  
+  client->text(buildSampleCounts());
+  Serial.printf("[SampleCount] %d samples sent to client %u\n", sampleLibrary.getCount(), client->id());
 }
 
 WebInterface::WebInterface() {
@@ -265,7 +359,7 @@ bool WebInterface::begin(const char* ssid, const char* password) {
   server->on("/api/trigger", HTTP_POST, [](AsyncWebServerRequest *request){
     if (request->hasParam("pad", true)) {
       int pad = request->getParam("pad", true)->value().toInt();
-      triggerPadWithLED(pad, 127);  // Enciende LED RGB
+      triggerPadWithLED(pad, 127, TIMING_LIVE, 0);  // Enciende LED RGB
       request->send(200, "text/plain", "OK");
     } else {
       request->send(400, "text/plain", "Missing pad parameter");
@@ -299,12 +393,13 @@ bool WebInterface::begin(const char* ssid, const char* password) {
   
   server->on("/api/getPattern", HTTP_GET, [](AsyncWebServerRequest *request){
     int pattern = sequencer.getCurrentPattern();
-    StaticJsonDocument<2048> doc;
+    DynamicJsonDocument doc(patternDocumentSize(pattern));
     
-    for (int track = 0; track < 8; track++) {
+    for (int track = 0; track < MAX_TRACKS; track++) {
       JsonArray trackSteps = doc.createNestedArray(String(track));
-      for (int step = 0; step < 16; step++) {
-        trackSteps.add(sequencer.getStep(track, step));
+      int length = sequencer.getTrackLength(pattern, track);
+      for (int step = 0; step < length; step++) {
+        trackSteps.add(sequencer.getStep(pattern, track, step));
       }
     }
     
@@ -315,7 +410,7 @@ bool WebInterface::begin(const char* ssid, const char* password) {
   
   // Endpoint para info del sistema (para dashboard /adm)
   server->on("/api/sysinfo", HTTP_GET, [this](AsyncWebServerRequest *request){
-    StaticJsonDocument<3072> doc;
+    DynamicJsonDocument doc(7168);
     
     // Info de memoria
     doc["heapFree"] = ESP.getFreeHeap();
@@ -366,6 +461,198 @@ bool WebInterface::begin(const char* ssid, const char* password) {
     doc["samplesLoaded"] = sampleManager.getLoadedSamplesCount();
     doc["memoryUsed"] = sampleManager.getTotalMemoryUsed();
     
+    // Arena de PSRAM dels samples: fragmentació = 1 - forat més gran / lliure
+    SampleArena& arena = sampleManager.getArena();
+    JsonObject arenaInfo = doc.createNestedObject("arena");
+    arenaInfo["capacity"] = arena.capacity();
+    arenaInfo["used"] = arena.used();
+    arenaInfo["free"] = arena.freeBytes();
+    arenaInfo["largestFree"] = arena.largestFree();
+    arenaInfo["fragmentation"] = arena.fragmentation();
+    arenaInfo["blocks"] = arena.handleCount();
+    arenaInfo["compactions"] = arena.getCompactions();
+    arenaInfo["failures"] = sampleManager.getArenaFailures();
+    arenaInfo["flashMapped"] = sampleManager.getFlashMappedBytes();  // Partició `samples`, fora de PSRAM
+    
+    // Samples comprimits: memòria estalviada, cost de decode i SNR mesurats a la càrrega
+    JsonObject codec = doc.createNestedObject("codec");
+    codec["defaultFormat"] = SampleCodec::formatName(sampleManager.getDefaultFormat());
+    codec["memorySaved"] = sampleManager.getMemorySaved();
+    JsonArray codecPads = codec.createNestedArray("pads");
+    for (int pad = 0; pad < MAX_SAMPLES; pad++) {
+      CodecReport report;
+      if (!sampleManager.getCodecReport(pad, report)) continue;
+      JsonObject p = codecPads.createNestedObject();
+      p["pad"] = pad;
+      p["format"] = SampleCodec::formatName(report.format);
+      p["stereo"] = sampleManager.isStereo(pad);
+      p["pcmBytes"] = report.pcmBytes;
+      p["storedBytes"] = report.storedBytes;
+      p["snrDb"] = report.snrDb;
+      p["cyclesPerFrame"] = report.decodeCyclesPerFrame;
+    }
+
+    // Cache de samples entre kits: hit rate i bytes per dimensionar el pressupost
+    SampleCacheStats cacheStats;
+    sampleManager.getCacheStats(cacheStats);
+    JsonObject cacheInfo = doc.createNestedObject("sampleCache");
+    cacheInfo["hits"] = cacheStats.hits;
+    cacheInfo["misses"] = cacheStats.misses;
+    cacheInfo["hitRate"] = (cacheStats.hits + cacheStats.misses) > 0
+                           ? (float)cacheStats.hits / (cacheStats.hits + cacheStats.misses) : 0.0f;
+    cacheInfo["evictions"] = cacheStats.evictions;
+    cacheInfo["entries"] = cacheStats.entries;
+    cacheInfo["inUse"] = cacheStats.referenced;
+    cacheInfo["bytes"] = cacheStats.bytesCached;
+    cacheInfo["idleBytes"] = cacheStats.bytesIdle;
+    cacheInfo["budget"] = cacheStats.budget;
+
+    // Kit en segon pla: temps de càrrega, espera fins al compàs i pic d'arena (dos kits)
+    KitLoadStats kitStats;
+    kitManager.getLoadStats(kitStats);
+    JsonObject kitInfo = doc.createNestedObject("kit");
+    kitInfo["current"] = kitManager.getCurrentKit();
+    kitInfo["name"] = kitManager.getCurrentKitName();
+    kitInfo["count"] = kitManager.getKitCount();
+    kitInfo["bank"] = audioEngine.getActiveBank();
+    kitInfo["loading"] = kitStats.pendingKit;
+    kitInfo["state"] = kitStats.state;
+    kitInfo["loads"] = kitStats.loads;
+    kitInfo["failures"] = kitStats.failures;
+    kitInfo["loaded"] = kitStats.lastLoaded;
+    kitInfo["total"] = kitStats.lastTotal;
+    kitInfo["loadMs"] = kitStats.loadMs;
+    kitInfo["swapWaitMs"] = kitStats.swapWaitMs;
+    kitInfo["swapUs"] = kitStats.swapUs;
+    kitInfo["deferredSwaps"] = kitStats.deferredSwaps;
+    kitInfo["peakArenaBytes"] = kitStats.peakArenaBytes;
+
+    // Última subida: tiempo hasta que el pad suena y escritura a flash en segundo plano
+    UploadStats uploadStats;
+    sampleUpload.getStats(uploadStats);
+    JsonObject uploadInfo = doc.createNestedObject("upload");
+    uploadInfo["uploads"] = uploadStats.uploads;
+    uploadInfo["failures"] = uploadStats.failures;
+    uploadInfo["bytesIn"] = uploadStats.bytesIn;
+    uploadInfo["framesOut"] = uploadStats.framesOut;
+    uploadInfo["resampled"] = uploadStats.resampled;
+    uploadInfo["resident"] = uploadStats.resident;
+    uploadInfo["ingestMs"] = uploadStats.ingestMs;
+    uploadInfo["flashMs"] = uploadStats.flashMs;
+    uploadInfo["stageWaits"] = uploadStats.stageWaits;
+
+    // Info del motor d'àudio (voice governor)
+    RenderStats renderStats;
+    audioEngine.getRenderStats(renderStats);
+    JsonObject audio = doc.createNestedObject("audio");
+    audio["activeVoices"] = audioEngine.getActiveVoices();
+    audio["maxVoices"] = MAX_VOICES;
+    audio["voiceCap"] = renderStats.voiceCap;
+    audio["renderUs"] = renderStats.lastRenderUs;
+    audio["renderPeakUs"] = renderStats.peakRenderUs;
+    audio["budgetUs"] = renderStats.budgetUs;
+    audio["voiceCostUs"] = renderStats.voiceCostUs;
+    audio["deadlineMisses"] = renderStats.deadlineMisses;
+    audio["voiceSteals"] = renderStats.voiceSteals;
+    audio["governorDrops"] = renderStats.governorDrops;
+    JsonArray renderHist = audio.createNestedArray("renderHistogram");
+    for (int i = 0; i < RENDER_HIST_BINS; i++) {
+      renderHist.add(renderStats.histogram[i]);
+    }
+
+    // Dual-core render: cost per veu i headroom (veus que caben al 70% del budget)
+    DualCoreStats dualStats;
+    audioEngine.getDualCoreStats(dualStats);
+    JsonObject dual = audio.createNestedObject("dualCore");
+    dual["enabled"] = dualStats.enabled;
+    dual["active"] = dualStats.active;
+    dual["blocks"] = dualStats.dualBlocks;
+    dual["lateStarts"] = dualStats.lateStarts;
+    dual["fallbacks"] = dualStats.fallbacks;
+    dual["workerStartUs"] = dualStats.workerStartUs;
+    dual["joinWaitUs"] = dualStats.joinWaitUs;
+    dual["singleCostUs"] = dualStats.singleCostUs;
+    dual["dualCostUs"] = dualStats.dualCostUs;
+    float targetUs = renderStats.budgetUs * GOVERNOR_TARGET_LOAD_PCT / 100.0f;
+    dual["headroomSingle"] = dualStats.singleCostUs > 0.0f ? (int)(targetUs / dualStats.singleCostUs) : 0;
+    dual["headroomDual"] = dualStats.dualCostUs > 0.0f ? (int)(targetUs / dualStats.dualCostUs) : 0;
+    dual["speedup"] = (dualStats.singleCostUs > 0.0f && dualStats.dualCostUs > 0.0f)
+                      ? dualStats.singleCostUs / dualStats.dualCostUs : 0.0f;
+
+    // Head cache (atac dels samples en SRAM interna)
+    JsonObject headCache = audio.createNestedObject("headCache");
+    headCache["ms"] = sampleManager.getHeadCacheMs();
+    headCache["bytes"] = sampleManager.getHeadCacheUsed();
+    headCache["budget"] = HEAD_CACHE_BUDGET;
+    headCache["cached"] = sampleManager.getHeadCachedCount();
+    headCache["hits"] = renderStats.headHits;
+    headCache["misses"] = renderStats.headMisses;
+
+    // Triggers del sequencer amb timestamp de frame i cua dels pads live
+    JsonObject schedule = audio.createNestedObject("schedule");
+    schedule["started"] = renderStats.scheduledTriggers;
+    schedule["late"] = renderStats.lateTriggers;
+    schedule["drops"] = renderStats.scheduleDrops;
+    schedule["liveDrops"] = renderStats.liveDrops;
+
+    // Alliberament diferit de samples (hot-swap segur)
+    RetireStats retireStats;
+    audioEngine.getRetireStats(retireStats);
+    JsonObject retire = audio.createNestedObject("retire");
+    retire["retired"] = retireStats.retired;
+    retire["voicesStopped"] = retireStats.voicesStopped;
+    retire["queueFull"] = retireStats.queueFull;
+    retire["lastWaitMs"] = retireStats.lastWaitMs;
+    retire["peakWaitMs"] = retireStats.peakWaitMs;
+
+    // Streaming des de LittleFS (samples més grans que STREAM_THRESHOLD_BYTES)
+    StreamStats streamStats;
+    sampleStreamer.getStats(streamStats);
+    JsonObject stream = audio.createNestedObject("stream");
+    stream["pads"] = streamStats.registeredPads;
+    stream["active"] = streamStats.activeStreams;
+    stream["slots"] = STREAM_SLOTS;
+    stream["underruns"] = streamStats.underruns;
+    stream["denied"] = streamStats.denied;
+    stream["chunks"] = streamStats.chunks;
+    stream["bytesRead"] = streamStats.bytesRead;
+    stream["readKBps"] = streamStats.readKBps;
+    stream["peakReadUs"] = streamStats.peakReadUs;
+
+    // Block prefetch PSRAM -> SRAM: cost per veu amb i sense
+    PrefetchStats prefetchStats;
+    audioEngine.getPrefetchStats(prefetchStats);
+    JsonObject prefetch = audio.createNestedObject("prefetch");
+    prefetch["enabled"] = prefetchStats.enabled;
+    prefetch["dma"] = prefetchStats.dma;
+    prefetch["copies"] = prefetchStats.copies;
+    prefetch["bytes"] = prefetchStats.bytes;
+    prefetch["dmaErrors"] = prefetchStats.dmaErrors;
+    prefetch["timeouts"] = prefetchStats.timeouts;
+    prefetch["waitUs"] = prefetchStats.waitUs;
+    prefetch["onCostUs"] = prefetchStats.onCostUs;
+    prefetch["offCostUs"] = prefetchStats.offCostUs;
+
+    // Reloj del secuenciador: retardo tick -> tarea (jitter) y coste de schedule()
+    ClockJitterStats clockStats;
+    sequencerClock.getStats(clockStats);
+    JsonObject clock = doc.createNestedObject("clock");
+    clock["source"] = sequencerClock.sourceName();
+    clock["running"] = sequencerClock.isRunning();
+    clock["periodUs"] = clockStats.periodUs;
+    clock["ticks"] = clockStats.ticks;
+    clock["dropped"] = clockStats.dropped;
+    clock["intervalMinUs"] = clockStats.ticks > 1 ? clockStats.intervalMinUs : 0;
+    clock["intervalMaxUs"] = clockStats.intervalMaxUs;
+    clock["delayUs"] = clockStats.lastDelayUs;
+    clock["meanDelayUs"] = clockStats.meanDelayUs;
+    clock["peakDelayUs"] = clockStats.peakDelayUs;
+    clock["peakWorkUs"] = clockStats.peakWorkUs;
+    JsonArray clockHist = clock.createNestedArray("delayHistogram");
+    for (int i = 0; i < CLOCK_HIST_BINS; i++) {
+      clockHist.add(clockStats.histogram[i]);
+    }
+
     // Uptime
     doc["uptime"] = millis();
     
@@ -373,7 +660,60 @@ bool WebInterface::begin(const char* ssid, const char* password) {
     serializeJson(doc, output);
     request->send(200, "application/json", output);
   });
-  
+
+  // Latencia de los triggers por origen: p50/p99/max del retardo hasta el bloc DMA (?reset=1 borra)
+  server->on("/api/jitter", HTTP_GET, [](AsyncWebServerRequest *request){
+    if (request->hasParam("reset")) {
+      triggerTiming.reset();
+      sequencerClock.resetStats();
+    }
+
+    DynamicJsonDocument doc(4096);
+    doc["windowSamples"] = TIMING_WINDOW;
+    // Bloc DMA -> DAC: constante, no incluida en las medidas
+    doc["outputLatencyUs"] = (uint32_t)((uint64_t)DMA_BUF_COUNT * DMA_BUF_LEN * 1000000ULL / SAMPLE_RATE);
+
+    TimingReport report;
+    uint32_t bins[TIMING_BINS];
+    JsonObject sources = doc.createNestedObject("sources");
+    for (int s = 0; s < TIMING_SOURCES; s++) {
+      triggerTiming.getReport(s, report);
+      triggerTiming.getHistogram(s, bins);
+      JsonObject src = sources.createNestedObject(TriggerTiming::sourceName(s));
+      src["total"] = report.total;
+      src["p50Us"] = report.p50Us;
+      src["p99Us"] = report.p99Us;
+      src["minUs"] = report.minUs;
+      src["maxUs"] = report.maxUs;
+      JsonArray hist = src.createNestedArray("histogram");
+      for (int i = 0; i < TIMING_BINS; i++) hist.add(bins[i]);
+    }
+
+    // Margen con que el secuenciador entrega cada step antes de su frame (p1 = el peor caso habitual)
+    triggerTiming.getLeadReport(report);
+    JsonObject lead = doc.createNestedObject("sequencerLead");
+    lead["total"] = report.total;
+    lead["p1Us"] = report.p1Us;
+    lead["p50Us"] = report.p50Us;
+    lead["minUs"] = report.minUs;
+    lead["maxUs"] = report.maxUs;
+
+    ClockJitterStats clockStats;
+    sequencerClock.getStats(clockStats);
+    JsonObject clock = doc.createNestedObject("clock");
+    clock["source"] = sequencerClock.sourceName();
+    clock["ticks"] = clockStats.ticks;
+    clock["dropped"] = clockStats.dropped;
+    clock["peakDelayUs"] = clockStats.peakDelayUs;
+
+    JsonArray edges = doc.createNestedArray("binEdgesUs");
+    for (int i = 0; i < TIMING_BINS - 1; i++) edges.add(TriggerTiming::binEdge(i));
+
+    String output;
+    serializeJson(doc, output);
+    request->send(200, "application/json", output);
+  });
+
   // Endpoint para subir samples WAV
   server->on("/api/upload", HTTP_POST, 
     [](AsyncWebServerRequest *request){
@@ -434,13 +774,14 @@ void WebInterface::onWebSocketEvent(AsyncWebSocket *server, AsyncWebSocketClient
         if (len == 3 && data[0] == 0x90) {
            int pad = data[1];
            int velocity = data[2];
-           triggerPadWithLED(pad, velocity);
+           triggerPadWithLED(pad, velocity, TIMING_LIVE, 0);
            // Opcional: Broadcast para feedback visual en otros clientes
            // broadcastPadTrigger(pad); 
         }
       }
       // 2. MANEJO DE TEXTO (JSON normal)
       else if (info->opcode == WS_TEXT) {
+        uint32_t receivedUs = micros();
         data[len] = 0;
         
         StaticJsonDocument<512> doc;
@@ -448,33 +789,15 @@ void WebInterface::onWebSocketEvent(AsyncWebSocket *server, AsyncWebSocketClient
         
         if (!error) {
           // Usar función común para procesar comandos
-          processCommand(doc);
+          processCommand(doc, TIMING_LIVE, receivedUs);
           
           // Comandos específicos del WebSocket que requieren respuesta
           String cmd = doc["cmd"];
           
           if (cmd == "getPattern") {
             int pattern = sequencer.getCurrentPattern();
-            StaticJsonDocument<3072> responseDoc;
-            responseDoc["type"] = "pattern";
-            responseDoc["index"] = pattern;
-            
-            // Send steps (active/inactive) - Solo 8 tracks activos
-            for (int track = 0; track < 8; track++) {
-              JsonArray trackSteps = responseDoc.createNestedArray(String(track));
-              for (int step = 0; step < 16; step++) {
-                trackSteps.add(sequencer.getStep(track, step));
-              }
-            }
-            
-            // Send velocities
-            JsonObject velocitiesObj = responseDoc.createNestedObject("velocities");
-            for (int track = 0; track < 8; track++) {
-              JsonArray trackVels = velocitiesObj.createNestedArray(String(track));
-              for (int step = 0; step < 16; step++) {
-                trackVels.add(sequencer.getStepVelocity(track, step));
-              }
-            }
+            DynamicJsonDocument responseDoc(patternDocumentSize(pattern));
+            populatePatternDocument(responseDoc, pattern);
             
             String output;
             serializeJson(responseDoc, output);
@@ -484,6 +807,13 @@ void WebInterface::onWebSocketEvent(AsyncWebSocket *server, AsyncWebSocketClient
               ws->textAll(output);
             }
           }
+          else if (cmd == "getSong") {
+            DynamicJsonDocument responseDoc(2048);
+            populateSongDocument(responseDoc);
+            String output;
+            serializeJson(responseDoc, output);
+            if (isClientReady(client)) client->text(output);
+          }
           else if (cmd == "init") {
             // Cliente solicita inicialización completa (se llama después de conectar)
             Serial.printf("[init] Client %u requesting full initialization\n", client->id());
@@ -505,83 +835,42 @@ void WebInterface::onWebSocketEvent(AsyncWebSocket *server, AsyncWebSocketClient
             sendSampleCounts(client);
           }
           else if (cmd == "getSamples") {
-            // Obtener lista de samples de una familia desde LittleFS
+            // Lista de samples de una familia desde el índice, por páginas
             const char* family = doc["family"];
             int padIndex = doc["pad"];
+            int offset = doc.containsKey("offset") ? (int)doc["offset"] : 0;
+            int limit = doc.containsKey("limit") ? (int)doc["limit"] : LIBRARY_PAGE_DEFAULT;
+            if (offset < 0) offset = 0;
+            if (limit < 1 || limit > LIBRARY_PAGE_MAX) limit = LIBRARY_PAGE_MAX;
+            int familyIndex = SampleLibrary::familyIndex(family);
             
-            Serial.printf("[getSamples] Family: %s, Pad: %d\n", family, padIndex);
+            static LibraryEntry page[LIBRARY_PAGE_MAX];  // Solo la tarea de red
+            int count = sampleLibrary.getPage(familyIndex, offset, limit, page);
+            int total = sampleLibrary.getFamilyCount(familyIndex);
             
-            // Verificar que LittleFS está montado
-            if (!LittleFS.begin(false)) {
-              Serial.println("[getSamples] ERROR: LittleFS not mounted!");
-              return;
-            }
-            
-            StaticJsonDocument<2048> responseDoc;
+            // LIBRARY_PAGE_MAX entradas; los nombres se referencian desde page, no se copian
+            DynamicJsonDocument responseDoc(8192);
             responseDoc["type"] = "sampleList";
             responseDoc["family"] = family;
             responseDoc["pad"] = padIndex;
+            responseDoc["offset"] = offset;
+            responseDoc["total"] = total;
+            responseDoc["revision"] = sampleLibrary.getRevision();
             
-            String path = String("/") + String(family);
-            Serial.printf("[getSamples] Opening: %s\n", path.c_str());
-            
-            File dir = LittleFS.open(path, "r");
-            
-            if (dir && dir.isDirectory()) {
-              Serial.println("[getSamples] Directory OK, listing files:");
-              JsonArray samples = responseDoc.createNestedArray("samples");
-              File file = dir.openNextFile();
-              int count = 0;
-              
-              while (file) {
-                if (!file.isDirectory()) {
-                  String filename = file.name();
-                  int lastSlash = filename.lastIndexOf('/');
-                  if (lastSlash >= 0) {
-                    filename = filename.substring(lastSlash + 1);
-                  }
-                  
-                  if (isSupportedSampleFile(filename)) {
-                    JsonObject sampleObj = samples.createNestedObject();
-                    sampleObj["name"] = filename;
-                    sampleObj["size"] = file.size();
-                    const char* format = detectSampleFormat(filename.c_str());
-                    sampleObj["format"] = format;
-                    uint32_t rate = 0;
-                    uint16_t channels = 0;
-                    uint16_t bits = 0;
-                    if (format && String(format) == "wav") {
-                      if (readWavInfo(file, rate, channels, bits)) {
-                        sampleObj["rate"] = rate;
-                        sampleObj["channels"] = channels;
-                        sampleObj["bits"] = bits;
-                      } else {
-                        sampleObj["rate"] = 0;
-                        sampleObj["channels"] = 0;
-                        sampleObj["bits"] = 0;
-                      }
-                    } else {
-                      sampleObj["rate"] = 44100;
-                      sampleObj["channels"] = 1;
-                      sampleObj["bits"] = 16;
-                    }
-                    count++;
-                    Serial.printf("  [%d] %s (%d KB)\n", count, filename.c_str(), file.size() / 1024);
-                    
-                    // Yield cada 3 samples para evitar watchdog
-                    if (count % 3 == 0) {
-                      yield();
-                    }
-                  }
-                }
-                file.close();
-                file = dir.openNextFile();
-              }
-              dir.close();
-              Serial.printf("[getSamples] Total: %d samples\n", count);
-            } else {
-              Serial.printf("[getSamples] ERROR: Cannot open %s\n", path.c_str());
+            JsonArray samples = responseDoc.createNestedArray("samples");
+            for (int i = 0; i < count; i++) {
+              const LibraryEntry& entry = page[i];
+              JsonObject sampleObj = samples.createNestedObject();
+              sampleObj["name"] = (const char*)entry.name;
+              sampleObj["size"] = entry.size;
+              sampleObj["format"] = entry.format == LIBRARY_WAV ? "wav" : "raw";
+              sampleObj["rate"] = entry.rate;
+              sampleObj["channels"] = entry.channels;
+              sampleObj["bits"] = entry.bits;
+              sampleObj["duration"] = SampleLibrary::durationMs(entry);
+              sampleObj["peak"] = entry.peak;
             }
+            Serial.printf("[getSamples] %s: %d of %d from %d\n", family ? family : "?", count, total, offset);
             
             String output;
             serializeJson(responseDoc, output);
@@ -630,14 +919,32 @@ void WebInterface::broadcastPadTrigger(int pad) {
   ws->textAll(output);
 }
 
+void WebInterface::broadcastPattern() {
+  if (!initialized || !ws) return;
+  int pattern = sequencer.getCurrentPattern();
+  DynamicJsonDocument doc(patternDocumentSize(pattern));
+  populatePatternDocument(doc, pattern);
+  String output;
+  serializeJson(doc, output);
+  ws->textAll(output);
+}
+
 void WebInterface::broadcastStep(int step) {
   if (!initialized || !ws) return;
   // Mensaje ultra-compacto para mínima latencia
-  StaticJsonDocument<64> doc;
+  StaticJsonDocument<256> doc;
   doc["type"] = "step";
   doc["step"] = step;
   doc["t"] = millis(); // timestamp para sincronización
   
+  // Polimetría: posición propia de cada track (solo si algún track no sigue el patrón)
+  if (sequencer.hasTrackTiming(sequencer.getCurrentPattern())) {
+    JsonArray tracks = doc.createNestedArray("tracks");
+    for (int track = 0; track < MAX_TRACKS; track++) {
+      tracks.add(sequencer.getTrackStep(track));
+    }
+  }
+  
   String output;
   serializeJson(doc, output);
   ws->textAll(output);
@@ -699,7 +1006,7 @@ void WebInterface::broadcastVisualizationData() {
 }
 
 // Procesar comandos JSON (compartido entre WebSocket y UDP)
-void WebInterface::processCommand(const JsonDocument& doc) {
+void WebInterface::processCommand(const JsonDocument& doc, uint8_t source, uint32_t receivedUs) {
   String cmd = doc["cmd"];
   
   if (cmd == "trigger") {
@@ -709,18 +1016,29 @@ void WebInterface::processCommand(const JsonDocument& doc) {
       return;
     }
     int velocity = doc.containsKey("vel") ? doc["vel"].as<int>() : 127;
-    triggerPadWithLED(pad, velocity);
+    triggerPadWithLED(pad, velocity, source, receivedUs);
     broadcastPadTrigger(pad);
   }
   else if (cmd == "setStep") {
     int track = doc["track"];
     int step = doc["step"];
-    if (track < 0 || track >= 8 || step < 0 || step >= 16) {
+    if (track < 0 || track >= MAX_TRACKS || step < 0 || step >= MAX_STEPS) {
       Serial.printf("[WS] Invalid track %d or step %d\n", track, step);
       return;
     }
     bool active = doc["active"];
-    sequencer.setStep(track, step, active);
+    if (!sequencer.setStep(track, step, active)) {
+      // Pool ple: la web ja ha pintat el step, que el desfaci
+      StaticJsonDocument<128> rejectDoc;
+      rejectDoc["type"] = "stepRejected";
+      rejectDoc["track"] = track;
+      rejectDoc["step"] = step;
+      rejectDoc["active"] = sequencer.getStep(track, step);
+      rejectDoc["poolSize"] = STEP_POOL_SIZE;
+      String output;
+      serializeJson(rejectDoc, output);
+      if (ws) ws->textAll(output);
+    }
   }
   else if (cmd == "start") {
     sequencer.start();
@@ -732,6 +1050,21 @@ void WebInterface::processCommand(const JsonDocument& doc) {
     float tempo = doc["value"];
     sequencer.setTempo(tempo);
   }
+  else if (cmd == "setSwing") {
+    int swing = doc["value"];
+    sequencer.setSwing(swing);
+  }
+  else if (cmd == "setStepMicroTiming") {
+    // Ticks a 96 PPQN (24 por step), ±MICRO_TIMING_MAX; solo steps activos
+    int track = doc["track"];
+    int step = doc["step"];
+    int ticks = doc["ticks"];
+    if (track < 0 || track >= MAX_TRACKS || step < 0 || step >= MAX_STEPS) {
+      Serial.printf("[WS] Invalid track %d or step %d\n", track, step);
+      return;
+    }
+    sequencer.setStepMicroTiming(sequencer.getCurrentPattern(), track, step, ticks);
+  }
   else if (cmd == "selectPattern") {
     int pattern = doc["index"];
     sequencer.selectPattern(pattern);
@@ -740,29 +1073,172 @@ void WebInterface::processCommand(const JsonDocument& doc) {
     // Enviar estado actualizado
     broadcastSequencerState();
     
-    // Enviar datos del patrón (matriz de steps) - Solo 8 tracks activos
-    StaticJsonDocument<3072> patternDoc;
-    patternDoc["type"] = "pattern";
-    patternDoc["index"] = pattern;
-    
-    for (int track = 0; track < 8; track++) {
-      JsonArray trackSteps = patternDoc.createNestedArray(String(track));
-      for (int step = 0; step < 16; step++) {
-        trackSteps.add(sequencer.getStep(track, step));
+    // Enviar datos del patrón (matriz de steps)
+    broadcastPattern();
+  }
+  else if (cmd == "setStepRatchet") {
+    // hits 1-8 (1 = quitar), spacing en ticks (0 = repartidos en el step), ramp = velocity por golpe
+    int track = doc["track"];
+    int step = doc["step"];
+    if (track < 0 || track >= MAX_TRACKS || step < 0 || step >= MAX_STEPS) {
+      Serial.printf("[WS] Invalid track %d or step %d\n", track, step);
+      return;
+    }
+    int hits = doc["hits"];
+    int spacing = doc.containsKey("spacing") ? doc["spacing"].as<int>() : 0;
+    int ramp = doc.containsKey("ramp") ? doc["ramp"].as<int>() : 0;
+    int pattern = sequencer.getCurrentPattern();
+    if (!sequencer.setStepRatchet(pattern, track, step, hits, spacing, ramp)) return;
+    
+    StaticJsonDocument<192> ratchetDoc;
+    ratchetDoc["type"] = "stepRatchet";
+    ratchetDoc["track"] = track;
+    ratchetDoc["step"] = step;
+    ratchetDoc["hits"] = sequencer.getStepRatchet(pattern, track, step, &spacing, &ramp);
+    ratchetDoc["spacing"] = spacing;
+    ratchetDoc["ramp"] = ramp;
+    String output;
+    serializeJson(ratchetDoc, output);
+    if (ws) ws->textAll(output);
+  }
+  else if (cmd == "setStepCondition") {
+    // probability 1-100 %, condition "", "1:2".."8:8", "fill", "!fill", "first", "!first", "pre", "!pre"
+    int track = doc["track"];
+    int step = doc["step"];
+    if (track < 0 || track >= MAX_TRACKS || step < 0 || step >= MAX_STEPS) {
+      Serial.printf("[WS] Invalid track %d or step %d\n", track, step);
+      return;
+    }
+    int probability = doc.containsKey("probability") ? doc["probability"].as<int>() : 100;
+    uint8_t condition = COND_NONE;
+    if (doc.containsKey("condition") && !Sequencer::parseCondition(doc["condition"], condition)) {
+      Serial.println("[WS] Unknown trig condition");
+      return;
+    }
+    int pattern = sequencer.getCurrentPattern();
+    if (!sequencer.setStepCondition(pattern, track, step, probability, condition)) return;
+    
+    StaticJsonDocument<192> conditionDoc;
+    conditionDoc["type"] = "stepCondition";
+    conditionDoc["track"] = track;
+    conditionDoc["step"] = step;
+    conditionDoc["probability"] = sequencer.getStepCondition(pattern, track, step, &condition);
+    char name[8];
+    Sequencer::conditionName(condition, name, sizeof(name));
+    conditionDoc["condition"] = name;
+    String output;
+    serializeJson(conditionDoc, output);
+    if (ws) ws->textAll(output);
+  }
+  else if (cmd == "setStepLock" || cmd == "clearStepLock") {
+    // param: "cutoff" | "resonance" | "decay" (0-127), "pitch" (±24 st), "pan" (-100..100), "slot" (pad 0-7)
+    int track = doc["track"];
+    int step = doc["step"];
+    if (track < 0 || track >= MAX_TRACKS || step < 0 || step >= MAX_STEPS) {
+      Serial.printf("[WS] Invalid track %d or step %d\n", track, step);
+      return;
+    }
+    uint8_t param = LOCK_ALL;  // clearStepLock sin param: todos
+    if (doc.containsKey("param")) {
+      param = lockParamFromName(doc["param"].as<const char*>());
+      if (param == 0) {
+        Serial.println("[WS] Unknown lock parameter");
+        return;
       }
     }
+    int pattern = sequencer.getCurrentPattern();
+    if (cmd == "setStepLock") {
+      if (param == LOCK_ALL || !doc.containsKey("value")) return;
+      if (!sequencer.setStepLock(pattern, track, step, param, doc["value"].as<int>())) return;
+    } else {
+      sequencer.clearStepLock(pattern, track, step, param);
+    }
     
-    JsonObject velocitiesObj = patternDoc.createNestedObject("velocities");
-    for (int track = 0; track < 8; track++) {
-      JsonArray trackVels = velocitiesObj.createNestedArray(String(track));
-      for (int step = 0; step < 16; step++) {
-        trackVels.add(sequencer.getStepVelocity(track, step));
+    ParamLock lock;
+    if (!sequencer.getStepLock(pattern, track, step, lock)) memset(&lock, 0, sizeof(lock));
+    StaticJsonDocument<256> lockDoc;
+    lockDoc["type"] = "stepLock";
+    addLockEntry(lockDoc.createNestedArray("lock"), track, step, lock);
+    String output;
+    serializeJson(lockDoc, output);
+    if (ws) ws->textAll(output);
+  }
+  else if (cmd == "fill") {
+    sequencer.setFill(doc["value"].as<bool>());
+  }
+  else if (cmd == "setPatternSeed") {
+    // Misma semilla = mismos resultados de probabilidad en cada reproducción
+    sequencer.setPatternSeed(sequencer.getCurrentPattern(), doc["seed"].as<uint32_t>());
+  }
+  else if (cmd == "queuePattern") {
+    // Entra al final del patrón en curso (parado: inmediato); index -1 cancela
+    int pattern = doc["index"];
+    if (pattern >= MAX_PATTERNS) {
+      Serial.printf("[WS] Invalid pattern %d\n", pattern);
+      return;
+    }
+    bool wasPlaying = sequencer.isPlaying();
+    sequencer.queuePattern(pattern);
+    if (!wasPlaying) {
+      broadcastSequencerState();
+      broadcastPattern();
+      return;
+    }
+    StaticJsonDocument<64> queuedDoc;
+    queuedDoc["type"] = "patternQueued";
+    queuedDoc["index"] = sequencer.getQueuedPattern();
+    String output;
+    serializeJson(queuedDoc, output);
+    if (ws) ws->textAll(output);
+  }
+  else if (cmd == "setSong" || cmd == "songAppend" || cmd == "clearSong" || cmd == "songMode") {
+    if (cmd == "setSong") {
+      // {"cmd":"setSong","song":"0:4,1:2,2"}
+      static SongEntry entries[SONG_MAX_ENTRIES];
+      const char* text = doc["song"];
+      int count = text ? parseSongString(text, entries) : -1;
+      if (count < 0 || !sequencer.setSong(entries, count)) {
+        Serial.println("[WS] Invalid song");
+        return;
       }
+    } else if (cmd == "songAppend") {
+      int repeats = doc.containsKey("repeats") ? doc["repeats"].as<int>() : 1;
+      if (!sequencer.appendSongEntry(doc["pattern"].as<int>(), repeats)) return;
+    } else if (cmd == "clearSong") {
+      sequencer.clearSong();
+    } else {
+      sequencer.setSongMode(doc["value"].as<bool>());
+      if (!sequencer.isPlaying()) broadcastPattern();  // Parado: ya está en la primera entrada
     }
-    
-    String patternOutput;
-    serializeJson(patternDoc, patternOutput);
-    ws->textAll(patternOutput);
+    DynamicJsonDocument songDoc(2048);
+    populateSongDocument(songDoc);
+    String output;
+    serializeJson(songDoc, output);
+    if (ws) ws->textAll(output);
+  }
+  else if (cmd == "setPatternLength") {
+    int length = doc["length"];
+    if (length < 1 || length > MAX_STEPS) {
+      Serial.printf("[WS] Invalid pattern length %d\n", length);
+      return;
+    }
+    sequencer.setPatternLength(sequencer.getCurrentPattern(), length);
+    broadcastPattern();
+  }
+  else if (cmd == "setTrackLength") {
+    // length 0 = sigue la longitud del patrón; divider 1-16 (opcional)
+    int track = doc["track"];
+    int length = doc["length"];
+    if (track < 0 || track >= MAX_TRACKS || length < 0 || length > MAX_STEPS) {
+      Serial.printf("[WS] Invalid track %d or length %d\n", track, length);
+      return;
+    }
+    int pattern = sequencer.getCurrentPattern();
+    sequencer.setTrackLength(pattern, track, length);
+    if (doc.containsKey("divider")) {
+      sequencer.setTrackDivider(pattern, track, doc["divider"].as<int>());
+    }
+    broadcastPattern();
   }
   else if (cmd == "loadSample") {
     const char* family = doc["family"];
@@ -773,16 +1249,25 @@ void WebInterface::processCommand(const JsonDocument& doc) {
       return;
     }
     
+    // Optional in-memory format ("pcm", "adpcm", "ulaw"); default otherwise
+    SampleFormat storage = sampleManager.getDefaultFormat();
+    if (doc.containsKey("storage") && !SampleCodec::parseFormat(doc["storage"], storage)) {
+      Serial.println("[loadSample] Unknown storage format, using default");
+      storage = sampleManager.getDefaultFormat();
+    }
+    
     String fullPath = String("/") + String(family) + String("/") + String(filename);
-    Serial.printf("[loadSample] Loading %s to pad %d\n", fullPath.c_str(), padIndex);
+    Serial.printf("[loadSample] Loading %s to pad %d (%s)\n", fullPath.c_str(), padIndex, SampleCodec::formatName(storage));
     
-    if (sampleManager.loadSample(fullPath.c_str(), padIndex)) {
+    if (sampleManager.loadSample(fullPath.c_str(), padIndex, storage)) {
       StaticJsonDocument<256> responseDoc;
       responseDoc["type"] = "sampleLoaded";
       responseDoc["pad"] = padIndex;
       responseDoc["filename"] = filename;
       responseDoc["size"] = sampleManager.getSampleLength(padIndex) * 2;
       responseDoc["format"] = detectSampleFormat(filename);
+      responseDoc["storage"] = SampleCodec::formatName(sampleManager.getSampleFormat(padIndex));
+      responseDoc["streamed"] = sampleManager.isStreamed(padIndex);
       
       String output;
       serializeJson(responseDoc, output);
@@ -791,6 +1276,58 @@ void WebInterface::processCommand(const JsonDocument& doc) {
       Serial.printf("[loadSample] Success! Size: %d bytes\n", sampleManager.getSampleLength(padIndex) * 2);
     }
   }
+  else if (cmd == "deleteSample") {
+    const char* family = doc["family"];
+    const char* filename = doc["filename"];
+    if (!family || !filename || SampleLibrary::familyIndex(family) < 0 || strchr(filename, '/')) {
+      Serial.println("[deleteSample] Invalid family or filename");
+      return;
+    }
+    
+    // Un sample en streaming se sigue leyendo del fichero
+    for (int pad = 0; pad < MAX_SAMPLES; pad++) {
+      const char* name = sampleManager.getSampleName(pad);
+      if (sampleManager.isStreamed(pad) && name && strncmp(name, filename, 31) == 0) {
+        Serial.printf("[deleteSample] %s streams on pad %d, not deleted\n", filename, pad);
+        return;
+      }
+    }
+    
+    String fullPath = String("/") + family + "/" + filename;
+    bool deleted = LittleFS.remove(fullPath);
+    if (deleted) sampleLibrary.removeFile(family, filename);
+    Serial.printf("[deleteSample] %s %s\n", fullPath.c_str(), deleted ? "deleted" : "FAILED");
+    
+    StaticJsonDocument<256> responseDoc;
+    responseDoc["type"] = "sampleDeleted";
+    responseDoc["family"] = family;
+    responseDoc["filename"] = filename;
+    responseDoc["success"] = deleted;
+    responseDoc["revision"] = sampleLibrary.getRevision();
+    
+    String output;
+    serializeJson(responseDoc, output);
+    if (ws) ws->textAll(output);
+  }
+  else if (cmd == "rescanLibrary") {
+    // Archivos copiados por otra vía (uploadfs parcial, etc.): índice desde cero
+    sampleLibrary.rebuild();
+    if (ws) ws->textAll(buildSampleCounts());
+  }
+  else if (cmd == "loadKit") {
+    int kitIndex = doc["kit"];
+    // Returns at once: the kit loads in the background and switches at the next bar
+    bool queued = kitManager.loadKit(kitIndex);
+    
+    StaticJsonDocument<128> responseDoc;
+    responseDoc["type"] = "kitLoading";
+    responseDoc["kit"] = kitIndex;
+    responseDoc["queued"] = queued;
+    
+    String output;
+    serializeJson(responseDoc, output);
+    if (ws) ws->textAll(output);
+  }
   else if (cmd == "mute") {
     int track = doc["track"];
     if (track < 0 || track >= 8) {
@@ -876,6 +1413,45 @@ void WebInterface::processCommand(const JsonDocument& doc) {
     int volume = doc["value"];
     audioEngine.setMasterVolume(volume);
   }
+  else if (cmd == "setDualCore") {
+    bool enabled = doc["value"];
+    audioEngine.setDualCoreRender(enabled);
+    audioEngine.resetRenderStats();  // Histograma net per comparar
+  }
+  else if (cmd == "setHeadCache") {
+    // as<double>: un valor fora de rang no es converteix en 0 ni dona la volta en uint16_t
+    double ms = doc.containsKey("value") ? doc["value"].as<double>() : -1.0;
+    if (!(ms >= 0.0 && ms <= HEAD_CACHE_MAX_MS)) {
+      Serial.printf("[WS] Invalid head cache length %.0f ms (must be 0-%d)\n", ms, HEAD_CACHE_MAX_MS);
+      return;
+    }
+    sampleManager.setHeadCacheMs((uint16_t)ms);
+    audioEngine.resetRenderStats();  // Histograma net per comparar
+  }
+  else if (cmd == "setSampleStorage") {
+    SampleFormat format;
+    if (!SampleCodec::parseFormat(doc["value"], format)) {
+      Serial.println("[WS] Invalid storage format (pcm, adpcm, ulaw)");
+      return;
+    }
+    sampleManager.setDefaultFormat(format);
+    Serial.printf("[WS] Default sample storage: %s\n", SampleCodec::formatName(format));
+  }
+  else if (cmd == "setSampleCacheBudget") {
+    int kb = doc["value"];
+    if (kb < 0) kb = 0;
+    sampleManager.setCacheBudget((size_t)kb * 1024);
+  }
+  else if (cmd == "setPrefetch") {
+    bool enabled = doc["value"];
+    audioEngine.setPrefetch(enabled);
+    audioEngine.resetRenderStats();  // Histograma net per comparar
+  }
+  else if (cmd == "setTrackPan") {
+    int track = doc["track"];
+    int pan = doc["value"];  // -100 (L) .. 0 .. +100 (R)
+    audioEngine.setTrackPan(track, pan);
+  }
   // ============= NEW: Per-Track Filter Commands =============
   else if (cmd == "setTrackFilter") {
     int track = doc["track"];
@@ -990,7 +1566,7 @@ void WebInterface::processCommand(const JsonDocument& doc) {
     int track = doc["track"];
     int step = doc["step"];
     int velocity = doc["velocity"];
-    if (track < 0 || track >= 8 || step < 0 || step >= 16) {
+    if (track < 0 || track >= MAX_TRACKS || step < 0 || step >= MAX_STEPS) {
       Serial.printf("[WS] Invalid track %d or step %d\n", track, step);
       return;
     }
@@ -1029,14 +1605,16 @@ void WebInterface::processCommand(const JsonDocument& doc) {
     int patternNum = doc.containsKey("pattern") ? doc["pattern"].as<int>() : sequencer.getCurrentPattern();
     
     // Crear respuesta con el patrón
-    StaticJsonDocument<2048> response;
+    DynamicJsonDocument response(patternDocumentSize(patternNum));
     response["cmd"] = "pattern_sync";
     response["pattern"] = patternNum;
+    response["length"] = sequencer.getPatternLength(patternNum);
     
     JsonArray data = response.createNestedArray("data");
     for (int t = 0; t < MAX_TRACKS; t++) {
       JsonArray track = data.createNestedArray();
-      for (int s = 0; s < STEPS_PER_PATTERN; s++) {
+      int length = sequencer.getTrackLength(patternNum, t);
+      for (int s = 0; s < length; s++) {
         track.add(sequencer.getStep(patternNum, t, s) ? 1 : 0);
       }
     }
@@ -1096,6 +1674,7 @@ void WebInterface::cleanupStaleUdpClients() {
 void WebInterface::handleUdp() {
   int packetSize = udp.parsePacket();
   if (packetSize > 0) {
+    uint32_t receivedUs = micros();  // Latencia UDP desde aquí (incluye el log y el parseo)
     char incomingPacket[512];
     int len = udp.read(incomingPacket, 511);
     if (len > 0) {
@@ -1114,7 +1693,7 @@ void WebInterface::handleUdp() {
       
       if (!error) {
         // Procesar comando usando la función común
-        processCommand(doc);
+        processCommand(doc, TIMING_UDP, receivedUs);
         
         // Enviar respuesta OK al cliente UDP
         StaticJsonDocument<64> responseDoc;
@@ -1202,19 +1781,18 @@ void WebInterface::broadcastMIDIDeviceStatus(bool connected, const MIDIDeviceInf
 // ========================================
 
 // Variables estáticas para mantener estado del upload
-static File uploadFile;
-static String uploadFilename;
 static int uploadPad = -1;
 static size_t uploadSize = 0;
 static size_t uploadReceived = 0;
 static bool uploadError = false;
 static String uploadErrorMsg = "";
+static uint32_t uploadId = 0;       // Una subida por request: otra desconexión no la cancela
 
+// Un solo paso: cada chunk se decodifica a PSRAM (SampleUpload) y el fichero se escribe en segundo plano
 void WebInterface::handleUpload(AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final) {
   // Obtener pad del parámetro de la URL
   if (index == 0) {
     // Primera parte del upload - reset de variables
-    uploadFilename = filename;
     uploadReceived = 0;
     uploadError = false;
     uploadErrorMsg = "";
@@ -1260,48 +1838,52 @@ void WebInterface::handleUpload(AsyncWebServerRequest *request, String filename,
       return;
     }
     
-    // Obtener nombre de la familia del pad
-    const char* families[] = {"BD", "SD", "CH", "OH", "CP", "RS", "CL", "CY",
-                              "CB", "MA", "HC", "HT", "MC", "MT", "LC", "LT"};
-    String familyName = families[uploadPad];
+    uploadSize = request->contentLength();
+    Serial.printf("[Upload] Expected size: %d bytes\n", uploadSize);
     
-    // Crear directorio si no existe
-    String dirPath = "/" + familyName;
-    if (!LittleFS.exists(dirPath)) {
-      LittleFS.mkdir(dirPath);
+    // Validar tamaño (max 2MB para seguridad)
+    if (uploadSize > 2 * 1024 * 1024) {
+      Serial.println("[Upload] ERROR: File too large (max 2MB)");
+      uploadError = true;
+      uploadErrorMsg = "File too large (max 2MB)";
+      broadcastUploadComplete(uploadPad, false, uploadErrorMsg);
+      return;
     }
     
-    // Crear path completo
-    String filePath = dirPath + "/" + filename;
+    // Obtener nombre de la familia del pad
+    const char* families[] = {"BD", "SD", "CH", "OH", "CP", "RS", "CL", "CY",
+                              "CB", "MA", "HC", "HT", "MC", "MT", "LC", "LT"};
     
     Serial.println("\n╔═══════════════════════════════════════════════╗");
     Serial.printf("║  📤 UPLOAD INICIADO: %s\n", filename.c_str());
     Serial.println("╚═══════════════════════════════════════════════╝");
-    Serial.printf("[Upload] Pad: %d (%s)\n", uploadPad, familyName.c_str());
-    Serial.printf("[Upload] File: %s\n", filePath.c_str());
+    Serial.printf("[Upload] Pad: %d (%s)\n", uploadPad, families[uploadPad]);
     
-    // Abrir archivo para escritura
-    uploadFile = LittleFS.open(filePath, "w");
-    if (!uploadFile) {
-      Serial.println("[Upload] ERROR: Failed to create file");
+    // La cabecera WAV se valida con este mismo chunk: no hace falta releer el fichero
+    if (!sampleUpload.start(uploadPad, families[uploadPad], filename.c_str(), sampleManager.getDefaultFormat(),
+                            uploadSize)) {
+      Serial.printf("[Upload] ERROR: %s\n", sampleUpload.error());
       uploadError = true;
-      uploadErrorMsg = "Failed to create file on flash";
+      uploadErrorMsg = sampleUpload.error();
       broadcastUploadComplete(uploadPad, false, uploadErrorMsg);
       return;
     }
     
-    uploadSize = request->contentLength();
-    Serial.printf("[Upload] Expected size: %d bytes\n", uploadSize);
-    
-    // Validar tamaño (max 2MB para seguridad)
-    if (uploadSize > 2 * 1024 * 1024) {
-      Serial.println("[Upload] ERROR: File too large (max 2MB)");
-      uploadFile.close();
-      uploadError = true;
-      uploadErrorMsg = "File too large (max 2MB)";
-      broadcastUploadComplete(uploadPad, false, uploadErrorMsg);
-      return;
-    }
+    // Cliente desconectado a mitad: el pad se queda con su sample anterior
+    // (tras finish() la subida ya no está activa y esto no hace nada)
+    uint32_t id = ++uploadId;
+    request->onDisconnect([this, id]() {
+      if (id != uploadId || !sampleUpload.isActive()) return;
+      sampleUpload.abort();
+      Serial.printf("[Upload] Client disconnected after %d/%d bytes, pad %d keeps its sample\n",
+                    uploadReceived, uploadSize, uploadPad);
+      broadcastUploadComplete(uploadPad, false, "Upload interrupted");
+      uploadPad = -1;
+      uploadSize = 0;
+      uploadReceived = 0;
+      uploadError = false;
+      uploadErrorMsg = "";
+    });
   }
   
   // Si hay error previo, no procesar más chunks
@@ -1312,17 +1894,15 @@ void WebInterface::handleUpload(AsyncWebServerRequest *request, String filename,
     return;
   }
   
-  // Escribir chunk de datos
-  if (uploadFile && len) {
-    size_t written = uploadFile.write(data, len);
-    if (written != len) {
-      Serial.printf("[Upload] ERROR: Write failed (%d/%d bytes)\n", written, len);
-      uploadFile.close();
+  // Decodificar chunk de datos
+  if (len) {
+    if (!sampleUpload.write(data, len)) {
+      Serial.printf("[Upload] ERROR: %s\n", sampleUpload.error());
       uploadError = true;
-      uploadErrorMsg = "Write error";
+      uploadErrorMsg = sampleUpload.error();
       broadcastUploadComplete(uploadPad, false, uploadErrorMsg);
       if (final) {
-        request->send(500, "application/json", "{\"success\":false,\"message\":\"Write error\"}");
+        request->send(400, "application/json", "{\"success\":false,\"message\":\"" + uploadErrorMsg + "\"}");
       }
       return;
     }
@@ -1330,7 +1910,7 @@ void WebInterface::handleUpload(AsyncWebServerRequest *request, String filename,
     uploadReceived += len;
     
     // Progreso cada 10%
-    int percent = (uploadReceived * 100) / uploadSize;
+    int percent = uploadSize > 0 ? (uploadReceived * 100) / uploadSize : 0;
     static int lastPercent = -1;
     if (percent != lastPercent && percent % 10 == 0) {
       Serial.printf("[Upload] Progress: %d%% (%d/%d bytes)\n", percent, uploadReceived, uploadSize);
@@ -1339,71 +1919,33 @@ void WebInterface::handleUpload(AsyncWebServerRequest *request, String filename,
     }
   }
   
-  // Upload completado
+  // Upload completado: el pad ya suena, el fichero termina de escribirse solo
   if (final) {
-    if (uploadFile) {
-      uploadFile.close();
-      
-      Serial.printf("[Upload] ✓ File written: %d bytes\n", uploadReceived);
-      
-      // Validar formato WAV
-      String filePath = "/" + String((const char*[]){"BD", "SD", "CH", "OH", "CP", "RS", "CL", "CY",
-                                                      "CB", "MA", "HC", "HT", "MC", "MT", "LC", "LT"}[uploadPad]) + "/" + uploadFilename;
-      File checkFile = LittleFS.open(filePath, "r");
-      
-      uint32_t sampleRate = 0;
-      uint16_t channels = 0;
-      uint16_t bitsPerSample = 0;
+    if (sampleUpload.finish()) {
+      Serial.printf("[Upload] ✓ Sample loaded to pad %d\n", uploadPad);
+      Serial.println("╔═══════════════════════════════════════════════╗");
+      Serial.println("║       ✅ UPLOAD COMPLETADO CON ÉXITO         ║");
+      Serial.println("╚═══════════════════════════════════════════════╝\n");
       
-      if (!validateWavFile(checkFile, sampleRate, channels, bitsPerSample)) {
-        checkFile.close();
-        LittleFS.remove(filePath);
-        Serial.println("[Upload] ERROR: Invalid WAV format");
-        request->send(400, "application/json", "{\"success\":false,\"message\":\"Invalid WAV format\"}");
-        broadcastUploadComplete(uploadPad, false, "Invalid WAV format");
-        uploadPad = -1;
-        uploadFilename = "";
-        uploadSize = 0;
-        uploadReceived = 0;
-        uploadError = false;
-        uploadErrorMsg = "";
-        return;
-      }
+      // Enviar respuesta HTTP exitosa
+      request->send(200, "application/json", "{\"success\":true,\"message\":\"Sample uploaded successfully\"}");
       
-      checkFile.close();
+      broadcastUploadComplete(uploadPad, true, "Sample uploaded and loaded successfully");
       
-      Serial.printf("[Upload] ✓ Valid WAV: %dHz, %dch, %dbit\n", sampleRate, channels, bitsPerSample);
+      // Broadcast state update
+      broadcastSequencerState();
+    } else {
+      Serial.printf("[Upload] ERROR: %s\n", sampleUpload.error());
       
-      // Cargar sample en el pad
-      bool loaded = sampleManager.loadSample(filePath.c_str(), uploadPad);
+      // Enviar respuesta HTTP de error
+      String message = sampleUpload.error();
+      request->send(400, "application/json", "{\"success\":false,\"message\":\"" + message + "\"}");
       
-      if (loaded) {
-        Serial.printf("[Upload] ✓ Sample loaded to pad %d\n", uploadPad);
-        Serial.println("╔═══════════════════════════════════════════════╗");
-        Serial.println("║       ✅ UPLOAD COMPLETADO CON ÉXITO         ║");
-        Serial.println("╚═══════════════════════════════════════════════╝\n");
-        
-        // Enviar respuesta HTTP exitosa
-        request->send(200, "application/json", "{\"success\":true,\"message\":\"Sample uploaded successfully\"}");
-        
-        broadcastUploadComplete(uploadPad, true, "Sample uploaded and loaded successfully");
-        
-        // Broadcast state update
-        broadcastSequencerState();
-      } else {
-        Serial.println("[Upload] ERROR: Failed to load sample");
-        LittleFS.remove(filePath);
-        
-        // Enviar respuesta HTTP de error
-        request->send(500, "application/json", "{\"success\":false,\"message\":\"Failed to load sample\"}");
-        
-        broadcastUploadComplete(uploadPad, false, "Failed to load sample");
-      }
+      broadcastUploadComplete(uploadPad, false, message);
     }
     
     // Reset variables
     uploadPad = -1;
-    uploadFilename = "";
     uploadSize = 0;
     uploadReceived = 0;
     uploadError = false;
@@ -1411,46 +1953,6 @@ void WebInterface::handleUpload(AsyncWebServerRequest *request, String filename,
   }
 }
 
-bool WebInterface::validateWavFile(File& file, uint32_t& sampleRate, uint16_t& channels, uint16_t& bitsPerSample) {
-  if (!file || file.size() < 44) {
-    return false;
-  }
-  
-  file.seek(0);
-  uint8_t header[44];
-  if (file.read(header, 44) != 44) {
-    return false;
-  }
-  
-  // Verificar firma RIFF
-  if (memcmp(header, "RIFF", 4) != 0 || memcmp(header + 8, "WAVE", 4) != 0) {
-    return false;
-  }
-  
-  // Extraer parámetros
-  channels = header[22] | (header[23] << 8);
-  sampleRate = header[24] | (header[25] << 8) | (header[26] << 16) | (header[27] << 24);
-  bitsPerSample = header[34] | (header[35] << 8);
-  
-  // Validar parámetros
-  if (sampleRate != 44100 && sampleRate != 48000) {
-    Serial.printf("[Validate] Invalid sample rate: %d (expected 44100 or 48000)\n", sampleRate);
-    return false;
-  }
-  
-  if (channels < 1 || channels > 2) {
-    Serial.printf("[Validate] Invalid channels: %d (expected 1 or 2)\n", channels);
-    return false;
-  }
-  
-  if (bitsPerSample != 16) {
-    Serial.printf("[Validate] Invalid bit depth: %d (expected 16)\n", bitsPerSample);
-    return false;
-  }
-  
-  return true;
-}
-
 void WebInterface::broadcastUploadProgress(int pad, int percent) {
   if (!initialized || !ws) return;
   
@@ -15,6 +15,7 @@
 #include <ArduinoJson.h>
 #include <map>
 #include "MIDIController.h"
+#include "TriggerTiming.h"
 
 #define UDP_PORT 8888  // Puerto para recibir comandos UDP
 
@@ -39,6 +40,7 @@ public:
   void sendSequencerStateToClient(AsyncWebSocketClient* client);
   void broadcastPadTrigger(int pad);
   void broadcastStep(int step);
+  void broadcastPattern();  // Current pattern matrix + lengths
   void broadcastVisualizationData();
   
   // MIDI functions
@@ -68,11 +70,11 @@ private:
   
   void onWebSocketEvent(AsyncWebSocket *server, AsyncWebSocketClient *client, 
                        AwsEventType type, void *arg, uint8_t *data, size_t len);
-  void processCommand(const JsonDocument& doc);  // Función común para procesar comandos
+  // Función común para procesar comandos. source / receivedUs: latencia de los triggers (/api/jitter)
+  void processCommand(const JsonDocument& doc, uint8_t source = TIMING_LIVE, uint32_t receivedUs = 0);
   
   // File upload handlers
   void handleUpload(AsyncWebServerRequest *request, String filename, size_t index, uint8_t *data, size_t len, bool final);
-  bool validateWavFile(File& file, uint32_t& sampleRate, uint16_t& channels, uint16_t& bitsPerSample);
 };
 
 #endif
@@ -3,8 +3,13 @@
 #include <Adafruit_NeoPixel.h>
 #include "AudioEngine.h"
 #include "SampleManager.h"
+#include "SampleStreamer.h"
+#include "SampleLibrary.h"
+#include "SampleUpload.h"
 #include "KitManager.h"
 #include "Sequencer.h"
+#include "ClockSource.h"
+#include "TriggerTiming.h"
 #include "WebInterface.h"
 #include "MIDIController.h"
 
@@ -20,8 +25,14 @@
 // --- OBJETOS GLOBALES ---
 AudioEngine audioEngine;
 SampleManager sampleManager;
+SampleStreamer sampleStreamer;
+SampleLibrary sampleLibrary;
+SampleUpload sampleUpload;
 KitManager kitManager;
 Sequencer sequencer;
+EspTimerClock espTimerClock;
+SequencerClock sequencerClock;
+TriggerTiming triggerTiming;
 WebInterface webInterface;
 MIDIController midiController;
 Adafruit_NeoPixel rgbLed(RGB_LED_NUM, RGB_LED_PIN, NEO_GRB + NEO_KHZ800);
@@ -38,12 +49,6 @@ const uint32_t instrumentColors[8] = {
     0xAAFFCC   // 7: CY - Rosa claro (RGB: 255,170,204 → GRB: 0xAA,0xFF,0xCC)
 };
 
-// Utility to detect supported audio sample files (.raw or .wav)
-static bool isValidSampleFile(const String& filename) {
-    return filename.endsWith(".raw") || filename.endsWith(".RAW") ||
-           filename.endsWith(".wav") || filename.endsWith(".WAV");
-}
-
 // === FUNCIONES DE SECUENCIA LED ===
 void showBootLED() {
     // Púrpura BRILLANTE: Inicio del sistema
@@ -109,7 +114,7 @@ void audioTask(void *pvParameters) {
 }
 
 // CORE 0: System, WiFi, Web Server (Prioridad Media)
-// - Secuenciador de patrones MIDI-style
+// - Visualización del secuenciador (los steps los programa SequencerClock)
 // - WiFi Access Point + WebServer
 // - Comandos UDP para control remoto
 // - Actualización de LED RGB con fade
@@ -121,7 +126,9 @@ void systemTask(void *pvParameters) {
     uint32_t lastLedUpdate = 0;
     
     while (true) {
-        sequencer.update();
+        if (!sequencerClock.isRunning()) sequencer.schedule();  // Sin reloj propio: como antes
+        sequencer.updateUi();
+        kitManager.update();   // Cambio de kit pendiente con el secuenciador parado
         webInterface.update(); // WiFi activado
         webInterface.handleUdp(); // Manejar comandos UDP
         midiController.update(); // Procesar eventos MIDI USB
@@ -147,15 +154,22 @@ void systemTask(void *pvParameters) {
 
 // Callback que el Sequencer llama cada vez que hay un "trigger" en un step
 // NO enciende el LED (solo secuenciador)
-void onStepTrigger(int track, uint8_t velocity) {
-    audioEngine.triggerSampleSequencer(track, velocity);
+// `frame` = cuándo debe sonar (reloj del AudioEngine): la voz arranca en ese frame exacto
+// `lock` = parameter locks del step (nullptr si no tiene), se aplican al arrancar la voz
+void onStepTrigger(int track, uint8_t velocity, uint32_t frame, const ParamLock* lock) {
+    // Margen con que llega el step antes de su frame (/api/jitter)
+    int32_t lead = (int32_t)(frame - audioEngine.getFramePosition());
+    triggerTiming.recordLead(lead > 0 ? (uint32_t)((uint64_t)lead * 1000000ULL / SAMPLE_RATE) : 0);
+    audioEngine.scheduleSampleSequencer(track, velocity, frame, lock);
 }
 
-// Función para triggers manuales desde live pads (web interface)
+// Función para triggers manuales desde live pads (web interface, MIDI, UDP)
 // Esta SÍ enciende el LED RGB
-void triggerPadWithLED(int track, uint8_t velocity) {
+// `source` / `requestUs`: de dónde viene y cuándo llegó, para medir la latencia (/api/jitter)
+void triggerPadWithLED(int track, uint8_t velocity, uint8_t source, uint32_t requestUs) {
+    if (requestUs == 0) requestUs = micros();
     Serial.printf("[PAD TRIGGER] Track: %d, Velocity: %d\n", track, velocity);
-    audioEngine.triggerSampleLive(track, velocity);
+    audioEngine.triggerSampleLive(track, velocity, source, requestUs);
     
     // Iluminar LED RGB con color del instrumento
     if (track >= 0 && track < 16) {
@@ -194,6 +208,28 @@ void listDir(const char * dirname, int levels){
     }
 }
 
+// Arranque sin banco empaquetado: primer sample (por nombre) de cada familia, desde el índice
+static void loadSamplesFromFolders() {
+    const char* families[] = {"BD", "SD", "CH", "OH", "CP", "RS", "CL", "CY"};
+    
+    for (int i = 0; i < 8; i++) {
+        LibraryEntry entry;
+        if (!sampleLibrary.getFirst(SampleLibrary::familyIndex(families[i]), entry)) {
+            Serial.printf("  [%d] %s: ✗ No compatible samples (.raw/.wav) found\n", i, families[i]);
+            continue;
+        }
+        
+        String fullPath = String("/") + String(families[i]) + "/" + entry.name;
+        Serial.printf("  [%d] %s: Loading %s... ", i, families[i], fullPath.c_str());
+        
+        if (sampleManager.loadSample(fullPath.c_str(), i)) {
+            Serial.printf("✓ (%d bytes)\n", sampleManager.getSampleLength(i) * 2);
+        } else {
+            Serial.println("✗ FAILED");
+        }
+    }
+}
+
 void setup() {
     // Inicializar LED RGB PRIMERO - MAGENTA BRILLANTE: BOOT
     rgbLed.begin();
@@ -265,67 +301,48 @@ void setup() {
     
     // 3. Sample Manager - Cargar todos los samples por familia
     sampleManager.begin();
+    sampleStreamer.begin();  // Reader de Core 0 per als samples més grans que la PSRAM
+    sampleLibrary.begin();   // Índice de /library.idx (se reconstruye si falta)
+    sampleUpload.begin();    // Subidas: WAV -> PSRAM al vuelo, escritura a flash en segundo plano
     
     Serial.println("[STEP 5] Loading all samples from families...");
-    const char* families[] = {"BD", "SD", "CH", "OH", "CP", "RS", "CL", "CY"};
+    uint32_t loadStart = millis();
     
-    for (int i = 0; i < 8; i++) {
-        String path = String("/") + String(families[i]);
-        Serial.printf("  [%d] %s: Opening %s... ", i, families[i], path.c_str());
-        
-        File dir = LittleFS.open(path, "r");
-        
-        if (dir && dir.isDirectory()) {
-            Serial.println("OK");
-            File file = dir.openNextFile();
-            bool loaded = false;
-            
-            while (file && !loaded) {
-                if (!file.isDirectory()) {
-                    String filename = file.name();
-                    if (isValidSampleFile(filename)) {
-                        // Extraer solo el nombre del archivo
-                        int lastSlash = filename.lastIndexOf('/');
-                        if (lastSlash >= 0) {
-                            filename = filename.substring(lastSlash + 1);
-                        }
-                        
-                        String fullPath = String("/") + String(families[i]) + "/" + filename;
-                        Serial.printf("       Loading %s... ", fullPath.c_str());
-                        
-                        if (sampleManager.loadSample(fullPath.c_str(), i)) {
-                            Serial.printf("✓ (%d bytes)\n", sampleManager.getSampleLength(i) * 2);
-                            loaded = true;
-                        } else {
-                            Serial.println("✗ FAILED");
-                        }
-                    }
-                }
-                file.close();
-                if (!loaded) {
-                    file = dir.openNextFile();
-                }
-            }
-            
-            dir.close();
-            
-            if (!loaded) {
-                Serial.println("       ✗ No compatible samples (.raw/.wav) found");
-            }
-        } else {
-            Serial.println("✗ Directory not found or not accessible");
-        }
+    // 1) Partición `samples`: se reproduce en sitio desde flash, sin copia a PSRAM
+    // 2) Banco empaquetado en LittleFS (pack_samples.py): índice + PCM alineado, lecturas grandes
+    // 3) Carpetas de familia
+    const char* sampleSource = "flash partition";
+    int packed = sampleManager.mapSampleBank(SAMPLE_PARTITION_LABEL);
+    if (packed <= 0) {
+        sampleSource = SAMPLE_BANK_PATH;
+        packed = sampleManager.loadSampleBank(SAMPLE_BANK_PATH);
     }
+    if (packed <= 0) {
+        sampleSource = "folders";
+        loadSamplesFromFolders();
+    }
+    
+    Serial.printf("✓ Samples loaded: %d/8 in %d ms (%s)\n", sampleManager.getLoadedSamplesCount(),
+                  millis() - loadStart, sampleSource);
     
-    Serial.printf("✓ Samples loaded: %d/8\n", sampleManager.getLoadedSamplesCount());
+    // Kits disponibles: loadKit los carga en segundo plano y cambia al inicio de compás
+    kitManager.scanKits();
 
     // 4. Sequencer Setup
+    sequencer.setFrameClock([]() { return audioEngine.getFramePosition(); }, SAMPLE_RATE);
     sequencer.setStepCallback(onStepTrigger);
+    sequencer.setBarCallback([]() {
+        kitManager.onBar();
+    });
     
     // Callback para sincronización en tiempo real con la web
     sequencer.setStepChangeCallback([](int newStep) {
         webInterface.broadcastStep(newStep);
     });
+    // Cambio de patrón en cola / song mode: la web recibe el patrón nuevo con su step 0
+    sequencer.setPatternChangeCallback([](int pattern) {
+        webInterface.broadcastPattern();
+    });
     sequencer.setTempo(110); // BPM inicial
     
     // === PATRÓN 0: HIP HOP BOOM BAP (8 tracks) ===
@@ -468,6 +485,8 @@ void setup() {
         
         // Callback para mensajes MIDI
         midiController.setMessageCallback([](const MIDIMessage& msg) {
+            uint32_t msgUs = micros();  // Latencia MIDI medida desde aquí (incluye el broadcast)
+            
             // Broadcast a la web
             webInterface.broadcastMIDIMessage(msg);
             
@@ -475,7 +494,7 @@ void setup() {
             if (msg.type == MIDI_NOTE_ON && msg.data2 > 0) {
                 int pad = msg.data1 - 36;
                 if (pad >= 0 && pad < 8) {
-                    triggerPadWithLED(pad, msg.data2);
+                    triggerPadWithLED(pad, msg.data2, TIMING_MIDI, msgUs);
                 }
             }
         });
@@ -520,6 +539,12 @@ void setup() {
         NULL,
         0       // CORE 0: WiFi, Web, Sequencer, LED
     );
+    
+    // CORE 0: Reloj del secuenciador - esp_timer -> cola -> tarea de prioridad 10
+    // Los steps ya no dependen del loop de SystemTask (WiFi, UDP, MIDI, LED)
+    if (!sequencerClock.begin(&espTimerClock)) {
+        Serial.println("⚠️  Sequencer clock failed - SystemTask schedules the steps");
+    }
 
     Serial.println("\n--- SISTEMA INICIADO ---");
     
@@ -531,18 +556,7 @@ void setup() {
 }
 
 void loop() {
-    // DISABLED: Cambio automático de patrones - el usuario controla manualmente
-    // static uint32_t lastPatternChange = 0;
-    // static int currentPatternIndex = 0;
-    // const uint32_t patternDuration = 8800;
-    
-    // if (millis() - lastPatternChange > patternDuration) {
-    //     currentPatternIndex = (currentPatternIndex + 1) % 5;
-    //     sequencer.selectPattern(currentPatternIndex);
-    //     const char* patternNames[] = {"Hip Hop", "Techno", "Drum & Bass", "Breakbeat", "House"};
-    //     Serial.printf("\n>>> Cambiando a Patrón %d: %s <<<\n", currentPatternIndex, patternNames[currentPatternIndex]);
-    //     lastPatternChange = millis();
-    // }
+    // Los cambios de patrón (cola y song mode) los hace el secuenciador al final del patrón
     
     // Stats cada 5 segundos
     static uint32_t lastStats = 0;
@@ -0,0 +1,141 @@
+/*
+ * arena_harness.cpp
+ * Prova de càrrega/descàrrega aleatòria de l'arena de samples (src/SampleArena) a Linux
+ *
+ * Milers de cicles d'allocate/release amb mides de sample (1 byte - 1 MB) sobre
+ * una regió de 8 MB, com la PSRAM. Cada bloc s'omple amb un patró propi i es
+ * verifica sencer abans d'alliberar-lo i després de cada compactació. Comprova
+ * també used(), els handles vius i que després de compact() només quedi un forat.
+ * Si una allocate falla amb prou espai lliure, compacta i ha de funcionar. Una de cada
+ * dues compactacions fixa la meitat dels blocs (com el banc que sona durant la
+ * precàrrega d'un kit): no s'han de moure ni corrompre. Surt amb 1 si falla
+ *
+ *   g++ -O2 -Isrc tools/arena_harness.cpp src/SampleArena.cpp -o arena_harness
+ *   ./arena_harness [cicles]
+ */
+
+#include "SampleArena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <vector>
+
+static const size_t REGION = 8 * 1024 * 1024;
+static const size_t MAX_SAMPLE = 1024 * 1024;
+static const size_t MAX_LIVE = 40;       // Per sota d'ARENA_MAX_HANDLES: com els slots + heads + temporals
+
+struct Block {
+  ArenaHandle handle;
+  size_t bytes;
+  uint8_t seed;
+};
+
+static size_t aligned(size_t bytes) { return (bytes + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1); }
+
+static void fill(uint8_t* p, const Block& b) {
+  for (size_t i = 0; i < b.bytes; i++) p[i] = (uint8_t)(b.seed + i * 31 + (i >> 8));
+}
+
+static bool intact(SampleArena& arena, const Block& b) {
+  const uint8_t* p = (const uint8_t*)arena.ptr(b.handle);
+  if (p == nullptr || arena.size(b.handle) < b.bytes) return false;
+  for (size_t i = 0; i < b.bytes; i++) {
+    if (p[i] != (uint8_t)(b.seed + i * 31 + (i >> 8))) return false;
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  int cycles = argc > 1 ? atoi(argv[1]) : 10000;
+  std::vector<uint8_t> memory(REGION);
+  SampleArena arena;
+  if (!arena.begin(memory.data(), REGION)) {
+    printf("FAIL begin\n");
+    return 1;
+  }
+
+  std::vector<Block> live;
+  srand(1);
+  int allocations = 0, full = 0, compactions = 0, pinnedCompactions = 0, failures = 0;
+  size_t moved = 0;
+  float peakFragmentation = 0;
+
+  for (int cycle = 0; cycle < cycles && failures == 0; cycle++) {
+    if (!live.empty() && (rand() % 2 || live.size() >= MAX_LIVE)) {
+      size_t k = rand() % live.size();
+      if (!intact(arena, live[k])) {
+        printf("FAIL cycle %d: block %d corrupted before release\n", cycle, live[k].handle);
+        failures++;
+      }
+      arena.release(live[k].handle);
+      live.erase(live.begin() + k);
+    } else {
+      Block b;
+      b.bytes = 1 + rand() % MAX_SAMPLE;
+      b.seed = (uint8_t)rand();
+      b.handle = arena.allocate(b.bytes);
+      if (b.handle == ARENA_INVALID_HANDLE && arena.freeBytes() >= aligned(b.bytes)) {
+        // Com SampleManager::allocateArena: hi ha espai però fragmentat
+        if (arena.fragmentation() > peakFragmentation) peakFragmentation = arena.fragmentation();
+        bool pinned[ARENA_MAX_HANDLES] = {};
+        void* before[ARENA_MAX_HANDLES] = {};
+        bool pinning = compactions % 2 == 1;
+        if (pinning) {
+          for (const Block& other : live) {
+            pinned[other.handle] = rand() % 2;
+            before[other.handle] = arena.ptr(other.handle);
+          }
+          pinnedCompactions++;
+        }
+        moved += arena.compact(pinning ? pinned : nullptr);
+        compactions++;
+        for (const Block& other : live) {
+          if (!intact(arena, other)) {
+            printf("FAIL cycle %d: block %d corrupted by compact\n", cycle, other.handle);
+            failures++;
+          }
+          if (pinned[other.handle] && arena.ptr(other.handle) != before[other.handle]) {
+            printf("FAIL cycle %d: pinned block %d moved\n", cycle, other.handle);
+            failures++;
+          }
+        }
+        if (!pinning && arena.largestFree() != arena.freeBytes()) {
+          printf("FAIL cycle %d: %zu free but largest hole %zu after compact\n", cycle, arena.freeBytes(),
+                 arena.largestFree());
+          failures++;
+        }
+        b.handle = arena.allocate(b.bytes);
+        if (b.handle == ARENA_INVALID_HANDLE && !pinning) {
+          printf("FAIL cycle %d: %zu bytes do not fit after compact\n", cycle, b.bytes);
+          failures++;
+        }
+      }
+      if (b.handle == ARENA_INVALID_HANDLE) {
+        full++;
+        continue;
+      }
+      fill((uint8_t*)arena.ptr(b.handle), b);
+      live.push_back(b);
+      allocations++;
+    }
+
+    size_t used = 0;
+    for (const Block& b : live) used += aligned(b.bytes);
+    if (used != arena.used() || (int)live.size() != arena.handleCount()) {
+      printf("FAIL cycle %d: used %zu / %d handles, arena says %zu / %d\n", cycle, used, (int)live.size(),
+             arena.used(), arena.handleCount());
+      failures++;
+    }
+  }
+
+  for (const Block& b : live) arena.release(b.handle);
+  if (arena.used() != 0 || arena.handleCount() != 0 || arena.largestFree() != REGION) {
+    printf("FAIL arena not empty after releasing everything\n");
+    failures++;
+  }
+
+  printf("%d cycles: %d allocations, %d full, %d compactions (%d pinned, %zu MB moved), peak fragmentation %.2f\n",
+         cycles, allocations, full, compactions, pinnedCompactions, moved / (1024 * 1024), peakFragmentation);
+  printf(failures == 0 ? "arena: OK\n" : "arena: %d FAILURES\n", failures);
+  return failures == 0 ? 0 : 1;
+}
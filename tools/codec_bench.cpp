@@ -0,0 +1,119 @@
+/*
+ * codec_bench.cpp
+ * Comprovació i benchmark dels codecs de sample (src/SampleCodec) a Linux
+ *
+ * Per a cada format (PCM16, IMA-ADPCM, µ-law) i senyal sintètic: bytes
+ * estalviats, SNR descodificat vs original i ns per mostra de decodeBlock.
+ * decodeRange ha de donar exactament el mateix que decodeBlock a qualsevol
+ * rang, també creuant vores de bloc i a l'últim bloc parcial: si no, surt amb 1
+ *
+ *   g++ -O2 -Isrc tools/codec_bench.cpp src/SampleCodec.cpp -o codec_bench
+ *   ./codec_bench
+ */
+
+#include "SampleCodec.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+static const uint32_t RATE = 44100;
+static const uint32_t FRAMES = RATE + 77;    // No múltiple de CODEC_BLOCK_SAMPLES: últim bloc parcial
+
+struct Signal {
+  const char* name;
+  int16_t (*generate)(uint32_t i);
+};
+
+static int16_t drum(uint32_t i) {
+  float env = expf(-(float)i / 6000.0f);
+  float noise = (float)(rand() % 2001 - 1000) / 1000.0f;
+  return (int16_t)(env * (18000.0f * sinf(i * 0.012f) + 6000.0f * noise));
+}
+static int16_t sine(uint32_t i) { return (int16_t)(16000.0f * sinf(2.0f * (float)M_PI * 440.0f * i / RATE)); }
+static int16_t noise(uint32_t) { return (int16_t)(rand() % 40001 - 20000); }
+static int16_t square(uint32_t i) { return (i / 50) % 2 ? 32767 : -32768; }   // Fons d'escala, salts màxims
+static int16_t quiet(uint32_t i) { return (int16_t)(40.0f * sinf(i * 0.05f)); }
+
+static const Signal signals[] = {
+  {"drum", drum}, {"sine 440", sine}, {"noise", noise}, {"square", square}, {"quiet", quiet}
+};
+static const SampleFormat formats[] = {SAMPLE_PCM16, SAMPLE_ADPCM, SAMPLE_ULAW};
+
+// Full decode block by block, the way a voice reads it
+static void decodeAll(SampleFormat format, const uint8_t* data, int16_t* out) {
+  for (uint32_t block = 0; block * CODEC_BLOCK_SAMPLES < FRAMES; block++) {
+    uint32_t start = block * CODEC_BLOCK_SAMPLES;
+    uint32_t count = FRAMES - start < CODEC_BLOCK_SAMPLES ? FRAMES - start : CODEC_BLOCK_SAMPLES;
+    SampleCodec::decodeBlock(format, data, block, count, out + start);
+  }
+}
+
+// Ranges around block edges and the partial tail; returns the mismatches
+static int checkRanges(SampleFormat format, const uint8_t* data, const int16_t* reference) {
+  const uint32_t B = CODEC_BLOCK_SAMPLES;
+  const uint32_t ranges[][2] = {
+    {0, 1}, {0, B}, {0, B + 1}, {B - 1, 2}, {B, B}, {B + 1, B - 2}, {B - 1, 3 * B + 2},
+    {5 * B - 3, 7}, {FRAMES - 1, 1}, {FRAMES - 77, 77}, {FRAMES - 78, 78}, {FRAMES - 300, 300}, {0, FRAMES}
+  };
+  std::vector<int16_t> out(FRAMES);
+  int failures = 0;
+  for (const auto& range : ranges) {
+    SampleCodec::decodeRange(format, data, range[0], range[1], out.data());
+    if (memcmp(out.data(), reference + range[0], range[1] * sizeof(int16_t)) != 0) {
+      printf("  FAIL %s decodeRange(%u, %u) != decodeBlock\n", SampleCodec::formatName(format), range[0], range[1]);
+      failures++;
+    }
+  }
+  return failures;
+}
+
+int main() {
+  int failures = 0;
+  std::vector<int16_t> pcm(FRAMES), decoded(FRAMES);
+
+  printf("%u frames (%u blocks of %d)\n", FRAMES, (FRAMES + CODEC_BLOCK_SAMPLES - 1) / CODEC_BLOCK_SAMPLES,
+         CODEC_BLOCK_SAMPLES);
+  printf("%-9s %-6s %9s %9s %7s %9s %10s\n", "signal", "format", "pcm B", "stored B", "saved", "SNR dB", "ns/sample");
+  for (const Signal& signal : signals) {
+    srand(1);
+    for (uint32_t i = 0; i < FRAMES; i++) pcm[i] = signal.generate(i);
+
+    for (SampleFormat format : formats) {
+      std::vector<uint8_t> encoded(SampleCodec::encodedSize(format, FRAMES));
+      SampleCodec::encode(format, pcm.data(), FRAMES, encoded.data());
+
+      auto start = std::chrono::steady_clock::now();
+      const int passes = 50;
+      for (int pass = 0; pass < passes; pass++) decodeAll(format, encoded.data(), decoded.data());
+      double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+      double signalPower = 0, noisePower = 0;
+      SampleCodec::accumulateError(pcm.data(), decoded.data(), FRAMES, signalPower, noisePower);
+      uint32_t pcmBytes = FRAMES * sizeof(int16_t);
+      printf("%-9s %-6s %9u %9zu %6.1f%% %9.1f %10.2f\n", signal.name, SampleCodec::formatName(format), pcmBytes,
+             encoded.size(), 100.0 * (1.0 - (double)encoded.size() / pcmBytes),
+             SampleCodec::snrDb(signalPower, noisePower), ns / passes / FRAMES);
+
+      if (format == SAMPLE_PCM16 && memcmp(decoded.data(), pcm.data(), pcmBytes) != 0) {
+        printf("  FAIL pcm round trip is not exact\n");
+        failures++;
+      }
+      failures += checkRanges(format, encoded.data(), decoded.data());
+    }
+  }
+
+  // µ-law: every code decodes to a value that encodes back to the same code
+  for (int code = 0; code < 256; code++) {
+    if (SampleCodec::encodeUlaw(SampleCodec::decodeUlaw((uint8_t)code)) != (uint8_t)code &&
+        SampleCodec::decodeUlaw((uint8_t)code) != 0) {
+      printf("  FAIL ulaw code %d does not round trip\n", code);
+      failures++;
+    }
+  }
+
+  printf(failures == 0 ? "decodeRange / round trips: OK\n" : "%d FAILURES\n", failures);
+  return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,38 @@
+/*
+ * Arduino.h (host)
+ * El mínim d'Arduino / FreeRTOS perquè el codi de src/ (Sequencer, ClockSource,
+ * AudioEngine...) compili a Linux per als bancs de tools/. micros() / millis()
+ * els defineix el banc
+ */
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+
+#define IRAM_ATTR
+#define PI 3.1415926535897932384626433832795
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+// Log silenciat: el banc imprimeix el seu propi informe
+struct HostSerial {
+  int printf(const char*, ...) { return 0; }
+  int println(...) { return 0; }
+  int print(...) { return 0; }
+  void flush() {}
+};
+inline HostSerial Serial;
+
+unsigned long micros();
+unsigned long millis();
+
+inline void* ps_malloc(size_t bytes) { return malloc(bytes); }
+
+#endif // HOST_ARDUINO_H
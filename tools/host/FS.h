@@ -0,0 +1,34 @@
+/*
+ * FS.h (host): fitxers buits; el streaming de LittleFS no es prova als bancs
+ */
+
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+#include <Arduino.h>
+
+enum SeekMode { SeekSet, SeekCur, SeekEnd };
+
+namespace fs {
+class File {
+public:
+  operator bool() const { return false; }
+  size_t read(uint8_t*, size_t) { return 0; }
+  size_t write(const uint8_t*, size_t) { return 0; }
+  bool seek(uint32_t, SeekMode = SeekSet) { return false; }
+  size_t position() const { return 0; }
+  size_t size() const { return 0; }
+  void close() {}
+};
+
+class FS {
+public:
+  File open(const char*, const char* = "r") { return File(); }
+  bool exists(const char*) { return false; }
+  bool remove(const char*) { return false; }
+};
+}
+
+using fs::File;
+
+#endif // HOST_FS_H
@@ -0,0 +1,12 @@
+/*
+ * LittleFS.h (host)
+ */
+
+#ifndef HOST_LITTLEFS_H
+#define HOST_LITTLEFS_H
+
+#include "FS.h"
+
+inline fs::FS LittleFS;
+
+#endif // HOST_LITTLEFS_H
@@ -0,0 +1,19 @@
+/*
+ * esp_heap_caps.h (host): tota la memòria és la mateixa
+ */
+
+#ifndef HOST_HEAP_CAPS_H
+#define HOST_HEAP_CAPS_H
+
+#include <stdlib.h>
+
+#define MALLOC_CAP_32BIT (1 << 1)
+#define MALLOC_CAP_8BIT (1 << 2)
+#define MALLOC_CAP_DMA (1 << 3)
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_INTERNAL (1 << 11)
+
+inline void* heap_caps_malloc(size_t bytes, uint32_t) { return malloc(bytes); }
+inline void heap_caps_free(void* ptr) { free(ptr); }
+
+#endif // HOST_HEAP_CAPS_H
@@ -0,0 +1,52 @@
+/*
+ * FreeRTOS.h (host): tipus i seccions crítiques (spinlock recursiu per fil, com el portMUX)
+ */
+
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+
+#include <stdint.h>
+#include <atomic>
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned UBaseType_t;
+typedef void* TaskHandle_t;
+typedef void* QueueHandle_t;
+typedef void (*TaskFunction_t)(void*);
+
+#define portMAX_DELAY 0xFFFFFFFF
+#define pdTRUE 1
+#define pdFALSE 0
+#define pdPASS 1
+#define pdFAIL 0
+
+typedef struct {
+  std::atomic<int> owner;     // 0 = free
+  int count;
+} portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {0, 0}
+
+inline int hostThreadId() {
+  static std::atomic<int> next(1);
+  thread_local int id = next++;
+  return id;
+}
+inline void hostEnterCritical(portMUX_TYPE* mux) {
+  int self = hostThreadId();
+  if (mux->owner.load(std::memory_order_relaxed) == self) {
+    mux->count++;
+    return;
+  }
+  int expected = 0;
+  while (!mux->owner.compare_exchange_weak(expected, self, std::memory_order_acquire)) expected = 0;
+  mux->count = 1;
+}
+inline void hostExitCritical(portMUX_TYPE* mux) {
+  if (--mux->count == 0) mux->owner.store(0, std::memory_order_release);
+}
+#define portENTER_CRITICAL(mux) hostEnterCritical(mux)
+#define portEXIT_CRITICAL(mux) hostExitCritical(mux)
+#define pdMS_TO_TICKS(ms) (ms)
+
+#endif // HOST_FREERTOS_H
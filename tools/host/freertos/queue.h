@@ -0,0 +1,15 @@
+/*
+ * queue.h (host): sense cues, els bancs criden el consumidor directament
+ */
+
+#ifndef HOST_QUEUE_H
+#define HOST_QUEUE_H
+
+#include "FreeRTOS.h"
+
+inline QueueHandle_t xQueueCreate(UBaseType_t, UBaseType_t) { return nullptr; }
+inline BaseType_t xQueueSend(QueueHandle_t, const void*, TickType_t) { return pdFALSE; }
+inline BaseType_t xQueueReceive(QueueHandle_t, void*, TickType_t) { return pdFALSE; }
+inline void vQueueDelete(QueueHandle_t) {}
+
+#endif // HOST_QUEUE_H
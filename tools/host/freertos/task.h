@@ -0,0 +1,63 @@
+/*
+ * task.h (host)
+ * Una tasca és un std::thread; les notificacions, un comptador amb condició.
+ * vTaskDelete no atura el fil: les tasques dels bancs viuen fins que surt el procés
+ */
+
+#ifndef HOST_TASK_H
+#define HOST_TASK_H
+
+#include "FreeRTOS.h"
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+struct HostTask {
+  std::mutex lock;
+  std::condition_variable wake;
+  uint32_t notifications = 0;
+};
+
+inline thread_local HostTask* hostTaskSelf = nullptr;
+inline HostTask hostMainTask;   // El fil de main()
+
+inline BaseType_t xTaskCreatePinnedToCore(TaskFunction_t code, const char*, uint32_t, void* arg,
+                                          UBaseType_t, TaskHandle_t* handle, BaseType_t) {
+  HostTask* task = new HostTask();
+  if (handle != nullptr) *handle = task;
+  std::thread([code, arg, task]() {
+    hostTaskSelf = task;
+    code(arg);
+  }).detach();
+  return pdPASS;
+}
+
+inline void vTaskDelete(TaskHandle_t) {}
+
+inline BaseType_t xTaskNotifyGive(TaskHandle_t handle) {
+  HostTask* task = (HostTask*)handle;
+  {
+    std::lock_guard<std::mutex> guard(task->lock);
+    task->notifications++;
+  }
+  task->wake.notify_one();
+  return pdPASS;
+}
+
+inline uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticks) {
+  HostTask* task = hostTaskSelf != nullptr ? hostTaskSelf : &hostMainTask;
+  std::unique_lock<std::mutex> guard(task->lock);
+  auto ready = [task]() { return task->notifications > 0; };
+  if (ticks == portMAX_DELAY) task->wake.wait(guard, ready);
+  else task->wake.wait_for(guard, std::chrono::milliseconds(ticks), ready);
+  uint32_t count = task->notifications;
+  if (clearOnExit) task->notifications = 0;
+  else if (count > 0) task->notifications--;
+  return count;
+}
+
+inline void vTaskDelay(TickType_t ticks) { std::this_thread::sleep_for(std::chrono::milliseconds(ticks)); }
+inline void taskYIELD() { std::this_thread::yield(); }
+
+#endif // HOST_TASK_H
@@ -0,0 +1,179 @@
+/*
+ * jitter_harness.cpp
+ * Retard dels triggers sota càrrega sintètica, a Linux
+ *
+ * El Sequencer real (src/Sequencer) programa steps contra un rellotge d'àudio
+ * simulat (blocs de DMA_BUF_LEN frames). Compara qui crida schedule():
+ *   - systemtask: el loop de SystemTask (5 ms + parades de web / UDP / LittleFS)
+ *   - clock: la tasca SequencerClock (tick de 2 ms, retard de l'esp_timer)
+ * Els pads de la web, MIDI i UDP arriben a l'atzar i sonen al següent bloc.
+ * Es mesura com al firmware (TriggerTiming): p50 / p99 / max per font, i el
+ * marge amb què el seqüenciador entrega cada step abans del seu frame
+ *
+ *   g++ -O2 -Itools/host -Isrc tools/jitter_harness.cpp src/Sequencer.cpp src/ClockSource.cpp src/TriggerTiming.cpp -o jitter_harness
+ *   ./jitter_harness [segons] [llavor]
+ */
+
+#include "Sequencer.h"
+#include "ClockSource.h"
+#include "TriggerTiming.h"
+#include <vector>
+
+static const uint32_t RATE = 44100;
+static const uint32_t BLOCK = 128;                              // DMA_BUF_LEN
+static const double BLOCK_US = BLOCK * 1000000.0 / RATE;        // ~2902 us
+static const uint32_t STEP_US = 50;                             // Resolució de la simulació
+static const uint32_t SYSTEM_PERIOD_US = 5000;                  // vTaskDelay(5) de SystemTask
+
+Sequencer sequencer;
+static int64_t nowUs = 0;
+static uint32_t blocksRendered = 0;
+static TriggerTiming timing;
+
+unsigned long micros() { return (unsigned long)nowUs; }
+unsigned long millis() { return (unsigned long)(nowUs / 1000); }
+
+// Com AudioEngine::getFramePosition(): primer frame del proper bloc
+static uint32_t framePosition() { return blocksRendered * BLOCK; }
+
+struct Pending {
+  uint32_t frame;             // Seqüenciador: frame demanat
+  uint32_t requestUs;         // Live: quan ha arribat
+  uint8_t source;
+};
+static std::vector<Pending> pending;
+
+static void onStep(int, uint8_t, uint32_t frame, const ParamLock*) {
+  int32_t lead = (int32_t)(frame - framePosition());
+  timing.recordLead(lead > 0 ? (uint32_t)((uint64_t)lead * 1000000ULL / RATE) : 0);
+  pending.push_back({frame, 0, TIMING_SEQUENCER});
+}
+
+static void onLive(uint8_t source) {
+  pending.push_back({0, (uint32_t)nowUs, source});
+}
+
+// fillBuffer: els steps del bloc (o endarrerits) arrenquen ara, els pads també
+static void renderBlock() {
+  uint32_t blockStart = blocksRendered * BLOCK;
+  uint32_t blockEnd = blockStart + BLOCK;
+  for (size_t i = 0; i < pending.size();) {
+    Pending& p = pending[i];
+    if (p.source == TIMING_SEQUENCER) {
+      if (p.frame >= blockEnd) { i++; continue; }
+      uint32_t late = p.frame < blockStart ? blockStart - p.frame : 0;
+      timing.recordStart(TIMING_SEQUENCER, (uint32_t)((uint64_t)late * 1000000ULL / RATE));
+    } else {
+      timing.recordStart(p.source, (uint32_t)nowUs - p.requestUs);
+    }
+    pending[i] = pending.back();
+    pending.pop_back();
+  }
+  blocksRendered++;
+}
+
+static double uniform() { return rand() / (RAND_MAX + 1.0); }
+
+// Feina del loop de SystemTask més enllà del vTaskDelay: sovint res, de tant en tant molt
+static uint32_t systemLoad() {
+  double r = uniform();
+  if (r < 0.003) return 60000 + rand() % 90000;   // Desar un patró / kit a LittleFS
+  if (r < 0.03) return 8000 + rand() % 25000;     // JSON gran per WebSocket, /api/sysinfo
+  if (r < 0.20) return 500 + rand() % 2500;       // Broadcast, paquet UDP
+  return rand() % 300;
+}
+
+// Retard del tick: tasca de l'esp_timer i WiFi (prioritat 22-23) per sobre del SeqClock (10)
+static uint32_t clockLate() {
+  return uniform() < 0.01 ? 1000 + rand() % 3000 : rand() % 300;
+}
+
+static void onTick(void*, const ClockTick& tick) {
+  int64_t saved = nowUs;
+  nowUs = tick.timeUs;
+  sequencer.schedule();
+  nowUs = saved;
+}
+
+static void setupPattern() {
+  for (int p = 0; p < 16; p++) sequencer.clearPattern(p);
+  sequencer.selectPattern(0);
+  for (int s = 0; s < 16; s++) {
+    if (s % 4 == 0) sequencer.setStep(0, s, true);              // Bombo
+    if (s % 8 == 4) sequencer.setStep(1, s, true);              // Caixa
+    sequencer.setStep(2, s, true);                              // Hi-hat
+    if (s % 3 == 0) sequencer.setStep(3, s, true);
+  }
+  sequencer.setTempo(174);
+}
+
+static void run(bool useClock, uint32_t seconds, unsigned seed) {
+  srand(seed);
+  nowUs = 0;
+  blocksRendered = 0;
+  pending.clear();
+  timing.reset();
+
+  SimulatedClock sim;
+  sequencer.stop();
+  sequencer.setFrameClock(framePosition, RATE);
+  sequencer.setStepCallback(onStep);
+  setupPattern();
+  sequencer.start();
+  if (useClock) sim.start(CLOCK_PERIOD_US, onTick, nullptr);
+
+  int64_t endUs = (int64_t)seconds * 1000000;
+  int64_t nextLoop = 0;
+  int64_t nextLive = 0;
+  uint32_t late = clockLate();
+  uint32_t ticks = 0;
+  for (int64_t t = 0; t < endUs; t += STEP_US) {
+    if (useClock) {
+      sim.advance(STEP_US, late);
+      if (sim.nowUs() >= (int64_t)(ticks + 1) * CLOCK_PERIOD_US) { ticks++; late = clockLate(); }
+    }
+    nowUs = t;
+
+    while (t >= (int64_t)((blocksRendered + 1) * BLOCK_US)) renderBlock();
+
+    // Pads de la web: AsyncTCP els atén a l'instant, fora de SystemTask
+    if (t >= nextLive) {
+      onLive(TIMING_LIVE);
+      nextLive = t + 50000 + rand() % 200000;
+    }
+
+    if (t >= nextLoop) {
+      if (!useClock) sequencer.schedule();
+      sequencer.updateUi();
+      // MIDI i UDP: es llegeixen al loop; la mesura comença al handler, com al firmware
+      if (uniform() < 0.05) onLive(TIMING_MIDI);
+      if (uniform() < 0.05) onLive(TIMING_UDP);
+      nextLoop = t + SYSTEM_PERIOD_US + systemLoad();
+    }
+  }
+
+  printf("\n== %s (%u s) ==\n", useClock ? "clock task, 2 ms tick" : "systemtask loop, 5 ms + load", seconds);
+  printf("%-10s %8s %8s %8s %8s\n", "source", "total", "p50 us", "p99 us", "max us");
+  TimingReport report;
+  for (int s = 0; s < TIMING_SOURCES; s++) {
+    timing.getReport(s, report);
+    printf("%-10s %8u %8u %8u %8u\n", TriggerTiming::sourceName(s), report.total, report.p50Us, report.p99Us, report.maxUs);
+  }
+  timing.getLeadReport(report);
+  // Marge = SEQ_LOOKAHEAD_FRAMES + l'offset de micro-timing; a 0 el step ja arriba tard
+  printf("lead       %8u  p1 %u us, p50 %u us, min %u us\n", report.total, report.p1Us, report.p50Us, report.minUs);
+
+  uint32_t bins[TIMING_BINS];
+  timing.getHistogram(TIMING_SEQUENCER, bins);
+  uint32_t lateSteps = 0;
+  for (int i = 1; i < TIMING_BINS; i++) lateSteps += bins[i];
+  printf("sequencer late (last window): %u\n", lateSteps);
+}
+
+int main(int argc, char** argv) {
+  uint32_t seconds = argc > 1 ? atoi(argv[1]) : 120;
+  unsigned seed = argc > 2 ? atoi(argv[2]) : 1;
+  run(false, seconds, seed);
+  run(true, seconds, seed);
+  return 0;
+}
@@ -0,0 +1,146 @@
+/*
+ * live_trigger_stress.cpp
+ * Pads live contra el hot-swap de samples, amb l'AudioEngine real a Linux
+ *
+ * Un fil fa d'àudio (process() sense parar), tres fan de web / UDP / MIDI
+ * (triggerSampleLive a l'atzar) i un altre carrega samples com SampleManager:
+ * treu el pad de la taula, retira el buffer, espera isRetireComplete() i el
+ * allibera; de tant en tant omple el banc standby, fa swapBank() i retira tot
+ * l'antic. Cap veu pot llegir un buffer ja alliberat: compilat amb
+ * -fsanitize=address, qualsevol lectura tardana surt com a heap-use-after-free.
+ * Surt amb 1 si un retire no es confirma
+ *
+ *   g++ -O1 -g -fsanitize=address -pthread -Itools/host -Isrc tools/live_trigger_stress.cpp src/AudioEngine.cpp src/SampleStreamer.cpp src/SampleCodec.cpp src/WavDecoder.cpp src/TriggerTiming.cpp -o live_trigger_stress
+ *   ./live_trigger_stress [segons]
+ */
+
+#include "AudioEngine.h"
+#include "SampleStreamer.h"
+#include <atomic>
+#include <chrono>
+#include <random>
+#include <thread>
+
+AudioEngine audioEngine;
+SampleStreamer sampleStreamer;
+TriggerTiming triggerTiming;
+
+static const int PADS = 8;
+static const uint32_t RETIRE_WAIT_MS = 2000;   // Amb el fil d'àudio sempre actiu no s'hi hauria d'arribar
+
+unsigned long micros() {
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+unsigned long millis() { return micros() / 1000; }
+
+static std::atomic<bool> running(true);
+static std::atomic<uint32_t> triggersSent(0);
+static int16_t* loaded[PAD_BANKS][PADS];       // Fil de càrrega només
+
+// Nou sample al pad, publicat com SampleManager::publishPad
+static void loadPad(std::mt19937& rng, int bank, int pad) {
+  uint32_t frames = 2000 + rng() % 20000;      // 45-500 ms: moltes veus acaben soles, altres es tallen
+  int16_t* buffer = (int16_t*)malloc(frames * sizeof(int16_t));
+  for (uint32_t i = 0; i < frames; i++) buffer[i] = (int16_t)(rng() % 20001 - 10000);
+  loaded[bank][pad] = buffer;
+  audioEngine.setBankSample(bank, pad, buffer, frames);
+}
+
+// Com SampleManager::reclaim: retirar, esperar que el core d'àudio ho confirmi, alliberar
+static bool reclaim(int16_t* const* buffers, int count) {
+  int slots[PADS];
+  for (int i = 0; i < count; i++) slots[i] = audioEngine.retireBuffer(buffers[i]);
+  uint32_t start = millis();
+  for (int i = 0; i < count; i++) {
+    while (slots[i] >= 0 && !audioEngine.isRetireComplete(slots[i])) {
+      if (millis() - start > RETIRE_WAIT_MS) {
+        printf("FAIL retire slot %d not acknowledged after %u ms\n", slots[i], RETIRE_WAIT_MS);
+        return false;
+      }
+      std::this_thread::yield();
+    }
+  }
+  for (int i = 0; i < count; i++) {
+    audioEngine.releaseRetireSlot(slots[i]);
+    if (slots[i] < 0) printf("FAIL retire table full\n");
+    free(buffers[i]);
+  }
+  for (int i = 0; i < count; i++) {
+    if (slots[i] < 0) return false;
+  }
+  return true;
+}
+
+static void audioThread() {
+  while (running.load()) audioEngine.process();
+}
+
+static void padThread(uint8_t source, uint32_t seed) {
+  std::mt19937 rng(seed);
+  while (running.load()) {
+    audioEngine.triggerSampleLive(rng() % PADS, 1 + rng() % 127, source, 0);
+    triggersSent++;
+    std::this_thread::sleep_for(std::chrono::microseconds(rng() % 300));
+  }
+}
+
+int main(int argc, char** argv) {
+  int seconds = argc > 1 ? atoi(argv[1]) : 5;
+  std::mt19937 rng(1);
+  int bank = audioEngine.getActiveBank();
+  for (int pad = 0; pad < PADS; pad++) loadPad(rng, bank, pad);
+
+  std::thread audio(audioThread);
+  std::thread web(padThread, TIMING_LIVE, 2), udp(padThread, TIMING_UDP, 3), midi(padThread, TIMING_MIDI, 4);
+
+  // Loader: hot-swap d'un pad, i cada 16 un canvi de kit sencer
+  uint32_t swaps = 0, kitSwaps = 0;
+  bool ok = true;
+  auto end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+  while (ok && std::chrono::steady_clock::now() < end) {
+    int active = audioEngine.getActiveBank();
+    if (swaps % 16 == 15) {
+      int standby = active ^ 1;
+      for (int pad = 0; pad < PADS; pad++) loadPad(rng, standby, pad);
+      audioEngine.swapBank();
+      int16_t* old[PADS];
+      for (int pad = 0; pad < PADS; pad++) {
+        audioEngine.setBankSample(active, pad, nullptr, 0);
+        old[pad] = loaded[active][pad];
+        loaded[active][pad] = nullptr;
+      }
+      ok = reclaim(old, PADS);
+      kitSwaps++;
+    } else {
+      int pad = rng() % PADS;
+      int16_t* old = loaded[active][pad];
+      audioEngine.setBankSample(active, pad, nullptr, 0);
+      ok = reclaim(&old, 1);
+      loadPad(rng, active, pad);
+    }
+    swaps++;
+  }
+
+  running.store(false);
+  web.join();
+  udp.join();
+  midi.join();
+  audio.join();
+
+  RenderStats render;
+  RetireStats retire;
+  audioEngine.getRenderStats(render);
+  audioEngine.getRetireStats(retire);
+  printf("%d s: %u live triggers (%u dropped, queue full), %u swaps (%u kit swaps), %u blocks\n", seconds,
+         triggersSent.load(), render.liveDrops, swaps, kitSwaps, audioEngine.getBlockEpoch());
+  printf("retired %u buffers, %u voices stopped on a retired buffer\n", retire.retired, retire.voicesStopped);
+  for (uint8_t source = TIMING_LIVE; source < TIMING_SOURCES; source++) {
+    TimingReport report;
+    triggerTiming.getReport(source, report);
+    printf("  %-5s %6u triggers -> block: p50 %u us, p99 %u us\n", TriggerTiming::sourceName(source), report.total,
+           report.p50Us, report.p99Us);
+  }
+  printf(ok ? "live triggers / hot-swap: OK\n" : "live triggers / hot-swap: FAILED\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+"""
+render_ab.py
+Mesura A/B de les opcions de render a la placa (ESP32-S3)
+
+Activa i desactiva una opció per UDP (els mateixos comandos JSON que el
+WebSocket), manté càrrega amb el sequencer i triggers de pads, i llegeix el
+render per bloc de /api/sysinfo en cada estat. Només fa servir la stdlib.
+
+Uso:
+    python tools/render_ab.py <ip> dualcore|headcache|prefetch [segons]
+
+Ejemplo:
+    python tools/render_ab.py 192.168.4.1 dualcore 30
+"""
+
+import json
+import socket
+import sys
+import threading
+import time
+import urllib.request
+
+UDP_PORT = 8888
+HIST_BINS = 12          # RENDER_HIST_BINS: 10% del budget per bin
+
+# Opció -> (comando, valor desactivat, valor activat)
+MODES = {
+    'dualcore': ('setDualCore', False, True),
+    'headcache': ('setHeadCache', 0, 20),
+    'prefetch': ('setPrefetch', False, True),
+}
+
+
+def send(sock, ip, message):
+    sock.sendto(json.dumps(message).encode(), (ip, UDP_PORT))
+
+
+def sysinfo(ip):
+    with urllib.request.urlopen(f'http://{ip}/api/sysinfo', timeout=10) as response:
+        return json.load(response)
+
+
+def percentile(hist, fraction):
+    """Upper edge (% of the budget) of the bin holding the given fraction of the blocks."""
+    total = sum(hist)
+    if total == 0:
+        return 0
+    seen = 0
+    for i, count in enumerate(hist):
+        seen += count
+        if seen >= fraction * total:
+            return (i + 1) * 10
+    return HIST_BINS * 10
+
+
+def load(sock, ip, stop):
+    """Live pads on top of the sequencer, to keep many voices playing."""
+    pad = 0
+    while not stop.is_set():
+        send(sock, ip, {'cmd': 'trigger', 'pad': pad, 'vel': 127})
+        pad = (pad + 1) % 8
+        time.sleep(0.02)
+
+
+def measure(sock, ip, command, value, seconds):
+    send(sock, ip, {'cmd': command, 'value': value})   # Resets the render stats
+    time.sleep(seconds)
+    return sysinfo(ip)['audio']
+
+
+def main():
+    if len(sys.argv) < 3 or sys.argv[2] not in MODES:
+        print(__doc__)
+        print('Modes:', ', '.join(MODES))
+        sys.exit(1)
+    ip = sys.argv[1]
+    mode = sys.argv[2]
+    seconds = int(sys.argv[3]) if len(sys.argv) > 3 else 20
+    command, off, on = MODES[mode]
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    send(sock, ip, {'cmd': 'start'})
+    stop = threading.Event()
+    loader = threading.Thread(target=load, args=(sock, ip, stop), daemon=True)
+    loader.start()
+    try:
+        results = [(str(off), measure(sock, ip, command, off, seconds)),
+                   (str(on), measure(sock, ip, command, on, seconds))]
+    finally:
+        stop.set()
+        send(sock, ip, {'cmd': 'stop'})
+
+    print(f'{mode}: {seconds}s per state, budget {results[0][1]["budgetUs"]}us')
+    print(f'{"state":>6} {"voices":>6} {"cap":>4} {"us/voice":>9} {"p50%":>5} {"p99%":>5} {"peak us":>8} {"misses":>7}')
+    for state, audio in results:
+        hist = audio['renderHistogram']
+        print(f'{state:>6} {audio["activeVoices"]:>6} {audio["voiceCap"]:>4} {audio["voiceCostUs"]:>9.1f} '
+              f'{percentile(hist, 0.5):>5} {percentile(hist, 0.99):>5} {audio["renderPeakUs"]:>8} '
+              f'{audio["deadlineMisses"]:>7}')
+
+    audio = results[-1][1]
+    if mode == 'dualcore':
+        dual = audio['dualCore']
+        print(f'dual-core: single {dual["singleCostUs"]:.1f}us/voice -> headroom {dual["headroomSingle"]} voices, '
+              f'dual {dual["dualCostUs"]:.1f}us/voice -> headroom {dual["headroomDual"]} voices, '
+              f'speedup {dual["speedup"]:.2f}, late starts {dual["lateStarts"]}, fallbacks {dual["fallbacks"]}')
+    elif mode == 'headcache':
+        for state, audio in results:
+            head = audio['headCache']
+            print(f'head {state}ms: {head["cached"]} samples, {head["bytes"]} bytes SRAM, '
+                  f'{head["hits"]} hits / {head["misses"]} misses')
+    elif mode == 'prefetch':
+        prefetch = audio['prefetch']
+        print(f'prefetch ({"GDMA" if prefetch["dma"] else "memcpy"}): off {prefetch["offCostUs"]:.1f}us/voice, '
+              f'on {prefetch["onCostUs"]:.1f}us/voice, {prefetch["copies"]} copies, '
+              f'{prefetch["timeouts"]} timeouts, {prefetch["dmaErrors"]} DMA errors')
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,163 @@
+/*
+ * render_bench.cpp
+ * Cost de render per bloc de l'AudioEngine real, a Linux
+ *
+ * Carrega 8 pads amb samples sintètics, manté N veus sonant i crida
+ * AudioEngine::process() (i2s_write torna a l'instant) cronometrant cada bloc.
+ * Compara les opcions del motor: single / dual-core (amb 1 CPU, només el cost del fork/join), head
+ * cache (atac en un buffer a part, com el de SRAM interna) i prefetch del
+ * bloc següent (sense ESP_PLATFORM la còpia és un memcpy dins process()).
+ * Mesura el cost de CPU de cada opció al host, no els efectes de l'ESP32-S3
+ * (latència de PSRAM, prioritats de FreeRTOS): per a això, tools/render_ab.py
+ *
+ *   g++ -O2 -pthread -Itools/host -Isrc tools/render_bench.cpp src/AudioEngine.cpp src/SampleStreamer.cpp src/SampleCodec.cpp src/WavDecoder.cpp src/TriggerTiming.cpp -o render_bench
+ *   ./render_bench [blocs per passada]
+ */
+
+#include "AudioEngine.h"
+#include "SampleStreamer.h"
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+AudioEngine audioEngine;
+SampleStreamer sampleStreamer;
+TriggerTiming triggerTiming;
+
+static const int PADS = 8;
+static const uint32_t SAMPLE_FRAMES = SAMPLE_RATE * 2;   // Prou llarg perquè les veus no s'acabin
+static const uint32_t HEAD_MS = 20;                      // HEAD_CACHE_DEFAULT_MS
+
+unsigned long micros() {
+  return (unsigned long)std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+unsigned long millis() { return micros() / 1000; }
+
+static int16_t* samples[PADS];
+static int16_t* heads[PADS];
+
+static void makeSamples() {
+  for (int pad = 0; pad < PADS; pad++) {
+    samples[pad] = (int16_t*)malloc(SAMPLE_FRAMES * sizeof(int16_t));
+    float freq = 60.0f + pad * 97.0f;
+    for (uint32_t i = 0; i < SAMPLE_FRAMES; i++) {
+      float env = expf(-(float)i / (SAMPLE_RATE * 0.8f));
+      samples[pad][i] = (int16_t)(20000.0f * env * sinf(2.0f * (float)M_PI * freq * i / SAMPLE_RATE));
+    }
+    audioEngine.setSampleBuffer(pad, samples[pad], SAMPLE_FRAMES);
+  }
+}
+
+// Com SampleManager::allocateHead: els primers `ms` de cada pad en una còpia (0 = sense)
+static void setHeads(uint32_t ms) {
+  uint32_t frames = SAMPLE_RATE * ms / 1000;
+  for (int pad = 0; pad < PADS; pad++) {
+    audioEngine.setSampleHead(pad, nullptr, 0);
+    free(heads[pad]);
+    heads[pad] = nullptr;
+    if (frames == 0) continue;
+    heads[pad] = (int16_t*)malloc(frames * sizeof(int16_t));
+    memcpy(heads[pad], samples[pad], frames * sizeof(int16_t));
+    audioEngine.setSampleHead(pad, heads[pad], frames);
+  }
+}
+
+struct BenchResult {
+  double meanUs;
+  uint32_t p99Us;
+  uint32_t peakUs;
+};
+
+// `voices` sonant tot el temps; els primers blocs (arrencada, governor) no compten
+static BenchResult run(int voices, uint32_t blocks) {
+  audioEngine.stopAll();
+  std::vector<uint32_t> times;
+  times.reserve(blocks);
+  int pad = 0;
+  for (uint32_t b = 0; b < blocks + 64; b++) {
+    // Els triggers arrenquen al process() següent, des de la cua live
+    for (int missing = voices - audioEngine.getActiveVoices(); missing > 0; missing--) {
+      audioEngine.triggerSampleLive(pad, 127);
+      pad = (pad + 1) % PADS;
+    }
+    auto start = std::chrono::steady_clock::now();
+    audioEngine.process();
+    auto end = std::chrono::steady_clock::now();
+    if (b >= 64) times.push_back((uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+  }
+  std::sort(times.begin(), times.end());
+  double sum = 0;
+  for (uint32_t t : times) sum += t;
+  BenchResult result;
+  result.meanUs = sum / times.size() / 1000.0;
+  result.p99Us = times[times.size() * 99 / 100] / 1000;
+  result.peakUs = times.back() / 1000;
+  return result;
+}
+
+// Opcions comparades; cada una s'activa només durant les seves mesures
+enum BenchMode { MODE_SINGLE, MODE_HEAD, MODE_PREFETCH, MODE_DUAL, MODE_COUNT };
+static const char* modeNames[MODE_COUNT] = {"single", "head 20ms", "prefetch", "dual-core"};
+
+static void applyMode(int mode, bool on) {
+  switch (mode) {
+    // Head cache: només els primers 20 ms de cada veu (de 2 s) llegeixen el head. Al host
+    // tota la memòria és igual de ràpida: la fila dona el cost del canvi head -> cos
+    case MODE_HEAD: setHeads(on ? HEAD_MS : 0); break;
+    // Prefetch: el memcpy de cada veu cau dins el temps cronometrat (a la placa, la GDMA
+    // copia durant l'i2s_write). Al host es veu el cost de la còpia, no la PSRAM estalviada
+    case MODE_PREFETCH: audioEngine.setPrefetch(on); break;
+    case MODE_DUAL: audioEngine.setDualCoreRender(on); break;
+    default: break;
+  }
+}
+
+static const int VOICE_COUNTS[] = {8, 16, 32};
+static const int VOICE_ROWS = 3;
+static const int ROUNDS = 5;    // Mediana: el soroll del host (altres processos) varia d'una passada a l'altra
+
+static BenchResult median(BenchResult* runs) {
+  std::sort(runs, runs + ROUNDS, [](const BenchResult& a, const BenchResult& b) { return a.meanUs < b.meanUs; });
+  return runs[ROUNDS / 2];
+}
+
+int main(int argc, char** argv) {
+  uint32_t blocks = argc > 1 ? atoi(argv[1]) : 10000;
+  makeSamples();
+  unsigned cpus = std::thread::hardware_concurrency();
+  // Fork/join: amb una sola CPU el worker no corre mai en paral·lel; es mesura igualment (el cost del handshake)
+  int modes = MODE_COUNT;
+
+  // Rondes intercalades: totes les opcions pateixen el mateix soroll
+  static BenchResult results[MODE_COUNT][VOICE_ROWS][ROUNDS];
+  for (int round = 0; round < ROUNDS; round++) {
+    for (int mode = 0; mode < modes; mode++) {
+      applyMode(mode, true);
+      for (int row = 0; row < VOICE_ROWS; row++) results[mode][row][round] = run(VOICE_COUNTS[row], blocks);
+      applyMode(mode, false);
+    }
+  }
+
+  printf("render per block (budget %lu us), median of %d x %u blocks, %u CPU(s)\n", BLOCK_BUDGET_US, ROUNDS, blocks, cpus);
+  printf("%-12s %6s %10s %8s %8s %12s\n", "mode", "voices", "mean us", "p99 us", "peak us", "us / voice");
+  for (int mode = 0; mode < modes; mode++) {
+    for (int row = 0; row < VOICE_ROWS; row++) {
+      BenchResult r = median(results[mode][row]);
+      printf("%-12s %6d %10.1f %8u %8u %12.2f\n", modeNames[mode], VOICE_COUNTS[row], r.meanUs, r.p99Us, r.peakUs,
+             r.meanUs / VOICE_COUNTS[row]);
+    }
+  }
+  DualCoreStats dual;
+  audioEngine.getDualCoreStats(dual);
+  printf("dual-core: %u blocks, %u late starts, %u fallbacks\n", dual.dualBlocks, dual.lateStarts, dual.fallbacks);
+
+  // Headroom com /api/sysinfo: veus que caben al GOVERNOR_TARGET_LOAD_PCT del budget, amb el cost per veu a 32 veus
+  float targetUs = BLOCK_BUDGET_US * GOVERNOR_TARGET_LOAD_PCT / 100.0f;
+  double singleCost = median(results[MODE_SINGLE][VOICE_ROWS - 1]).meanUs / VOICE_COUNTS[VOICE_ROWS - 1];
+  double dualCost = median(results[MODE_DUAL][VOICE_ROWS - 1]).meanUs / VOICE_COUNTS[VOICE_ROWS - 1];
+  printf("voice headroom: single %d, dual %d, speedup %.2fx%s\n", (int)(targetUs / singleCost), (int)(targetUs / dualCost),
+         singleCost / dualCost, cpus >= 2 ? "" : " (1 CPU: no parallelism, fork/join cost only)");
+  return 0;
+}
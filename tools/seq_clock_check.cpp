@@ -0,0 +1,107 @@
+/*
+ * seq_clock_check.cpp
+ * Separació entre steps amb el rellotge del seqüenciador (src/ClockSource) a Linux
+ *
+ * Com la tasca SeqClock: un SimulatedClock de CLOCK_PERIOD_US crida
+ * Sequencer::schedule() a cada tick. Els ticks arriben tard (0-300 us, i un de
+ * cada cent 4 ms, com un esp_timer o una tasca retardats) i el loop de la UI
+ * (updateUi, 5 ms) s'atura 40 ms de tant en tant. El rellotge d'àudio avança per
+ * blocs de DMA_BUF_LEN. 16 steps a 174 BPM durant 60 s: cada step ha de caure a
+ * ±1 frame del seu lloc a la graella i cap tick es pot perdre. Surt amb 1 si falla
+ *
+ *   g++ -O2 -Itools/host -Isrc tools/seq_clock_check.cpp src/Sequencer.cpp src/ClockSource.cpp -o seq_clock_check
+ *   ./seq_clock_check [segons] [llavor]
+ */
+
+#include "Sequencer.h"
+#include "ClockSource.h"
+#include <math.h>
+#include <vector>
+
+static const uint32_t RATE = 44100;
+static const uint32_t BLOCK = 128;                  // DMA_BUF_LEN
+static const float BPM = 174.0f;
+static const uint32_t SLICE_US = 500;               // Resolució de la simulació
+static const uint32_t UI_PERIOD_US = 5000;          // vTaskDelay(5) de SystemTask
+static const uint32_t UI_STALL_US = 40000;
+
+unsigned long micros() { return 0; }
+unsigned long millis() { return 0; }
+
+Sequencer sequencer;
+static SimulatedClock simClock;
+static ClockJitter jitter;
+static std::vector<uint32_t> hits;
+static uint32_t expectedSequence = 0;
+static uint32_t lostTicks = 0;
+
+// Com AudioEngine::getFramePosition(): primer frame del proper bloc
+static uint32_t framePosition() {
+  uint64_t frames = (uint64_t)simClock.nowUs() * RATE / 1000000ULL;
+  return (uint32_t)((frames / BLOCK + 1) * BLOCK);
+}
+
+// Com SequencerClock::clockTask, sense la cua: el tick ja arriba amb el seu retard
+static void onTick(void*, const ClockTick& tick) {
+  if (tick.sequence != expectedSequence) lostTicks += tick.sequence - expectedSequence;
+  expectedSequence = tick.sequence + 1;
+  sequencer.schedule();
+  jitter.record(tick, simClock.nowUs(), 0);
+}
+
+int main(int argc, char** argv) {
+  int seconds = argc > 1 ? atoi(argv[1]) : 60;
+  srand(argc > 2 ? atoi(argv[2]) : 3);
+
+  for (int p = 0; p < MAX_PATTERNS; p++) sequencer.clearPattern(p);
+  sequencer.selectPattern(0);
+  for (int s = 0; s < STEPS_PER_PATTERN; s++) sequencer.setStep(0, s, true);
+  sequencer.setFrameClock(framePosition, RATE);
+  sequencer.setTempo(BPM);
+  sequencer.setStepCallback([](int, uint8_t, uint32_t frame, const ParamLock*) { hits.push_back(frame); });
+  sequencer.setStepChangeCallback([](int) {});
+
+  jitter.reset(CLOCK_PERIOD_US);
+  simClock.start(CLOCK_PERIOD_US, onTick, nullptr);
+  sequencer.start();
+
+  int64_t uiNext = 0;
+  int uiCalls = 0;
+  for (int64_t t = 0; t < (int64_t)seconds * 1000000; t += SLICE_US) {
+    uint32_t late = (rand() % 100 == 0) ? 4000 : rand() % 300;
+    simClock.advance(SLICE_US, late);
+    if (t >= uiNext) {
+      sequencer.updateUi();
+      uiCalls++;
+      uiNext = t + ((rand() % 50 == 0) ? UI_STALL_US : UI_PERIOD_US);
+    }
+  }
+
+  // Step = 24 ticks de num / den frames (Sequencer::calculateTickRate)
+  uint64_t num = (uint64_t)RATE * 60000ULL;
+  uint64_t den = (uint64_t)(BPM * 1000.0f + 0.5f) * SEQ_PPQN;
+  double stepFrames = (double)TICKS_PER_STEP * num / den;
+  int badGaps = 0, offGrid = 0;
+  double minGap = 1e9, maxGap = 0;
+  for (size_t i = 1; i < hits.size(); i++) {
+    double gap = (double)(hits[i] - hits[i - 1]);
+    if (gap < minGap) minGap = gap;
+    if (gap > maxGap) maxGap = gap;
+    if (fabs(gap - stepFrames) > 1.0) badGaps++;
+    // Mateixa graella que el primer step: floor del tick exacte, cap error acumulat
+    uint64_t grid = (uint64_t)i * TICKS_PER_STEP * num / den;
+    int64_t offset = (int64_t)(hits[i] - hits[0]) - (int64_t)grid;
+    if (offset < -1 || offset > 1) offGrid++;
+  }
+
+  ClockJitterStats stats;
+  jitter.getStats(stats);
+  double expectedSteps = seconds * BPM / 60.0 * 4;
+  printf("%d s at %.0f BPM: %zu steps (expected ~%.0f), step %.2f frames, gaps %.0f-%.0f\n", seconds, BPM,
+         hits.size(), expectedSteps, stepFrames, minGap, maxGap);
+  printf("bad gaps %d, off grid %d, ticks %u (lost %u), tick interval %u-%u us, ui calls %d\n", badGaps, offGrid,
+         stats.ticks, lostTicks, stats.intervalMinUs, stats.intervalMaxUs, uiCalls);
+  bool ok = badGaps == 0 && offGrid == 0 && lostTicks == 0 && fabs(hits.size() - expectedSteps) <= 2;
+  printf(ok ? "clock: OK\n" : "clock: FAILED\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,178 @@
+/*
+ * seq_condition_check.cpp
+ * Probabilitat i condicions per step del Sequencer (src/Sequencer) a Linux
+ *
+ * Un patró d'un compàs a 120 BPM que es repeteix 40000 cops:
+ *   - 10 / 30 / 90 %: freqüència dins de 4 sigma, i sense dependència del compàs anterior
+ *   - 3:4 exactament al 3r de cada 4 cicles, !first tots menys el primer, fill només amb fill
+ *   - pre: el step 0 sona si i només si el step 8 del compàs anterior ha sonat
+ *   - la mateixa llavor (setPatternSeed) dona exactament els mateixos triggers, una altra no;
+ *     silenciar un track no canvia el que treuen els altres del PRNG
+ * Surt amb 1 si falla
+ *
+ *   g++ -O2 -Itools/host -Isrc tools/seq_condition_check.cpp src/Sequencer.cpp -o seq_condition_check
+ *   ./seq_condition_check [compassos]
+ */
+
+#include "Sequencer.h"
+#include <math.h>
+#include <vector>
+
+static const uint32_t RATE = 44100;
+static const uint32_t BLOCK = 128;                  // DMA_BUF_LEN
+static const uint32_t BAR_FRAMES = RATE * 2;        // 120 BPM
+static const uint32_t START_FRAME = 1000;
+
+unsigned long micros() { return 0; }
+unsigned long millis() { return 0; }
+
+struct Hit {
+  int track;
+  uint32_t frame;
+};
+
+static uint32_t nowFrame = 0;
+static std::vector<Hit> hits;
+static Sequencer seq;
+static int bars = 40000;
+static int failures = 0;
+
+// Tracks del patró de prova
+enum {
+  T_P10, T_P30, T_P90, T_RATIO, T_NOT_FIRST, T_FILL, T_PRE, T_PLAIN
+};
+
+static std::vector<Hit> run(uint8_t mutedMask, bool fill) {
+  for (int t = 0; t < MAX_TRACKS; t++) seq.muteTrack(t, (mutedMask >> t) & 1);
+  seq.setFill(fill);
+  seq.stop();
+  seq.reset();
+  hits.clear();
+  nowFrame = START_FRAME;
+  seq.start();
+  // Para a mig compàs: el step 8 de l'últim compàs ja ha sonat, el step 0 del següent no
+  uint64_t blocks = ((uint64_t)bars * BAR_FRAMES - BAR_FRAMES / 4) / BLOCK;
+  for (uint64_t b = 0; b < blocks; b++) {
+    nowFrame += BLOCK;
+    seq.update();
+  }
+  return hits;
+}
+
+// played[bar] per step 0 (o step 8) d'un track
+static std::vector<bool> perBar(const std::vector<Hit>& run, int track, bool secondHalf) {
+  std::vector<bool> played(bars, false);
+  if (run.empty()) return played;
+  uint32_t origin = run.front().frame;             // Step 0 del primer compàs (cap track té micro-timing)
+  for (const Hit& h : run) {
+    if (h.track != track) continue;
+    uint32_t offset = h.frame - origin;
+    if ((offset % BAR_FRAMES >= BAR_FRAMES / 2) == secondHalf && offset / BAR_FRAMES < (uint32_t)bars) {
+      played[offset / BAR_FRAMES] = true;
+    }
+  }
+  return played;
+}
+
+static void expect(bool ok, const char* what) {
+  printf("  %-58s %s\n", what, ok ? "ok" : "FAIL");
+  if (!ok) failures++;
+}
+
+static bool same(const std::vector<Hit>& a, const std::vector<Hit>& b, int skipTrack = -1) {
+  std::vector<Hit> x, y;
+  for (const Hit& h : a) if (h.track != skipTrack) x.push_back(h);
+  for (const Hit& h : b) if (h.track != skipTrack) y.push_back(h);
+  if (x.size() != y.size()) return false;
+  for (size_t i = 0; i < x.size(); i++) {
+    if (x[i].track != y[i].track || x[i].frame != y[i].frame) return false;
+  }
+  return true;
+}
+
+static void checkProbability(const std::vector<Hit>& run, int track, int percent) {
+  std::vector<bool> played = perBar(run, track, false);
+  int count = 0, afterHit = 0, hitThenHit = 0;
+  for (int b = 0; b < bars; b++) {
+    if (played[b]) count++;
+    if (b > 0 && played[b - 1]) {
+      afterHit++;
+      if (played[b]) hitThenHit++;
+    }
+  }
+  double p = percent / 100.0;
+  double observed = (double)count / bars;
+  double sigma = sqrt(p * (1 - p) / bars);
+  double conditional = afterHit ? (double)hitThenHit / afterHit : 0;
+  double sigmaConditional = sqrt(p * (1 - p) / (afterHit ? afterHit : 1));
+  printf("  %d%%: %.4f (%+.1f sigma), after a hit %.4f (%+.1f sigma)\n", percent, observed, (observed - p) / sigma,
+         conditional, (conditional - p) / sigmaConditional);
+  char what[64];
+  snprintf(what, sizeof(what), "%d%% within 4 sigma, independent of the previous bar", percent);
+  expect(fabs(observed - p) < 4 * sigma && fabs(conditional - p) < 4 * sigmaConditional, what);
+}
+
+int main(int argc, char** argv) {
+  if (argc > 1) bars = atoi(argv[1]);
+  for (int p = 0; p < MAX_PATTERNS; p++) seq.clearPattern(p);
+  seq.selectPattern(0);
+  for (int t = 0; t < MAX_TRACKS; t++) seq.setStep(t, 0, true);
+  seq.setStepCondition(0, T_P10, 0, 10, COND_NONE);
+  seq.setStepCondition(0, T_P30, 0, 30, COND_NONE);
+  seq.setStepCondition(0, T_P90, 0, 90, COND_NONE);
+  seq.setStepCondition(0, T_RATIO, 0, 100, Sequencer::makeRatioCondition(3, 4));
+  seq.setStepCondition(0, T_NOT_FIRST, 0, 100, COND_NOT_FIRST);
+  seq.setStepCondition(0, T_FILL, 0, 100, COND_FILL);
+  seq.setStep(T_PRE, 8, true);
+  seq.setStepCondition(0, T_PRE, 8, 50, COND_NONE);
+  seq.setStepCondition(0, T_PRE, 0, 100, COND_PRE);
+  seq.setFrameClock([]() { return nowFrame; }, RATE);
+  seq.setTempo(120);
+  seq.setStepCallback([](int track, uint8_t, uint32_t frame, const ParamLock*) { hits.push_back({track, frame}); });
+
+  std::vector<Hit> base = run(0, false);
+  printf("%d bars, %zu triggers\n", bars, base.size());
+
+  checkProbability(base, T_P10, 10);
+  checkProbability(base, T_P30, 30);
+  checkProbability(base, T_P90, 90);
+
+  std::vector<bool> ratio = perBar(base, T_RATIO, false), notFirst = perBar(base, T_NOT_FIRST, false);
+  std::vector<bool> fillOff = perBar(base, T_FILL, false), plain = perBar(base, T_PLAIN, false);
+  std::vector<bool> pre = perBar(base, T_PRE, false), preSource = perBar(base, T_PRE, true);
+  bool ratioOk = true, notFirstOk = true, fillOffOk = true, plainOk = true, preOk = !pre[0];
+  int preCount = 0;
+  for (int b = 0; b < bars; b++) {
+    if (ratio[b] != (b % 4 == 2)) ratioOk = false;
+    if (notFirst[b] != (b != 0)) notFirstOk = false;
+    if (fillOff[b]) fillOffOk = false;
+    if (!plain[b]) plainOk = false;
+    if (b > 0 && pre[b] != preSource[b - 1]) preOk = false;
+    if (pre[b]) preCount++;
+  }
+  expect(plainOk, "step without condition plays every bar");
+  expect(ratioOk, "3:4 plays on the 3rd of every 4 cycles");
+  expect(notFirstOk, "!first plays on every cycle but the first");
+  expect(fillOffOk, "fill is silent without fill");
+  printf("  pre: %d bars played\n", preCount);
+  expect(preOk && preCount > 0, "pre follows the previous conditional step of the track");
+
+  std::vector<Hit> fillOn = run(0, true);
+  std::vector<bool> fillPlayed = perBar(fillOn, T_FILL, false);
+  bool fillOnOk = true;
+  for (int b = 0; b < bars; b++) if (!fillPlayed[b]) fillOnOk = false;
+  expect(fillOnOk && same(base, fillOn, T_FILL), "fill plays with fill, other tracks unchanged");
+
+  expect(same(base, run(0, false)), "same seed: identical triggers");
+  uint32_t seed = seq.getPatternSeed(0);
+  seq.setPatternSeed(0, 12345);
+  expect(!same(base, run(0, false)), "another seed: different triggers");
+  seq.setPatternSeed(0, seed);
+  expect(same(base, run(0, false)), "seed restored: identical triggers again");
+
+  std::vector<Hit> muted = run(1u << T_P30, false);
+  expect(same(base, muted, T_P30), "muting a track leaves the other tracks' draws unchanged");
+
+  printf(failures == 0 ? "conditions: OK\n" : "conditions: %d FAILED\n", failures);
+  return failures == 0 ? 0 : 1;
+}
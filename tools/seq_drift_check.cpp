@@ -0,0 +1,79 @@
+/*
+ * seq_drift_check.cpp
+ * Deriva acumulada del rellotge de ticks del Sequencer (src/Sequencer) a Linux
+ *
+ * Un step per compàs durant 10000 compassos a diversos tempos (també no enters).
+ * El rellotge d'àudio avança per blocs de DMA_BUF_LEN i el frame de cada
+ * trigger es compara amb el valor exacte en aritmètica entera:
+ *   inici + floor(tick * frameRate * 60000 / (milliBPM * PPQN)) + MICRO_TIMING_MAX ticks
+ * Cap compàs pot diferir ni un frame: l'error no creix amb el temps. El rellotge
+ * comença 2^20 frames abans de la volta dels 32 bits (~24 s): tots els tempos la
+ * travessen. Surt amb 1 si falla
+ *
+ *   g++ -O2 -Itools/host -Isrc tools/seq_drift_check.cpp src/Sequencer.cpp -o seq_drift_check
+ *   ./seq_drift_check [compassos]
+ */
+
+#include "Sequencer.h"
+#include <math.h>
+#include <vector>
+
+static const uint32_t RATE = 44100;
+static const uint32_t BLOCK = 128;                  // DMA_BUF_LEN
+static const uint32_t TICKS_PER_BAR = SEQ_PPQN * 4;
+static const uint32_t START_FRAME = 0xFFF00000;      // getFramePosition() a punt de donar la volta
+
+unsigned long micros() { return 0; }
+unsigned long millis() { return 0; }
+
+static uint32_t nowFrame = 0;
+static std::vector<uint32_t> hits;
+
+int main(int argc, char** argv) {
+  int bars = argc > 1 ? atoi(argv[1]) : 10000;
+  const float tempos[] = {40.0f, 97.3f, 120.0f, 133.33f, 174.0f, 300.0f};
+  int failures = 0;
+
+  for (float bpm : tempos) {
+    Sequencer seq;
+    for (int p = 0; p < MAX_PATTERNS; p++) seq.clearPattern(p);
+    seq.selectPattern(0);
+    seq.setStep(0, 0, true, 100);                   // Un trigger per compàs
+    seq.setFrameClock([]() { return nowFrame; }, RATE);
+    seq.setTempo(bpm);
+    seq.setStepCallback([](int, uint8_t, uint32_t frame, const ParamLock*) { hits.push_back(frame); });
+
+    hits.clear();
+    nowFrame = START_FRAME;
+    uint32_t start = nowFrame;
+    seq.start();
+    while (hits.size() < (size_t)bars) {
+      nowFrame += BLOCK;
+      seq.update();
+    }
+
+    // Com Sequencer::calculateTickRate: 1 tick = num / den frames
+    uint64_t milliBpm = (uint64_t)(bpm * 1000.0f + 0.5f);
+    uint64_t num = (uint64_t)RATE * 60000ULL;
+    uint64_t den = milliBpm * SEQ_PPQN;
+    uint64_t offset = (uint64_t)MICRO_TIMING_MAX * num / den;
+    int64_t maxError = 0;
+    for (int bar = 0; bar < bars; bar++) {
+      uint64_t expected = start + (uint64_t)bar * TICKS_PER_BAR * num / den + offset;
+      int64_t error = llabs((int32_t)(hits[bar] - (uint32_t)expected));   // El frame de 32 bits dona la volta
+      if (error > maxError) maxError = error;
+    }
+
+    // Contra el temps ideal en coma flotant: dos floor (graella + offset), entre -2 i 0 frames
+    // siguin quants siguin els compassos
+    // (relatiu a l'inici: el frame absolut ja ha donat la volta)
+    double ideal = (bars - 1) * (double)TICKS_PER_BAR * num / den + (double)MICRO_TIMING_MAX * num / den;
+    double drift = (int32_t)(hits[bars - 1] - start - (uint32_t)floor(ideal)) - (ideal - floor(ideal));
+    printf("%7.2f BPM: %d bars, max error %lld frames, last bar %+.3f frames from ideal (%.1f min)\n", bpm, bars,
+           (long long)maxError, drift, ideal / RATE / 60.0);
+    if (maxError != 0 || drift <= -2.0 || drift > 0.0) failures++;
+  }
+
+  printf(failures == 0 ? "drift: OK\n" : "drift: %d tempos FAILED\n", failures);
+  return failures == 0 ? 0 : 1;
+}
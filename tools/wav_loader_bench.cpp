@@ -0,0 +1,111 @@
+/*
+ * wav_loader_bench.cpp
+ * Benchmark del decodificador de WAV (src/WavDecoder) a Linux
+ *
+ * Genera WAVs sintètics (8/16/24 bits, float 32, mono/stereo) i mesura el
+ * throughput de càrrega llegint frame a frame (com l'antic parseWavFile) i per
+ * blocs de 1/4/8/16 KB. Cada read() és una crida al sistema, com cada
+ * File::read a LittleFS: el que importa és el nombre de lectures
+ *
+ *   g++ -O2 -Isrc tools/wav_loader_bench.cpp src/WavDecoder.cpp -o wav_loader_bench
+ *   ./wav_loader_bench [segons]
+ */
+
+#include "WavDecoder.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+static const uint32_t RATE = 44100;
+static const char* PATH = "/tmp/wav_loader_bench.raw";
+
+static size_t readFd(void* context, uint8_t* dst, size_t bytes) {
+  size_t total = 0;
+  while (total < bytes) {
+    ssize_t n = read(*(int*)context, dst + total, bytes - total);
+    if (n <= 0) break;
+    total += n;
+  }
+  return total;
+}
+
+// Data chunk only: the header parse is the same for every strategy
+static bool writeData(const WavFormat& format, uint32_t frames) {
+  std::vector<uint8_t> data(frames * WavDecoder::frameBytes(format));
+  uint8_t* p = data.data();
+  for (uint32_t i = 0; i < frames * format.channels; i++) {
+    float v = 0.8f * sinf(i * 0.013f);
+    switch (format.encoding) {
+      case WAV_PCM8:  *p++ = (uint8_t)(128 + (int)(v * 127)); break;
+      case WAV_PCM16: { int16_t s = (int16_t)(v * 32767); memcpy(p, &s, 2); p += 2; break; }
+      case WAV_PCM24: { int32_t s = (int32_t)(v * 8388607); memcpy(p, &s, 3); p += 3; break; }
+      case WAV_PCM32: { int32_t s = (int32_t)(v * 2147483000.0f); memcpy(p, &s, 4); p += 4; break; }
+      case WAV_FLOAT32: memcpy(p, &v, 4); p += 4; break;
+    }
+  }
+  FILE* f = fopen(PATH, "wb");
+  if (f == nullptr) return false;
+  bool ok = fwrite(data.data(), 1, data.size(), f) == data.size();
+  fclose(f);
+  return ok;
+}
+
+// Returns MB/s of source data; `out` receives the samples
+static double run(const WavFormat& format, uint32_t frames, size_t chunk, std::vector<int16_t>& out) {
+  out.assign(frames, 0);
+  std::vector<uint8_t> scratch(chunk > 0 ? chunk : WavDecoder::frameBytes(format));
+  int fd = open(PATH, O_RDONLY);
+  if (fd < 0) return 0.0;
+
+  auto start = std::chrono::steady_clock::now();
+  uint32_t done = 0;
+  if (chunk == 0) {
+    // Old path: one read per frame
+    uint32_t bytes = WavDecoder::frameBytes(format);
+    while (done < frames && readFd(&fd, scratch.data(), bytes) == bytes) {
+      WavDecoder::convert(format, scratch.data(), 1, &out[done++]);
+    }
+  } else {
+    done = WavDecoder::decode(format, readFd, &fd, frames, out.data(), scratch.data(), chunk);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  close(fd);
+
+  if (done != frames) return 0.0;
+  return frames * WavDecoder::frameBytes(format) / (1024.0 * 1024.0) / seconds;
+}
+
+int main(int argc, char** argv) {
+  uint32_t frames = RATE * (argc > 1 ? atoi(argv[1]) : 5);
+  const WavEncoding encodings[] = {WAV_PCM8, WAV_PCM16, WAV_PCM24, WAV_PCM32, WAV_FLOAT32};
+  const uint8_t sizes[] = {1, 2, 3, 4, 4};
+  const size_t chunks[] = {0, 1024, 4096, 8192, 16384};
+
+  printf("%-14s %-3s %12s %12s %12s %12s %12s\n", "format", "ch", "per-frame", "1 KB", "4 KB", "8 KB", "16 KB");
+  bool mismatch = false;
+  for (int e = 0; e < 5; e++) {
+    for (uint8_t channels = 1; channels <= 2; channels++) {
+      WavFormat format = {encodings[e], channels, sizes[e], RATE};
+      if (!writeData(format, frames)) {
+        printf("cannot write %s\n", PATH);
+        return 1;
+      }
+      printf("%-14s %-3d", WavDecoder::encodingName(format.encoding), channels);
+      std::vector<int16_t> reference, out;
+      for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        double mbps = run(format, frames, chunks[c], c == 0 ? reference : out);
+        if (c > 0 && out != reference) mismatch = true;
+        printf(" %9.1f MB/s", mbps);
+      }
+      printf("\n");
+    }
+  }
+  unlink(PATH);
+  if (mismatch) printf("MISMATCH between per-frame and chunked output\n");
+  return mismatch ? 1 : 0;
+}